@@ -13,6 +13,7 @@ CORE_SOURCES = 								\
     Ap4AtomFactory.cpp                      \
     Ap4AtomSampleTable.cpp                  \
     Ap4AvccAtom.cpp                         \
+    Ap4BatchRunner.cpp                      \
     Ap4ByteStream.cpp                       \
     Ap4Co64Atom.cpp                         \
     Ap4ContainerAtom.cpp                    \
@@ -29,12 +30,15 @@ CORE_SOURCES = 								\
     Ap4File.cpp                             \
     Ap4FileWriter.cpp                       \
     Ap4FileCopier.cpp                       \
+    Ap4FileUpdater.cpp                      \
+    Ap4Fragmenter.cpp                       \
     Ap4FrmaAtom.cpp                         \
     Ap4FtypAtom.cpp                         \
     Ap4HdlrAtom.cpp                         \
     Ap4HintTrackReader.cpp                  \
     Ap4HmhdAtom.cpp                         \
     Ap4IkmsAtom.cpp                         \
+    Ap4Instrumentation.cpp                  \
     Ap4IproAtom.cpp                         \
     Ap4IsfmAtom.cpp                         \
     Ap4IsltAtom.cpp                         \
@@ -135,7 +139,7 @@ CRYPTO_OBJECTS = $(CRYPTO_SOURCES:.cpp=.o)
 METADATA_SOURCES = Ap4MetaData.cpp
 METADATA_OBJECTS = $(METADATA_SOURCES:.cpp=.o)
 
-SYSTEM_SOURCES = $(FILE_BYTE_STREAM_IMPLEMENTATION).cpp $(RANDOM_IMPLEMENTATION).cpp
+SYSTEM_SOURCES = $(FILE_BYTE_STREAM_IMPLEMENTATION).cpp $(RANDOM_IMPLEMENTATION).cpp $(THREADS_IMPLEMENTATION).cpp
 SYSTEM_OBJECTS = $(SYSTEM_SOURCES:.cpp=.o)
 
 CODECS_SOURCES = Ap4AdtsParser.cpp Ap4BitStream.cpp Ap4Mp4AudioInfo.cpp
@@ -19,6 +19,7 @@ export TARGET
 
 export FILE_BYTE_STREAM_IMPLEMENTATION
 export RANDOM_IMPLEMENTATION
+export THREADS_IMPLEMENTATION
 
 export CC
 export AUTODEP_CPP
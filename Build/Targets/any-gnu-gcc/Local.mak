@@ -30,7 +30,7 @@ STRIP = $(GCC_CROSS_PREFIX)strip
 COMPILE_CPP  = $(GCC_CROSS_PREFIX)g++
 
 # how to link object files
-LINK_CPP = $(GCC_CROSS_PREFIX)g++ -L.
+LINK_CPP = $(GCC_CROSS_PREFIX)g++ -pthread -L.
 
 # optimization flags
 OPTIMIZE_CPP = -O3 -ffunction-sections -fdata-sections
@@ -64,6 +64,7 @@ LIBRARIES_CPP =
 #######################################################################
 FILE_BYTE_STREAM_IMPLEMENTATION = Ap4StdCFileByteStream
 RANDOM_IMPLEMENTATION = Ap4PosixRandom
+THREADS_IMPLEMENTATION = Ap4PosixThreads
 
 #######################################################################
 #    includes
@@ -16,6 +16,7 @@ def generate(env, gcc_cross_prefix=None, gcc_strict=True, gcc_stop_on_warning=Tr
     compiler_defines = ['-D_REENTRANT']
     env.AppendUnique(CCFLAGS  = compiler_defines)
     env.AppendUnique(CPPFLAGS = compiler_defines)
+    env.AppendUnique(LINKFLAGS = ['-pthread'])
 
     if env['build_config'] == 'Debug':
         env.AppendUnique(CCFLAGS = '-g')
@@ -41,6 +41,8 @@
 #define BANNER "AAC to MP4 Converter - Version 1.0\n"\
                "(Bento4 Version " AP4_VERSION_STRING ")\n"\
                "(c) 2002-2008 Axiomatic Systems, LLC"
+
+const unsigned int AP4_AAC2MP4_INPUT_BUFFER_SIZE = 65536; // must hold at least 2 ADTS frames
  
 /*----------------------------------------------------------------------
 |   PrintUsageAndExit
@@ -96,19 +98,30 @@ main(int argc, char** argv)
     // create a sample table
     AP4_SyntheticSampleTable* sample_table = new AP4_SyntheticSampleTable();
 
+    // all the samples are stored in a single memory stream
+    AP4_MemoryByteStream* sample_storage = new AP4_MemoryByteStream();
+
     // create an ADTS parser
     AP4_AdtsParser parser;
     bool           initialized = false;
     unsigned int   sample_description_index = 0;
 
-    // read from the input, feed, and get AAC frames
-    AP4_UI32     sample_rate = 0;
-    AP4_Cardinal sample_count = 0;
-    bool eos = false;
+    // read from the input and get AAC frames directly from the input buffer
+    AP4_UI32       sample_rate = 0;
+    AP4_Cardinal   sample_count = 0;
+    AP4_DataBuffer input_buffer(AP4_AAC2MP4_INPUT_BUFFER_SIZE);
+    AP4_Size       input_offset = 0;
+    bool           eos = false;
     for(;;) {
         // try to get a frame
         AP4_AacFrame frame;
-        result = parser.FindFrame(frame);
+        AP4_Size     bytes_consumed = 0;
+        result = parser.FindFrameInBuffer(input_buffer.GetData()+input_offset,
+                                          input_buffer.GetDataSize()-input_offset,
+                                          frame,
+                                          bytes_consumed,
+                                          eos);
+        input_offset += bytes_consumed;
         if (AP4_SUCCEEDED(result)) {
             AP4_Debug("AAC frame [%06d]: size = %d, %d kHz, %d ch\n",
                        sample_count,
@@ -138,38 +151,45 @@ main(int argc, char** argv)
                 sample_rate = frame.m_Info.m_SamplingFrequency;
             }
 
-            AP4_MemoryByteStream* sample_data = new AP4_MemoryByteStream(frame.m_Info.m_FrameLength);
-            frame.m_Source->ReadBytes(sample_data->UseData(), frame.m_Info.m_FrameLength);
-            sample_table->AddSample(*sample_data, 0, frame.m_Info.m_FrameLength, 1024, sample_description_index, 0, 0, true);
-            sample_data->Release();
+            AP4_Position sample_position = 0;
+            sample_storage->Tell(sample_position);
+            result = sample_storage->Write(frame.m_Data, frame.m_Info.m_FrameLength);
+            if (AP4_SUCCEEDED(result)) {
+                result = sample_table->AddSample(*sample_storage, sample_position, frame.m_Info.m_FrameLength, 1024, sample_description_index, 0, 0, true);
+            }
+            if (AP4_FAILED(result)) {
+                AP4_Debug("ERROR: failed to add sample (%d)\n", result);
+                return 1;
+            }
             sample_count++;
         } else if (!eos) {
-            // read some data and feed the parser
-            AP4_UI08 input_buffer[4096];
-            AP4_Size to_read = parser.GetBytesFree();
-            if (to_read) {
-                AP4_Size bytes_read = 0;
-                if (to_read > sizeof(input_buffer)) to_read = sizeof(input_buffer);
-                result = input->ReadPartial(input_buffer, to_read, bytes_read);
-                if (AP4_SUCCEEDED(result)) {
-                    AP4_Size to_feed = bytes_read;
-                    result = parser.Feed(input_buffer, &to_feed);
-                    if (AP4_FAILED(result)) {
-                        AP4_Debug("ERROR: parser.Feed() failed (%d)\n", result);
-                        return 1;
-                    }
-                } else {
-                    if (result == AP4_ERROR_EOS) {
-                        eos = true;
-                        parser.Feed(NULL, 0, true);
-                    }
-                }
+            // move the unparsed data to the front of the buffer and read some more
+            AP4_Size leftover = input_buffer.GetDataSize()-input_offset;
+            if (leftover && input_offset) {
+                AP4_MoveMemory(input_buffer.UseData(), input_buffer.GetData()+input_offset, leftover);
+            }
+            input_buffer.SetDataSize(leftover);
+            input_offset = 0;
+            AP4_Size bytes_read = 0;
+            result = input->ReadPartial(input_buffer.UseData()+leftover,
+                                        input_buffer.GetBufferSize()-leftover,
+                                        bytes_read);
+            if (AP4_SUCCEEDED(result)) {
+                input_buffer.SetDataSize(leftover+bytes_read);
+            } else if (result == AP4_ERROR_EOS) {
+                eos = true;
+            } else {
+                AP4_Debug("ERROR: failed to read from the input (%d)\n", result);
+                return 1;
             }
         } else {
             break;
         }
     }
 
+    // the sample table keeps its own reference to the sample storage
+    sample_storage->Release();
+
     // create a movie
     AP4_Movie* movie = new AP4_Movie();
 
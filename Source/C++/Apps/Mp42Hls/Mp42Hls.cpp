@@ -82,6 +82,10 @@ static struct _Options {
     const char*           segment_url_template;
     unsigned int          segment_duration;
     unsigned int          segment_duration_threshold;
+    bool                  live;
+    unsigned int          live_window;
+    unsigned int          target_duration;
+    unsigned int          part_duration;
     const char*           encryption_key_hex;
     AP4_UI08              encryption_key[16];
     AP4_UI08              encryption_iv[16];
@@ -91,6 +95,7 @@ static struct _Options {
     const char*           encryption_key_format;
     const char*           encryption_key_format_versions;
     AP4_Array<AP4_String> encryption_key_lines;
+    unsigned int          encryption_threads;
 } Options;
 
 static struct _Stats {
@@ -103,6 +108,26 @@ static struct _Stats {
     double   max_iframe_bitrate;
 } Stats;
 
+/*----------------------------------------------------------------------
+|   types
++---------------------------------------------------------------------*/
+struct PlaylistPart {
+    double       duration;
+    AP4_UI32     size;
+    AP4_Position position;
+    bool         independent;
+};
+
+struct PlaylistSegment {
+    PlaylistSegment() : index(0), duration(0.0), size(0), position(0) {}
+    
+    unsigned int            index;
+    double                  duration;
+    AP4_UI32                size;
+    AP4_Position            position;
+    AP4_Array<PlaylistPart> parts;
+};
+
 /*----------------------------------------------------------------------
 |   constants
 +---------------------------------------------------------------------*/
@@ -156,6 +181,19 @@ PrintUsageAndExit()
             "    (default: segment-%%d.<ext> for separate segment files, or stream.<ext> for single file)\n"
             "  --iframe-index-filename <filename>\n"
             "    Filename to use for the I-Frame playlist (default: iframes.m3u8 when HLS version >= 4)\n"
+            "  --live\n"
+            "    Rewrite the playlist each time a segment (or partial segment) is complete,\n"
+            "    instead of once at the end. I-Frame playlists are not generated in this mode\n"
+            "  --live-window <n>\n"
+            "    Maximum number of segments listed in a live playlist, older segments\n"
+            "    are removed from the playlist (default: 0, keep all segments)\n"
+            "  --target-duration <n>\n"
+            "    Target duration in seconds announced by a live playlist. It can't change once\n"
+            "    published, so segments longer than that are only reported with a warning\n"
+            "    (default: the segment duration)\n"
+            "  --part-duration <n>\n"
+            "    Target duration in milliseconds of the low-latency partial segments\n"
+            "    listed in a live playlist (default: 0, no partial segments)\n"
             "  --output-single-file\n"
             "    Output all the media in a single file instead of separate segment files.\n"
             "    The segment filename template and segment URL template must be simple strings\n"
@@ -179,6 +217,9 @@ PrintUsageAndExit()
             "    This option can be used multiple times, once for each preformatted key line to be included in the playlist.\n"
             "    (this option is mutually exclusive with the --encryption-key-uri, --encryption-key-format and --encryption-key-format-versions options)\n"
             "    (the IV and METHOD parameters will automatically be added, so they must not appear in the <ext-x-key-line> argument)\n"
+            "  --encryption-threads <n>\n"
+            "    Mux AES-128 segments in memory and encrypt complete segments on <n> threads\n"
+            "    (default: 0, encrypt while muxing). Not supported with --live or --output-single-file\n"
             );
     exit(1);
 }
@@ -261,49 +302,38 @@ OpenOutput(const char* filename_pattern, unsigned int segment_number)
     return output;
 }
 
-/*----------------------------------------------------------------------
-|   PreventStartCodeEmulation
-+---------------------------------------------------------------------*/
-static void
-PreventStartCodeEmulation(const AP4_UI08* payload, AP4_Size payload_size, AP4_DataBuffer& output)
-{
-    output.Reserve(payload_size*2); // more than enough
-    AP4_Size  output_size = 0;
-    AP4_UI08* buffer = output.UseData();
-    
-	unsigned int zero_counter = 0;
-	for (unsigned int i = 0; i < payload_size; i++) {
-		if (zero_counter == 2) {
-            if (payload[i] == 0 || payload[i] == 1 || payload[i] == 2 || payload[i] == 3) {
-                buffer[output_size++] = 3;
-                zero_counter = 0;
-            }
-		}
-
-        buffer[output_size++] = payload[i];
-
-		if (payload[i] == 0) {
-			++zero_counter;
-		} else {
-			zero_counter = 0;
-		}		
-	}
-
-    output.SetDataSize(output_size);
-}
-
 /*----------------------------------------------------------------------
 |   EncryptingStream
 +---------------------------------------------------------------------*/
-class EncryptingStream: public AP4_ByteStream {
+/*
+ * In deferred mode, the segment is buffered in memory as it is written, and
+ * is only encrypted and written to the output when Run() is called, which
+ * may happen on a worker thread (see SegmentEncryptionPool).
+ */
+class EncryptingStream: public AP4_ByteStream, public AP4_Runnable {
 public:
-    static AP4_Result Create(const AP4_UI08* key, const AP4_UI08* iv, AP4_ByteStream* output, EncryptingStream*& stream);
+    static AP4_Result Create(const AP4_UI08*    key,
+                             const AP4_UI08*    iv,
+                             AP4_ByteStream*    output,
+                             bool               deferred,
+                             EncryptingStream*& stream);
     virtual AP4_Result ReadPartial(void* , AP4_Size, AP4_Size&) {
         return AP4_ERROR_NOT_SUPPORTED;
     }
     virtual AP4_Result WritePartial(const void* buffer,
                                     AP4_Size    bytes_to_write, 
                                     AP4_Size&   bytes_written) {
+        if (m_Deferred) {
+            m_Buffer.Reserve(m_Buffer.GetDataSize()+bytes_to_write);
+            AP4_Result result = m_Buffer.AppendData((const AP4_UI08*)buffer, bytes_to_write);
+            if (AP4_FAILED(result)) {
+                bytes_written = 0;
+                return result;
+            }
+            bytes_written = bytes_to_write;
+            m_Size       += bytes_to_write;
+            return AP4_SUCCESS;
+        }
         AP4_UI08* out = new AP4_UI08[bytes_to_write+16];
         AP4_Size  out_size = bytes_to_write+16;
         AP4_Result result = m_StreamCipher->ProcessBuffer((const AP4_UI08*)buffer,
@@ -321,6 +351,14 @@ public:
         return result;
     }
     virtual AP4_Result Flush() {
+        if (m_Deferred) {
+            // the padding is added when the segment is encrypted
+            if (!m_Padded) {
+                m_Size  += 16-(m_Size%16);
+                m_Padded = true;
+            }
+            return AP4_SUCCESS;
+        }
         AP4_UI08 trailer[16];
         AP4_Size trailer_size = sizeof(trailer);
         AP4_Result result = m_StreamCipher->ProcessBuffer(NULL, 0, trailer, &trailer_size, true);
@@ -343,13 +381,33 @@ public:
             delete this;
         }
     }
+    
+    // AP4_Runnable methods
+    void Run() {
+        // encrypt the whole segment in place, in a single pass
+        AP4_Size size     = m_Buffer.GetDataSize();
+        AP4_Size out_size = size+16;
+        m_Result = m_Buffer.Reserve(out_size);
+        if (AP4_FAILED(m_Result)) return;
+        m_Result = m_StreamCipher->ProcessBuffer(m_Buffer.GetData(),
+                                                 size,
+                                                 m_Buffer.UseData(),
+                                                 &out_size,
+                                                 true);
+        if (AP4_FAILED(m_Result)) return;
+        m_Result = m_Output->Write(m_Buffer.GetData(), out_size);
+    }
+    AP4_Result GetResult() { return m_Result; }
 
 private:
-    EncryptingStream(AP4_CbcStreamCipher* stream_cipher, AP4_ByteStream* output):
+    EncryptingStream(AP4_CbcStreamCipher* stream_cipher, AP4_ByteStream* output, bool deferred):
         m_ReferenceCount(1),
         m_StreamCipher(stream_cipher),
         m_Output(output),
-        m_Size(0) {
+        m_Size(0),
+        m_Deferred(deferred),
+        m_Padded(false),
+        m_Result(AP4_SUCCESS) {
         output->AddReference();
     }
     ~EncryptingStream() {
@@ -360,13 +418,21 @@ private:
     AP4_CbcStreamCipher* m_StreamCipher;
     AP4_ByteStream*      m_Output;
     AP4_LargeSize        m_Size;
+    bool                 m_Deferred;
+    bool                 m_Padded;
+    AP4_DataBuffer       m_Buffer;
+    AP4_Result           m_Result;
 };
 
 /*----------------------------------------------------------------------
 |   EncryptingStream::Create
 +---------------------------------------------------------------------*/
 AP4_Result
-EncryptingStream::Create(const AP4_UI08* key, const AP4_UI08* iv, AP4_ByteStream* output, EncryptingStream*& stream) {
+EncryptingStream::Create(const AP4_UI08*    key,
+                         const AP4_UI08*    iv,
+                         AP4_ByteStream*    output,
+                         bool               deferred,
+                         EncryptingStream*& stream) {
     stream = NULL;
     AP4_BlockCipher* block_cipher = NULL;
     AP4_Result result = AP4_DefaultBlockCipherFactory::Instance.CreateCipher(AP4_BlockCipher::AES_128,
@@ -379,11 +445,80 @@ EncryptingStream::Create(const AP4_UI08* key, const AP4_UI08* iv, AP4_ByteStream
     if (AP4_FAILED(result)) return result;
     AP4_CbcStreamCipher* stream_cipher = new AP4_CbcStreamCipher(block_cipher);
     stream_cipher->SetIV(iv);
-    stream = new EncryptingStream(stream_cipher, output);
+    stream = new EncryptingStream(stream_cipher, output, deferred);
     
     return AP4_SUCCESS;
 }
 
+/*----------------------------------------------------------------------
+|   SegmentEncryptionPool
++---------------------------------------------------------------------*/
+/*
+ * Encrypts complete (deferred) segments, one thread per segment. CBC
+ * encryption is sequential within a segment, but segments have independent
+ * IVs, so a batch of segments is encrypted concurrently while the next
+ * batch is being muxed.
+ */
+class SegmentEncryptionPool {
+public:
+    SegmentEncryptionPool(unsigned int thread_count) : m_ThreadCount(thread_count) {}
+    ~SegmentEncryptionPool() {
+        Wait();
+        for (unsigned int i=0; i<m_Pending.ItemCount(); i++) {
+            m_Pending[i]->Release();
+        }
+    }
+    
+    // takes ownership of the caller's reference to the segment
+    AP4_Result Add(EncryptingStream* segment) {
+        m_Pending.Append(segment);
+        if (m_Pending.ItemCount() < m_ThreadCount) return AP4_SUCCESS;
+        AP4_Result result = Wait();
+        if (AP4_FAILED(result)) return result;
+        Start();
+        return AP4_SUCCESS;
+    }
+    
+    // encrypt and write out all the segments added so far
+    AP4_Result Flush() {
+        AP4_Result result = Wait();
+        if (AP4_FAILED(result)) return result;
+        Start();
+        return Wait();
+    }
+    
+private:
+    void Start() {
+        for (unsigned int i=0; i<m_Pending.ItemCount(); i++) {
+            AP4_Thread* thread = new AP4_Thread(*m_Pending[i]);
+            if (AP4_FAILED(thread->Start())) {
+                // fall back to encrypting on this thread
+                m_Pending[i]->Run();
+            }
+            m_Running.Append(m_Pending[i]);
+            m_Threads.Append(thread);
+        }
+        m_Pending.Clear();
+    }
+    AP4_Result Wait() {
+        AP4_Result result = AP4_SUCCESS;
+        for (unsigned int i=0; i<m_Running.ItemCount(); i++) {
+            m_Threads[i]->Wait();
+            delete m_Threads[i];
+            if (AP4_SUCCEEDED(result)) result = m_Running[i]->GetResult();
+            m_Running[i]->Release();
+        }
+        m_Running.Clear();
+        m_Threads.Clear();
+        return result;
+    }
+    
+    unsigned int                 m_ThreadCount;
+    AP4_Array<EncryptingStream*> m_Pending;
+    AP4_Array<EncryptingStream*> m_Running;
+    AP4_Array<AP4_Thread*>       m_Threads;
+};
+
 /*----------------------------------------------------------------------
 |   SampleEncrypter
 +---------------------------------------------------------------------*/
@@ -405,6 +540,7 @@ private:
 
     AP4_CbcStreamCipher* m_StreamCipher;
     AP4_UI08             m_IV[16];
+    AP4_DataBuffer       m_EncryptedSample; // reused from sample to sample
 };
 
 /*----------------------------------------------------------------------
@@ -515,7 +651,9 @@ SampleEncrypter::EncryptAudioSample(AP4_DataBuffer& sample, AP4_SampleDescriptio
 AP4_Result
 SampleEncrypter::EncryptVideoSample(AP4_DataBuffer& sample, AP4_UI08 nalu_length_size)
 {
-    AP4_DataBuffer encrypted;
+    AP4_DataBuffer& encrypted = m_EncryptedSample;
+    encrypted.SetDataSize(0);
+    encrypted.Reserve(sample.GetDataSize()+sample.GetDataSize()/64+1024); // escaping rarely adds much
     
     AP4_UI08* nalu = sample.UseData();
     AP4_Size  bytes_remaining = sample.GetDataSize();
@@ -555,31 +693,31 @@ SampleEncrypter::EncryptVideoSample(AP4_DataBuffer& sample, AP4_UI08 nalu_length
                                               nalu+nalu_length_size+32+i, &one_block_size);
             }
 
-            // perform startcode emulation prevention
-            AP4_DataBuffer escaped_nalu;
-            PreventStartCodeEmulation(nalu+nalu_length_size, nalu_length, escaped_nalu);
+            // perform startcode emulation prevention, directly after the length field
+            AP4_Size length_offset = encrypted.GetDataSize();
+            encrypted.AppendData(nalu, nalu_length_size);
+            AP4_NalParser::Escape(nalu+nalu_length_size, nalu_length, encrypted);
             
             // the size may have changed
             // FIXME: this could overflow if nalu_length_size is too small
+            AP4_Size  escaped_size  = encrypted.GetDataSize()-length_offset-nalu_length_size;
+            AP4_UI08* length_field  = encrypted.UseData()+length_offset;
             switch (nalu_length_size) {
                 case 1:
-                    nalu[0] = (AP4_UI08)(escaped_nalu.GetDataSize()&0xFF);
+                    length_field[0] = (AP4_UI08)(escaped_size&0xFF);
                     break;
                     
                 case 2:
-                    AP4_BytesFromUInt16BE(nalu, escaped_nalu.GetDataSize());
+                    AP4_BytesFromUInt16BE(length_field, escaped_size);
                     break;
         
                 case 4:
-                    AP4_BytesFromUInt32BE(nalu, escaped_nalu.GetDataSize());
+                    AP4_BytesFromUInt32BE(length_field, escaped_size);
                     break;
                     
                 default:
                     break;
             }
-
-            encrypted.AppendData(nalu, nalu_length_size);
-            encrypted.AppendData(escaped_nalu.GetData(), escaped_nalu.GetDataSize());
         } else {
             encrypted.AppendData(nalu, nalu_length_size);
             encrypted.AppendData(nalu+nalu_length_size, nalu_length);
@@ -988,6 +1126,238 @@ ReadSample(SampleReader&   reader,
     return AP4_SUCCESS;
 }
 
+/*----------------------------------------------------------------------
+|   WriteKeyLines
++---------------------------------------------------------------------*/
+static void
+WriteKeyLines(AP4_ByteStream* playlist)
+{
+    if (Options.encryption_mode == ENCRYPTION_MODE_NONE) return;
+    
+    if (Options.encryption_key_lines.ItemCount()) {
+        for (unsigned int i=0; i<Options.encryption_key_lines.ItemCount(); i++) {
+            AP4_String& key_line = Options.encryption_key_lines[i];
+            const char* key_line_cstr = key_line.GetChars();
+            bool omit_iv = false;
+            
+            // omit the IV if the key line starts with a "!" (and skip the "!")
+            if (key_line[0] == '!') {
+                ++key_line_cstr;
+                omit_iv = true;
+            }
+            
+            playlist->WriteString("#EXT-X-KEY:METHOD=");
+            if (Options.encryption_mode == ENCRYPTION_MODE_AES_128) {
+                playlist->WriteString("AES-128");
+            } else if (Options.encryption_mode == ENCRYPTION_MODE_SAMPLE_AES) {
+                playlist->WriteString("SAMPLE-AES");
+            }
+            playlist->WriteString(",");
+            playlist->WriteString(key_line_cstr);
+            if ((Options.encryption_iv_mode == ENCRYPTION_IV_MODE_RANDOM ||
+                 Options.encryption_iv_mode == ENCRYPTION_IV_MODE_FPS) && !omit_iv) {
+                playlist->WriteString(",IV=0x");
+                char iv_hex[33];
+                iv_hex[32] = 0;
+                AP4_FormatHex(Options.encryption_iv, 16, iv_hex);
+                playlist->WriteString(iv_hex);
+            }
+            playlist->WriteString("\r\n");
+        }
+    } else {
+        playlist->WriteString("#EXT-X-KEY:METHOD=");
+        if (Options.encryption_mode == ENCRYPTION_MODE_AES_128) {
+            playlist->WriteString("AES-128");
+        } else if (Options.encryption_mode == ENCRYPTION_MODE_SAMPLE_AES) {
+            playlist->WriteString("SAMPLE-AES");
+        }
+        playlist->WriteString(",URI=\"");
+        playlist->WriteString(Options.encryption_key_uri);
+        playlist->WriteString("\"");
+        if (Options.encryption_iv_mode == ENCRYPTION_IV_MODE_RANDOM) {
+            playlist->WriteString(",IV=0x");
+            char iv_hex[33];
+            iv_hex[32] = 0;
+            AP4_FormatHex(Options.encryption_iv, 16, iv_hex);
+            playlist->WriteString(iv_hex);
+        }
+        if (Options.encryption_key_format) {
+            playlist->WriteString(",KEYFORMAT=\"");
+            playlist->WriteString(Options.encryption_key_format);
+            playlist->WriteString("\"");
+        }
+        if (Options.encryption_key_format_versions) {
+            playlist->WriteString(",KEYFORMATVERSIONS=\"");
+            playlist->WriteString(Options.encryption_key_format_versions);
+            playlist->WriteString("\"");
+        }
+        playlist->WriteString("\r\n");
+    }
+}
+
+/*----------------------------------------------------------------------
+|   WriteParts
++---------------------------------------------------------------------*/
+static void
+WriteParts(AP4_ByteStream* playlist, const PlaylistSegment& segment)
+{
+    char url[4096];
+    char string_buffer[4096+256];
+    sprintf(url, Options.segment_url_template, segment.index);
+    for (unsigned int i=0; i<segment.parts.ItemCount(); i++) {
+        const PlaylistPart& part = segment.parts[i];
+        sprintf(string_buffer, "#EXT-X-PART:DURATION=%f,URI=\"%s\",BYTERANGE=\"%d@%lld\"%s\r\n",
+                part.duration,
+                url,
+                part.size,
+                part.position,
+                part.independent ? ",INDEPENDENT=YES" : "");
+        playlist->WriteString(string_buffer);
+    }
+}
+
+/*----------------------------------------------------------------------
+|   AddPart
++---------------------------------------------------------------------*/
+static void
+AddPart(PlaylistSegment& segment,
+        AP4_ByteStream&  output,
+        AP4_Position&    part_start,
+        double           duration,
+        bool             independent)
+{
+    AP4_Position part_end = 0;
+    output.Tell(part_end);
+    if (part_end <= part_start) return;
+    
+    PlaylistPart part;
+    part.duration    = duration;
+    part.size        = (AP4_UI32)(part_end-part_start);
+    part.position    = part_start;
+    part.independent = independent;
+    segment.parts.Append(part);
+    part_start = part_end;
+
+    if (Options.verbose) {
+        printf("Part %d.%d, duration=%.3f, %d bytes @%lld%s\n",
+               segment.index,
+               segment.parts.ItemCount()-1,
+               part.duration,
+               part.size,
+               part.position,
+               independent ? " (independent)" : "");
+    }
+}
+
+/*----------------------------------------------------------------------
+|   WriteMediaPlaylist
+|
+|   In live mode, the playlist is written to a temporary file that then
+|   replaces the previous one, so that a server never sees a partial
+|   playlist. 'open_segment' is the segment currently being written
+|   (if any), of which only the parts are listed.
++---------------------------------------------------------------------*/
+static AP4_Result
+WriteMediaPlaylist(AP4_List<PlaylistSegment>& segments,
+                   const PlaylistSegment*     open_segment,
+                   unsigned int               media_sequence,
+                   unsigned int               target_duration,
+                   bool                       independent_segments,
+                   bool                       ended,
+                   unsigned int               hint_segment_index,
+                   AP4_Position               hint_position)
+{
+    char            string_buffer[4096];
+    AP4_ByteStream* playlist = NULL;
+    char            temp_filename[4096];
+    if (Options.live) {
+        sprintf(temp_filename, "%s.tmp", Options.index_filename);
+        AP4_Result result = AP4_FileByteStream::Create(temp_filename, AP4_FileByteStream::STREAM_MODE_WRITE, playlist);
+        if (AP4_FAILED(result)) {
+            fprintf(stderr, "ERROR: cannot open output (%d)\n", result);
+            return AP4_ERROR_CANNOT_OPEN_FILE;
+        }
+    } else {
+        playlist = OpenOutput(Options.index_filename, 0);
+        if (playlist == NULL) return AP4_ERROR_CANNOT_OPEN_FILE;
+    }
+    
+    playlist->WriteString("#EXTM3U\r\n");
+    if (Options.hls_version > 1) {
+        sprintf(string_buffer, "#EXT-X-VERSION:%d\r\n", Options.hls_version);
+        playlist->WriteString(string_buffer);
+    }
+    if (!Options.live) {
+        playlist->WriteString("#EXT-X-PLAYLIST-TYPE:VOD\r\n");
+    } else if (Options.live_window == 0) {
+        playlist->WriteString("#EXT-X-PLAYLIST-TYPE:EVENT\r\n");
+    }
+    if (independent_segments) {
+        playlist->WriteString("#EXT-X-INDEPENDENT-SEGMENTS\r\n");
+    }
+    playlist->WriteString("#EXT-X-TARGETDURATION:");
+    sprintf(string_buffer, "%d\r\n", target_duration);
+    playlist->WriteString(string_buffer);
+    if (Options.part_duration) {
+        double part_target = (double)Options.part_duration/1000.0;
+        sprintf(string_buffer, "#EXT-X-SERVER-CONTROL:PART-HOLD-BACK=%f\r\n", 3.0*part_target);
+        playlist->WriteString(string_buffer);
+        sprintf(string_buffer, "#EXT-X-PART-INF:PART-TARGET=%f\r\n", part_target);
+        playlist->WriteString(string_buffer);
+    }
+    sprintf(string_buffer, "#EXT-X-MEDIA-SEQUENCE:%u\r\n", media_sequence);
+    playlist->WriteString(string_buffer);
+
+    WriteKeyLines(playlist);
+    
+    for (AP4_List<PlaylistSegment>::Item* item = segments.FirstItem(); item; item = item->GetNext()) {
+        const PlaylistSegment& segment = *item->GetData();
+        WriteParts(playlist, segment);
+        if (Options.hls_version >= 3) {
+            sprintf(string_buffer, "#EXTINF:%f,\r\n", segment.duration);
+        } else {
+            sprintf(string_buffer, "#EXTINF:%u,\r\n", (unsigned int)(segment.duration+0.5));
+        }
+        playlist->WriteString(string_buffer);
+        if (Options.output_single_file) {
+            sprintf(string_buffer, "#EXT-X-BYTERANGE:%d@%lld\r\n", segment.size, segment.position);
+            playlist->WriteString(string_buffer);
+        }
+        sprintf(string_buffer, Options.segment_url_template, segment.index);
+        playlist->WriteString(string_buffer);
+        playlist->WriteString("\r\n");
+    }
+    
+    if (ended) {
+        playlist->WriteString("#EXT-X-ENDLIST\r\n");
+    } else {
+        if (open_segment) {
+            WriteParts(playlist, *open_segment);
+        }
+        if (Options.part_duration) {
+            playlist->WriteString("#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"");
+            sprintf(string_buffer, Options.segment_url_template, hint_segment_index);
+            playlist->WriteString(string_buffer);
+            sprintf(string_buffer, "\",BYTERANGE-START=%lld\r\n", hint_position);
+            playlist->WriteString(string_buffer);
+        }
+    }
+    playlist->Release();
+    
+    if (Options.live) {
+#if defined(_WIN32)
+        // rename() does not replace an existing file on Windows
+        remove(Options.index_filename);
+#endif
+        if (rename(temp_filename, Options.index_filename)) {
+            fprintf(stderr, "ERROR: cannot replace playlist\n");
+            return AP4_ERROR_CANNOT_OPEN_FILE;
+        }
+    }
+    
+    return AP4_SUCCESS;
+}
+
 /*----------------------------------------------------------------------
 |   WriteSamples
 +---------------------------------------------------------------------*/
@@ -1019,10 +1389,16 @@ WriteSamples(AP4_Mpeg2TsWriter*               ts_writer,
     unsigned int            segment_number = 0;
     AP4_ByteStream*         segment_output = NULL;
     double                  segment_duration = 0.0;
-    AP4_Array<double>       segment_durations;
-    AP4_Array<AP4_UI32>     segment_sizes;
     AP4_Position            segment_position = 0;
-    AP4_Array<AP4_Position> segment_positions;
+    PlaylistSegment*        segment = NULL;
+    AP4_List<PlaylistSegment> segments;
+    unsigned int            media_sequence = 0;
+    unsigned int            target_duration = Options.live ? Options.target_duration : 0;
+    double                  total_duration = 0.0;
+    double                  part_start_ts = 0.0;
+    AP4_Position            part_start = 0;
+    bool                    part_has_video = false;
+    bool                    part_independent = false;
     AP4_Array<AP4_Position> iframe_positions;
     AP4_Array<AP4_UI32>     iframe_sizes;
     AP4_Array<double>       iframe_times;
@@ -1033,6 +1409,8 @@ WriteSamples(AP4_Mpeg2TsWriter*               ts_writer,
     AP4_ByteStream*         playlist = NULL;
     char                    string_buffer[4096];
     SampleEncrypter*        sample_encrypter = NULL;
+    EncryptingStream*       deferred_segment = NULL;
+    SegmentEncryptionPool   encryption_pool(Options.encryption_threads);
     AP4_Result              result = AP4_SUCCESS;
     
     // prime the samples
@@ -1093,10 +1471,30 @@ WriteSamples(AP4_Mpeg2TsWriter*               ts_writer,
                         segment_size = (AP4_UI32)(segment_end-segment_position);
                     }
                     
+                    // close the last part of the segment
+                    if (Options.part_duration) {
+                        AddPart(*segment, *raw_output, part_start, last_ts-part_start_ts, video_track ? part_independent : true);
+                    }
+                    
                     // update counters
-                    segment_sizes.Append(segment_size);
-                    segment_positions.Append(segment_position);
-                    segment_durations.Append(segment_duration);
+                    segment->duration = segment_duration;
+                    segment->size     = segment_size;
+                    segment->position = segment_position;
+                    segments.Add(segment);
+                    segment = NULL;
+                    if ((unsigned int)(segment_duration+0.5) > target_duration) {
+                        if (Options.live) {
+                            // the target duration of a live playlist can't change once published
+                            fprintf(stderr, "WARNING: segment %d is longer (%.3f) than the target duration (%d)\n",
+                                    segment_number, segment_duration, target_duration);
+                        } else {
+                            target_duration = (unsigned int)segment_duration;
+                        }
+                    }
+                    total_duration                += segment_duration;
+                    Stats.segments_total_size     += segment_size;
+                    Stats.segments_total_duration += segment_duration;
+                    ++Stats.segment_count;
             
                     if (segment_duration != 0.0) {
                         double segment_bitrate = 8.0*(double)segment_size/segment_duration;
@@ -1113,13 +1511,52 @@ WriteSamples(AP4_Mpeg2TsWriter*               ts_writer,
                                segment_size,
                                segment_position);
                     }
-                    if (!Options.output_single_file) {
+                    if (deferred_segment) {
+                        // the pool takes over our reference to the segment
+                        result = encryption_pool.Add(deferred_segment);
+                        deferred_segment = NULL;
+                        segment_output   = NULL;
+                        if (AP4_FAILED(result)) {
+                            fprintf(stderr, "ERROR: failed to encrypt segment (%d)\n", result);
+                            return result;
+                        }
+                    } else if (!Options.output_single_file) {
                         segment_output->Release();
                         segment_output = NULL;
                     }
                     ++segment_number;
                     audio_sample_count = 0;
                     video_sample_count = 0;
+                    
+                    if (Options.live) {
+                        // slide the window
+                        while (Options.live_window && segments.ItemCount() > Options.live_window) {
+                            PlaylistSegment* oldest = NULL;
+                            segments.PopHead(oldest);
+                            delete oldest;
+                            ++media_sequence;
+                        }
+                        
+                        // only the segments close to the live edge need to list their parts
+                        double edge_distance = 0.0;
+                        for (AP4_List<PlaylistSegment>::Item* item = segments.LastItem(); item; item = item->GetPrev()) {
+                            if (edge_distance > 3.0*(double)target_duration) {
+                                if (item->GetData()->parts.ItemCount() == 0) break;
+                                item->GetData()->parts.Clear();
+                            }
+                            edge_distance += item->GetData()->duration;
+                        }
+                        
+                        // update the playlist, unless this is the last segment
+                        if (chosen_track) {
+                            AP4_Position next_position = 0;
+                            if (Options.output_single_file) {
+                                raw_output->Tell(next_position);
+                            }
+                            result = WriteMediaPlaylist(segments, NULL, media_sequence, target_duration, video_track != NULL, false, segment_number, next_position);
+                            if (AP4_FAILED(result)) return result;
+                        }
+                    }
                 }
                 new_segment = true;
             }
@@ -1139,6 +1576,14 @@ WriteSamples(AP4_Mpeg2TsWriter*               ts_writer,
                 }
             }
             
+            // setup the new segment record
+            segment = new PlaylistSegment();
+            segment->index   = segment_number;
+            part_start       = segment_position;
+            part_start_ts    = last_ts;
+            part_has_video   = false;
+            part_independent = false;
+
             // manage the new segment stream
             if (segment_output == NULL) {
                 segment_output = OpenOutput(Options.segment_filename_template, segment_number);
@@ -1153,13 +1598,15 @@ WriteSamples(AP4_Mpeg2TsWriter*               ts_writer,
             }
             if (Options.encryption_mode == ENCRYPTION_MODE_AES_128) {
                 EncryptingStream* encrypting_stream = NULL;
-                result = EncryptingStream::Create(Options.encryption_key, Options.encryption_iv, raw_output, encrypting_stream);
+                bool deferred = Options.encryption_threads != 0;
+                result = EncryptingStream::Create(Options.encryption_key, Options.encryption_iv, raw_output, deferred, encrypting_stream);
                 if (AP4_FAILED(result)) {
                     fprintf(stderr, "ERROR: failed to create encrypting stream (%d)\n", result);
                     return result;
                 }
                 segment_output->Release();
                 segment_output = encrypting_stream;
+                if (deferred) deferred_segment = encrypting_stream;
             } else if (Options.encryption_mode == ENCRYPTION_MODE_SAMPLE_AES) {
                 delete sample_encrypter;
                 sample_encrypter = NULL;
@@ -1220,6 +1667,21 @@ WriteSamples(AP4_Mpeg2TsWriter*               ts_writer,
             }
         }
 
+        // check if we need to start a new part
+        if (Options.part_duration && (video_track == NULL || chosen_track == video_track)) {
+            double part_ts             = video_track ? video_ts : audio_ts;
+            double part_frame_duration = video_track ? video_frame_duration : audio_frame_duration;
+            if (part_ts > part_start_ts &&
+                part_ts+part_frame_duration-part_start_ts > (double)Options.part_duration/1000.0) {
+                segment_output->Flush();
+                AddPart(*segment, *raw_output, part_start, part_ts-part_start_ts, video_track ? part_independent : true);
+                part_start_ts  = part_ts;
+                part_has_video = false;
+                result = WriteMediaPlaylist(segments, segment, media_sequence, target_duration, video_track != NULL, false, segment_number, part_start);
+                if (AP4_FAILED(result)) return result;
+            }
+        }
+        
         // write the samples out and advance to the next sample
         if (chosen_track == audio_track) {
             // perform sample-level encryption if needed
@@ -1272,9 +1734,13 @@ WriteSamples(AP4_Mpeg2TsWriter*               ts_writer,
             if (AP4_FAILED(result)) return result;
             AP4_Position frame_end = 0;
             segment_output->Tell(frame_end);
+            if (!part_has_video) {
+                part_has_video   = true;
+                part_independent = video_sample.IsSync();
+            }
             
-            // measure I frames
-            if (video_sample.IsSync()) {
+            // measure I frames (not in live mode, where there is no I-Frame playlist)
+            if (video_sample.IsSync() && !Options.live) {
                 AP4_UI64 frame_size = 0;
                 if (frame_end > frame_start) {
                     frame_size = frame_end-frame_start;
@@ -1301,116 +1767,19 @@ WriteSamples(AP4_Mpeg2TsWriter*               ts_writer,
         }
     }
     
-    // create the media playlist/index file
-    playlist = OpenOutput(Options.index_filename, 0);
-    if (playlist == NULL) return AP4_ERROR_CANNOT_OPEN_FILE;
-
-    unsigned int target_duration = 0;
-    double       total_duration = 0.0;
-    for (unsigned int i=0; i<segment_durations.ItemCount(); i++) {
-        if ((unsigned int)(segment_durations[i]+0.5) > target_duration) {
-            target_duration = (unsigned int)segment_durations[i];
-        }
-        total_duration += segment_durations[i];
-    }
-
-    playlist->WriteString("#EXTM3U\r\n");
-    if (Options.hls_version > 1) {
-        sprintf(string_buffer, "#EXT-X-VERSION:%d\r\n", Options.hls_version);
-        playlist->WriteString(string_buffer);
-    }
-    playlist->WriteString("#EXT-X-PLAYLIST-TYPE:VOD\r\n");
-    if (video_track) {
-        playlist->WriteString("#EXT-X-INDEPENDENT-SEGMENTS\r\n");
-    }
-    playlist->WriteString("#EXT-X-TARGETDURATION:");
-    sprintf(string_buffer, "%d\r\n", target_duration);
-    playlist->WriteString(string_buffer);
-    playlist->WriteString("#EXT-X-MEDIA-SEQUENCE:0\r\n");
-
-    if (Options.encryption_mode != ENCRYPTION_MODE_NONE) {
-        if (Options.encryption_key_lines.ItemCount()) {
-            for (unsigned int i=0; i<Options.encryption_key_lines.ItemCount(); i++) {
-                AP4_String& key_line = Options.encryption_key_lines[i];
-                const char* key_line_cstr = key_line.GetChars();
-                bool omit_iv = false;
-                
-                // omit the IV if the key line starts with a "!" (and skip the "!")
-                if (key_line[0] == '!') {
-                    ++key_line_cstr;
-                    omit_iv = true;
-                }
-                
-                playlist->WriteString("#EXT-X-KEY:METHOD=");
-                if (Options.encryption_mode == ENCRYPTION_MODE_AES_128) {
-                    playlist->WriteString("AES-128");
-                } else if (Options.encryption_mode == ENCRYPTION_MODE_SAMPLE_AES) {
-                    playlist->WriteString("SAMPLE-AES");
-                }
-                playlist->WriteString(",");
-                playlist->WriteString(key_line_cstr);
-                if ((Options.encryption_iv_mode == ENCRYPTION_IV_MODE_RANDOM ||
-                     Options.encryption_iv_mode == ENCRYPTION_IV_MODE_FPS) && !omit_iv) {
-                    playlist->WriteString(",IV=0x");
-                    char iv_hex[33];
-                    iv_hex[32] = 0;
-                    AP4_FormatHex(Options.encryption_iv, 16, iv_hex);
-                    playlist->WriteString(iv_hex);
-                }
-                playlist->WriteString("\r\n");
-            }
-        } else {
-            playlist->WriteString("#EXT-X-KEY:METHOD=");
-            if (Options.encryption_mode == ENCRYPTION_MODE_AES_128) {
-                playlist->WriteString("AES-128");
-            } else if (Options.encryption_mode == ENCRYPTION_MODE_SAMPLE_AES) {
-                playlist->WriteString("SAMPLE-AES");
-            }
-            playlist->WriteString(",URI=\"");
-            playlist->WriteString(Options.encryption_key_uri);
-            playlist->WriteString("\"");
-            if (Options.encryption_iv_mode == ENCRYPTION_IV_MODE_RANDOM) {
-                playlist->WriteString(",IV=0x");
-                char iv_hex[33];
-                iv_hex[32] = 0;
-                AP4_FormatHex(Options.encryption_iv, 16, iv_hex);
-                playlist->WriteString(iv_hex);
-            }
-            if (Options.encryption_key_format) {
-                playlist->WriteString(",KEYFORMAT=\"");
-                playlist->WriteString(Options.encryption_key_format);
-                playlist->WriteString("\"");
-            }
-            if (Options.encryption_key_format_versions) {
-                playlist->WriteString(",KEYFORMATVERSIONS=\"");
-                playlist->WriteString(Options.encryption_key_format_versions);
-                playlist->WriteString("\"");
-            }
-            playlist->WriteString("\r\n");
-        }
+    // wait for all the segments to be encrypted and written out
+    result = encryption_pool.Flush();
+    if (AP4_FAILED(result)) {
+        fprintf(stderr, "ERROR: failed to encrypt segment (%d)\n", result);
+        return result;
     }
     
-    for (unsigned int i=0; i<segment_durations.ItemCount(); i++) {
-        if (Options.hls_version >= 3) {
-            sprintf(string_buffer, "#EXTINF:%f,\r\n", segment_durations[i]);
-        } else {
-            sprintf(string_buffer, "#EXTINF:%u,\r\n", (unsigned int)(segment_durations[i]+0.5));
-        }
-        playlist->WriteString(string_buffer);
-        if (Options.output_single_file) {
-            sprintf(string_buffer, "#EXT-X-BYTERANGE:%d@%lld\r\n", segment_sizes[i], segment_positions[i]);
-            playlist->WriteString(string_buffer);
-        }
-        sprintf(string_buffer, Options.segment_url_template, i);
-        playlist->WriteString(string_buffer);
-        playlist->WriteString("\r\n");
-    }
-                    
-    playlist->WriteString("#EXT-X-ENDLIST\r\n");
-    playlist->Release();
+    // create the media playlist/index file
+    result = WriteMediaPlaylist(segments, NULL, media_sequence, target_duration, video_track != NULL, true, 0, 0);
+    if (AP4_FAILED(result)) return result;
 
     // create the iframe playlist/index file
-    if (video_track && Options.hls_version >= 4) {
+    if (video_track && Options.iframe_index_filename && Options.hls_version >= 4) {
         // compute the iframe durations and target duration
         for (unsigned int i=0; i<iframe_positions.ItemCount(); i++) {
             double iframe_duration = 0.0;
@@ -1489,11 +1858,6 @@ WriteSamples(AP4_Mpeg2TsWriter*               ts_writer,
     }
     
     // update stats
-    Stats.segment_count = segment_sizes.ItemCount();
-    for (unsigned int i=0; i<segment_sizes.ItemCount(); i++) {
-        Stats.segments_total_size     += segment_sizes[i];
-        Stats.segments_total_duration += segment_durations[i];
-    }
     Stats.iframe_count = iframe_sizes.ItemCount();
     for (unsigned int i=0; i<iframe_sizes.ItemCount(); i++) {
         Stats.iframes_total_size += iframe_sizes[i];
@@ -1512,6 +1876,8 @@ WriteSamples(AP4_Mpeg2TsWriter*               ts_writer,
     }
     
     if (segment_output) segment_output->Release();
+    delete segment;
+    segments.DeleteReferences();
     delete sample_encrypter;
     
     return result;
@@ -1545,12 +1911,17 @@ main(int argc, char** argv)
     Options.segment_url_template           = NULL;
     Options.segment_duration               = 6;
     Options.segment_duration_threshold     = DefaultSegmentDurationThreshold;
+    Options.live                           = false;
+    Options.live_window                    = 0;
+    Options.target_duration                = 0;
+    Options.part_duration                  = 0;
     Options.encryption_key_hex             = NULL;
     Options.encryption_mode                = ENCRYPTION_MODE_NONE;
     Options.encryption_iv_mode             = ENCRYPTION_IV_MODE_NONE;
     Options.encryption_key_uri             = "key.bin";
     Options.encryption_key_format          = NULL;
     Options.encryption_key_format_versions = NULL;
+    Options.encryption_threads             = 0;
     AP4_SetMemory(Options.encryption_key, 0, sizeof(Options.encryption_key));
     AP4_SetMemory(Options.encryption_iv,  0, sizeof(Options.encryption_iv));
     AP4_SetMemory(&Stats, 0, sizeof(Stats));
@@ -1639,6 +2010,26 @@ main(int argc, char** argv)
                 return 1;
             }
             Options.video_track_id = (unsigned int)strtoul(*args++, NULL, 10);
+        } else if (!strcmp(arg, "--live")) {
+            Options.live = true;
+        } else if (!strcmp(arg, "--live-window")) {
+            if (*args == NULL) {
+                fprintf(stderr, "ERROR: --live-window requires a number\n");
+                return 1;
+            }
+            Options.live_window = (unsigned int)strtoul(*args++, NULL, 10);
+        } else if (!strcmp(arg, "--target-duration")) {
+            if (*args == NULL) {
+                fprintf(stderr, "ERROR: --target-duration requires a number\n");
+                return 1;
+            }
+            Options.target_duration = (unsigned int)strtoul(*args++, NULL, 10);
+        } else if (!strcmp(arg, "--part-duration")) {
+            if (*args == NULL) {
+                fprintf(stderr, "ERROR: --part-duration requires a number\n");
+                return 1;
+            }
+            Options.part_duration = (unsigned int)strtoul(*args++, NULL, 10);
         } else if (!strcmp(arg, "--output-single-file")) {
             Options.output_single_file = true;
         } else if (!strcmp(arg, "--index-filename")) {
@@ -1723,6 +2114,12 @@ main(int argc, char** argv)
                 return 1;
             }
             Options.encryption_key_lines.Append(*args++);
+        } else if (!strcmp(arg, "--encryption-threads")) {
+            if (*args == NULL) {
+                fprintf(stderr, "ERROR: --encryption-threads requires a number\n");
+                return 1;
+            }
+            Options.encryption_threads = (unsigned int)strtoul(*args++, NULL, 10);
         } else if (Options.input == NULL) {
             Options.input = arg;
         } else {
@@ -1752,6 +2149,37 @@ main(int argc, char** argv)
         fprintf(stderr, "WARNING: forcing version to 4 in order to support I-FRAME-ONLY playlists\n");
         Options.hls_version = 4;
     }
+    if ((Options.live_window || Options.part_duration || Options.target_duration) && !Options.live) {
+        fprintf(stderr, "ERROR: --live-window, --part-duration and --target-duration require --live\n");
+        return 1;
+    }
+    if (Options.live && Options.segment_duration == 0) {
+        fprintf(stderr, "ERROR: --live requires a non-zero segment duration\n");
+        return 1;
+    }
+    if (Options.live && Options.target_duration == 0) {
+        Options.target_duration = Options.segment_duration;
+    }
+    if (Options.part_duration && Options.encryption_mode == ENCRYPTION_MODE_AES_128) {
+        fprintf(stderr, "ERROR: --part-duration cannot be used with AES-128 encryption\n");
+        return 1;
+    }
+    if (Options.encryption_threads && Options.encryption_mode != ENCRYPTION_MODE_AES_128) {
+        fprintf(stderr, "WARNING: --encryption-threads is only used with AES-128 encryption\n");
+        Options.encryption_threads = 0;
+    }
+    if (Options.encryption_threads && (Options.live || Options.output_single_file)) {
+        fprintf(stderr, "ERROR: --encryption-threads cannot be used with --live or --output-single-file\n");
+        return 1;
+    }
+    if (Options.live && Options.iframe_index_filename) {
+        fprintf(stderr, "WARNING: --iframe-index-filename will be ignored in live mode\n");
+        Options.iframe_index_filename = NULL;
+    }
+    if (Options.part_duration && Options.hls_version > 0 && Options.hls_version < 6) {
+        Options.hls_version = 6;
+        fprintf(stderr, "WARNING: forcing version to 6 in order to support partial segments\n");
+    }
     if (Options.encryption_iv_mode == ENCRYPTION_IV_MODE_NONE && Options.encryption_mode != ENCRYPTION_MODE_NONE) {
         if (Options.encryption_mode == ENCRYPTION_MODE_SAMPLE_AES) {
             // sequence-mode IVs don't work well with i-frame only playlists, use random instead
@@ -1769,8 +2197,10 @@ main(int argc, char** argv)
         fprintf(stderr, "WARNING: forcing version to 4 in order to support single file output\n");
     }
     if (Options.hls_version == 0) {
-        // default version is 3 for cleartext or AES-128 encryption, and 5 for SAMPLE-AES
-        if (Options.encryption_mode == ENCRYPTION_MODE_SAMPLE_AES) {
+        // default version is 3 for cleartext or AES-128 encryption, 5 for SAMPLE-AES, and 6 for partial segments
+        if (Options.part_duration) {
+            Options.hls_version = 6;
+        } else if (Options.encryption_mode == ENCRYPTION_MODE_SAMPLE_AES) {
             Options.hls_version = 5;
         } else if (Options.output_single_file || Options.iframe_index_filename) {
             Options.hls_version = 4;
@@ -1785,7 +2215,7 @@ main(int argc, char** argv)
     }
 
     // compute some derived values
-    if (Options.iframe_index_filename == NULL) {
+    if (Options.iframe_index_filename == NULL && !Options.live) {
         if (Options.hls_version >= 4) {
             Options.iframe_index_filename = "iframes.m3u8";
         }
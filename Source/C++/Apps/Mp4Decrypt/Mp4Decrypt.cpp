@@ -51,8 +51,12 @@ PrintUsageAndExit()
             BANNER 
             "\n\n"
             "usage: mp4decrypt [options] <input> <output>\n"
+            "       mp4decrypt [options] --batch <manifest>\n"
             "Options are:\n"
             "  --show-progress : show progress details\n"
+            "  --instrumentation <filename> : write processing counters (time, bytes\n"
+            "      and calls for each stage, and buffer high-water marks) to <filename>,\n"
+            "      in JSON format\n"
             "  --key <id>:<k>\n"
             "      <id> is either a track ID in decimal or a 128-bit KID in hex,\n"
             "      <k> is a 128-bit key in hex\n"
@@ -63,6 +67,15 @@ PrintUsageAndExit()
             "  --fragments-info <filename>\n"
             "      Decrypt the fragments read from <input>, with track info read\n"
             "      from <filename>.\n"
+            "  --batch <manifest>\n"
+            "      Decrypt all the files listed in <manifest> (use -stdin to read it\n"
+            "      from the standard input) instead of a single <input> and <output>.\n"
+            "      Each line of the manifest is an input and an output filename,\n"
+            "      separated by a tab or, for names without spaces, by a space.\n"
+            "  --batch-threads <n>\n"
+            "      Number of files decrypted in parallel in batch mode (default: 1)\n"
+            "      note: Marlin IPMP files are parsed with a shared atom factory, so\n"
+            "      only use 1 thread for batches that include Marlin IPMP files.\n"
             );
     exit(1);
 }
@@ -84,94 +97,22 @@ ProgressListener::OnProgress(unsigned int step, unsigned int total)
 }
 
 /*----------------------------------------------------------------------
-|   main
+|   DecryptFile
 +---------------------------------------------------------------------*/
-int
-main(int argc, char** argv)
+/*
+ * Returns 1 if the files could not be opened, 0 otherwise. In both cases,
+ * 'result' is set to the result of the operation.
+ */
+static int
+DecryptFile(const char*                      input_filename,
+            const char*                      output_filename,
+            const char*                      fragments_info_filename,
+            AP4_ProtectionKeyMap&            key_map,
+            AP4_AtomFactory&                 atom_factory,
+            AP4_Processor::ProgressListener* listener,
+            AP4_Result&                      result)
 {
-    if (argc == 1) {
-        PrintUsageAndExit();
-    }
-
-    // create a key map object to hold keys
-    AP4_ProtectionKeyMap key_map;
-    
-    // parse options
-    const char* input_filename = NULL;
-    const char* output_filename = NULL;
-    const char* fragments_info_filename = NULL;
-    bool        show_progress = false;
-
-    char* arg;
-    while ((arg = *++argv)) {
-        if (!strcmp(arg, "--key")) {
-            arg = *++argv;
-            if (arg == NULL) {
-                fprintf(stderr, "ERROR: missing argument after --key option\n");
-                return 1;
-            }
-            char* keyid_text = NULL;
-            char* key_text = NULL;
-            if (AP4_SplitArgs(arg, keyid_text, key_text)) {
-                fprintf(stderr, "ERROR: invalid argument for --key option\n");
-                return 1;
-            }
-            unsigned char key[16];
-            unsigned int  track_id = 0;
-            unsigned char kid[16];
-            if (strlen(keyid_text) == 32) {
-                if (AP4_ParseHex(keyid_text, kid, 16)) {
-                    fprintf(stderr, "ERROR: invalid hex format for key id\n");
-                    return 1;
-                }
-            } else {
-                track_id = (unsigned int)strtoul(keyid_text, NULL, 10);
-                if (track_id == 0) {
-                    fprintf(stderr, "ERROR: invalid key id\n");
-                    return 1;
-                }
-            }
-            if (AP4_ParseHex(key_text, key, 16)) {
-                fprintf(stderr, "ERROR: invalid hex format for key\n");
-                return 1;
-            }
-            // set the key in the map
-            if (track_id) {
-                key_map.SetKey(track_id, key, 16);
-            } else {
-                key_map.SetKeyForKid(kid, key, 16);
-            }
-        } else if (!strcmp(arg, "--fragments-info")) {
-            arg = *++argv;
-            if (arg == NULL) {
-                fprintf(stderr, "ERROR: missing argument for --fragments-info option\n");
-                return 1;
-            }
-            fragments_info_filename = arg;
-        } else if (!strcmp(arg, "--show-progress")) {
-            show_progress = true;
-        } else if (input_filename == NULL) {
-            input_filename = arg;
-        } else if (output_filename == NULL) {
-            output_filename = arg;
-        } else {
-            fprintf(stderr, "ERROR: unexpected argument (%s)\n", arg);
-            return 1;
-        }
-    }
-
-    // check the arguments
-    if (input_filename == NULL) {
-        fprintf(stderr, "ERROR: missing input filename\n");
-        return 1;
-    }
-    if (output_filename == NULL) {
-        fprintf(stderr, "ERROR: missing output filename\n");
-        return 1;
-    }
-
     // create the input stream
-    AP4_Result result;
     AP4_ByteStream* input = NULL;
     result = AP4_FileByteStream::Create(input_filename, AP4_FileByteStream::STREAM_MODE_READ, input);
     if (AP4_FAILED(result)) {
@@ -184,6 +125,7 @@ main(int argc, char** argv)
     result = AP4_FileByteStream::Create(output_filename, AP4_FileByteStream::STREAM_MODE_WRITE, output);
     if (AP4_FAILED(result)) {
         fprintf(stderr, "ERROR: cannot open output file (%s) %d\n", output_filename, result);
+        input->Release();
         return 1;
     }
 
@@ -193,13 +135,15 @@ main(int argc, char** argv)
         result = AP4_FileByteStream::Create(fragments_info_filename, AP4_FileByteStream::STREAM_MODE_READ, fragments_info);
         if (AP4_FAILED(result)) {
             fprintf(stderr, "ERROR: cannot open fragments info file (%s)\n", fragments_info_filename);
+            input->Release();
+            output->Release();
             return 1;
         }
     }
 
     // create the decrypting processor
     AP4_Processor* processor = NULL;
-    AP4_File* input_file = new AP4_File(fragments_info?*fragments_info:*input);
+    AP4_File* input_file = new AP4_File(fragments_info?*fragments_info:*input, atom_factory, false);
     AP4_FtypAtom* ftyp = input_file->GetFileType();
     if (ftyp) {
         if (ftyp->GetMajorBrand() == AP4_OMA_DCF_BRAND_ODCF || ftyp->HasCompatibleBrand(AP4_OMA_DCF_BRAND_ODCF)) {
@@ -251,11 +195,10 @@ main(int argc, char** argv)
     }
     
     // process/decrypt the file
-    ProgressListener listener;
     if (fragments_info) {
-        result = processor->Process(*input, *output, *fragments_info, show_progress?&listener:NULL);
+        result = processor->Process(*input, *output, *fragments_info, listener, atom_factory);
     } else {
-        result = processor->Process(*input, *output, show_progress?&listener:NULL);
+        result = processor->Process(*input, *output, listener, atom_factory);
     }
     if (AP4_FAILED(result)) {
         fprintf(stderr, "ERROR: failed to process the file (%d)\n", result);
@@ -265,6 +208,254 @@ main(int argc, char** argv)
     delete processor;
     input->Release();
     output->Release();
+    if (fragments_info) fragments_info->Release();
 
     return 0;
 }
+
+/*----------------------------------------------------------------------
+|   BatchWorker
++---------------------------------------------------------------------*/
+class BatchWorker : public AP4_BatchRunner::Worker {
+public:
+    BatchWorker(AP4_ProtectionKeyMap& key_map) : m_KeyMap(key_map) {}
+
+    // AP4_BatchRunner::Worker methods
+    virtual AP4_Result ProcessJob(AP4_BatchRunner::Job& job) {
+        AP4_Result result = AP4_SUCCESS;
+        DecryptFile(job.m_InputFilename.GetChars(),
+                    job.m_OutputFilename.GetChars(),
+                    NULL,
+                    m_KeyMap,
+                    m_AtomFactory,
+                    NULL,
+                    result);
+        return result;
+    }
+
+private:
+    // members
+    AP4_ProtectionKeyMap&  m_KeyMap;
+    AP4_DefaultAtomFactory m_AtomFactory; // reused from one job to the next
+};
+
+/*----------------------------------------------------------------------
+|   RunBatch
++---------------------------------------------------------------------*/
+static int
+RunBatch(const char* manifest_filename, unsigned int thread_count, AP4_ProtectionKeyMap& key_map)
+{
+    // load the jobs
+    AP4_BatchRunner runner;
+    AP4_ByteStream* manifest = NULL;
+    AP4_Result result = AP4_FileByteStream::Create(manifest_filename, AP4_FileByteStream::STREAM_MODE_READ, manifest);
+    if (AP4_FAILED(result)) {
+        fprintf(stderr, "ERROR: cannot open batch manifest (%s)\n", manifest_filename);
+        return 1;
+    }
+    result = runner.ParseManifest(*manifest);
+    manifest->Release();
+    if (AP4_FAILED(result)) {
+        fprintf(stderr, "ERROR: invalid batch manifest (%d)\n", result);
+        return 1;
+    }
+    AP4_Array<AP4_BatchRunner::Job>& jobs = runner.GetJobs();
+    
+    // run the jobs, with one worker per thread
+    if (thread_count > jobs.ItemCount()) thread_count = jobs.ItemCount();
+    if (thread_count == 0) thread_count = 1;
+    AP4_Array<AP4_BatchRunner::Worker*> workers;
+    for (unsigned int i=0; i<thread_count; i++) {
+        workers.Append(new BatchWorker(key_map));
+    }
+    runner.Run(workers);
+    for (unsigned int i=0; i<workers.ItemCount(); i++) {
+        delete workers[i];
+    }
+    
+    // report the jobs that failed
+    unsigned int failure_count = 0;
+    for (unsigned int i=0; i<jobs.ItemCount(); i++) {
+        if (AP4_FAILED(jobs[i].m_Result)) {
+            fprintf(stderr, "ERROR: failed to decrypt %s (%d)\n", jobs[i].m_InputFilename.GetChars(), jobs[i].m_Result);
+            ++failure_count;
+        }
+    }
+    
+    return failure_count ? 1 : 0;
+}
+
+/*----------------------------------------------------------------------
+|   WriteInstrumentation
++---------------------------------------------------------------------*/
+static void
+WriteInstrumentation(AP4_InstrumentationCounters& counters, const char* filename)
+{
+    AP4_ByteStream* stream = NULL;
+    AP4_Result result = AP4_FileByteStream::Create(filename, AP4_FileByteStream::STREAM_MODE_WRITE, stream);
+    if (AP4_FAILED(result)) {
+        fprintf(stderr, "ERROR: cannot open instrumentation file (%s)\n", filename);
+        return;
+    }
+    result = counters.WriteJson(*stream);
+    if (AP4_FAILED(result)) {
+        fprintf(stderr, "ERROR: failed to write instrumentation file (%d)\n", result);
+    }
+    stream->Release();
+}
+
+/*----------------------------------------------------------------------
+|   main
++---------------------------------------------------------------------*/
+int
+main(int argc, char** argv)
+{
+    if (argc == 1) {
+        PrintUsageAndExit();
+    }
+
+    // create a key map object to hold keys
+    AP4_ProtectionKeyMap key_map;
+    
+    // parse options
+    const char* input_filename = NULL;
+    const char* output_filename = NULL;
+    const char* fragments_info_filename = NULL;
+    const char* instrumentation_filename = NULL;
+    const char* batch_filename = NULL;
+    unsigned int batch_threads = 1;
+    bool        show_progress = false;
+
+    char* arg;
+    while ((arg = *++argv)) {
+        if (!strcmp(arg, "--key")) {
+            arg = *++argv;
+            if (arg == NULL) {
+                fprintf(stderr, "ERROR: missing argument after --key option\n");
+                return 1;
+            }
+            char* keyid_text = NULL;
+            char* key_text = NULL;
+            if (AP4_SplitArgs(arg, keyid_text, key_text)) {
+                fprintf(stderr, "ERROR: invalid argument for --key option\n");
+                return 1;
+            }
+            unsigned char key[16];
+            unsigned int  track_id = 0;
+            unsigned char kid[16];
+            if (strlen(keyid_text) == 32) {
+                if (AP4_ParseHex(keyid_text, kid, 16)) {
+                    fprintf(stderr, "ERROR: invalid hex format for key id\n");
+                    return 1;
+                }
+            } else {
+                track_id = (unsigned int)strtoul(keyid_text, NULL, 10);
+                if (track_id == 0) {
+                    fprintf(stderr, "ERROR: invalid key id\n");
+                    return 1;
+                }
+            }
+            if (AP4_ParseHex(key_text, key, 16)) {
+                fprintf(stderr, "ERROR: invalid hex format for key\n");
+                return 1;
+            }
+            // set the key in the map
+            if (track_id) {
+                key_map.SetKey(track_id, key, 16);
+            } else {
+                key_map.SetKeyForKid(kid, key, 16);
+            }
+        } else if (!strcmp(arg, "--fragments-info")) {
+            arg = *++argv;
+            if (arg == NULL) {
+                fprintf(stderr, "ERROR: missing argument for --fragments-info option\n");
+                return 1;
+            }
+            fragments_info_filename = arg;
+        } else if (!strcmp(arg, "--show-progress")) {
+            show_progress = true;
+        } else if (!strcmp(arg, "--instrumentation")) {
+            arg = *++argv;
+            if (arg == NULL) {
+                fprintf(stderr, "ERROR: missing argument for --instrumentation option\n");
+                return 1;
+            }
+            instrumentation_filename = arg;
+        } else if (!strcmp(arg, "--batch")) {
+            arg = *++argv;
+            if (arg == NULL) {
+                fprintf(stderr, "ERROR: missing argument for --batch option\n");
+                return 1;
+            }
+            batch_filename = arg;
+        } else if (!strcmp(arg, "--batch-threads")) {
+            arg = *++argv;
+            if (arg == NULL) {
+                fprintf(stderr, "ERROR: missing argument for --batch-threads option\n");
+                return 1;
+            }
+            batch_threads = (unsigned int)strtoul(arg, NULL, 10);
+            if (batch_threads == 0 || batch_threads > AP4_BATCH_RUNNER_MAX_WORKERS) {
+                fprintf(stderr, "ERROR: --batch-threads must be between 1 and %d\n", AP4_BATCH_RUNNER_MAX_WORKERS);
+                return 1;
+            }
+        } else if (input_filename == NULL) {
+            input_filename = arg;
+        } else if (output_filename == NULL) {
+            output_filename = arg;
+        } else {
+            fprintf(stderr, "ERROR: unexpected argument (%s)\n", arg);
+            return 1;
+        }
+    }
+
+    // check the arguments
+    if (batch_filename) {
+        if (input_filename || fragments_info_filename) {
+            fprintf(stderr, "ERROR: --batch cannot be used with an input filename or --fragments-info\n");
+            return 1;
+        }
+    } else {
+        if (input_filename == NULL) {
+            fprintf(stderr, "ERROR: missing input filename\n");
+            return 1;
+        }
+        if (output_filename == NULL) {
+            fprintf(stderr, "ERROR: missing output filename\n");
+            return 1;
+        }
+    }
+
+    // start measuring if needed
+    AP4_InstrumentationCounters instrumentation;
+    if (instrumentation_filename) {
+        AP4_Instrumentation::SetInstance(&instrumentation);
+    }
+
+    int exit_code = 0;
+    if (batch_filename) {
+        // run the jobs of the batch
+        exit_code = RunBatch(batch_filename, batch_threads, key_map);
+    } else {
+        // process/decrypt the file
+        AP4_Result result = AP4_SUCCESS;
+        ProgressListener listener;
+        if (DecryptFile(input_filename,
+                        output_filename,
+                        fragments_info_filename,
+                        key_map,
+                        AP4_DefaultAtomFactory::Instance_,
+                        show_progress?&listener:NULL,
+                        result)) {
+            return 1;
+        }
+    }
+
+    // write the instrumentation counters
+    if (instrumentation_filename) {
+        AP4_Instrumentation::SetInstance(NULL);
+        WriteInstrumentation(instrumentation, instrumentation_filename);
+    }
+
+    return exit_code;
+}
@@ -66,10 +66,144 @@ PrintUsageAndExit()
             "      value in big-endian byte order\n"
             "  --format <format>\n"
             "      format to use for the output, where <format> is either \n"
-            "      'text' (default) or 'json'\n");
+            "      'text' (default), 'json' or 'segments'\n"
+            "      ('segments' is the same as 'json', except that each 'moof'\n"
+            "      atom is reduced to a summary of its fragment: offset, and for\n"
+            "      each 'traf', the track ID, sample count, duration and sync\n"
+            "      sample information, and the sample count of each 'trun')\n");
     exit(1);
 }
 
+/*----------------------------------------------------------------------
+|   types
++---------------------------------------------------------------------*/
+struct TrackDefaults {
+    TrackDefaults() : track_id(0), sample_duration(0), sample_flags(0) {}
+    AP4_UI32 track_id;
+    AP4_UI32 sample_duration;
+    AP4_UI32 sample_flags;
+};
+
+/*----------------------------------------------------------------------
+|   CollectTrackDefaults
++---------------------------------------------------------------------*/
+static void
+CollectTrackDefaults(AP4_ContainerAtom* moov, AP4_Array<TrackDefaults>& defaults)
+{
+    AP4_ContainerAtom* mvex = AP4_DYNAMIC_CAST(AP4_ContainerAtom, moov->GetChild(AP4_ATOM_TYPE_MVEX));
+    if (mvex == NULL) return;
+    for (AP4_List<AP4_Atom>::Item* item = mvex->GetChildren().FirstItem();
+                                   item;
+                                   item = item->GetNext()) {
+        AP4_TrexAtom* trex = AP4_DYNAMIC_CAST(AP4_TrexAtom, item->GetData());
+        if (trex == NULL) continue;
+        TrackDefaults entry;
+        entry.track_id        = trex->GetTrackId();
+        entry.sample_duration = trex->GetDefaultSampleDuration();
+        entry.sample_flags    = trex->GetDefaultSampleFlags();
+        defaults.Append(entry);
+    }
+}
+
+/*----------------------------------------------------------------------
+|   InspectFragmentSummary
++---------------------------------------------------------------------*/
+static void
+InspectFragmentSummary(AP4_ContainerAtom*              moof,
+                       AP4_Position                    offset,
+                       const AP4_Array<TrackDefaults>& defaults,
+                       AP4_AtomInspector&              inspector)
+{
+    inspector.StartAtom("moof", 0, 0, moof->GetHeaderSize(), moof->GetSize());
+    inspector.AddField("offset", offset);
+    AP4_MfhdAtom* mfhd = AP4_DYNAMIC_CAST(AP4_MfhdAtom, moof->GetChild(AP4_ATOM_TYPE_MFHD));
+    if (mfhd) {
+        inspector.AddField("sequence number", mfhd->GetSequenceNumber());
+    }
+    
+    for (AP4_List<AP4_Atom>::Item* traf_item = moof->GetChildren().FirstItem();
+                                   traf_item;
+                                   traf_item = traf_item->GetNext()) {
+        AP4_ContainerAtom* traf = AP4_DYNAMIC_CAST(AP4_ContainerAtom, traf_item->GetData());
+        if (traf == NULL || traf->GetType() != AP4_ATOM_TYPE_TRAF) continue;
+        AP4_TfhdAtom* tfhd = AP4_DYNAMIC_CAST(AP4_TfhdAtom, traf->GetChild(AP4_ATOM_TYPE_TFHD));
+        if (tfhd == NULL) continue;
+        
+        // resolve the defaults, from the 'tfhd' first, then from the 'trex'
+        AP4_UI32 default_sample_duration = 0;
+        AP4_UI32 default_sample_flags    = 0;
+        for (unsigned int i=0; i<defaults.ItemCount(); i++) {
+            if (defaults[i].track_id == tfhd->GetTrackId()) {
+                default_sample_duration = defaults[i].sample_duration;
+                default_sample_flags    = defaults[i].sample_flags;
+                break;
+            }
+        }
+        if (tfhd->GetFlags() & AP4_TFHD_FLAG_DEFAULT_SAMPLE_DURATION_PRESENT) {
+            default_sample_duration = tfhd->GetDefaultSampleDuration();
+        }
+        if (tfhd->GetFlags() & AP4_TFHD_FLAG_DEFAULT_SAMPLE_FLAGS_PRESENT) {
+            default_sample_flags = tfhd->GetDefaultSampleFlags();
+        }
+        
+        // accumulate the sample info from all the 'trun' atoms
+        AP4_UI64     duration          = 0;
+        AP4_Cardinal sample_count      = 0;
+        AP4_Cardinal sync_sample_count = 0;
+        bool         first_is_sync     = false;
+        for (AP4_List<AP4_Atom>::Item* item = traf->GetChildren().FirstItem();
+                                       item;
+                                       item = item->GetNext()) {
+            AP4_TrunAtom* trun = AP4_DYNAMIC_CAST(AP4_TrunAtom, item->GetData());
+            if (trun == NULL) continue;
+            AP4_UI32 trun_flags = trun->GetFlags();
+            const AP4_Array<AP4_TrunAtom::Entry>& entries = trun->GetEntries();
+            for (unsigned int i=0; i<entries.ItemCount(); i++) {
+                if (trun_flags & AP4_TRUN_FLAG_SAMPLE_DURATION_PRESENT) {
+                    duration += entries[i].sample_duration;
+                } else {
+                    duration += default_sample_duration;
+                }
+                AP4_UI32 sample_flags = default_sample_flags;
+                if (i==0 && (trun_flags & AP4_TRUN_FLAG_FIRST_SAMPLE_FLAGS_PRESENT)) {
+                    sample_flags = trun->GetFirstSampleFlags();
+                } else if (trun_flags & AP4_TRUN_FLAG_SAMPLE_FLAGS_PRESENT) {
+                    sample_flags = entries[i].sample_flags;
+                }
+                bool is_sync = ((sample_flags & AP4_FRAG_FLAG_SAMPLE_IS_DIFFERENCE) == 0);
+                if (is_sync) ++sync_sample_count;
+                if (sample_count == 0) first_is_sync = is_sync;
+                ++sample_count;
+            }
+        }
+        
+        inspector.StartAtom("traf", 0, 0, traf->GetHeaderSize(), traf->GetSize());
+        inspector.AddField("track ID", tfhd->GetTrackId());
+        AP4_TfdtAtom* tfdt = AP4_DYNAMIC_CAST(AP4_TfdtAtom, traf->GetChild(AP4_ATOM_TYPE_TFDT));
+        if (tfdt) {
+            inspector.AddField("base media decode time", tfdt->GetBaseMediaDecodeTime());
+        }
+        inspector.AddField("sample count", sample_count);
+        inspector.AddField("duration", duration);
+        inspector.AddField("sync sample count", sync_sample_count);
+        inspector.AddField("first sample is sync", first_is_sync?1:0, AP4_AtomInspector::HINT_BOOLEAN);
+        
+        // keep one child per 'trun', with just its sample count
+        for (AP4_List<AP4_Atom>::Item* item = traf->GetChildren().FirstItem();
+                                       item;
+                                       item = item->GetNext()) {
+            AP4_TrunAtom* trun = AP4_DYNAMIC_CAST(AP4_TrunAtom, item->GetData());
+            if (trun == NULL) continue;
+            inspector.StartAtom("trun", 0, 0, trun->GetHeaderSize(), trun->GetSize());
+            inspector.AddField("sample count", trun->GetEntries().ItemCount());
+            inspector.EndAtom();
+        }
+        inspector.EndAtom();
+    }
+    
+    inspector.EndAtom();
+}
+
 /*----------------------------------------------------------------------
 |   CreateTrackDumpByteStream
 +---------------------------------------------------------------------*/
@@ -239,6 +373,7 @@ main(int argc, char** argv)
     AP4_Array<AP4_Ordinal>  tracks_to_dump;
     AP4_Ordinal             verbosity   = 0;
     bool                    json_format = false;
+    bool                    segments    = false;
 
     // parse the command line
     argv++;
@@ -287,6 +422,9 @@ main(int argc, char** argv)
             }
             if (strcmp(arg, "json") == 0) {
                 json_format = true;
+            } else if (strcmp(arg, "segments") == 0) {
+                json_format = true;
+                segments    = true;
             } else if (strcmp(arg, "text")) {
                 fprintf(stderr, "ERROR: unknown output format\n");
                 return 1;
@@ -339,6 +477,9 @@ main(int argc, char** argv)
     // inspect the atoms one by one
     AP4_Atom* atom;
     AP4_DefaultAtomFactory atom_factory;
+    AP4_Array<TrackDefaults> track_defaults;
+    AP4_Position atom_offset = 0;
+    input->Tell(atom_offset);
     while (atom_factory.CreateAtomFromStream(*input, atom) == AP4_SUCCESS) {
         // remember the current stream position because the Inspect method
         // may read from the stream (there may be stream references in some
@@ -347,7 +488,16 @@ main(int argc, char** argv)
         input->Tell(position);
 
         // inspect the atom
-        atom->Inspect(*inspector);
+        AP4_ContainerAtom* container = AP4_DYNAMIC_CAST(AP4_ContainerAtom, atom);
+        if (segments && container && atom->GetType() == AP4_ATOM_TYPE_MOOF) {
+            InspectFragmentSummary(container, atom_offset, track_defaults, *inspector);
+        } else {
+            atom->Inspect(*inspector);
+            if (segments && container && atom->GetType() == AP4_ATOM_TYPE_MOOV) {
+                CollectTrackDefaults(container, track_defaults);
+            }
+        }
+        atom_offset = position;
 
         // restore the previous stream position
         input->Seek(position);
@@ -31,6 +31,7 @@
 +---------------------------------------------------------------------*/
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "Ap4.h"
 
@@ -49,14 +50,29 @@ PrintUsageAndExit()
 {
     fprintf(stderr, 
             BANNER 
-            "\n\nusage: mp4edit [commands] <input> <output>\n"
-            "    where commands include one or more of:\n"
+            "\n\nusage: mp4edit [options] [commands] <input> [<output>]\n"
+            "    where options include:\n"
+            "    --in-place: modify the input file directly instead of writing\n"
+            "      an output file (only the moov atom is rewritten, the media data\n"
+            "      is not copied)\n"
+            "    and where commands include one or more of:\n"
             "    --insert <atom_path>:<atom_source_file>[:<position>]\n"
             "    --remove <atom_path>\n"
             "    --replace <atom_path>:<atom_source_file>\n");
     exit(1);
 }
 
+/*----------------------------------------------------------------------
+|   IsInMoov
++---------------------------------------------------------------------*/
+static bool
+IsInMoov(const char* atom_path, bool allow_moov)
+{
+    // true if the path designates the moov atom itself or something inside it
+    if (strncmp(atom_path, "moov", 4)) return false;
+    return atom_path[4] == '/' || (allow_moov && atom_path[4] == '\0');
+}
+
 /*----------------------------------------------------------------------
 |   AP4_EditingProcessor
 +---------------------------------------------------------------------*/
@@ -303,9 +319,13 @@ main(int argc, char** argv)
     // parse arguments
     const char* input_filename = NULL;
     const char* output_filename = NULL;
+    bool        in_place = false;
+    bool        outside_moov = false;
     char* arg;
     while ((arg = *++argv)) {
-        if (!AP4_CompareStrings(arg, "--insert")) {
+        if (!AP4_CompareStrings(arg, "--in-place")) {
+            in_place = true;
+        } else if (!AP4_CompareStrings(arg, "--insert")) {
             char* param = *++argv;
             if (param == NULL) {
                 fprintf(stderr, "ERROR: missing argument for --insert command\n");
@@ -337,6 +357,7 @@ main(int argc, char** argv)
                     file_path[1] = ':';
                 }
                 processor.AddCommand(AP4_EditingProcessor::Command::TYPE_INSERT, atom_path, file_path, position);
+                if (!IsInMoov(atom_path, true)) outside_moov = true;
             } else {
                 fprintf(stderr, "ERROR: invalid format for --insert command argument\n");
                 return 1;
@@ -348,6 +369,7 @@ main(int argc, char** argv)
                 return 1;
             }
             processor.AddCommand(AP4_EditingProcessor::Command::TYPE_REMOVE, atom_path, "");
+            if (!IsInMoov(atom_path, false)) outside_moov = true;
         } else if (!AP4_CompareStrings(arg, "--replace")) {
             char* param = *++argv;
             if (param == NULL) {
@@ -358,6 +380,7 @@ main(int argc, char** argv)
             char* file_path = NULL;
             if (AP4_SUCCEEDED(AP4_SplitArgs(param, atom_path, file_path))) {
                 processor.AddCommand(AP4_EditingProcessor::Command::TYPE_REPLACE, atom_path, file_path);
+                if (!IsInMoov(atom_path, false)) outside_moov = true;
             } else {
                 fprintf(stderr, "ERROR: invalid format for --replace command argument\n");
                 return 1;
@@ -377,19 +400,48 @@ main(int argc, char** argv)
         fprintf(stderr, "ERROR: missing input filename\n");
         return 1;
     }
-    if (output_filename == NULL) {
+    if (output_filename == NULL && !in_place) {
         fprintf(stderr, "ERROR: missing output filename\n");
         return 1;
     }
+    if (output_filename != NULL && in_place) {
+        fprintf(stderr, "ERROR: unexpected output filename with --in-place\n");
+        return 1;
+    }
+    if (outside_moov && in_place) {
+        fprintf(stderr, "ERROR: --in-place only supports edits inside the moov atom\n");
+        return 1;
+    }
 
 	// create the input stream
     AP4_Result result;
     AP4_ByteStream* input = NULL;
-    result = AP4_FileByteStream::Create(input_filename, AP4_FileByteStream::STREAM_MODE_READ, input);
+    result = AP4_FileByteStream::Create(input_filename, 
+                                        in_place ?
+                                        AP4_FileByteStream::STREAM_MODE_READ_WRITE :
+                                        AP4_FileByteStream::STREAM_MODE_READ, 
+                                        input);
     if (AP4_FAILED(result)) {
         fprintf(stderr, "ERROR: cannot open input file (%s)\n", input_filename);
         return 1;
     }
+    
+    // in-place update: apply the edits to the moov atom and write it back
+    if (in_place) {
+        AP4_File* file = new AP4_File(*input, true);
+        result = processor.Initialize(*file, *input, NULL);
+        if (AP4_SUCCEEDED(result)) {
+            result = AP4_FileUpdater::Update(*file, *input);
+            if (result == AP4_ERROR_NOT_SUPPORTED) {
+                fprintf(stderr, "ERROR: the new moov atom does not fit in place in this file, use an output file instead\n");
+            } else if (AP4_FAILED(result)) {
+                fprintf(stderr, "ERROR: failed to update the file in place (%d)\n", result);
+            }
+        }
+        delete file;
+        input->Release();
+        return AP4_SUCCEEDED(result)?0:1;
+    }
 
 	// create the output stream
     AP4_ByteStream* output = NULL;
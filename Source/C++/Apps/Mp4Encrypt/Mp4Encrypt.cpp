@@ -51,15 +51,26 @@ PrintUsageAndExit()
         BANNER 
         "\n\n"
         "usage: mp4encrypt --method <method> [options] <input> <output>\n"
+        "       mp4encrypt --method <method> [options] --batch <manifest>\n"
         "     <method> is OMA-PDCF-CBC, OMA-PDCF-CTR, MARLIN-IPMP-ACBC,\n"
         "     MARLIN-IPMP-ACGK, ISMA-IAEC, PIFF-CBC, PIFF-CTR, ,MPEG-CENC,\n"
         "     MPEG-CBC1, MPEG-CENS, MPEG-CBCS\n"
         "  Options:\n"
         "  --show-progress\n"
         "      Show progress details\n"
+        "  --instrumentation <filename>\n"
+        "      Write processing counters (time, bytes and calls for each stage,\n"
+        "      and buffer high-water marks) to <filename>, in JSON format\n"
         "  --fragments-info <filename>\n"
         "      Encrypt the fragments read from <input>, with track info read\n"
         "      from <filename>\n"
+        "  --batch <manifest>\n"
+        "      Encrypt all the files listed in <manifest> (use -stdin to read it\n"
+        "      from the standard input) instead of a single <input> and <output>.\n"
+        "      Each line of the manifest is an input and an output filename,\n"
+        "      separated by a tab or, for names without spaces, by a space.\n"
+        "  --batch-threads <n>\n"
+        "      Number of files encrypted in parallel in batch mode (default: 1)\n"
         "  --key <n>:<k>:<iv>\n"   
         "      Specifies the key to use for a track (or group key).\n"
         "      <n> is a track ID, <k> a 128-bit key in hex (32 characters)\n"
@@ -159,9 +170,12 @@ ProgressListener::OnProgress(unsigned int step, unsigned int total)
 |   CheckWarning
 +---------------------------------------------------------------------*/
 static bool
-CheckWarning(AP4_ByteStream& stream, AP4_ProtectionKeyMap& key_map, Method method)
+CheckWarning(AP4_ByteStream&       stream,
+             AP4_ProtectionKeyMap& key_map,
+             Method                method,
+             AP4_AtomFactory&      atom_factory)
 {
-    AP4_File file(stream, true);
+    AP4_File file(stream, atom_factory, true);
     AP4_Movie* movie = file.GetMovie();
     if (!movie) {
         if (method != METHOD_MPEG_CENC &&
@@ -209,6 +223,275 @@ CheckWarning(AP4_ByteStream& stream, AP4_ProtectionKeyMap& key_map, Method metho
     return warning;
 }
 
+/*----------------------------------------------------------------------
+|   CreateProcessor
++---------------------------------------------------------------------*/
+static AP4_Processor*
+CreateProcessor(Method                    method,
+                const char*               kms_uri,
+                AP4_ProtectionKeyMap&     key_map,
+                AP4_TrackPropertyMap&     property_map,
+                AP4_Array<AP4_PsshAtom*>& pssh_atoms)
+{
+    // create an encrypting processor
+    AP4_Processor* processor = NULL;
+    if (method == METHOD_ISMA_AES) {
+        AP4_IsmaEncryptingProcessor* isma_processor = new AP4_IsmaEncryptingProcessor(kms_uri);
+        isma_processor->GetKeyMap().SetKeys(key_map);
+        processor = isma_processor;
+    } else if (method == METHOD_MARLIN_IPMP_ACBC ||
+               method == METHOD_MARLIN_IPMP_ACGK) {
+        bool use_group_key = (method == METHOD_MARLIN_IPMP_ACGK);
+        AP4_MarlinIpmpEncryptingProcessor* marlin_processor = 
+            new AP4_MarlinIpmpEncryptingProcessor(use_group_key);
+        marlin_processor->GetKeyMap().SetKeys(key_map);
+        marlin_processor->GetPropertyMap().SetProperties(property_map);
+        processor = marlin_processor;
+    } else if (method == METHOD_OMA_PDCF_CTR ||
+               method == METHOD_OMA_PDCF_CBC) {
+        AP4_OmaDcfEncryptingProcessor* oma_processor = 
+            new AP4_OmaDcfEncryptingProcessor(method == METHOD_OMA_PDCF_CTR?
+                                              AP4_OMA_DCF_CIPHER_MODE_CTR :
+                                              AP4_OMA_DCF_CIPHER_MODE_CBC);
+        oma_processor->GetKeyMap().SetKeys(key_map);
+        oma_processor->GetPropertyMap().SetProperties(property_map);
+        processor = oma_processor;
+    } else if (method == METHOD_PIFF_CTR  ||
+               method == METHOD_PIFF_CBC  ||
+               method == METHOD_MPEG_CENC ||
+               method == METHOD_MPEG_CBC1 ||
+               method == METHOD_MPEG_CENS ||
+               method == METHOD_MPEG_CBCS) {
+        AP4_CencVariant variant = AP4_CENC_VARIANT_MPEG_CENC;
+        switch (method) {
+            case METHOD_PIFF_CBC:
+                variant = AP4_CENC_VARIANT_PIFF_CBC;
+                break;
+                
+            case METHOD_PIFF_CTR:
+                variant = AP4_CENC_VARIANT_PIFF_CTR;
+                break;
+                
+            case METHOD_MPEG_CENC:
+                variant = AP4_CENC_VARIANT_MPEG_CENC;
+                break;
+                
+            case METHOD_MPEG_CBC1:
+                variant = AP4_CENC_VARIANT_MPEG_CBC1;
+                break;
+
+            case METHOD_MPEG_CENS:
+                variant = AP4_CENC_VARIANT_MPEG_CENS;
+                break;
+
+            case METHOD_MPEG_CBCS:
+                variant = AP4_CENC_VARIANT_MPEG_CBCS;
+                break;
+
+            default:
+                break;
+        }
+        AP4_CencEncryptingProcessor* cenc_processor = new AP4_CencEncryptingProcessor(variant);
+        cenc_processor->GetKeyMap().SetKeys(key_map);
+        cenc_processor->GetPropertyMap().SetProperties(property_map);
+        for (unsigned int i=0; i<pssh_atoms.ItemCount(); i++) {
+            cenc_processor->GetPsshAtoms().Append(pssh_atoms[i]);
+        }
+        processor = cenc_processor;
+    }
+
+    return processor;
+}
+
+/*----------------------------------------------------------------------
+|   EncryptFile
++---------------------------------------------------------------------*/
+/*
+ * Returns 1 if the files could not be opened or if there is a warning in
+ * strict mode, 0 otherwise. In all cases, 'result' is set to the result of
+ * the operation.
+ */
+static int
+EncryptFile(const char*                      input_filename,
+            const char*                      output_filename,
+            const char*                      fragments_info_filename,
+            AP4_Processor&                   processor,
+            AP4_ProtectionKeyMap&            key_map,
+            Method                           method,
+            bool                             strict,
+            AP4_AtomFactory&                 atom_factory,
+            AP4_Processor::ProgressListener* listener,
+            AP4_Result&                      result)
+{
+    // create the input stream
+    AP4_ByteStream* input = NULL;
+    result = AP4_FileByteStream::Create(input_filename, AP4_FileByteStream::STREAM_MODE_READ, input);
+    if (AP4_FAILED(result)) {
+        fprintf(stderr, "ERROR: cannot open input file (%s)\n", input_filename);
+        return 1;
+    }
+
+    // create the output stream
+    AP4_ByteStream* output = NULL;
+    result = AP4_FileByteStream::Create(output_filename, AP4_FileByteStream::STREAM_MODE_WRITE, output);
+    if (AP4_FAILED(result)) {
+        fprintf(stderr, "ERROR: cannot open output file (%s)\n", output_filename);
+        input->Release();
+        return 1;
+    }
+
+    // create the fragments info stream if needed
+    AP4_ByteStream* fragments_info = NULL;
+    if (fragments_info_filename) {
+        result = AP4_FileByteStream::Create(fragments_info_filename, AP4_FileByteStream::STREAM_MODE_READ, fragments_info);
+        if (AP4_FAILED(result)) {
+            fprintf(stderr, "ERROR: cannot open fragments info file (%s)\n", fragments_info_filename);
+            input->Release();
+            output->Release();
+            return 1;
+        }
+    }
+    
+    // process/encrypt the file
+    bool check = CheckWarning(fragments_info?*fragments_info:*input, key_map, method, atom_factory);
+    if (strict && check) {
+        result = AP4_FAILURE;
+    } else if (fragments_info) {
+        result = processor.Process(*input, *output, *fragments_info, listener, atom_factory);
+    } else {
+        result = processor.Process(*input, *output, listener, atom_factory);
+    }
+    if (AP4_FAILED(result) && !(strict && check)) {
+        fprintf(stderr, "ERROR: failed to process the file (%d)\n", result);
+    }
+
+    // cleanup
+    input->Release();
+    output->Release();
+    if (fragments_info) fragments_info->Release();
+
+    return (strict && check) ? 1 : 0;
+}
+
+/*----------------------------------------------------------------------
+|   BatchWorker
++---------------------------------------------------------------------*/
+class BatchWorker : public AP4_BatchRunner::Worker {
+public:
+    BatchWorker(Method                    method,
+                const char*               kms_uri,
+                AP4_ProtectionKeyMap&     key_map,
+                AP4_TrackPropertyMap&     property_map,
+                AP4_Array<AP4_PsshAtom*>& pssh_atoms,
+                bool                      strict) :
+        m_Method(method),
+        m_KmsUri(kms_uri),
+        m_KeyMap(key_map),
+        m_PropertyMap(property_map),
+        m_PsshAtoms(pssh_atoms),
+        m_Strict(strict) {}
+
+    // AP4_BatchRunner::Worker methods
+    virtual AP4_Result ProcessJob(AP4_BatchRunner::Job& job) {
+        AP4_Processor* processor = CreateProcessor(m_Method, m_KmsUri, m_KeyMap, m_PropertyMap, m_PsshAtoms);
+        AP4_Result result = AP4_SUCCESS;
+        EncryptFile(job.m_InputFilename.GetChars(),
+                    job.m_OutputFilename.GetChars(),
+                    NULL,
+                    *processor,
+                    m_KeyMap,
+                    m_Method,
+                    m_Strict,
+                    m_AtomFactory,
+                    NULL,
+                    result);
+        delete processor;
+        return result;
+    }
+
+private:
+    // members
+    Method                    m_Method;
+    const char*               m_KmsUri;
+    AP4_ProtectionKeyMap&     m_KeyMap;
+    AP4_TrackPropertyMap&     m_PropertyMap;
+    AP4_Array<AP4_PsshAtom*>& m_PsshAtoms;
+    bool                      m_Strict;
+    AP4_DefaultAtomFactory    m_AtomFactory; // reused from one job to the next
+};
+
+/*----------------------------------------------------------------------
+|   RunBatch
++---------------------------------------------------------------------*/
+static int
+RunBatch(const char*               manifest_filename,
+         unsigned int              thread_count,
+         Method                    method,
+         const char*               kms_uri,
+         AP4_ProtectionKeyMap&     key_map,
+         AP4_TrackPropertyMap&     property_map,
+         AP4_Array<AP4_PsshAtom*>& pssh_atoms,
+         bool                      strict)
+{
+    // load the jobs
+    AP4_BatchRunner runner;
+    AP4_ByteStream* manifest = NULL;
+    AP4_Result result = AP4_FileByteStream::Create(manifest_filename, AP4_FileByteStream::STREAM_MODE_READ, manifest);
+    if (AP4_FAILED(result)) {
+        fprintf(stderr, "ERROR: cannot open batch manifest (%s)\n", manifest_filename);
+        return 1;
+    }
+    result = runner.ParseManifest(*manifest);
+    manifest->Release();
+    if (AP4_FAILED(result)) {
+        fprintf(stderr, "ERROR: invalid batch manifest (%d)\n", result);
+        return 1;
+    }
+    AP4_Array<AP4_BatchRunner::Job>& jobs = runner.GetJobs();
+    
+    // run the jobs, with one worker per thread
+    if (thread_count > jobs.ItemCount()) thread_count = jobs.ItemCount();
+    if (thread_count == 0) thread_count = 1;
+    AP4_Array<AP4_BatchRunner::Worker*> workers;
+    for (unsigned int i=0; i<thread_count; i++) {
+        workers.Append(new BatchWorker(method, kms_uri, key_map, property_map, pssh_atoms, strict));
+    }
+    runner.Run(workers);
+    for (unsigned int i=0; i<workers.ItemCount(); i++) {
+        delete workers[i];
+    }
+    
+    // report the jobs that failed
+    unsigned int failure_count = 0;
+    for (unsigned int i=0; i<jobs.ItemCount(); i++) {
+        if (AP4_FAILED(jobs[i].m_Result)) {
+            fprintf(stderr, "ERROR: failed to encrypt %s (%d)\n", jobs[i].m_InputFilename.GetChars(), jobs[i].m_Result);
+            ++failure_count;
+        }
+    }
+    
+    return failure_count ? 1 : 0;
+}
+
+/*----------------------------------------------------------------------
+|   WriteInstrumentation
++---------------------------------------------------------------------*/
+static void
+WriteInstrumentation(AP4_InstrumentationCounters& counters, const char* filename)
+{
+    AP4_ByteStream* stream = NULL;
+    AP4_Result result = AP4_FileByteStream::Create(filename, AP4_FileByteStream::STREAM_MODE_WRITE, stream);
+    if (AP4_FAILED(result)) {
+        fprintf(stderr, "ERROR: cannot open instrumentation file (%s)\n", filename);
+        return;
+    }
+    result = counters.WriteJson(*stream);
+    if (AP4_FAILED(result)) {
+        fprintf(stderr, "ERROR: failed to write instrumentation file (%d)\n", result);
+    }
+    stream->Release();
+}
+
 /*----------------------------------------------------------------------
 |   main
 +---------------------------------------------------------------------*/
@@ -223,6 +506,9 @@ main(int argc, char** argv)
     const char*              input_filename = NULL;
     const char*              output_filename = NULL;
     const char*              fragments_info_filename = NULL;
+    const char*              instrumentation_filename = NULL;
+    const char*              batch_filename = NULL;
+    unsigned int             batch_threads = 1;
     AP4_ProtectionKeyMap     key_map;
     AP4_TrackPropertyMap     property_map;
     bool                     show_progress = false;
@@ -339,6 +625,31 @@ main(int argc, char** argv)
             kms_uri = arg;
         } else if (!strcmp(arg, "--show-progress")) {
             show_progress = true;
+        } else if (!strcmp(arg, "--instrumentation")) {
+            arg = *++argv;
+            if (arg == NULL) {
+                fprintf(stderr, "ERROR: missing argument for --instrumentation option\n");
+                return 1;
+            }
+            instrumentation_filename = arg;
+        } else if (!strcmp(arg, "--batch")) {
+            arg = *++argv;
+            if (arg == NULL) {
+                fprintf(stderr, "ERROR: missing argument for --batch option\n");
+                return 1;
+            }
+            batch_filename = arg;
+        } else if (!strcmp(arg, "--batch-threads")) {
+            arg = *++argv;
+            if (arg == NULL) {
+                fprintf(stderr, "ERROR: missing argument for --batch-threads option\n");
+                return 1;
+            }
+            batch_threads = (unsigned int)strtoul(arg, NULL, 10);
+            if (batch_threads == 0 || batch_threads > AP4_BATCH_RUNNER_MAX_WORKERS) {
+                fprintf(stderr, "ERROR: --batch-threads must be between 1 and %d\n", AP4_BATCH_RUNNER_MAX_WORKERS);
+                return 1;
+            }
         } else if (!strcmp(arg, "--strict")) {
             strict = true;
         } else if (!strcmp(arg, "--key")) {
@@ -510,142 +821,75 @@ main(int argc, char** argv)
         fprintf(stderr, "ERROR: missing --method argument\n");
         return 1;
     }
-    if (input_filename == NULL) {
-        fprintf(stderr, "ERROR: missing input filename\n");
-        return 1;
-    }
-    if (output_filename == NULL) {
-        fprintf(stderr, "ERROR: missing output filename\n");
-        return 1;
-    }
-
-    // create an encrypting processor
-    AP4_Processor* processor = NULL;
-    if (method == METHOD_ISMA_AES) {
-        if (kms_uri == NULL) {
-            fprintf(stderr, "ERROR: method ISMA-IAEC requires --kms-uri\n");
+    if (batch_filename) {
+        if (input_filename || fragments_info_filename) {
+            fprintf(stderr, "ERROR: --batch cannot be used with an input filename or --fragments-info\n");
             return 1;
         }
-        AP4_IsmaEncryptingProcessor* isma_processor = new AP4_IsmaEncryptingProcessor(kms_uri);
-        isma_processor->GetKeyMap().SetKeys(key_map);
-        processor = isma_processor;
-    } else if (method == METHOD_MARLIN_IPMP_ACBC ||
-               method == METHOD_MARLIN_IPMP_ACGK) {
-        bool use_group_key = (method == METHOD_MARLIN_IPMP_ACGK);
-        if (use_group_key) {
-            // check that the group key is set
-            if (key_map.GetKey(0) == NULL) {
-                fprintf(stderr, "ERROR: method MARLIN-IPMP-ACGK requires a group key\n");
-                return 1;
-            }
-        }
-        AP4_MarlinIpmpEncryptingProcessor* marlin_processor = 
-            new AP4_MarlinIpmpEncryptingProcessor(use_group_key);
-        marlin_processor->GetKeyMap().SetKeys(key_map);
-        marlin_processor->GetPropertyMap().SetProperties(property_map);
-        processor = marlin_processor;
-    } else if (method == METHOD_OMA_PDCF_CTR ||
-               method == METHOD_OMA_PDCF_CBC) {
-        AP4_OmaDcfEncryptingProcessor* oma_processor = 
-            new AP4_OmaDcfEncryptingProcessor(method == METHOD_OMA_PDCF_CTR?
-                                              AP4_OMA_DCF_CIPHER_MODE_CTR :
-                                              AP4_OMA_DCF_CIPHER_MODE_CBC);
-        oma_processor->GetKeyMap().SetKeys(key_map);
-        oma_processor->GetPropertyMap().SetProperties(property_map);
-        processor = oma_processor;
-    } else if (method == METHOD_PIFF_CTR  ||
-               method == METHOD_PIFF_CBC  ||
-               method == METHOD_MPEG_CENC ||
-               method == METHOD_MPEG_CBC1 ||
-               method == METHOD_MPEG_CENS ||
-               method == METHOD_MPEG_CBCS) {
-        AP4_CencVariant variant = AP4_CENC_VARIANT_MPEG_CENC;
-        switch (method) {
-            case METHOD_PIFF_CBC:
-                variant = AP4_CENC_VARIANT_PIFF_CBC;
-                break;
-                
-            case METHOD_PIFF_CTR:
-                variant = AP4_CENC_VARIANT_PIFF_CTR;
-                break;
-                
-            case METHOD_MPEG_CENC:
-                variant = AP4_CENC_VARIANT_MPEG_CENC;
-                break;
-                
-            case METHOD_MPEG_CBC1:
-                variant = AP4_CENC_VARIANT_MPEG_CBC1;
-                break;
-
-            case METHOD_MPEG_CENS:
-                variant = AP4_CENC_VARIANT_MPEG_CENS;
-                break;
-
-            case METHOD_MPEG_CBCS:
-                variant = AP4_CENC_VARIANT_MPEG_CBCS;
-                break;
-
-            default:
-                break;
+    } else {
+        if (input_filename == NULL) {
+            fprintf(stderr, "ERROR: missing input filename\n");
+            return 1;
         }
-        AP4_CencEncryptingProcessor* cenc_processor = new AP4_CencEncryptingProcessor(variant);
-        cenc_processor->GetKeyMap().SetKeys(key_map);
-        cenc_processor->GetPropertyMap().SetProperties(property_map);
-        for (unsigned int i=0; i<pssh_atoms.ItemCount(); i++) {
-            cenc_processor->GetPsshAtoms().Append(pssh_atoms[i]);
+        if (output_filename == NULL) {
+            fprintf(stderr, "ERROR: missing output filename\n");
+            return 1;
         }
-        processor = cenc_processor;
     }
-    
-    // create the input stream
-    AP4_ByteStream* input = NULL;
-    result = AP4_FileByteStream::Create(input_filename, AP4_FileByteStream::STREAM_MODE_READ, input);
-    if (AP4_FAILED(result)) {
-        fprintf(stderr, "ERROR: cannot open input file (%s)\n", input_filename);
+    if (method == METHOD_ISMA_AES && kms_uri == NULL) {
+        fprintf(stderr, "ERROR: method ISMA-IAEC requires --kms-uri\n");
         return 1;
     }
-
-    // create the output stream
-    AP4_ByteStream* output = NULL;
-    result = AP4_FileByteStream::Create(output_filename, AP4_FileByteStream::STREAM_MODE_WRITE, output);
-    if (AP4_FAILED(result)) {
-        fprintf(stderr, "ERROR: cannot open output file (%s)\n", output_filename);
+    if (method == METHOD_MARLIN_IPMP_ACGK && key_map.GetKey(0) == NULL) {
+        fprintf(stderr, "ERROR: method MARLIN-IPMP-ACGK requires a group key\n");
         return 1;
     }
 
-    // create the fragments info stream if needed
-    AP4_ByteStream* fragments_info = NULL;
-    if (fragments_info_filename) {
-        result = AP4_FileByteStream::Create(fragments_info_filename, AP4_FileByteStream::STREAM_MODE_READ, fragments_info);
-        if (AP4_FAILED(result)) {
-            fprintf(stderr, "ERROR: cannot open fragments info file (%s)\n", fragments_info_filename);
-            return 1;
-        }
+    // start measuring if needed
+    AP4_InstrumentationCounters instrumentation;
+    if (instrumentation_filename) {
+        AP4_Instrumentation::SetInstance(&instrumentation);
     }
-    
-    // process/decrypt the file
-    ProgressListener listener;
-    if (fragments_info) {
-        bool check = CheckWarning(*fragments_info, key_map, method);
-        if (strict && check) return 1;
-        result = processor->Process(*input, *output, *fragments_info, show_progress?&listener:NULL);
+
+    int exit_code = 0;
+    if (batch_filename) {
+        // encrypt all the files of the batch
+        exit_code = RunBatch(batch_filename,
+                             batch_threads,
+                             method,
+                             kms_uri,
+                             key_map,
+                             property_map,
+                             pssh_atoms,
+                             strict);
     } else {
-        bool check = CheckWarning(*input, key_map, method);
-        if (strict && check) return 1;
-        result = processor->Process(*input, *output, show_progress?&listener:NULL);
-    }
-    if (AP4_FAILED(result)) {
-        fprintf(stderr, "ERROR: failed to process the file (%d)\n", result);
+        // create an encrypting processor and process/encrypt the file
+        AP4_Processor* processor = CreateProcessor(method, kms_uri, key_map, property_map, pssh_atoms);
+        ProgressListener listener;
+        exit_code = EncryptFile(input_filename,
+                                output_filename,
+                                fragments_info_filename,
+                                *processor,
+                                key_map,
+                                method,
+                                strict,
+                                AP4_DefaultAtomFactory::Instance_,
+                                show_progress?&listener:NULL,
+                                result);
+        delete processor;
+        if (exit_code) return exit_code;
     }
 
     // cleanup
-    delete processor;
-    input->Release();
-    output->Release();
-    if (fragments_info) fragments_info->Release();
     for (unsigned int i=0; i<pssh_atoms.ItemCount(); i++) {
         delete pssh_atoms[i];
     }
+
+    // write the instrumentation counters
+    if (instrumentation_filename) {
+        AP4_Instrumentation::SetInstance(NULL);
+        WriteInstrumentation(instrumentation, instrumentation_filename);
+    }
     
-    return 0;
+    return exit_code;
 }
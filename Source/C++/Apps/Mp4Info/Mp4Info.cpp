@@ -33,7 +33,6 @@
 #include <stdlib.h>
 
 #include "Ap4.h"
-#include "Ap4BitStream.h"
 #include "Ap4Mp4AudioInfo.h"
 #include "Ap4HevcParser.h"
 
@@ -834,23 +833,6 @@ ShowDcfInfo(AP4_File& file)
     }
 }
 
-/*----------------------------------------------------------------------
-|   ReadGolomb
-+---------------------------------------------------------------------*/
-static unsigned int
-ReadGolomb(AP4_BitStream& bits)
-{
-    unsigned int leading_zeros = 0;
-    while (bits.ReadBit() == 0) {
-        leading_zeros++;
-    }
-    if (leading_zeros) {
-        return (1<<leading_zeros)-1+bits.ReadBits(leading_zeros);
-    } else {
-        return 0;
-    }
-}
-
 /*----------------------------------------------------------------------
 |   ShowAvcInfo
 +---------------------------------------------------------------------*/
@@ -884,10 +866,9 @@ ShowAvcInfo(const AP4_DataBuffer& sample_data, AP4_AvcSampleDescription* avc_des
         
         switch (*data & 0x1F) {
             case 1: {
-                AP4_BitStream bits;
-                bits.WriteBytes(data+1, 8);
-                ReadGolomb(bits);
-                unsigned int slice_type = ReadGolomb(bits);
+                AP4_BitReader bits(data+1, 8);
+                bits.ReadGolomb();
+                unsigned int slice_type = bits.ReadGolomb();
                 switch (slice_type) {
                     case 0: printf("<P>");  break;
                     case 1: printf("<B>");  break;
@@ -44,6 +44,7 @@
                "(c) 2002-20016 Axiomatic Systems, LLC"
 
 const unsigned int AP4_MUX_DEFAULT_VIDEO_FRAME_RATE = 24;
+const unsigned int AP4_MUX_AAC_INPUT_BUFFER_SIZE   = 65536; // must hold at least 2 ADTS frames
 
 /*----------------------------------------------------------------------
 |   globals
@@ -101,7 +102,13 @@ PrintUsageAndExit()
             "If no type is specified for an input, the type will be inferred from the file extension\n"
             "\n"
             "Options:\n"
-            "  --verbose: show more details\n");
+            "  --verbose: show more details\n"
+            "  --parallel: parse the inputs concurrently, one thread per input\n"
+            "  --memory-budget <n>: keep up to <n> megabytes of sample data in memory\n"
+            "    while muxing, and only use a temporary file for what does not fit\n"
+            "    (default=0: all the sample data is staged in a temporary file)\n"
+            "  --interleave <n>: interleave the tracks in chunks of <n> milliseconds\n"
+            "    (default: the samples of each track are written one track after the other)\n");
     exit(1);
 }
 
@@ -142,16 +149,193 @@ ParseParameters(const char* params_str, AP4_Array<Parameter>& parameters)
     return AP4_SUCCESS;
 }
 
+/*----------------------------------------------------------------------
+|   SampleStorageStream
++---------------------------------------------------------------------*/
+/**
+ * Random-access stream used to stage sample data before the final file
+ * is written. The first bytes of the stream, up to a memory budget, are
+ * kept in memory blocks. Anything beyond the budget spills to a
+ * temporary file that is only created when needed.
+ */
+class SampleStorageStream : public AP4_ByteStream
+{
+public:
+    SampleStorageStream(const char* spill_filename, AP4_LargeSize memory_budget);
+    
+    // AP4_ByteStream methods
+    AP4_Result ReadPartial(void*     buffer,
+                           AP4_Size  bytes_to_read,
+                           AP4_Size& bytes_read);
+    AP4_Result WritePartial(const void* buffer,
+                            AP4_Size    bytes_to_write,
+                            AP4_Size&   bytes_written);
+    AP4_Result Seek(AP4_Position position);
+    AP4_Result Tell(AP4_Position& position) {
+        position = m_Position;
+        return AP4_SUCCESS;
+    }
+    AP4_Result GetSize(AP4_LargeSize& size) {
+        size = m_Size;
+        return AP4_SUCCESS;
+    }
+    
+    // AP4_Referenceable methods
+    void AddReference() { ++m_ReferenceCount; }
+    void Release()      { if (--m_ReferenceCount == 0) delete this; }
+    
+    // methods
+    AP4_Result OpenSpillFile();
+    
+private:
+    // constants
+    enum { BLOCK_SIZE = 1024*1024 };
+    
+    // methods
+    ~SampleStorageStream();
+    
+    // members
+    AP4_Cardinal         m_ReferenceCount;
+    AP4_String           m_SpillFilename;
+    AP4_ByteStream*      m_SpillFile;
+    AP4_LargeSize        m_MemoryCapacity;
+    AP4_Array<AP4_UI08*> m_Blocks;
+    AP4_LargeSize        m_Size;
+    AP4_Position         m_Position;
+};
+
+/*----------------------------------------------------------------------
+|   SampleStorageStream::SampleStorageStream
++---------------------------------------------------------------------*/
+SampleStorageStream::SampleStorageStream(const char* spill_filename, AP4_LargeSize memory_budget) :
+    m_ReferenceCount(1),
+    m_SpillFilename(spill_filename),
+    m_SpillFile(NULL),
+    m_MemoryCapacity(memory_budget-(memory_budget%BLOCK_SIZE)),
+    m_Size(0),
+    m_Position(0)
+{
+}
+
+/*----------------------------------------------------------------------
+|   SampleStorageStream::~SampleStorageStream
++---------------------------------------------------------------------*/
+SampleStorageStream::~SampleStorageStream()
+{
+    for (unsigned int i=0; i<m_Blocks.ItemCount(); i++) {
+        delete[] m_Blocks[i];
+    }
+    if (m_SpillFile) {
+        m_SpillFile->Release();
+        remove(m_SpillFilename.GetChars());
+    }
+}
+
+/*----------------------------------------------------------------------
+|   SampleStorageStream::OpenSpillFile
++---------------------------------------------------------------------*/
+AP4_Result
+SampleStorageStream::OpenSpillFile()
+{
+    if (m_SpillFile) return AP4_SUCCESS;
+    return AP4_FileByteStream::Create(m_SpillFilename.GetChars(),
+                                      AP4_FileByteStream::STREAM_MODE_WRITE,
+                                      m_SpillFile);
+}
+
+/*----------------------------------------------------------------------
+|   SampleStorageStream::ReadPartial
++---------------------------------------------------------------------*/
+AP4_Result
+SampleStorageStream::ReadPartial(void*     buffer,
+                                 AP4_Size  bytes_to_read,
+                                 AP4_Size& bytes_read)
+{
+    bytes_read = 0;
+    if (bytes_to_read == 0) return AP4_SUCCESS;
+    if (m_Position >= m_Size) return AP4_ERROR_EOS;
+    if (m_Position+bytes_to_read > m_Size) {
+        bytes_to_read = (AP4_Size)(m_Size-m_Position);
+    }
+    
+    if (m_Position < m_MemoryCapacity) {
+        // read from the memory block that contains the current position
+        AP4_Size block_offset = (AP4_Size)(m_Position%BLOCK_SIZE);
+        AP4_Size chunk = BLOCK_SIZE-block_offset;
+        if (chunk > bytes_to_read) chunk = bytes_to_read;
+        AP4_CopyMemory(buffer, m_Blocks[(unsigned int)(m_Position/BLOCK_SIZE)]+block_offset, chunk);
+        bytes_read = chunk;
+    } else {
+        // read from the spill file
+        AP4_Result result = m_SpillFile->Seek(m_Position-m_MemoryCapacity);
+        if (AP4_FAILED(result)) return result;
+        result = m_SpillFile->ReadPartial(buffer, bytes_to_read, bytes_read);
+        if (AP4_FAILED(result)) return result;
+    }
+    m_Position += bytes_read;
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   SampleStorageStream::WritePartial
++---------------------------------------------------------------------*/
+AP4_Result
+SampleStorageStream::WritePartial(const void* buffer,
+                                  AP4_Size    bytes_to_write,
+                                  AP4_Size&   bytes_written)
+{
+    bytes_written = 0;
+    if (bytes_to_write == 0) return AP4_SUCCESS;
+    
+    if (m_Position < m_MemoryCapacity) {
+        // write into the memory block that contains the current position
+        unsigned int block_index = (unsigned int)(m_Position/BLOCK_SIZE);
+        while (block_index >= m_Blocks.ItemCount()) {
+            m_Blocks.Append(new AP4_UI08[BLOCK_SIZE]);
+        }
+        AP4_Size block_offset = (AP4_Size)(m_Position%BLOCK_SIZE);
+        AP4_Size chunk = BLOCK_SIZE-block_offset;
+        if (chunk > bytes_to_write) chunk = bytes_to_write;
+        AP4_CopyMemory(m_Blocks[block_index]+block_offset, buffer, chunk);
+        bytes_written = chunk;
+    } else {
+        // write to the spill file
+        AP4_Result result = OpenSpillFile();
+        if (AP4_FAILED(result)) return result;
+        result = m_SpillFile->Seek(m_Position-m_MemoryCapacity);
+        if (AP4_FAILED(result)) return result;
+        result = m_SpillFile->WritePartial(buffer, bytes_to_write, bytes_written);
+        if (AP4_FAILED(result)) return result;
+    }
+    m_Position += bytes_written;
+    if (m_Position > m_Size) m_Size = m_Position;
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   SampleStorageStream::Seek
++---------------------------------------------------------------------*/
+AP4_Result
+SampleStorageStream::Seek(AP4_Position position)
+{
+    if (position > m_Size) return AP4_ERROR_OUT_OF_RANGE;
+    m_Position = position;
+    return AP4_SUCCESS;
+}
+
 /*----------------------------------------------------------------------
 |   SampleFileStorage
 +---------------------------------------------------------------------*/
 class SampleFileStorage
 {
 public:
-    static AP4_Result Create(const char* basename, SampleFileStorage*& sample_file_storage);
+    static AP4_Result Create(const char*        basename,
+                             AP4_LargeSize      memory_budget,
+                             SampleFileStorage*& sample_file_storage);
     ~SampleFileStorage() {
         m_Stream->Release();
-        remove(m_Filename.GetChars());
     }
     
     AP4_Result StoreSample(AP4_Sample& from_sample, AP4_Sample& to_sample) {
@@ -181,34 +365,41 @@ public:
     AP4_ByteStream* GetStream() { return m_Stream; }
     
 private:
-    SampleFileStorage(const char* basename) : m_Stream(NULL) {
-        AP4_Size name_length = (AP4_Size)AP4_StringLength(basename);
-        char* filename = new char[name_length+2];
-        AP4_CopyMemory(filename, basename, name_length);
-        filename[name_length]   = '_';
-        filename[name_length+1] = '\0';
-        m_Filename = filename;
-        delete[] filename;
-    }
+    SampleFileStorage() : m_Stream(NULL) {}
 
-    AP4_ByteStream* m_Stream;
-    AP4_String      m_Filename;
+    SampleStorageStream* m_Stream;
 };
 
 /*----------------------------------------------------------------------
 |   SampleFileStorage::Create
 +---------------------------------------------------------------------*/
 AP4_Result
-SampleFileStorage::Create(const char* basename, SampleFileStorage*& sample_file_storage)
+SampleFileStorage::Create(const char*         basename,
+                          AP4_LargeSize       memory_budget,
+                          SampleFileStorage*& sample_file_storage)
 {
     sample_file_storage = NULL;
-    SampleFileStorage* object = new SampleFileStorage(basename);
-    AP4_Result result = AP4_FileByteStream::Create(object->m_Filename.GetChars(),
-                                                   AP4_FileByteStream::STREAM_MODE_WRITE,
-                                                   object->m_Stream);
-    if (AP4_FAILED(result)) {
-        return result;
+    
+    // the spill file name is the basename with a '_' suffix
+    AP4_Size name_length = (AP4_Size)AP4_StringLength(basename);
+    char* filename = new char[name_length+2];
+    AP4_CopyMemory(filename, basename, name_length);
+    filename[name_length]   = '_';
+    filename[name_length+1] = '\0';
+    SampleStorageStream* stream = new SampleStorageStream(filename, memory_budget);
+    delete[] filename;
+    
+    // without a memory budget, everything goes to the file, so create it now
+    if (memory_budget == 0) {
+        AP4_Result result = stream->OpenSpillFile();
+        if (AP4_FAILED(result)) {
+            stream->Release();
+            return result;
+        }
     }
+    
+    SampleFileStorage* object = new SampleFileStorage();
+    object->m_Stream = stream;
     sample_file_storage = object;
     return AP4_SUCCESS;
 }
@@ -246,7 +437,7 @@ SortSamples(SampleOrder* array, unsigned int n)
 |   AddAacTrack
 +---------------------------------------------------------------------*/
 static void
-AddAacTrack(AP4_Movie&            movie,
+AddAacTrack(AP4_Array<AP4_Track*>& tracks,
             const char*           input_name,
             AP4_Array<Parameter>& /*parameters*/,
             SampleFileStorage&    sample_storage)
@@ -266,14 +457,22 @@ AddAacTrack(AP4_Movie&            movie,
     bool           initialized = false;
     unsigned int   sample_description_index = 0;
 
-    // read from the input, feed, and get AAC frames
-    AP4_UI32     sample_rate = 0;
-    AP4_Cardinal sample_count = 0;
-    bool eos = false;
+    // read from the input and get AAC frames directly from the input buffer
+    AP4_UI32       sample_rate = 0;
+    AP4_Cardinal   sample_count = 0;
+    AP4_DataBuffer input_buffer(AP4_MUX_AAC_INPUT_BUFFER_SIZE);
+    AP4_Size       input_offset = 0;
+    bool           eos = false;
     for(;;) {
         // try to get a frame
         AP4_AacFrame frame;
-        result = parser.FindFrame(frame);
+        AP4_Size     bytes_consumed = 0;
+        result = parser.FindFrameInBuffer(input_buffer.GetData()+input_offset,
+                                          input_buffer.GetDataSize()-input_offset,
+                                          frame,
+                                          bytes_consumed,
+                                          eos);
+        input_offset += bytes_consumed;
         if (AP4_SUCCEEDED(result)) {
             if (Options.verbose) {
                 printf("AAC frame [%06d]: size = %d, %d kHz, %d ch\n",
@@ -312,38 +511,34 @@ AddAacTrack(AP4_Movie&            movie,
             // read and store the sample data
             AP4_Position position = 0;
             sample_storage.GetStream()->Tell(position);
-            AP4_DataBuffer sample_data(frame.m_Info.m_FrameLength);
-            sample_data.SetDataSize(frame.m_Info.m_FrameLength);
-            frame.m_Source->ReadBytes(sample_data.UseData(), frame.m_Info.m_FrameLength);
-            sample_storage.GetStream()->Write(sample_data.GetData(), frame.m_Info.m_FrameLength);
+            sample_storage.GetStream()->Write(frame.m_Data, frame.m_Info.m_FrameLength);
 
             // add the sample to the table
             sample_table->AddSample(*sample_storage.GetStream(), position, frame.m_Info.m_FrameLength, 1024, sample_description_index, 0, 0, true);
             sample_count++;
-        } else {
-            if (eos) break;
-        }
-
-        // read some data and feed the parser
-        AP4_UI08 input_buffer[4096];
-        AP4_Size to_read = parser.GetBytesFree();
-        if (to_read) {
+        } else if (!eos) {
+            // move the unparsed data to the front of the buffer and read some more
+            AP4_Size leftover = input_buffer.GetDataSize()-input_offset;
+            if (leftover && input_offset) {
+                AP4_MoveMemory(input_buffer.UseData(), input_buffer.GetData()+input_offset, leftover);
+            }
+            input_buffer.SetDataSize(leftover);
+            input_offset = 0;
             AP4_Size bytes_read = 0;
-            if (to_read > sizeof(input_buffer)) to_read = sizeof(input_buffer);
-            result = input->ReadPartial(input_buffer, to_read, bytes_read);
+            result = input->ReadPartial(input_buffer.UseData()+leftover,
+                                        input_buffer.GetBufferSize()-leftover,
+                                        bytes_read);
             if (AP4_SUCCEEDED(result)) {
-                AP4_Size to_feed = bytes_read;
-                result = parser.Feed(input_buffer, &to_feed);
-                if (AP4_FAILED(result)) {
-                    AP4_Debug("ERROR: parser.Feed() failed (%d)\n", result);
-                    return;
-                }
+                input_buffer.SetDataSize(leftover+bytes_read);
+            } else if (result == AP4_ERROR_EOS) {
+                eos = true;
             } else {
-                if (result == AP4_ERROR_EOS) {
-                    eos = true;
-                    parser.Feed(NULL, NULL, AP4_BITSTREAM_FLAG_EOS);
-                }
+                fprintf(stderr, "ERROR: failed to read from input file (%d)\n", result);
+                input->Release();
+                return;
             }
+        } else {
+            break;
         }
     }
     
@@ -361,14 +556,14 @@ AddAacTrack(AP4_Movie&            movie,
     // cleanup
     input->Release();
     
-    movie.AddTrack(track);
+    tracks.Append(track);
 }
 
 /*----------------------------------------------------------------------
 |   AddH264Track
 +---------------------------------------------------------------------*/
 static void
-AddH264Track(AP4_Movie&            movie,
+AddH264Track(AP4_Array<AP4_Track*>& tracks,
              const char*           input_name,
              AP4_Array<Parameter>& parameters,
              AP4_Array<AP4_UI32>&  brands,
@@ -492,7 +687,7 @@ AddH264Track(AP4_Movie&            movie,
         }
     }
     for (unsigned int i=0; i<sample_orders.ItemCount(); i++) {
-        sample_table->UseSample(sample_orders[i].m_DecodeOrder).SetCts(1000ULL*(AP4_UI64)(i+max_delta));
+        sample_table->SetSampleCts(sample_orders[i].m_DecodeOrder, 1000ULL*(AP4_UI64)(i+max_delta));
     }
     
     // check the video parameters
@@ -571,14 +766,14 @@ AddH264Track(AP4_Movie&            movie,
     // cleanup
     input->Release();
     
-    movie.AddTrack(track);
+    tracks.Append(track);
 }
 
 /*----------------------------------------------------------------------
 |   AddH265Track
 +---------------------------------------------------------------------*/
 static void
-AddH265Track(AP4_Movie&            movie,
+AddH265Track(AP4_Array<AP4_Track*>& tracks,
              const char*           input_name,
              AP4_Array<Parameter>& parameters,
              AP4_Array<AP4_UI32>&  brands,
@@ -712,7 +907,7 @@ AddH265Track(AP4_Movie&            movie,
         }
     }
     for (unsigned int i=0; i<sample_orders.ItemCount(); i++) {
-        sample_table->UseSample(sample_orders[i].m_DecodeOrder).SetCts(1000ULL*(AP4_UI64)(i+max_delta));
+        sample_table->SetSampleCts(sample_orders[i].m_DecodeOrder, 1000ULL*(AP4_UI64)(i+max_delta));
     }
     
     // check that we have at least one SPS
@@ -828,14 +1023,14 @@ AddH265Track(AP4_Movie&            movie,
     // cleanup
     input->Release();
     
-    movie.AddTrack(track);
+    tracks.Append(track);
 }
 
 /*----------------------------------------------------------------------
 |   AddMp4Tracks
 +---------------------------------------------------------------------*/
 static void
-AddMp4Tracks(AP4_Movie&            movie,
+AddMp4Tracks(AP4_Array<AP4_Track*>& tracks,
              const char*           input_name,
              AP4_Array<Parameter>& parameters,
              AP4_Array<AP4_UI32>&  /*brands*/)
@@ -902,12 +1097,48 @@ AddMp4Tracks(AP4_Movie&            movie,
             track = track->Clone();
             // reset the track ID so that it can be re-assigned
             track->SetId(0);
-            movie.AddTrack(track);
+            tracks.Append(track);
         }
         track_item = track_item->GetNext();
     }
 }
 
+/*----------------------------------------------------------------------
+|   TrackParser
++---------------------------------------------------------------------*/
+class TrackParser : public AP4_Runnable
+{
+public:
+    TrackParser(const char* input_type, const char* input_name) :
+        m_InputType(input_type),
+        m_InputName(input_name),
+        m_SampleStorage(NULL) {}
+    ~TrackParser() {
+        delete m_SampleStorage;
+    }
+    
+    // AP4_Runnable methods
+    void Run() {
+        if (m_InputType == "h264") {
+            AddH264Track(m_Tracks, m_InputName.GetChars(), m_Parameters, m_Brands, *m_SampleStorage);
+        } else if (m_InputType == "h265") {
+            AddH265Track(m_Tracks, m_InputName.GetChars(), m_Parameters, m_Brands, *m_SampleStorage);
+        } else if (m_InputType == "aac") {
+            AddAacTrack(m_Tracks, m_InputName.GetChars(), m_Parameters, *m_SampleStorage);
+        } else if (m_InputType == "mp4") {
+            AddMp4Tracks(m_Tracks, m_InputName.GetChars(), m_Parameters, m_Brands);
+        }
+    }
+    
+    // members
+    AP4_String            m_InputType;
+    AP4_String            m_InputName;
+    AP4_Array<Parameter>  m_Parameters;
+    AP4_Array<AP4_UI32>   m_Brands;
+    AP4_Array<AP4_Track*> m_Tracks;
+    SampleFileStorage*    m_SampleStorage;
+};
+
 /*----------------------------------------------------------------------
 |   main
 +---------------------------------------------------------------------*/
@@ -921,10 +1152,33 @@ main(int argc, char** argv)
     
     const char* output_filename = NULL;
     AP4_Array<char*> input_names;
+    AP4_LargeSize memory_budget = 0;
+    bool parallel = false;
+    AP4_UI32 interleave_duration = 0;
     
     while (char* arg = *++argv) {
         if (!strcmp(arg, "--verbose")) {
             Options.verbose = true;
+        } else if (!strcmp(arg, "--memory-budget")) {
+            arg = *++argv;
+            if (arg == NULL) {
+                fprintf(stderr, "ERROR: missing argument after --memory-budget option\n");
+                return 1;
+            }
+            memory_budget = (AP4_LargeSize)strtoul(arg, NULL, 10)*1024*1024;
+        } else if (!strcmp(arg, "--interleave")) {
+            arg = *++argv;
+            if (arg == NULL) {
+                fprintf(stderr, "ERROR: missing argument after --interleave option\n");
+                return 1;
+            }
+            interleave_duration = (AP4_UI32)strtoul(arg, NULL, 10);
+            if (interleave_duration == 0) {
+                fprintf(stderr, "ERROR: invalid value for --interleave option\n");
+                return 1;
+            }
+        } else if (!strcmp(arg, "--parallel")) {
+            parallel = true;
         } else if (!strcmp(arg, "--track")) {
             input_names.Append(*++argv);
         } else if (output_filename == NULL) {
@@ -944,23 +1198,9 @@ main(int argc, char** argv)
         return 1;
     }
 
-    // create the movie object to hold the tracks
-    AP4_Movie* movie = new AP4_Movie();
-
-    // setup the brands
-    AP4_Array<AP4_UI32> brands;
-    brands.Append(AP4_FILE_BRAND_ISOM);
-    brands.Append(AP4_FILE_BRAND_MP42);
-
-    // create a temp file to store the sample data
-    SampleFileStorage* sample_storage = NULL;
-    AP4_Result result = SampleFileStorage::Create(output_filename, sample_storage);
-    if (AP4_FAILED(result)) {
-        fprintf(stderr, "ERROR: failed to create temporary sample data storage (%d)\n", result);
-        return 1;
-    }
-    
-    // add all the tracks
+    // setup a parser for each input
+    AP4_Array<TrackParser*> parsers;
+    AP4_Result result = AP4_SUCCESS;
     for (unsigned int i=0; i<input_names.ItemCount(); i++) {
         char*       input_name = input_names[i];
         const char* input_type = NULL;
@@ -1003,29 +1243,93 @@ main(int argc, char** argv)
                 }
             } else {
                 fprintf(stderr, "ERROR: unable to determine type for input '%s'\n", input_name);
-                delete sample_storage;
-                return 1;
+                result = AP4_ERROR_INVALID_PARAMETERS;
+                break;
             }
         }
+        if (strcmp(input_type, "h264") &&
+            strcmp(input_type, "h265") &&
+            strcmp(input_type, "aac")  &&
+            strcmp(input_type, "mp4")) {
+            fprintf(stderr, "ERROR: unsupported input type '%s'\n", input_type);
+            result = AP4_ERROR_INVALID_PARAMETERS;
+            break;
+        }
+        
+        TrackParser* parser = new TrackParser(input_type, input_name);
+        parsers.Append(parser);
         
         // parse parameters
-        AP4_Array<Parameter> parameters;
         if (input_params) {
-            ParseParameters(input_params, parameters);
+            ParseParameters(input_params, parser->m_Parameters);
         }
-        
-        if (!strcmp(input_type, "h264")) {
-            AddH264Track(*movie, input_name, parameters, brands, *sample_storage);
-        } else if (!strcmp(input_type, "h265")) {
-            AddH265Track(*movie, input_name, parameters, brands, *sample_storage);
-        } else if (!strcmp(input_type, "aac")) {
-            AddAacTrack(*movie, input_name, parameters, *sample_storage);
-        } else if (!strcmp(input_type, "mp4")) {
-            AddMp4Tracks(*movie, input_name, parameters, brands);
+    }
+    
+    // create a memory arena and/or temp file to store the sample data of
+    // each input that is not an mp4 file (each one gets its own, with an
+    // equal share of the memory budget)
+    unsigned int storage_count = 0;
+    for (unsigned int i=0; AP4_SUCCEEDED(result) && i<parsers.ItemCount(); i++) {
+        if (parsers[i]->m_InputType != "mp4") ++storage_count;
+    }
+    for (unsigned int i=0; AP4_SUCCEEDED(result) && i<parsers.ItemCount(); i++) {
+        TrackParser* parser = parsers[i];
+        if (parser->m_InputType == "mp4") continue;
+        char basename[1024];
+        if (i == 0) {
+            AP4_FormatString(basename, sizeof(basename), "%s", output_filename);
         } else {
-            fprintf(stderr, "ERROR: unsupported input type '%s'\n", input_type);
-            delete sample_storage;
-            return 1;
+            AP4_FormatString(basename, sizeof(basename), "%s_%d", output_filename, i);
+        }
+        result = SampleFileStorage::Create(basename,
+                                           memory_budget/storage_count,
+                                           parser->m_SampleStorage);
+        if (AP4_FAILED(result)) {
+            fprintf(stderr, "ERROR: failed to create temporary sample data storage (%d)\n", result);
+        }
+    }
+    if (AP4_FAILED(result)) {
+        for (unsigned int i=0; i<parsers.ItemCount(); i++) {
+            delete parsers[i];
+        }
+        return 1;
+    }
+    
+    // parse all the inputs, either one after the other, or concurrently
+    if (parallel && parsers.ItemCount() > 1) {
+        AP4_Array<AP4_Thread*> threads;
+        for (unsigned int i=0; i<parsers.ItemCount(); i++) {
+            AP4_Thread* thread = new AP4_Thread(*parsers[i]);
+            if (AP4_FAILED(thread->Start())) {
+                // fall back to parsing on this thread
+                parsers[i]->Run();
+            }
+            threads.Append(thread);
+        }
+        for (unsigned int i=0; i<threads.ItemCount(); i++) {
+            threads[i]->Wait();
+            delete threads[i];
+        }
+    } else {
+        for (unsigned int i=0; i<parsers.ItemCount(); i++) {
+            parsers[i]->Run();
+        }
+    }
+    
+    // create the movie object to hold the tracks, and the brands list
+    AP4_Movie* movie = new AP4_Movie();
+    AP4_Array<AP4_UI32> brands;
+    brands.Append(AP4_FILE_BRAND_ISOM);
+    brands.Append(AP4_FILE_BRAND_MP42);
+    
+    // add all the tracks, in the order of the inputs
+    for (unsigned int i=0; i<parsers.ItemCount(); i++) {
+        TrackParser* parser = parsers[i];
+        for (unsigned int j=0; j<parser->m_Brands.ItemCount(); j++) {
+            brands.Append(parser->m_Brands[j]);
+        }
+        for (unsigned int j=0; j<parser->m_Tracks.ItemCount(); j++) {
+            movie->AddTrack(parser->m_Tracks[j]);
         }
     }
 
@@ -1034,7 +1338,10 @@ main(int argc, char** argv)
     result = AP4_FileByteStream::Create(output_filename, AP4_FileByteStream::STREAM_MODE_WRITE, output);
     if (AP4_FAILED(result)) {
         AP4_Debug("ERROR: cannot open output '%s' (%d)\n", output_filename, result);
-        delete sample_storage;
+        for (unsigned int i=0; i<parsers.ItemCount(); i++) {
+            delete parsers[i];
+        }
+        delete movie;
         return 1;
     }
     
@@ -1045,10 +1352,16 @@ main(int argc, char** argv)
     file.SetFileType(AP4_FILE_BRAND_MP42, 1, &brands[0], brands.ItemCount());
 
     // write the file to the output
-    AP4_FileWriter::Write(file, *output);
+    if (interleave_duration) {
+        AP4_FileWriter::Write(file, *output, AP4_FileWriter::INTERLEAVING_INTERLEAVED, interleave_duration);
+    } else {
+        AP4_FileWriter::Write(file, *output);
+    }
     
     // cleanup
-    delete sample_storage;
+    for (unsigned int i=0; i<parsers.ItemCount(); i++) {
+        delete parsers[i];
+    }
     output->Release();
     
     return 0;
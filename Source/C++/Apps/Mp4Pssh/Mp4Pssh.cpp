@@ -51,8 +51,12 @@ PrintUsageAndExit()
 {
     fprintf(stderr, 
             BANNER 
-            "\n\nusage: mp4pssh [commands] <input> <output>\n"
-            "    where commands include one or more of:\n"
+            "\n\nusage: mp4pssh [options] [commands] <input> [<output>]\n"
+            "    where options include:\n"
+            "    --in-place: modify the input file directly instead of writing\n"
+            "      an output file (only the moov atom is rewritten, the media data\n"
+            "      is not copied)\n"
+            "    and where commands include one or more of:\n"
             "    --insert <system-id-hex>:<pssh-data-file>\n"
             "    --remove <system-id-hex>\n"
             "    --replace <system-id-hex>:<pssh-data-file>\n");
@@ -307,10 +311,13 @@ main(int argc, char** argv)
     // parse arguments
     const char* input_filename = NULL;
     const char* output_filename = NULL;
+    bool        in_place = false;
     char* arg;
     AP4_Result result;
     while ((arg = *++argv)) {
-        if (!AP4_CompareStrings(arg, "--insert")) {
+        if (!AP4_CompareStrings(arg, "--in-place")) {
+            in_place = true;
+        } else if (!AP4_CompareStrings(arg, "--insert")) {
             char* param = *++argv;
             if (param == NULL) {
                 fprintf(stderr, "ERROR: missing argument for --insert command\n");
@@ -394,18 +401,43 @@ main(int argc, char** argv)
         fprintf(stderr, "ERROR: missing input filename\n");
         return 1;
     }
-    if (output_filename == NULL) {
+    if (output_filename == NULL && !in_place) {
         fprintf(stderr, "ERROR: missing output filename\n");
         return 1;
     }
+    if (output_filename != NULL && in_place) {
+        fprintf(stderr, "ERROR: unexpected output filename with --in-place\n");
+        return 1;
+    }
 
 	// create the input stream
     AP4_ByteStream* input = NULL;
-    result = AP4_FileByteStream::Create(input_filename, AP4_FileByteStream::STREAM_MODE_READ, input);
+    result = AP4_FileByteStream::Create(input_filename, 
+                                        in_place ?
+                                        AP4_FileByteStream::STREAM_MODE_READ_WRITE :
+                                        AP4_FileByteStream::STREAM_MODE_READ, 
+                                        input);
     if (AP4_FAILED(result)) {
         fprintf(stderr, "ERROR: cannot open input file (%s)\n", input_filename);
         return 1;
     }
+    
+    // in-place update: apply the edits to the moov atom and write it back
+    if (in_place) {
+        AP4_File* file = new AP4_File(*input, true);
+        result = processor.Initialize(*file, *input, NULL);
+        if (AP4_SUCCEEDED(result)) {
+            result = AP4_FileUpdater::Update(*file, *input);
+            if (result == AP4_ERROR_NOT_SUPPORTED) {
+                fprintf(stderr, "ERROR: the new moov atom does not fit in place in this file, use an output file instead\n");
+            } else if (AP4_FAILED(result)) {
+                fprintf(stderr, "ERROR: failed to update the file in place (%d)\n", result);
+            }
+        }
+        delete file;
+        input->Release();
+        return AP4_SUCCEEDED(result)?0:1;
+    }
 
 	// create the output stream
     AP4_ByteStream* output = NULL;
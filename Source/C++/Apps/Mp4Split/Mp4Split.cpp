@@ -421,7 +421,11 @@ main(int argc, char** argv)
         
         // write the atom
         if (output && atom->GetType() != AP4_ATOM_TYPE_MFRA && TrackIdMatches(track_id)) {
-            atom->Write(*output);
+            if (atom->GetType() == AP4_ATOM_TYPE_MOOF) {
+                atom->WriteBuffered(*output);
+            } else {
+                atom->Write(*output);
+            }
         }
         delete atom;
     }
@@ -86,6 +86,7 @@ static struct {
     AP4_List<Command> commands;
     bool              need_input;
     bool              need_output;
+    bool              in_place;
 } Options;
 
 static const int LINE_WIDTH = 79;
@@ -99,6 +100,10 @@ PrintUsageAndExit()
     fprintf(stderr, 
             BANNER 
             "\n\nusage: mp4tag [options] [commands...] <input> [<output>]\n"
+            "options:\n"
+            "  --in-place        modify the input file directly instead of writing an\n"
+            "                    output file (only the metadata is rewritten, the media\n"
+            "                    data is not copied)\n"
             "commands:\n"
             "  --help            print this usage information\n"
             "  --show-tags       show tags found in the input file\n"
@@ -152,6 +157,8 @@ ParseCommandLine(int argc, char** argv)
     for (int i=0; i<argc; i++) {
         if (AP4_CompareStrings("--help", argv[i]) == 0) {
         PrintUsageAndExit();
+        } else if (AP4_CompareStrings("--in-place", argv[i]) == 0) {
+            Options.in_place = true;
         } else if (AP4_CompareStrings("--show-tags", argv[i]) == 0) {
             Options.commands.Add(new Command(Command::TYPE_SHOW_TAGS));
             Options.need_input = true;
@@ -778,6 +785,7 @@ main(int argc, char** argv)
     Options.output_filename = NULL;
     Options.need_input      = false;
     Options.need_output     = false;
+    Options.in_place        = false;
 
     // parse command line
     ParseCommandLine(argc-1, argv+1);
@@ -794,7 +802,7 @@ main(int argc, char** argv)
             PrintUsageAndExit();
         }
     }
-    if (Options.need_output) {
+    if (Options.need_output && !Options.in_place) {
         if (Options.output_filename == NULL) {
             fprintf(stderr, "ERROR: output file name missing\n");
             PrintUsageAndExit();
@@ -813,7 +821,11 @@ main(int argc, char** argv)
     AP4_LargeSize   moov_size = 0;
     AP4_Result      result    = AP4_SUCCESS;
     if (Options.need_input) {
-        result =AP4_FileByteStream::Create(Options.input_filename, AP4_FileByteStream::STREAM_MODE_READ, input);
+        result =AP4_FileByteStream::Create(Options.input_filename, 
+                                           Options.need_output && Options.in_place ?
+                                           AP4_FileByteStream::STREAM_MODE_READ_WRITE :
+                                           AP4_FileByteStream::STREAM_MODE_READ,
+                                           input);
         if (AP4_FAILED(result)) {
             fprintf(stderr, "ERROR: cannot open input file\n");
             return 1;
@@ -831,7 +843,7 @@ main(int argc, char** argv)
     }
 
     AP4_ByteStream* output = NULL;
-    if (Options.need_output) {
+    if (Options.need_output && !Options.in_place) {
         result = AP4_FileByteStream::Create(Options.output_filename, AP4_FileByteStream::STREAM_MODE_WRITE, output);
         if (AP4_FAILED(result)) {
             fprintf(stderr, "ERROR: cannot open output file for writing\n");
@@ -891,6 +903,14 @@ main(int argc, char** argv)
         
         // write the modified file
         AP4_FileCopier::Write(*file, *output);
+    } else if (Options.need_output) {
+        // only rewrite the moov atom, the chunk offsets don't change
+        result = AP4_FileUpdater::Update(*file, *input);
+        if (result == AP4_ERROR_NOT_SUPPORTED) {
+            fprintf(stderr, "ERROR: the new moov atom does not fit in place in this file, use an output file instead\n");
+        } else if (AP4_FAILED(result)) {
+            fprintf(stderr, "ERROR: failed to update the file in place (%d)\n", result);
+        }
     }
     
 end:
@@ -899,5 +919,5 @@ end:
     delete output;
     Options.commands.DeleteReferences();
 
-    return result;
+    return AP4_SUCCEEDED(result)?0:1;
 }
@@ -31,6 +31,7 @@
 +---------------------------------------------------------------------*/
 #include "Bento4C.h"
 #include "Ap4.h"
+#include "Ap4CommonEncryption.h"
 
 /*----------------------------------------------------------------------
 |   constants
@@ -59,6 +60,17 @@ const int AP4_SAMPLE_DESCRIPTION_TYPE_PROTECTED = AP4_SampleDescription::TYPE_PR
 const int AP4_SAMPLE_DESCRIPTION_TYPE_AVC       = AP4_SampleDescription::TYPE_AVC;
 const int AP4_SAMPLE_DESCRIPTION_TYPE_HEVC      = AP4_SampleDescription::TYPE_HEVC;
 
+const int AP4_FRAGMENTER_FORCE_SYNC_MODE_NONE = AP4_Fragmenter::FORCE_SYNC_MODE_NONE;
+const int AP4_FRAGMENTER_FORCE_SYNC_MODE_AUTO = AP4_Fragmenter::FORCE_SYNC_MODE_AUTO;
+const int AP4_FRAGMENTER_FORCE_SYNC_MODE_ALL  = AP4_Fragmenter::FORCE_SYNC_MODE_ALL;
+
+const int AP4_CENC_ENCRYPTION_VARIANT_PIFF_CTR  = AP4_CENC_VARIANT_PIFF_CTR;
+const int AP4_CENC_ENCRYPTION_VARIANT_PIFF_CBC  = AP4_CENC_VARIANT_PIFF_CBC;
+const int AP4_CENC_ENCRYPTION_VARIANT_MPEG_CENC = AP4_CENC_VARIANT_MPEG_CENC;
+const int AP4_CENC_ENCRYPTION_VARIANT_MPEG_CBC1 = AP4_CENC_VARIANT_MPEG_CBC1;
+const int AP4_CENC_ENCRYPTION_VARIANT_MPEG_CENS = AP4_CENC_VARIANT_MPEG_CENS;
+const int AP4_CENC_ENCRYPTION_VARIANT_MPEG_CBCS = AP4_CENC_VARIANT_MPEG_CBCS;
+
 /*----------------------------------------------------------------------
 |   AP4_DelegatorByteStream
 +---------------------------------------------------------------------*/
@@ -508,6 +520,45 @@ AP4_File_Inspect(AP4_File* self, AP4_AtomInspector* inspector)
     return self->Inspect(*inspector);
 }
 
+AP4_Cardinal
+AP4_File_GetTopLevelAtomCount(AP4_File* self)
+{
+    return self->GetChildren().ItemCount();
+}
+
+AP4_UI32
+AP4_File_GetTopLevelAtomType(AP4_File* self, AP4_Ordinal index)
+{
+    AP4_Atom* atom = NULL;
+    if (AP4_FAILED(self->GetChildren().Get(index, atom))) {
+        return 0;
+    } else {
+        return atom->GetType();
+    }
+}
+
+AP4_UI64
+AP4_File_GetTopLevelAtomSize(AP4_File* self, AP4_Ordinal index)
+{
+    AP4_Atom* atom = NULL;
+    if (AP4_FAILED(self->GetChildren().Get(index, atom))) {
+        return 0;
+    } else {
+        return atom->GetSize();
+    }
+}
+
+AP4_Result
+AP4_File_WriteTopLevelAtom(AP4_File*       self,
+                           AP4_Ordinal     index,
+                           AP4_ByteStream* stream)
+{
+    AP4_Atom* atom = NULL;
+    AP4_Result result = self->GetChildren().Get(index, atom);
+    if (AP4_FAILED(result)) return result;
+    return atom->Write(*stream);
+}
+
 void
 AP4_File_Destroy(AP4_File* self) 
 {
@@ -576,6 +627,12 @@ AP4_Movie_GetDurationMs(AP4_Movie* self)
     return self->GetDurationMs();
 }
 
+int
+AP4_Movie_HasFragments(AP4_Movie* self)
+{
+    return (int) self->HasFragments();
+}
+
 void
 AP4_Movie_Destroy(AP4_Movie* self)
 {
@@ -1377,5 +1434,135 @@ AP4_AtomInspector_FromDelegate(AP4_AtomInspectorDelegate* delegate)
     return new AP4_DelegatorAtomInspector(delegate);
 }
 
+AP4_AtomInspector*
+AP4_JsonInspector_Create(AP4_ByteStream* stream)
+{
+    return new AP4_JsonInspector(*stream);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Fragmenter implementation
++---------------------------------------------------------------------*/
+void
+AP4_Fragmenter_SetFragmentDuration(AP4_Fragmenter* self, unsigned int fragment_duration)
+{
+    self->SetFragmentDuration(fragment_duration);
+}
+
+void
+AP4_Fragmenter_SetTimescale(AP4_Fragmenter* self, AP4_UI32 timescale)
+{
+    self->SetTimescale(timescale);
+}
+
+void
+AP4_Fragmenter_SetTrackId(AP4_Fragmenter* self, AP4_UI32 track_id)
+{
+    self->SetTrackId(track_id);
+}
+
+void
+AP4_Fragmenter_SetCreateSegmentIndex(AP4_Fragmenter* self, int create_segment_index)
+{
+    self->SetCreateSegmentIndex(create_segment_index?true:false);
+}
+
+void
+AP4_Fragmenter_SetTrim(AP4_Fragmenter* self, int trim)
+{
+    self->SetTrim(trim?true:false);
+}
+
+void
+AP4_Fragmenter_SetNoTfdt(AP4_Fragmenter* self, int no_tfdt)
+{
+    self->SetNoTfdt(no_tfdt?true:false);
+}
+
+void
+AP4_Fragmenter_SetTfdtStart(AP4_Fragmenter* self, double tfdt_start)
+{
+    self->SetTfdtStart(tfdt_start);
+}
+
+void
+AP4_Fragmenter_SetSequenceNumberStart(AP4_Fragmenter* self, unsigned int sequence_number_start)
+{
+    self->SetSequenceNumberStart(sequence_number_start);
+}
+
+void
+AP4_Fragmenter_SetForceSyncMode(AP4_Fragmenter* self, int mode)
+{
+    self->SetForceSyncMode((AP4_Fragmenter::ForceSyncMode) mode);
+}
+
+AP4_Result
+AP4_Fragmenter_Fragment(AP4_Fragmenter* self, AP4_ByteStream* output)
+{
+    return self->Fragment(*output);
+}
+
+void
+AP4_Fragmenter_Destroy(AP4_Fragmenter* self)
+{
+    delete self;
+}
+
+AP4_Fragmenter*
+AP4_Fragmenter_Create(AP4_File* file, AP4_ByteStream* stream)
+{
+    return new AP4_Fragmenter(*file, *stream);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Processor implementation
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Processor_Process(AP4_Processor*  self,
+                      AP4_ByteStream* input,
+                      AP4_ByteStream* output)
+{
+    return self->Process(*input, *output);
+}
+
+void
+AP4_Processor_Destroy(AP4_Processor* self)
+{
+    delete self;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_CencEncryptingProcessor implementation
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_CencEncryptingProcessor_SetKey(AP4_CencEncryptingProcessor* self,
+                                   AP4_UI32                     track_id,
+                                   const AP4_UI08*              key,
+                                   AP4_Size                     key_size,
+                                   const AP4_UI08*              iv,
+                                   AP4_Size                     iv_size)
+{
+    return self->GetKeyMap().SetKey(track_id, key, key_size, iv, iv_size);
+}
 
+AP4_Result
+AP4_CencEncryptingProcessor_SetProperty(AP4_CencEncryptingProcessor* self,
+                                        AP4_UI32                     track_id,
+                                        const char*                  name,
+                                        const char*                  value)
+{
+    return self->GetPropertyMap().SetProperty(track_id, name, value);
+}
+
+AP4_Processor*
+AP4_CencEncryptingProcessor_AsProcessor(AP4_CencEncryptingProcessor* self)
+{
+    return self;
+}
 
+AP4_CencEncryptingProcessor*
+AP4_CencEncryptingProcessor_Create(int variant)
+{
+    return new AP4_CencEncryptingProcessor((AP4_CencVariant) variant);
+}
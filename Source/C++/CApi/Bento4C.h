@@ -51,6 +51,9 @@ class AP4_MpegAudioSampleDescription;
 class AP4_ProtectedSampleDescription;
 class AP4_SyntheticSampleTable;
 class AP4_AtomInspector;
+class AP4_Fragmenter;
+class AP4_Processor;
+class AP4_CencEncryptingProcessor;
 #else
 typedef struct AP4_ByteStream AP4_ByteStream;
 typedef struct AP4_DataBuffer AP4_DataBuffer;
@@ -68,6 +71,9 @@ typedef struct AP4_MpegAudioSampleDescription AP4_MpegAudioSampleDescription;
 typedef struct AP4_ProtectedSampleDescription AP4_ProtectedSampleDescription;
 typedef struct AP4_SyntheticSampleTable AP4_SyntheticSampleTable;
 typedef struct AP4_AtomInspector AP4_AtomInspector;
+typedef struct AP4_Fragmenter AP4_Fragmenter;
+typedef struct AP4_Processor AP4_Processor;
+typedef struct AP4_CencEncryptingProcessor AP4_CencEncryptingProcessor;
 #endif
 
 typedef enum {
@@ -249,6 +255,17 @@ extern const int AP4_ATOM_INSPECTOR_HINT_NONE;
 extern const int AP4_ATOM_INSPECTOR_HINT_HEX;
 extern const int AP4_ATOM_INSPECTOR_HIN_BOOLEAN;
 
+extern const int AP4_FRAGMENTER_FORCE_SYNC_MODE_NONE;
+extern const int AP4_FRAGMENTER_FORCE_SYNC_MODE_AUTO;
+extern const int AP4_FRAGMENTER_FORCE_SYNC_MODE_ALL;
+
+extern const int AP4_CENC_ENCRYPTION_VARIANT_PIFF_CTR;
+extern const int AP4_CENC_ENCRYPTION_VARIANT_PIFF_CBC;
+extern const int AP4_CENC_ENCRYPTION_VARIANT_MPEG_CENC;
+extern const int AP4_CENC_ENCRYPTION_VARIANT_MPEG_CBC1;
+extern const int AP4_CENC_ENCRYPTION_VARIANT_MPEG_CENS;
+extern const int AP4_CENC_ENCRYPTION_VARIANT_MPEG_CBCS;
+
 /*----------------------------------------------------------------------
 |   result codes
 +---------------------------------------------------------------------*/
@@ -469,6 +486,20 @@ AP4_File_IsMoovBeforeMdat(const AP4_File* self);
 AP4_Result
 AP4_File_Inspect(AP4_File* self, AP4_AtomInspector* inspector);
 
+AP4_Cardinal
+AP4_File_GetTopLevelAtomCount(AP4_File* self);
+
+AP4_UI32
+AP4_File_GetTopLevelAtomType(AP4_File* self, AP4_Ordinal index); /* 0 if out of range */
+
+AP4_UI64
+AP4_File_GetTopLevelAtomSize(AP4_File* self, AP4_Ordinal index); /* 0 if out of range */
+
+AP4_Result
+AP4_File_WriteTopLevelAtom(AP4_File*       self,
+                           AP4_Ordinal     index,
+                           AP4_ByteStream* stream);
+
 const AP4_MetaData*
 AP4_File_GetMetaData(AP4_File* self);
 
@@ -508,6 +539,9 @@ AP4_Movie_GetDuration(AP4_Movie* self);
 AP4_UI32
 AP4_Movie_GetDurationMs(AP4_Movie* self);
 
+int
+AP4_Movie_HasFragments(AP4_Movie* self);
+
 AP4_Result
 AP4_Movie_AddTrack(AP4_Movie* self, AP4_Track* track);
 
@@ -892,9 +926,91 @@ AP4_AtomInspector_Destroy(AP4_AtomInspector* self);
 AP4_AtomInspector*
 AP4_PrintInspector_Create(AP4_ByteStream* stream);
 
+AP4_AtomInspector*
+AP4_JsonInspector_Create(AP4_ByteStream* stream);
+
 AP4_AtomInspector*
 AP4_AtomInspector_FromDelegate(AP4_AtomInspectorDelegate* delegate);
 
+/*----------------------------------------------------------------------
+|   AP4_Fragmenter methods
++---------------------------------------------------------------------*/
+void
+AP4_Fragmenter_SetFragmentDuration(AP4_Fragmenter* self, unsigned int fragment_duration); /* ms, 0 = auto */
+
+void
+AP4_Fragmenter_SetTimescale(AP4_Fragmenter* self, AP4_UI32 timescale); /* 0 = keep the track timescales */
+
+void
+AP4_Fragmenter_SetTrackId(AP4_Fragmenter* self, AP4_UI32 track_id); /* 0 = all tracks */
+
+void
+AP4_Fragmenter_SetCreateSegmentIndex(AP4_Fragmenter* self, int create_segment_index);
+
+void
+AP4_Fragmenter_SetTrim(AP4_Fragmenter* self, int trim);
+
+void
+AP4_Fragmenter_SetNoTfdt(AP4_Fragmenter* self, int no_tfdt);
+
+void
+AP4_Fragmenter_SetTfdtStart(AP4_Fragmenter* self, double tfdt_start);
+
+void
+AP4_Fragmenter_SetSequenceNumberStart(AP4_Fragmenter* self, unsigned int sequence_number_start);
+
+void
+AP4_Fragmenter_SetForceSyncMode(AP4_Fragmenter* self, int mode); /* see AP4_FRAGMENTER_FORCE_SYNC_MODE_XXX constants */
+
+AP4_Result
+AP4_Fragmenter_Fragment(AP4_Fragmenter* self, AP4_ByteStream* output);
+
+void
+AP4_Fragmenter_Destroy(AP4_Fragmenter* self);
+
+/*----------------------------------------------------------------------
+|   AP4_Fragmenter constructors
++---------------------------------------------------------------------*/
+AP4_Fragmenter*
+AP4_Fragmenter_Create(AP4_File* file, AP4_ByteStream* stream); /* stream: the stream the file was parsed from */
+
+/*----------------------------------------------------------------------
+|   AP4_Processor methods
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Processor_Process(AP4_Processor*  self,
+                      AP4_ByteStream* input,
+                      AP4_ByteStream* output);
+
+void
+AP4_Processor_Destroy(AP4_Processor* self);
+
+/*----------------------------------------------------------------------
+|   AP4_CencEncryptingProcessor methods
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_CencEncryptingProcessor_SetKey(AP4_CencEncryptingProcessor* self,
+                                   AP4_UI32                     track_id,
+                                   const AP4_UI08*              key,
+                                   AP4_Size                     key_size,
+                                   const AP4_UI08*              iv,
+                                   AP4_Size                     iv_size);
+
+AP4_Result
+AP4_CencEncryptingProcessor_SetProperty(AP4_CencEncryptingProcessor* self,
+                                        AP4_UI32                     track_id,
+                                        const char*                  name,
+                                        const char*                  value);
+
+AP4_Processor*
+AP4_CencEncryptingProcessor_AsProcessor(AP4_CencEncryptingProcessor* self);
+
+/*----------------------------------------------------------------------
+|   AP4_CencEncryptingProcessor constructors
++---------------------------------------------------------------------*/
+AP4_CencEncryptingProcessor*
+AP4_CencEncryptingProcessor_Create(int variant); /* see AP4_CENC_ENCRYPTION_VARIANT_XXX constants */
+
 #ifdef __cplusplus
 }
 #endif /*__cplusplus */
@@ -31,11 +31,13 @@
 +---------------------------------------------------------------------*/
 #include "Ap4BitStream.h"
 #include "Ap4AdtsParser.h"
+#include "Ap4Utils.h"
 
 /*----------------------------------------------------------------------
 |   constants
 +---------------------------------------------------------------------*/
 #define AP4_ADTS_HEADER_SIZE 7
+#define AP4_ADTS_CRC_SIZE    2
 
 #define AP4_ADTS_SYNC_MASK     0xFFF6 /* 12 sync bits plus 2 layer bits */
 #define AP4_ADTS_SYNC_PATTERN  0xFFF0 /* 12 sync bits=1 layer=0         */
@@ -61,6 +63,35 @@ AP4_AdtsSamplingFrequencyTable[16] =
     0       /* Escape code */
 };
 
+/*----------------------------------------------------------------------+
+|    AP4_AdtsFindSyncWord
+|
+|    Find the first candidate sync word in a contiguous buffer. 0xFF bytes
+|    are located with AP4_FindByte (memchr, vectorized by most C libraries)
+|    and only those are checked against the full sync pattern.
+|    Returns the offset of the candidate, or data_size if there is none.
+|    A 0xFF last byte is returned as a candidate, since the byte that
+|    follows it is not known yet.
+|
++----------------------------------------------------------------------*/
+static AP4_Size
+AP4_AdtsFindSyncWord(const AP4_UI08* data, AP4_Size data_size)
+{
+    AP4_Size offset = 0;
+    while (offset < data_size) {
+        const AP4_UI08* sync = (const AP4_UI08*)AP4_FindByte(data+offset, 0xFF, data_size-offset);
+        if (sync == NULL) break;
+        offset = (AP4_Size)(sync-data);
+        if (offset+1 == data_size) return offset;
+        if ((((sync[0] << 8) | sync[1]) & AP4_ADTS_SYNC_MASK) == AP4_ADTS_SYNC_PATTERN) {
+            return offset;
+        }
+        ++offset;
+    }
+
+    return data_size;
+}
+
 /*----------------------------------------------------------------------+
 |    AP4_AdtsHeader::AP4_AdtsHeader
 +----------------------------------------------------------------------*/
@@ -182,7 +213,22 @@ AP4_AdtsParser::FindHeader(AP4_UI08* header)
     AP4_Size available = m_Bits.GetBytesAvailable();
 
     /* look for the sync pattern */
-    while (available-- >= AP4_ADTS_HEADER_SIZE) {
+    while (available >= AP4_ADTS_HEADER_SIZE) {
+        if (m_Bits.m_BitsCached == 0) {
+            /* nothing cached: skip directly to the next candidate in the */
+            /* contiguous part of the ring buffer                         */
+            AP4_Size scan_size = m_Bits.GetContiguousBytesAvailable();
+            if (scan_size > available-(AP4_ADTS_HEADER_SIZE-1)) {
+                scan_size = available-(AP4_ADTS_HEADER_SIZE-1);
+            }
+            AP4_Size skip = AP4_AdtsFindSyncWord(m_Bits.m_Buffer+m_Bits.m_Out, scan_size);
+            if (skip) {
+                m_Bits.SkipBytes(skip);
+                available -= skip;
+                continue;
+            }
+        }
+        --available;
         m_Bits.PeekBytes(header, 2);
 
         if ((((header[0] << 8) | header[1]) & AP4_ADTS_SYNC_MASK) == AP4_ADTS_SYNC_PATTERN) {
@@ -250,29 +296,7 @@ AP4_AdtsParser::FindFrame(AP4_AacFrame& frame)
     m_Bits.SkipBytes(AP4_ADTS_HEADER_SIZE);
 
     /* fill in the frame info */
-    frame.m_Info.m_Standard = (adts_header.m_Id == 1 ? 
-                            AP4_AAC_STANDARD_MPEG2 :
-                            AP4_AAC_STANDARD_MPEG4);
-    switch (adts_header.m_ProfileObjectType) {
-        case 0:
-            frame.m_Info.m_Profile = AP4_AAC_PROFILE_MAIN;
-            break;
-
-        case 1:
-            frame.m_Info.m_Profile = AP4_AAC_PROFILE_LC;
-            break;
-
-        case 2: 
-            frame.m_Info.m_Profile = AP4_AAC_PROFILE_SSR;
-            break;
-
-        case 3:
-            frame.m_Info.m_Profile = AP4_AAC_PROFILE_LTP;
-    }
-    frame.m_Info.m_FrameLength = adts_header.m_FrameLength-AP4_ADTS_HEADER_SIZE;
-    frame.m_Info.m_ChannelConfiguration = adts_header.m_ChannelConfiguration;
-    frame.m_Info.m_SamplingFrequencyIndex = adts_header.m_SamplingFrequencyIndex;
-    frame.m_Info.m_SamplingFrequency = AP4_AdtsSamplingFrequencyTable[adts_header.m_SamplingFrequencyIndex];
+    SetFrameInfo(adts_header, frame.m_Info);
 
     /* skip crc if present */
     if (adts_header.m_ProtectionAbsent == 0) {
@@ -281,6 +305,7 @@ AP4_AdtsParser::FindFrame(AP4_AacFrame& frame)
 
     /* set the frame source */
     frame.m_Source = &m_Bits;
+    frame.m_Data   = NULL;
 
     return AP4_SUCCESS;
 
@@ -291,6 +316,95 @@ fail:
     return AP4_ERROR_CORRUPTED_BITSTREAM;
 }
 
+/*----------------------------------------------------------------------+
+|    AP4_AdtsParser::FindFrameInBuffer
++----------------------------------------------------------------------*/
+AP4_Result
+AP4_AdtsParser::FindFrameInBuffer(const AP4_UI08* data,
+                                  AP4_Size        data_size,
+                                  AP4_AacFrame&   frame,
+                                  AP4_Size&       bytes_consumed,
+                                  bool            eos)
+{
+    AP4_Size offset = 0;
+    for (;;) {
+        /* find the next candidate header */
+        offset += AP4_AdtsFindSyncWord(data+offset, data_size-offset);
+        if (data_size-offset < AP4_ADTS_HEADER_SIZE) break;
+        const AP4_UI08* raw_header = data+offset;
+        AP4_Size        available  = data_size-offset;
+
+        /* parse and check the header */
+        AP4_AdtsHeader adts_header(raw_header);
+        AP4_Size header_size = AP4_ADTS_HEADER_SIZE+(adts_header.m_ProtectionAbsent?0:AP4_ADTS_CRC_SIZE);
+        if (AP4_FAILED(adts_header.Check()) || adts_header.m_FrameLength < header_size) {
+            ++offset;
+            continue;
+        }
+
+        /* check the header of the next frame if we can see it */
+        if (available >= adts_header.m_FrameLength+AP4_ADTS_HEADER_SIZE) {
+            const AP4_UI08* peek_raw_header = raw_header+adts_header.m_FrameLength;
+            AP4_AdtsHeader peek_adts_header(peek_raw_header);
+            if (AP4_FAILED(peek_adts_header.Check()) ||
+                !AP4_AdtsHeader::MatchFixed((unsigned char*)peek_raw_header, (unsigned char*)raw_header)) {
+                ++offset;
+                continue;
+            }
+        } else if (available < adts_header.m_FrameLength || !eos) {
+            /* not enough for a frame, or not at the end */
+            break;
+        }
+
+        /* return a view of the payload */
+        SetFrameInfo(adts_header, frame.m_Info);
+        frame.m_Source = NULL;
+        frame.m_Data   = raw_header+header_size;
+        bytes_consumed = offset+adts_header.m_FrameLength;
+
+        return AP4_SUCCESS;
+    }
+
+    /* everything before the candidate header (if any) can be discarded */
+    bytes_consumed = offset;
+    return AP4_ERROR_NOT_ENOUGH_DATA;
+}
+
+/*----------------------------------------------------------------------+
+|    AP4_AdtsParser::SetFrameInfo
++----------------------------------------------------------------------*/
+void
+AP4_AdtsParser::SetFrameInfo(const AP4_AdtsHeader& header, AP4_AacFrameInfo& info)
+{
+    info.m_Standard = (header.m_Id == 1 ? 
+                       AP4_AAC_STANDARD_MPEG2 :
+                       AP4_AAC_STANDARD_MPEG4);
+    switch (header.m_ProfileObjectType) {
+        case 0:
+            info.m_Profile = AP4_AAC_PROFILE_MAIN;
+            break;
+
+        case 1:
+            info.m_Profile = AP4_AAC_PROFILE_LC;
+            break;
+
+        case 2: 
+            info.m_Profile = AP4_AAC_PROFILE_SSR;
+            break;
+
+        case 3:
+            info.m_Profile = AP4_AAC_PROFILE_LTP;
+    }
+    info.m_FrameLength = header.m_FrameLength-AP4_ADTS_HEADER_SIZE;
+    if (header.m_ProtectionAbsent == 0) {
+        // the frame length includes the CRC
+        info.m_FrameLength -= AP4_ADTS_CRC_SIZE;
+    }
+    info.m_ChannelConfiguration = header.m_ChannelConfiguration;
+    info.m_SamplingFrequencyIndex = header.m_SamplingFrequencyIndex;
+    info.m_SamplingFrequency = AP4_AdtsSamplingFrequencyTable[header.m_SamplingFrequencyIndex];
+}
+
 /*----------------------------------------------------------------------+
 |    AP4_AdtsParser::GetBytesFree
 +----------------------------------------------------------------------*/
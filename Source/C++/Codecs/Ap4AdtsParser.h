@@ -90,7 +90,8 @@ typedef struct {
 } AP4_AacFrameInfo;
 
 typedef struct {
-    AP4_BitStream*   m_Source;
+    AP4_BitStream*   m_Source; // set by FindFrame(), NULL otherwise
+    const AP4_UI08*  m_Data;   // set by FindFrameInBuffer(), NULL otherwise
     AP4_AacFrameInfo m_Info;
 } AP4_AacFrame;
 
@@ -106,6 +107,23 @@ public:
                     AP4_Size*       buffer_size,
                     AP4_Flags       flags = 0);
     AP4_Result FindFrame(AP4_AacFrame& frame);
+
+    /**
+     * Find the next frame directly in a contiguous buffer, bypassing the
+     * internal ring buffer (Feed() is not used in this mode).
+     * On success, frame.m_Data points to the frame payload inside the
+     * buffer, and bytes_consumed is the number of bytes up to the end of
+     * the frame. If AP4_ERROR_NOT_ENOUGH_DATA is returned, bytes_consumed is
+     * the number of bytes that can be discarded before calling again with
+     * more data. Candidate headers that fail validation are skipped.
+     * As with FindFrame(), a frame is only returned once the header of the
+     * next frame can be checked, unless eos is true.
+     */
+    AP4_Result FindFrameInBuffer(const AP4_UI08* data,
+                                 AP4_Size        data_size,
+                                 AP4_AacFrame&   frame,
+                                 AP4_Size&       bytes_consumed,
+                                 bool            eos = false);
     AP4_Result Skip(AP4_Size size);
     AP4_Size   GetBytesFree();
     AP4_Size   GetBytesAvailable();
@@ -113,6 +131,7 @@ public:
 private:
     // methods
     AP4_Result FindHeader(AP4_UI08* header);
+    static void SetFrameInfo(const AP4_AdtsHeader& header, AP4_AacFrameInfo& info);
 
     // members
     AP4_BitStream m_Bits;
@@ -52,6 +52,12 @@
 #define DBG_PRINTF_5(_x0, _x1, _x2, _x3, _x4, _x5)
 #endif
 
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+// number of NAL unit bytes looked at before trying the whole NAL unit
+const unsigned int AP4_AVC_SLICE_HEADER_PARSE_SIZE = 512;
+
 /*----------------------------------------------------------------------
 |   AP4_AvcNalParser::NaluTypeName
 +---------------------------------------------------------------------*/
@@ -168,37 +174,6 @@ AP4_AvcFrameParser::~AP4_AvcFrameParser()
     }
 }
 
-/*----------------------------------------------------------------------
-|   ReadGolomb
-+---------------------------------------------------------------------*/
-static unsigned int
-ReadGolomb(AP4_BitReader& bits)
-{
-    unsigned int leading_zeros = 0;
-    while (bits.ReadBit() == 0) {
-        leading_zeros++;
-        if (leading_zeros > 32) return 0; // safeguard
-    }
-    if (leading_zeros) {
-        return (1<<leading_zeros)-1+bits.ReadBits(leading_zeros);
-    } else {
-        return 0;
-    }
-}
-
-/*----------------------------------------------------------------------
-|   SignedGolomb
-+---------------------------------------------------------------------*/
-static int
-SignedGolomb(unsigned int code_num)
-{
-    if (code_num % 2) {
-        return (code_num+1)/2;
-    } else {
-        return -((int)code_num/2);
-    }
-}
-
 /*----------------------------------------------------------------------
 |   AP4_AvcSequenceParameterSet::AP4_AvcSequenceParameterSet
 +---------------------------------------------------------------------*/
@@ -282,7 +257,7 @@ AP4_AvcFrameParser::ParseSPS(const unsigned char*         data,
     sps.constraint_set3_flag = bits.ReadBit();
     bits.SkipBits(4);
     sps.level_idc = bits.ReadBits(8);
-    sps.seq_parameter_set_id = ReadGolomb(bits);
+    sps.seq_parameter_set_id = bits.ReadGolomb();
     if (sps.seq_parameter_set_id > AP4_AVC_SPS_MAX_ID) {
         return AP4_ERROR_INVALID_FORMAT;
     }
@@ -293,13 +268,13 @@ AP4_AvcFrameParser::ParseSPS(const unsigned char*         data,
         sps.profile_idc  ==  44   ||
         sps.profile_idc  ==  83   ||
         sps.profile_idc  ==  86) {
-        sps.chroma_format_idc = ReadGolomb(bits);
+        sps.chroma_format_idc = bits.ReadGolomb();
         sps.separate_colour_plane_flag = 0;
         if (sps.chroma_format_idc == 3) {
             sps.separate_colour_plane_flag = bits.ReadBit();
         }
-        sps.bit_depth_luma_minus8 = ReadGolomb(bits);
-        sps.bit_depth_chroma_minus8 = ReadGolomb(bits);
+        sps.bit_depth_luma_minus8 = bits.ReadGolomb();
+        sps.bit_depth_chroma_minus8 = bits.ReadGolomb();
         sps.qpprime_y_zero_transform_bypass_flag = bits.ReadBit();
         sps.seq_scaling_matrix_present_flag = bits.ReadBit();
         if (sps.seq_scaling_matrix_present_flag) {
@@ -311,7 +286,7 @@ AP4_AvcFrameParser::ParseSPS(const unsigned char*         data,
                         int next_scale = 8;
                         for (unsigned int j=0; j<16; j++) {
                             if (next_scale) {
-                                int delta_scale = SignedGolomb(ReadGolomb(bits));
+                                int delta_scale = bits.ReadSignedGolomb();
                                 next_scale = (last_scale + delta_scale + 256) % 256;
                                 sps.use_default_scaling_matrix_4x4[i] = (j == 0 && next_scale == 0);
                             }
@@ -323,7 +298,7 @@ AP4_AvcFrameParser::ParseSPS(const unsigned char*         data,
                         int next_scale = 8;
                         for (unsigned int j=0; j<64; j++) {
                             if (next_scale) {
-                                int delta_scale = SignedGolomb(ReadGolomb(bits));
+                                int delta_scale = bits.ReadSignedGolomb();
                                 next_scale = (last_scale + delta_scale + 256) % 256;
                                 sps.use_default_scaling_matrix_8x8[i-6] = (j == 0 && next_scale == 0);
                             }
@@ -335,29 +310,29 @@ AP4_AvcFrameParser::ParseSPS(const unsigned char*         data,
             }
         }
     }
-    sps.log2_max_frame_num_minus4 = ReadGolomb(bits);
-    sps.pic_order_cnt_type = ReadGolomb(bits);
+    sps.log2_max_frame_num_minus4 = bits.ReadGolomb();
+    sps.pic_order_cnt_type = bits.ReadGolomb();
     if (sps.pic_order_cnt_type > 2) {
         return AP4_ERROR_INVALID_FORMAT;
     }
     if (sps.pic_order_cnt_type == 0) {
-        sps.log2_max_pic_order_cnt_lsb_minus4 = ReadGolomb(bits);
+        sps.log2_max_pic_order_cnt_lsb_minus4 = bits.ReadGolomb();
     } else if (sps.pic_order_cnt_type == 1) {
         sps.delta_pic_order_always_zero_flags = bits.ReadBit();
-        sps.offset_for_non_ref_pic = SignedGolomb(ReadGolomb(bits));
-        sps.offset_for_top_to_bottom_field = SignedGolomb(ReadGolomb(bits));
-        sps.num_ref_frames_in_pic_order_cnt_cycle = ReadGolomb(bits);
+        sps.offset_for_non_ref_pic = bits.ReadSignedGolomb();
+        sps.offset_for_top_to_bottom_field = bits.ReadSignedGolomb();
+        sps.num_ref_frames_in_pic_order_cnt_cycle = bits.ReadGolomb();
         if (sps.num_ref_frames_in_pic_order_cnt_cycle > AP4_AVC_SPS_MAX_NUM_REF_FRAMES_IN_PIC_ORDER_CNT_CYCLE) {
             return AP4_ERROR_INVALID_FORMAT;
         }
         for (unsigned int i=0; i<sps.num_ref_frames_in_pic_order_cnt_cycle; i++) {
-            sps.offset_for_ref_frame[i] = SignedGolomb(ReadGolomb(bits));
+            sps.offset_for_ref_frame[i] = bits.ReadSignedGolomb();
         }
     }
-    sps.num_ref_frames                       = ReadGolomb(bits);
+    sps.num_ref_frames                       = bits.ReadGolomb();
     sps.gaps_in_frame_num_value_allowed_flag = bits.ReadBit();
-    sps.pic_width_in_mbs_minus1              = ReadGolomb(bits);
-    sps.pic_height_in_map_units_minus1       = ReadGolomb(bits);
+    sps.pic_width_in_mbs_minus1              = bits.ReadGolomb();
+    sps.pic_height_in_map_units_minus1       = bits.ReadGolomb();
     sps.frame_mbs_only_flag                  = bits.ReadBit();
     if (!sps.frame_mbs_only_flag) {
         sps.mb_adaptive_frame_field_flag = bits.ReadBit();
@@ -365,10 +340,10 @@ AP4_AvcFrameParser::ParseSPS(const unsigned char*         data,
     sps.direct_8x8_inference_flag = bits.ReadBit();
     sps.frame_cropping_flag       = bits.ReadBit();
     if (sps.frame_cropping_flag) {
-        sps.frame_crop_left_offset   = ReadGolomb(bits);
-        sps.frame_crop_right_offset  = ReadGolomb(bits);
-        sps.frame_crop_top_offset    = ReadGolomb(bits);
-        sps.frame_crop_bottom_offset = ReadGolomb(bits);
+        sps.frame_crop_left_offset   = bits.ReadGolomb();
+        sps.frame_crop_right_offset  = bits.ReadGolomb();
+        sps.frame_crop_top_offset    = bits.ReadGolomb();
+        sps.frame_crop_bottom_offset = bits.ReadGolomb();
     }
 
     return AP4_SUCCESS;
@@ -418,38 +393,38 @@ AP4_AvcFrameParser::ParsePPS(const unsigned char*        data,
     
     bits.SkipBits(8); // NAL Unit Type
 
-    pps.pic_parameter_set_id     = ReadGolomb(bits);
+    pps.pic_parameter_set_id     = bits.ReadGolomb();
     if (pps.pic_parameter_set_id > AP4_AVC_PPS_MAX_ID) {
         return AP4_ERROR_INVALID_FORMAT;
     }
-    pps.seq_parameter_set_id     = ReadGolomb(bits);
+    pps.seq_parameter_set_id     = bits.ReadGolomb();
     if (pps.seq_parameter_set_id > AP4_AVC_SPS_MAX_ID) {
         return AP4_ERROR_INVALID_FORMAT;
     }
     pps.entropy_coding_mode_flag = bits.ReadBit();
     pps.pic_order_present_flag   = bits.ReadBit();
-    pps.num_slice_groups_minus1  = ReadGolomb(bits);
+    pps.num_slice_groups_minus1  = bits.ReadGolomb();
     if (pps.num_slice_groups_minus1 >= AP4_AVC_PPS_MAX_SLICE_GROUPS) {
         return AP4_ERROR_INVALID_FORMAT;
     }
     if (pps.num_slice_groups_minus1 > 0) {
-        pps.slice_group_map_type = ReadGolomb(bits);
+        pps.slice_group_map_type = bits.ReadGolomb();
         if (pps.slice_group_map_type == 0) {
             for (unsigned int i=0; i<=pps.num_slice_groups_minus1; i++) {
-                pps.run_length_minus1[i] = ReadGolomb(bits);
+                pps.run_length_minus1[i] = bits.ReadGolomb();
             }
         } else if (pps.slice_group_map_type == 2) {
             for (unsigned int i=0; i<pps.num_slice_groups_minus1; i++) {
-                pps.top_left[i] = ReadGolomb(bits);
-                pps.bottom_right[i] = ReadGolomb(bits);
+                pps.top_left[i] = bits.ReadGolomb();
+                pps.bottom_right[i] = bits.ReadGolomb();
             }
         } else if (pps.slice_group_map_type == 3 ||
                    pps.slice_group_map_type == 4 ||
                    pps.slice_group_map_type == 5) {
             pps.slice_group_change_direction_flag = bits.ReadBit();
-            pps.slice_group_change_rate_minus1 = ReadGolomb(bits);
+            pps.slice_group_change_rate_minus1 = bits.ReadGolomb();
         } else if (pps.slice_group_map_type == 6) {
-            pps.pic_size_in_map_units_minus1 = ReadGolomb(bits);
+            pps.pic_size_in_map_units_minus1 = bits.ReadGolomb();
             if (pps.pic_size_in_map_units_minus1 >= AP4_AVC_PPS_MAX_PIC_SIZE_IN_MAP_UNITS) {
                 return AP4_ERROR_INVALID_FORMAT;
             }
@@ -466,13 +441,13 @@ AP4_AvcFrameParser::ParsePPS(const unsigned char*        data,
             }
         }
     }
-    pps.num_ref_idx_10_active_minus1 = ReadGolomb(bits);
-    pps.num_ref_idx_11_active_minus1 = ReadGolomb(bits);
+    pps.num_ref_idx_10_active_minus1 = bits.ReadGolomb();
+    pps.num_ref_idx_11_active_minus1 = bits.ReadGolomb();
     pps.weighted_pred_flag           = bits.ReadBit();
     pps.weighted_bipred_idc          = bits.ReadBits(2);
-    pps.pic_init_qp_minus26          = SignedGolomb(ReadGolomb(bits));
-    pps.pic_init_qs_minus26          = SignedGolomb(ReadGolomb(bits));
-    pps.chroma_qp_index_offset       = SignedGolomb(ReadGolomb(bits));
+    pps.pic_init_qp_minus26          = bits.ReadSignedGolomb();
+    pps.pic_init_qs_minus26          = bits.ReadSignedGolomb();
+    pps.chroma_qp_index_offset       = bits.ReadSignedGolomb();
     pps.deblocking_filter_control_present_flag = bits.ReadBit();
     pps.constrained_intra_pred_flag            = bits.ReadBit();
     pps.redundant_pic_cnt_present_flag         = bits.ReadBit();
@@ -533,16 +508,43 @@ AP4_AvcFrameParser::ParseSliceHeader(const AP4_UI08*     data,
                                      unsigned int        nal_ref_idc,
                                      AP4_AvcSliceHeader& slice_header)
 {
+    // slice headers are short, so start by unescaping and parsing only the
+    // start of the NAL unit, and only use all of it if the header didn't fit
+    if (data_size > AP4_AVC_SLICE_HEADER_PARSE_SIZE) {
+        AP4_AvcSliceHeader initial_slice_header = slice_header;
+        AP4_DataBuffer unescaped(data, AP4_AVC_SLICE_HEADER_PARSE_SIZE);
+        AP4_NalParser::Unescape(unescaped);
+        AP4_Result result = ParseUnescapedSliceHeader(unescaped, nal_unit_type, nal_ref_idc, slice_header);
+        
+        // the last byte may not have been unescaped like in the whole NAL unit
+        if (AP4_SUCCEEDED(result) && slice_header.size+8 <= 8*unescaped.GetDataSize()) {
+            return AP4_SUCCESS;
+        }
+        slice_header = initial_slice_header;
+    }
+    
     AP4_DataBuffer unescaped(data, data_size);
     AP4_NalParser::Unescape(unescaped);
+    return ParseUnescapedSliceHeader(unescaped, nal_unit_type, nal_ref_idc, slice_header);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_AvcFrameParser::ParseUnescapedSliceHeader
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_AvcFrameParser::ParseUnescapedSliceHeader(const AP4_DataBuffer& unescaped,
+                                              unsigned int          nal_unit_type,
+                                              unsigned int          nal_ref_idc,
+                                              AP4_AvcSliceHeader&   slice_header)
+{
     AP4_BitReader bits(unescaped.GetData(), unescaped.GetDataSize());
 
     // init the computer fields
     slice_header.size = 0;
     
-    slice_header.first_mb_in_slice    = ReadGolomb(bits);
-    slice_header.slice_type           = ReadGolomb(bits);
-    slice_header.pic_parameter_set_id = ReadGolomb(bits);
+    slice_header.first_mb_in_slice    = bits.ReadGolomb();
+    slice_header.slice_type           = bits.ReadGolomb();
+    slice_header.pic_parameter_set_id = bits.ReadGolomb();
     if (slice_header.pic_parameter_set_id > AP4_AVC_PPS_MAX_ID) {
         return AP4_ERROR_INVALID_FORMAT;
     }
@@ -565,22 +567,22 @@ AP4_AvcFrameParser::ParseSliceHeader(const AP4_UI08*     data,
         }
     }
     if (nal_unit_type == AP4_AVC_NAL_UNIT_TYPE_CODED_SLICE_OF_IDR_PICTURE) {
-        slice_header.idr_pic_id = ReadGolomb(bits);
+        slice_header.idr_pic_id = bits.ReadGolomb();
     }
     if (sps->pic_order_cnt_type == 0) {
         slice_header.pic_order_cnt_lsb = bits.ReadBits(sps->log2_max_pic_order_cnt_lsb_minus4 + 4);
         if (pps->pic_order_present_flag && !slice_header.field_pic_flag) {
-            slice_header.delta_pic_order_cnt[0] = SignedGolomb(ReadGolomb(bits));
+            slice_header.delta_pic_order_cnt[0] = bits.ReadSignedGolomb();
         }
     }
     if (sps->pic_order_cnt_type == 1 && !sps->delta_pic_order_always_zero_flags) {
-        slice_header.delta_pic_order_cnt[0] = SignedGolomb(ReadGolomb(bits));
+        slice_header.delta_pic_order_cnt[0] = bits.ReadSignedGolomb();
         if (pps->pic_order_present_flag && !slice_header.field_pic_flag) {
-            slice_header.delta_pic_order_cnt[1] = SignedGolomb(ReadGolomb(bits));
+            slice_header.delta_pic_order_cnt[1] = bits.ReadSignedGolomb();
         }
     }
     if (pps->redundant_pic_cnt_present_flag) {
-        slice_header.redundant_pic_cnt = ReadGolomb(bits);
+        slice_header.redundant_pic_cnt = bits.ReadGolomb();
     }
     
     unsigned int slice_type = slice_header.slice_type % 5; // this seems to be implicit in the spec
@@ -595,9 +597,9 @@ AP4_AvcFrameParser::ParseSliceHeader(const AP4_UI08*     data,
         slice_header.num_ref_idx_active_override_flag = bits.ReadBit();
         
         if (slice_header.num_ref_idx_active_override_flag) {
-            slice_header.num_ref_idx_l0_active_minus1 = ReadGolomb(bits);
+            slice_header.num_ref_idx_l0_active_minus1 = bits.ReadGolomb();
             if ((slice_header.slice_type % 5) == AP4_AVC_SLICE_TYPE_B) {
-                slice_header.num_ref_idx_l1_active_minus1 = ReadGolomb(bits);
+                slice_header.num_ref_idx_l1_active_minus1 = bits.ReadGolomb();
             }
         } else {
             slice_header.num_ref_idx_l0_active_minus1 = pps->num_ref_idx_10_active_minus1;
@@ -610,12 +612,16 @@ AP4_AvcFrameParser::ParseSliceHeader(const AP4_UI08*     data,
         slice_header.ref_pic_list_reordering_flag_l0 = bits.ReadBit();
         if (slice_header.ref_pic_list_reordering_flag_l0) {
             do {
-                slice_header.reordering_of_pic_nums_idc = ReadGolomb(bits);
+                slice_header.reordering_of_pic_nums_idc = bits.ReadGolomb();
                 if (slice_header.reordering_of_pic_nums_idc == 0 ||
 					slice_header.reordering_of_pic_nums_idc == 1) {
-                    slice_header.abs_diff_pic_num_minus1 = ReadGolomb(bits);
+                    slice_header.abs_diff_pic_num_minus1 = bits.ReadGolomb();
                 } else if (slice_header.reordering_of_pic_nums_idc == 2) {
-                    slice_header.long_term_pic_num = ReadGolomb(bits);
+                    slice_header.long_term_pic_num = bits.ReadGolomb();
+                }
+                if (bits.GetBitsRead() > 8*unescaped.GetDataSize()) {
+                    // ran out of data before the end of the list
+                    return AP4_ERROR_INVALID_FORMAT;
                 }
             } while (slice_header.reordering_of_pic_nums_idc != 3);
         }
@@ -624,12 +630,16 @@ AP4_AvcFrameParser::ParseSliceHeader(const AP4_UI08*     data,
         slice_header.ref_pic_list_reordering_flag_l1 = bits.ReadBit();
         if (slice_header.ref_pic_list_reordering_flag_l1) {
             do {
-                slice_header.reordering_of_pic_nums_idc = ReadGolomb(bits);
+                slice_header.reordering_of_pic_nums_idc = bits.ReadGolomb();
                 if (slice_header.reordering_of_pic_nums_idc == 0 ||
 					slice_header.reordering_of_pic_nums_idc == 1) {
-                    slice_header.abs_diff_pic_num_minus1 = ReadGolomb(bits);
+                    slice_header.abs_diff_pic_num_minus1 = bits.ReadGolomb();
                 } else if (slice_header.reordering_of_pic_nums_idc == 2) {
-                    slice_header.long_term_pic_num = ReadGolomb(bits);
+                    slice_header.long_term_pic_num = bits.ReadGolomb();
+                }
+                if (bits.GetBitsRead() > 8*unescaped.GetDataSize()) {
+                    // ran out of data before the end of the list
+                    return AP4_ERROR_INVALID_FORMAT;
                 }
             } while (slice_header.reordering_of_pic_nums_idc != 3);
         }
@@ -639,24 +649,24 @@ AP4_AvcFrameParser::ParseSliceHeader(const AP4_UI08*     data,
         (slice_type == AP4_AVC_SLICE_TYPE_P || slice_type == AP4_AVC_SLICE_TYPE_SP)) ||
 		(pps->weighted_bipred_idc == 1 && slice_type == AP4_AVC_SLICE_TYPE_B)) {
         // pred_weight_table
-        slice_header.luma_log2_weight_denom = ReadGolomb(bits);
+        slice_header.luma_log2_weight_denom = bits.ReadGolomb();
         
         if (sps->chroma_format_idc != 0) {
-            slice_header.chroma_log2_weight_denom = ReadGolomb(bits);
+            slice_header.chroma_log2_weight_denom = bits.ReadGolomb();
         }
         
         for (unsigned int i=0; i<=slice_header.num_ref_idx_l0_active_minus1; i++) {
             unsigned int luma_weight_l0_flag = bits.ReadBit();
             if (luma_weight_l0_flag) {
-                /* slice_header.luma_weight_l0[i] = SignedGolomb( */ ReadGolomb(bits);
-                /* slice_header.luma_offset_l0[i] = SignedGolomb( */ ReadGolomb(bits);
+                /* slice_header.luma_weight_l0[i] = SignedGolomb( */ bits.ReadGolomb();
+                /* slice_header.luma_offset_l0[i] = SignedGolomb( */ bits.ReadGolomb();
             }
             if (sps->chroma_format_idc != 0) {
                 unsigned int chroma_weight_l0_flag = bits.ReadBit();
                 if (chroma_weight_l0_flag) {
                     for (unsigned int j=0; j<2; j++) {
-                        /* slice_header.chroma_weight_l0[i][j] = SignedGolomb( */ ReadGolomb(bits);
-                        /* slice_header.chroma_offset_l0[i][j] = SignedGolomb( */ ReadGolomb(bits);
+                        /* slice_header.chroma_weight_l0[i][j] = SignedGolomb( */ bits.ReadGolomb();
+                        /* slice_header.chroma_offset_l0[i][j] = SignedGolomb( */ bits.ReadGolomb();
                     }
                 }
             }
@@ -665,15 +675,15 @@ AP4_AvcFrameParser::ParseSliceHeader(const AP4_UI08*     data,
             for (unsigned int i=0; i<=slice_header.num_ref_idx_l1_active_minus1; i++) {
                 unsigned int luma_weight_l1_flag = bits.ReadBit();
                 if (luma_weight_l1_flag) {
-                    /* slice_header.luma_weight_l1[i] = SignedGolomb( */ ReadGolomb(bits);
-                    /* slice_header.luma_offset_l1[i] = SignedGolomb( */ ReadGolomb(bits);
+                    /* slice_header.luma_weight_l1[i] = SignedGolomb( */ bits.ReadGolomb();
+                    /* slice_header.luma_offset_l1[i] = SignedGolomb( */ bits.ReadGolomb();
                 }
                 if (sps->chroma_format_idc != 0) {
                     unsigned int chroma_weight_l1_flag = bits.ReadBit();
                     if (chroma_weight_l1_flag) {
                         for (unsigned int j=0; j<2; j++) {
-                            /* slice_header.chroma_weight_l1[i][j] = SignedGolomb( */ ReadGolomb(bits);
-                            /* slice_header.chroma_offset_l1[i][j] = SignedGolomb( */ ReadGolomb(bits);
+                            /* slice_header.chroma_weight_l1[i][j] = SignedGolomb( */ bits.ReadGolomb();
+                            /* slice_header.chroma_offset_l1[i][j] = SignedGolomb( */ bits.ReadGolomb();
                         }
                     }
                 }
@@ -691,44 +701,44 @@ AP4_AvcFrameParser::ParseSliceHeader(const AP4_UI08*     data,
             if (adaptive_ref_pic_marking_mode_flag) {
                 unsigned int memory_management_control_operation = 0;
                 do {
-                    memory_management_control_operation = ReadGolomb(bits);
+                    memory_management_control_operation = bits.ReadGolomb();
                     if (memory_management_control_operation == 1 || memory_management_control_operation == 3) {
-                        slice_header.difference_of_pic_nums_minus1 = ReadGolomb(bits);
+                        slice_header.difference_of_pic_nums_minus1 = bits.ReadGolomb();
                     }
                     if (memory_management_control_operation == 2) {
-                        slice_header.long_term_pic_num = ReadGolomb(bits);
+                        slice_header.long_term_pic_num = bits.ReadGolomb();
                     }
                     if (memory_management_control_operation == 3 || memory_management_control_operation == 6) {
-                        slice_header.long_term_frame_idx = ReadGolomb(bits);
+                        slice_header.long_term_frame_idx = bits.ReadGolomb();
                     }
                     if (memory_management_control_operation == 4) {
-                        slice_header.max_long_term_frame_idx_plus1 = ReadGolomb(bits);
+                        slice_header.max_long_term_frame_idx_plus1 = bits.ReadGolomb();
                     }
                 } while (memory_management_control_operation != 0);
             }
         }
     }
     if (pps->entropy_coding_mode_flag && slice_type != AP4_AVC_SLICE_TYPE_I && slice_type != AP4_AVC_SLICE_TYPE_SI) {
-        slice_header.cabac_init_idc = ReadGolomb(bits);
+        slice_header.cabac_init_idc = bits.ReadGolomb();
     }
-    slice_header.slice_qp_delta = ReadGolomb(bits);
+    slice_header.slice_qp_delta = bits.ReadGolomb();
     if (slice_type == AP4_AVC_SLICE_TYPE_SP || slice_type == AP4_AVC_SLICE_TYPE_SI) {
         if (slice_type == AP4_AVC_SLICE_TYPE_SP) {
             slice_header.sp_for_switch_flag = bits.ReadBit();
         }
-        slice_header.slice_qs_delta = SignedGolomb(ReadGolomb(bits));
+        slice_header.slice_qs_delta = bits.ReadSignedGolomb();
     }
     if (pps->deblocking_filter_control_present_flag) {
-        slice_header.disable_deblocking_filter_idc = ReadGolomb(bits);
+        slice_header.disable_deblocking_filter_idc = bits.ReadGolomb();
         if (slice_header.disable_deblocking_filter_idc != 1) {
-            slice_header.slice_alpha_c0_offset_div2 = SignedGolomb(ReadGolomb(bits));
-            slice_header.slice_beta_offset_div2     = SignedGolomb(ReadGolomb(bits));
+            slice_header.slice_alpha_c0_offset_div2 = bits.ReadSignedGolomb();
+            slice_header.slice_beta_offset_div2     = bits.ReadSignedGolomb();
         }
     }
     if (pps->num_slice_groups_minus1 > 0 &&
         pps->slice_group_map_type >= 3   &&
         pps->slice_group_map_type <= 5) {
-        slice_header.slice_group_change_cycle = ReadGolomb(bits);
+        slice_header.slice_group_change_cycle = bits.ReadGolomb();
     }
 
     /* compute the size */
@@ -1049,6 +1059,7 @@ AP4_AvcFrameParser::Feed(const AP4_UI08* nal_unit,
                                       nal_ref_idc,
                                       *slice_header);
             if (AP4_FAILED(result)) {
+                delete slice_header;
                 return AP4_ERROR_INVALID_FORMAT;
             }
             
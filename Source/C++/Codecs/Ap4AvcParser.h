@@ -293,6 +293,10 @@ public:
 
 private:
     // methods
+    AP4_Result ParseUnescapedSliceHeader(const AP4_DataBuffer& unescaped,
+                                         unsigned int          nal_unit_type,
+                                         unsigned int          nal_ref_idc,
+                                         AP4_AvcSliceHeader&   slice_header);
     bool SameFrame(unsigned int nal_unit_type_1, unsigned int nal_ref_idc_1, AP4_AvcSliceHeader& sh1,
                    unsigned int nal_unit_type_2, unsigned int nal_ref_idc_2, AP4_AvcSliceHeader& sh2);
     AP4_AvcSequenceParameterSet* GetSliceSPS(AP4_AvcSliceHeader& sh);
@@ -57,6 +57,12 @@
 #define DBG_PRINTF_7(_x0, _x1, _x2, _x3, _x4, _x5, _x6, _x7)
 #endif
 
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+// number of NAL unit bytes looked at before trying the whole NAL unit
+const unsigned int AP4_HEVC_SLICE_SEGMENT_HEADER_PARSE_SIZE = 512;
+
 /*----------------------------------------------------------------------
 |   AP4_HevcNalParser::NaluTypeName
 +---------------------------------------------------------------------*/
@@ -137,37 +143,6 @@ AP4_HevcNalParser::SliceTypeName(unsigned int slice_type)
     }
 }
 
-/*----------------------------------------------------------------------
-|   ReadGolomb
-+---------------------------------------------------------------------*/
-static unsigned int
-ReadGolomb(AP4_BitReader& bits)
-{
-    unsigned int leading_zeros = 0;
-    while (bits.ReadBit() == 0) {
-        leading_zeros++;
-        if (leading_zeros > 32) return 0; // safeguard
-    }
-    if (leading_zeros) {
-        return (1<<leading_zeros)-1+bits.ReadBits(leading_zeros);
-    } else {
-        return 0;
-    }
-}
-
-/*----------------------------------------------------------------------
-|   SignedGolomb
-+---------------------------------------------------------------------*/
-static int
-SignedGolomb(unsigned int code_num)
-{
-    if (code_num % 2) {
-        return (code_num+1)/2;
-    } else {
-        return -((int)code_num/2);
-    }
-}
-
 /*----------------------------------------------------------------------
 |   BitsNeeded
 +---------------------------------------------------------------------*/
@@ -200,17 +175,17 @@ scaling_list_data(AP4_BitReader& bits)
         for (unsigned int matrixId = 0; matrixId < ((sizeId == 3)?2:6); matrixId++) {
             unsigned int flag = bits.ReadBit(); // scaling_list_pred_mode_flag[ sizeId ][ matrixId ]
             if (!flag) {
-                ReadGolomb(bits); // scaling_list_pred_matrix_id_delta[ sizeId ][ matrixId ]
+                bits.ReadGolomb(); // scaling_list_pred_matrix_id_delta[ sizeId ][ matrixId ]
             } else {
                 // nextCoef = 8;
                 unsigned int coefNum = (1 << (4+(sizeId << 1)));
                 if (coefNum > 64) coefNum = 64;
                 if (sizeId > 1) {
-                    ReadGolomb(bits); // scaling_list_dc_coef_minus8[ sizeId − 2 ][ matrixId ]
+                    bits.ReadGolomb(); // scaling_list_dc_coef_minus8[ sizeId − 2 ][ matrixId ]
                     // nextCoef = scaling_list_dc_coef_minus8[ sizeId − 2 ][ matrixId ] + 8
                 }
                 for (unsigned i = 0; i < coefNum; i++) {
-                    ReadGolomb(bits); // scaling_list_delta_coef
+                    bits.ReadGolomb(); // scaling_list_delta_coef
                     // nextCoef = ( nextCoef + scaling_list_delta_coef + 256 ) % 256
                     // ScalingList[ sizeId ][ matrixId ][ i ] = nextCoef
                 }
@@ -237,10 +212,10 @@ parse_st_ref_pic_set(AP4_HevcShortTermRefPicSet*         rps,
     if (inter_ref_pic_set_prediction_flag) {
         unsigned int delta_idx_minus1 = 0;
         if (stRpsIdx == num_short_term_ref_pic_sets) {
-            delta_idx_minus1 = ReadGolomb(bits);
+            delta_idx_minus1 = bits.ReadGolomb();
         }
         /* delta_rps_sign = */ bits.ReadBit();
-        /* abs_delta_rps_minus1 = */ ReadGolomb(bits);
+        /* abs_delta_rps_minus1 = */ bits.ReadGolomb();
         if (delta_idx_minus1+1 > stRpsIdx) return AP4_ERROR_INVALID_FORMAT; // should not happen
         unsigned int RefRpsIdx = stRpsIdx - (delta_idx_minus1 + 1);
         unsigned int NumDeltaPocs = sps->short_term_ref_pic_sets[RefRpsIdx].num_negative_pics + sps->short_term_ref_pic_sets[RefRpsIdx].num_positive_pics;
@@ -251,17 +226,17 @@ parse_st_ref_pic_set(AP4_HevcShortTermRefPicSet*         rps,
             }
         }
     } else {
-        rps->num_negative_pics = ReadGolomb(bits);
-        rps->num_positive_pics = ReadGolomb(bits);
+        rps->num_negative_pics = bits.ReadGolomb();
+        rps->num_positive_pics = bits.ReadGolomb();
         if (rps->num_negative_pics > 16 || rps->num_positive_pics > 16) {
             return AP4_ERROR_INVALID_FORMAT;
         }
         for (unsigned int i=0; i<rps->num_negative_pics; i++) {
-            rps->delta_poc_s0_minus1[i] = ReadGolomb(bits);
+            rps->delta_poc_s0_minus1[i] = bits.ReadGolomb();
             rps->used_by_curr_pic_s0_flag[i] = bits.ReadBit();
         }
         for (unsigned i=0; i<rps->num_positive_pics; i++) {
-            rps->delta_poc_s1_minus1[i] = ReadGolomb(bits);
+            rps->delta_poc_s1_minus1[i] = bits.ReadGolomb();
             rps->used_by_curr_pic_s1_flag[i] = bits.ReadBit();
         }
     }
@@ -312,6 +287,32 @@ AP4_HevcSliceSegmentHeader::Parse(const AP4_UI08*                data,
                                   unsigned int                   nal_unit_type,
                                   AP4_HevcPictureParameterSet**  picture_parameter_sets,
                                   AP4_HevcSequenceParameterSet** sequence_parameter_sets) {
+    // slice segment headers are short, so start by unescaping and parsing only
+    // the start of the NAL unit, and only use all of it if the header didn't fit
+    if (data_size > AP4_HEVC_SLICE_SEGMENT_HEADER_PARSE_SIZE) {
+        AP4_DataBuffer unescaped(data, AP4_HEVC_SLICE_SEGMENT_HEADER_PARSE_SIZE);
+        AP4_NalParser::Unescape(unescaped);
+        AP4_Result result = ParseUnescaped(unescaped, nal_unit_type, picture_parameter_sets, sequence_parameter_sets);
+        
+        // the last byte may not have been unescaped like in the whole NAL unit
+        if (AP4_SUCCEEDED(result) && size+8 <= 8*unescaped.GetDataSize()) {
+            return AP4_SUCCESS;
+        }
+    }
+    
+    AP4_DataBuffer unescaped(data, data_size);
+    AP4_NalParser::Unescape(unescaped);
+    return ParseUnescaped(unescaped, nal_unit_type, picture_parameter_sets, sequence_parameter_sets);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_HevcSliceSegmentHeader::ParseUnescaped
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_HevcSliceSegmentHeader::ParseUnescaped(const AP4_DataBuffer&          unescaped,
+                                           unsigned int                   nal_unit_type,
+                                           AP4_HevcPictureParameterSet**  picture_parameter_sets,
+                                           AP4_HevcSequenceParameterSet** sequence_parameter_sets) {
     // initialize all members to 0
     AP4_SetMemory(this, 0, sizeof(*this));
     
@@ -319,15 +320,13 @@ AP4_HevcSliceSegmentHeader::Parse(const AP4_UI08*                data,
     pic_output_flag = 1;
 
     // start the parser
-    AP4_DataBuffer unescaped(data, data_size);
-    AP4_NalParser::Unescape(unescaped);
     AP4_BitReader bits(unescaped.GetData(), unescaped.GetDataSize());
 
     first_slice_segment_in_pic_flag = bits.ReadBit();
     if (nal_unit_type >= AP4_HEVC_NALU_TYPE_BLA_W_LP && nal_unit_type <= AP4_HEVC_NALU_TYPE_RSV_IRAP_VCL23) {
         no_output_of_prior_pics_flag = bits.ReadBit();
     }
-    slice_pic_parameter_set_id = ReadGolomb(bits);
+    slice_pic_parameter_set_id = bits.ReadGolomb();
     if (slice_pic_parameter_set_id > AP4_HEVC_PPS_MAX_ID) {
         return AP4_ERROR_INVALID_FORMAT;
     }
@@ -369,7 +368,7 @@ AP4_HevcSliceSegmentHeader::Parse(const AP4_UI08*                data,
             bits.ReadBits(pps->num_extra_slice_header_bits); // slice_reserved_flag[...]
         }
     
-        slice_type = ReadGolomb(bits);
+        slice_type = bits.ReadGolomb();
         if (slice_type != AP4_HEVC_SLICE_TYPE_B && slice_type != AP4_HEVC_SLICE_TYPE_P && slice_type != AP4_HEVC_SLICE_TYPE_I) {
             return AP4_ERROR_INVALID_FORMAT;
         }
@@ -402,9 +401,9 @@ AP4_HevcSliceSegmentHeader::Parse(const AP4_UI08*                data,
             
             if (sps->long_term_ref_pics_present_flag) {
                 if (sps->num_long_term_ref_pics_sps > 0) {
-                    num_long_term_sps = ReadGolomb(bits);
+                    num_long_term_sps = bits.ReadGolomb();
                 }
-                num_long_term_pics = ReadGolomb(bits);
+                num_long_term_pics = bits.ReadGolomb();
                 
                 if (num_long_term_sps > sps->num_long_term_ref_pics_sps) {
                     return AP4_ERROR_INVALID_FORMAT;
@@ -423,7 +422,7 @@ AP4_HevcSliceSegmentHeader::Parse(const AP4_UI08*                data,
                     }
                     unsigned int delta_poc_msb_present_flag /*[i]*/ = bits.ReadBit();
                     if (delta_poc_msb_present_flag /*[i]*/) {
-                        /* delta_poc_msb_cycle_lt[i] = */ ReadGolomb(bits);
+                        /* delta_poc_msb_cycle_lt[i] = */ bits.ReadGolomb();
                     }
                 }
             }
@@ -443,9 +442,9 @@ AP4_HevcSliceSegmentHeader::Parse(const AP4_UI08*                data,
             unsigned int num_ref_idx_l1_active_minus1 = pps->num_ref_idx_l1_default_active_minus1;
             unsigned int num_ref_idx_active_override_flag = bits.ReadBit();
             if (num_ref_idx_active_override_flag) {
-                num_ref_idx_l0_active_minus1 = ReadGolomb(bits);
+                num_ref_idx_l0_active_minus1 = bits.ReadGolomb();
                 if (slice_type == AP4_HEVC_SLICE_TYPE_B) {
-                    num_ref_idx_l1_active_minus1 = ReadGolomb(bits);
+                    num_ref_idx_l1_active_minus1 = bits.ReadGolomb();
                 }
             }
             if (num_ref_idx_l0_active_minus1 > 14 || num_ref_idx_l1_active_minus1 > 14) {
@@ -482,15 +481,15 @@ AP4_HevcSliceSegmentHeader::Parse(const AP4_UI08*                data,
                 }
                 if (( collocated_from_l0_flag && num_ref_idx_l0_active_minus1 > 0) ||
                     (!collocated_from_l0_flag && num_ref_idx_l1_active_minus1 > 0)) {
-                    /* collocated_ref_idx = */ ReadGolomb(bits);
+                    /* collocated_ref_idx = */ bits.ReadGolomb();
                 }
             }
             if ((pps->weighted_pred_flag   && slice_type == AP4_HEVC_SLICE_TYPE_P) ||
                 (pps->weighted_bipred_flag && slice_type == AP4_HEVC_SLICE_TYPE_B)) {
                 // +++ pred_weight_table()
-                /* luma_log2_weight_denom = */ ReadGolomb(bits);
+                /* luma_log2_weight_denom = */ bits.ReadGolomb();
                 if (sps->chroma_format_idc != 0) {
-                    /* delta_chroma_log2_weight_denom = */ /* SignedGolomb( */ ReadGolomb(bits) /*)*/;
+                    /* delta_chroma_log2_weight_denom = */ /* SignedGolomb( */ bits.ReadGolomb() /*)*/;
                 }
                 unsigned int luma_weight_l0_flag[16] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
                 for (unsigned int i=0; i<=num_ref_idx_l0_active_minus1; i++) {
@@ -504,13 +503,13 @@ AP4_HevcSliceSegmentHeader::Parse(const AP4_UI08*                data,
                 }
                 for (unsigned int i=0; i<=num_ref_idx_l0_active_minus1; i++) {
                     if (luma_weight_l0_flag[i]) {
-                        /* delta_luma_weight_l0[i] = */ /*SignedGolomb(*/ ReadGolomb(bits) /*)*/;
-                        /* luma_offset_l0[i] = */ /*SignedGolomb(*/ ReadGolomb(bits) /*)*/;
+                        /* delta_luma_weight_l0[i] = */ /*SignedGolomb(*/ bits.ReadGolomb() /*)*/;
+                        /* luma_offset_l0[i] = */ /*SignedGolomb(*/ bits.ReadGolomb() /*)*/;
                     }
                     if (chroma_weight_l0_flag[i]) {
                         for (unsigned int j=0; j<2; j++) {
-                            /* delta_chroma_weight_l0[i][j] = */ /*SignedGolomb(*/ ReadGolomb(bits) /*)*/;
-                            /* delta_chroma_offset_l0[i][j] = */ /*SignedGolomb(*/ ReadGolomb(bits) /*)*/;
+                            /* delta_chroma_weight_l0[i][j] = */ /*SignedGolomb(*/ bits.ReadGolomb() /*)*/;
+                            /* delta_chroma_offset_l0[i][j] = */ /*SignedGolomb(*/ bits.ReadGolomb() /*)*/;
                         }
                     }
                 }
@@ -527,25 +526,25 @@ AP4_HevcSliceSegmentHeader::Parse(const AP4_UI08*                data,
                     }
                     for (unsigned int i=0; i<=num_ref_idx_l1_active_minus1; i++) {
                         if (luma_weight_l1_flag[i]) {
-                            /* delta_luma_weight_l1[i] = */ /*SignedGolomb(*/ ReadGolomb(bits) /*)*/;
-                            /* luma_offset_l1[i] = */ /*SignedGolomb(*/ ReadGolomb(bits) /*)*/;
+                            /* delta_luma_weight_l1[i] = */ /*SignedGolomb(*/ bits.ReadGolomb() /*)*/;
+                            /* luma_offset_l1[i] = */ /*SignedGolomb(*/ bits.ReadGolomb() /*)*/;
                         }
                         if (chroma_weight_l1_flag[i]) {
                             for (unsigned int j=0; j<2; j++) {
-                                /* delta_chroma_weight_l1[i][j] = */ /*SignedGolomb(*/ ReadGolomb(bits) /*)*/;
-                                /* delta_chroma_offset_l1[i][j] = */ /*SignedGolomb(*/ ReadGolomb(bits) /*)*/;
+                                /* delta_chroma_weight_l1[i][j] = */ /*SignedGolomb(*/ bits.ReadGolomb() /*)*/;
+                                /* delta_chroma_offset_l1[i][j] = */ /*SignedGolomb(*/ bits.ReadGolomb() /*)*/;
                             }
                         }
                     }
                 }
                 // --- pred_weight_table()
             }
-            /* five_minus_max_num_merge_cand = */ ReadGolomb(bits);
+            /* five_minus_max_num_merge_cand = */ bits.ReadGolomb();
         }
-        /* slice_qp_delta = */ /*SignedGolomb(*/ ReadGolomb(bits) /*)*/;
+        /* slice_qp_delta = */ /*SignedGolomb(*/ bits.ReadGolomb() /*)*/;
         if (pps->pps_slice_chroma_qp_offsets_present_flag) {
-            /* slice_cb_qp_offset = */ /*SignedGolomb(*/ ReadGolomb(bits) /*)*/;
-            /* slice_cr_qp_offset = */ /*SignedGolomb(*/ ReadGolomb(bits) /*)*/;
+            /* slice_cb_qp_offset = */ /*SignedGolomb(*/ bits.ReadGolomb() /*)*/;
+            /* slice_cr_qp_offset = */ /*SignedGolomb(*/ bits.ReadGolomb() /*)*/;
         }
         unsigned int deblocking_filter_override_flag = 0;
         if (pps->deblocking_filter_override_enabled_flag) {
@@ -554,8 +553,8 @@ AP4_HevcSliceSegmentHeader::Parse(const AP4_UI08*                data,
         if (deblocking_filter_override_flag) {
             slice_deblocking_filter_disabled_flag = bits.ReadBit();
             if (!slice_deblocking_filter_disabled_flag) {
-                /* slice_beta_offset_div2 = */ /*SignedGolomb(*/ ReadGolomb(bits) /*)*/;
-                /* slice_tc_offset_div2   = */ /*SignedGolomb(*/ ReadGolomb(bits) /*)*/;
+                /* slice_beta_offset_div2 = */ /*SignedGolomb(*/ bits.ReadGolomb() /*)*/;
+                /* slice_tc_offset_div2   = */ /*SignedGolomb(*/ bits.ReadGolomb() /*)*/;
             }
         }
         if (pps->pps_loop_filter_across_slices_enabled_flag &&
@@ -565,9 +564,9 @@ AP4_HevcSliceSegmentHeader::Parse(const AP4_UI08*                data,
     }
 
     if (pps->tiles_enabled_flag || pps->entropy_coding_sync_enabled_flag) {
-        num_entry_point_offsets = ReadGolomb(bits);
+        num_entry_point_offsets = bits.ReadGolomb();
         if (num_entry_point_offsets > 0 ) {
-            offset_len_minus1 = ReadGolomb(bits);
+            offset_len_minus1 = bits.ReadGolomb();
             if (offset_len_minus1 > 31) {
                 return AP4_ERROR_INVALID_FORMAT;
             }
@@ -578,7 +577,7 @@ AP4_HevcSliceSegmentHeader::Parse(const AP4_UI08*                data,
     }
 
     if (pps->slice_segment_header_extension_present_flag) {
-        unsigned int slice_segment_header_extension_length = ReadGolomb(bits);
+        unsigned int slice_segment_header_extension_length = bits.ReadGolomb();
         for (unsigned int i=0; i<slice_segment_header_extension_length; i++) {
             bits.ReadBits(8); // slice_segment_header_extension_data_byte[i]
         }
@@ -714,11 +713,11 @@ AP4_HevcPictureParameterSet::Parse(const unsigned char* data, unsigned int data_
 
     bits.SkipBits(16); // NAL Unit Header
 
-    pps_pic_parameter_set_id = ReadGolomb(bits);
+    pps_pic_parameter_set_id = bits.ReadGolomb();
     if (pps_pic_parameter_set_id > AP4_HEVC_PPS_MAX_ID) {
         return AP4_ERROR_INVALID_FORMAT;
     }
-    pps_seq_parameter_set_id = ReadGolomb(bits);
+    pps_seq_parameter_set_id = bits.ReadGolomb();
     if (pps_seq_parameter_set_id > AP4_HEVC_SPS_MAX_ID) {
         return AP4_ERROR_INVALID_FORMAT;
     }
@@ -727,17 +726,17 @@ AP4_HevcPictureParameterSet::Parse(const unsigned char* data, unsigned int data_
     num_extra_slice_header_bits              = bits.ReadBits(3);
     sign_data_hiding_enabled_flag            = bits.ReadBit();
     cabac_init_present_flag                  = bits.ReadBit();
-    num_ref_idx_l0_default_active_minus1     = ReadGolomb(bits);
-    num_ref_idx_l1_default_active_minus1     = ReadGolomb(bits);
-    init_qp_minus26                          = SignedGolomb(ReadGolomb(bits));
+    num_ref_idx_l0_default_active_minus1     = bits.ReadGolomb();
+    num_ref_idx_l1_default_active_minus1     = bits.ReadGolomb();
+    init_qp_minus26                          = bits.ReadSignedGolomb();
     constrained_intra_pred_flag              = bits.ReadBit();
     transform_skip_enabled_flag              = bits.ReadBit();
     cu_qp_delta_enabled_flag                 = bits.ReadBit();
     if (cu_qp_delta_enabled_flag) {
-        diff_cu_qp_delta_depth = ReadGolomb(bits);
+        diff_cu_qp_delta_depth = bits.ReadGolomb();
     }
-    pps_cb_qp_offset                         = SignedGolomb(ReadGolomb(bits));
-    pps_cr_qp_offset                         = SignedGolomb(ReadGolomb(bits));
+    pps_cb_qp_offset                         = bits.ReadSignedGolomb();
+    pps_cr_qp_offset                         = bits.ReadSignedGolomb();
     pps_slice_chroma_qp_offsets_present_flag = bits.ReadBit();
     weighted_pred_flag                       = bits.ReadBit();
     weighted_bipred_flag                     = bits.ReadBit();
@@ -745,15 +744,15 @@ AP4_HevcPictureParameterSet::Parse(const unsigned char* data, unsigned int data_
     tiles_enabled_flag                       = bits.ReadBit();
     entropy_coding_sync_enabled_flag         = bits.ReadBit();
     if (tiles_enabled_flag) {
-        num_tile_columns_minus1 = ReadGolomb(bits);
-        num_tile_rows_minus1    = ReadGolomb(bits);
+        num_tile_columns_minus1 = bits.ReadGolomb();
+        num_tile_rows_minus1    = bits.ReadGolomb();
         uniform_spacing_flag    = bits.ReadBit();
         if (!uniform_spacing_flag) {
             for (unsigned int i=0; i<num_tile_columns_minus1; i++) {
-                ReadGolomb(bits); // column_width_minus1[i]
+                bits.ReadGolomb(); // column_width_minus1[i]
             }
             for (unsigned int i = 0; i < num_tile_rows_minus1; i++) {
-                ReadGolomb(bits); // row_height_minus1[i]
+                bits.ReadGolomb(); // row_height_minus1[i]
             }
         }
         loop_filter_across_tiles_enabled_flag = bits.ReadBit();
@@ -764,8 +763,8 @@ AP4_HevcPictureParameterSet::Parse(const unsigned char* data, unsigned int data_
         deblocking_filter_override_enabled_flag = bits.ReadBit();
         pps_deblocking_filter_disabled_flag     = bits.ReadBit();
         if (!pps_deblocking_filter_disabled_flag) {
-            pps_beta_offset_div2 = SignedGolomb(ReadGolomb(bits));
-            pps_tc_offset_div2   = SignedGolomb(ReadGolomb(bits));
+            pps_beta_offset_div2 = bits.ReadSignedGolomb();
+            pps_tc_offset_div2   = bits.ReadSignedGolomb();
         }
     }
     pps_scaling_list_data_present_flag = bits.ReadBit();
@@ -773,7 +772,7 @@ AP4_HevcPictureParameterSet::Parse(const unsigned char* data, unsigned int data_
         scaling_list_data(bits);
     }
     lists_modification_present_flag = bits.ReadBit();
-    log2_parallel_merge_level_minus2 = ReadGolomb(bits);
+    log2_parallel_merge_level_minus2 = bits.ReadGolomb();
     slice_segment_header_extension_present_flag = bits.ReadBit();
     
     return AP4_SUCCESS;
@@ -854,28 +853,28 @@ AP4_HevcSequenceParameterSet::Parse(const unsigned char* data, unsigned int data
         return result;
     }
     
-    sps_seq_parameter_set_id = ReadGolomb(bits);
+    sps_seq_parameter_set_id = bits.ReadGolomb();
     if (sps_seq_parameter_set_id > AP4_HEVC_SPS_MAX_ID) {
         return AP4_ERROR_INVALID_FORMAT;
     }
 
-    chroma_format_idc = ReadGolomb(bits);
+    chroma_format_idc = bits.ReadGolomb();
     if (chroma_format_idc == 3) {
         separate_colour_plane_flag = bits.ReadBit();
     }
-    pic_width_in_luma_samples  = ReadGolomb(bits);
-    pic_height_in_luma_samples = ReadGolomb(bits);
+    pic_width_in_luma_samples  = bits.ReadGolomb();
+    pic_height_in_luma_samples = bits.ReadGolomb();
     conformance_window_flag    = bits.ReadBit();
     
     if (conformance_window_flag) {
-        conf_win_left_offset    = ReadGolomb(bits);
-        conf_win_right_offset   = ReadGolomb(bits);
-        conf_win_top_offset     = ReadGolomb(bits);
-        conf_win_bottom_offset  = ReadGolomb(bits);
-    }
-    bit_depth_luma_minus8                    = ReadGolomb(bits);
-    bit_depth_chroma_minus8                  = ReadGolomb(bits);
-    log2_max_pic_order_cnt_lsb_minus4        = ReadGolomb(bits);
+        conf_win_left_offset    = bits.ReadGolomb();
+        conf_win_right_offset   = bits.ReadGolomb();
+        conf_win_top_offset     = bits.ReadGolomb();
+        conf_win_bottom_offset  = bits.ReadGolomb();
+    }
+    bit_depth_luma_minus8                    = bits.ReadGolomb();
+    bit_depth_chroma_minus8                  = bits.ReadGolomb();
+    log2_max_pic_order_cnt_lsb_minus4        = bits.ReadGolomb();
     if (log2_max_pic_order_cnt_lsb_minus4 > 16) {
         return AP4_ERROR_INVALID_FORMAT;
     }
@@ -883,16 +882,16 @@ AP4_HevcSequenceParameterSet::Parse(const unsigned char* data, unsigned int data
     for (unsigned int i = (sps_sub_layer_ordering_info_present_flag ? 0 : sps_max_sub_layers_minus1);
                       i <= sps_max_sub_layers_minus1;
                       i++) {
-        sps_max_dec_pic_buffering_minus1[i] = ReadGolomb(bits);
-        sps_max_num_reorder_pics[i]         = ReadGolomb(bits);
-        sps_max_latency_increase_plus1[i]   = ReadGolomb(bits);
-    }
-    log2_min_luma_coding_block_size_minus3   = ReadGolomb(bits);
-    log2_diff_max_min_luma_coding_block_size = ReadGolomb(bits);
-    log2_min_transform_block_size_minus2     = ReadGolomb(bits);
-    log2_diff_max_min_transform_block_size   = ReadGolomb(bits);
-    max_transform_hierarchy_depth_inter      = ReadGolomb(bits);
-    max_transform_hierarchy_depth_intra      = ReadGolomb(bits);
+        sps_max_dec_pic_buffering_minus1[i] = bits.ReadGolomb();
+        sps_max_num_reorder_pics[i]         = bits.ReadGolomb();
+        sps_max_latency_increase_plus1[i]   = bits.ReadGolomb();
+    }
+    log2_min_luma_coding_block_size_minus3   = bits.ReadGolomb();
+    log2_diff_max_min_luma_coding_block_size = bits.ReadGolomb();
+    log2_min_transform_block_size_minus2     = bits.ReadGolomb();
+    log2_diff_max_min_transform_block_size   = bits.ReadGolomb();
+    max_transform_hierarchy_depth_inter      = bits.ReadGolomb();
+    max_transform_hierarchy_depth_intra      = bits.ReadGolomb();
     scaling_list_enabled_flag                = bits.ReadBit();
     if (scaling_list_enabled_flag) {
         sps_scaling_list_data_present_flag = bits.ReadBit();
@@ -906,11 +905,11 @@ AP4_HevcSequenceParameterSet::Parse(const unsigned char* data, unsigned int data
     if (pcm_enabled_flag) {
         pcm_sample_bit_depth_luma_minus1 = bits.ReadBits(4);
         pcm_sample_bit_depth_chroma_minus1 = bits.ReadBits(4);
-        log2_min_pcm_luma_coding_block_size_minus3 = ReadGolomb(bits);
-        log2_diff_max_min_pcm_luma_coding_block_size = ReadGolomb(bits);
+        log2_min_pcm_luma_coding_block_size_minus3 = bits.ReadGolomb();
+        log2_diff_max_min_pcm_luma_coding_block_size = bits.ReadGolomb();
         pcm_loop_filter_disabled_flag = bits.ReadBit();
     }
-    num_short_term_ref_pic_sets = ReadGolomb(bits);
+    num_short_term_ref_pic_sets = bits.ReadGolomb();
     if (num_short_term_ref_pic_sets > AP4_HEVC_SPS_MAX_RPS) {
         return AP4_ERROR_INVALID_FORMAT;
     }
@@ -920,7 +919,7 @@ AP4_HevcSequenceParameterSet::Parse(const unsigned char* data, unsigned int data
     }
     long_term_ref_pics_present_flag = bits.ReadBit();
     if (long_term_ref_pics_present_flag) {
-        num_long_term_ref_pics_sps = ReadGolomb(bits);
+        num_long_term_ref_pics_sps = bits.ReadGolomb();
         for (unsigned int i=0; i<num_long_term_ref_pics_sps; i++) {
             /* lt_ref_pic_poc_lsb_sps[i] = */ bits.ReadBits(log2_max_pic_order_cnt_lsb_minus4 + 4);
             /* used_by_curr_pic_lt_sps_flag[i] = */ bits.ReadBit();
@@ -992,12 +991,12 @@ AP4_HevcVideoParameterSet::Parse(const unsigned char* data, unsigned int data_si
     for (unsigned int i = (vps_sub_layer_ordering_info_present_flag ? 0 : vps_max_sub_layers_minus1);
                       i <= vps_max_sub_layers_minus1;
                       i++) {
-        vps_max_dec_pic_buffering_minus1[i] = ReadGolomb(bits);
-        vps_max_num_reorder_pics[i]         = ReadGolomb(bits);
-        vps_max_latency_increase_plus1[i]   = ReadGolomb(bits);
+        vps_max_dec_pic_buffering_minus1[i] = bits.ReadGolomb();
+        vps_max_num_reorder_pics[i]         = bits.ReadGolomb();
+        vps_max_latency_increase_plus1[i]   = bits.ReadGolomb();
     }
     vps_max_layer_id          = bits.ReadBits(6);
-    vps_num_layer_sets_minus1 = ReadGolomb(bits);
+    vps_num_layer_sets_minus1 = bits.ReadGolomb();
     for (unsigned int i = 1; i <= vps_num_layer_sets_minus1; i++) {
         for (unsigned int j = 0; j <= vps_max_layer_id; j++) {
             bits.ReadBit();
@@ -1009,7 +1008,7 @@ AP4_HevcVideoParameterSet::Parse(const unsigned char* data, unsigned int data_si
         vps_time_scale                      = bits.ReadBits(32);
         vps_poc_proportional_to_timing_flag = bits.ReadBit();
         if (vps_poc_proportional_to_timing_flag) {
-            vps_num_ticks_poc_diff_one_minus1 = ReadGolomb(bits);
+            vps_num_ticks_poc_diff_one_minus1 = bits.ReadGolomb();
         }
     }
     
@@ -308,6 +308,10 @@ struct AP4_HevcSliceSegmentHeader {
                      unsigned int                   nal_unit_type,
                      AP4_HevcPictureParameterSet**  picture_parameter_sets,
                      AP4_HevcSequenceParameterSet** sequence_parameter_sets);
+    AP4_Result ParseUnescaped(const AP4_DataBuffer&          unescaped,
+                              unsigned int                   nal_unit_type,
+                              AP4_HevcPictureParameterSet**  picture_parameter_sets,
+                              AP4_HevcSequenceParameterSet** sequence_parameter_sets);
 
     unsigned int size; // size of the parsed data
     
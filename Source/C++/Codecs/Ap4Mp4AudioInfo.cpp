@@ -29,7 +29,7 @@
 /*----------------------------------------------------------------------
 |   includes
 +---------------------------------------------------------------------*/
-#include "Ap4BitStream.h"
+#include "Ap4Utils.h"
 #include "Ap4Mp4AudioInfo.h"
 #include "Ap4DataBuffer.h"
 #include "Ap4SampleDescription.h"
@@ -53,28 +53,18 @@ class AP4_Mp4AudioDsiParser
 {
 public:
     AP4_Mp4AudioDsiParser(const AP4_UI08* data, AP4_Size data_size) :
-        m_Data(data, data_size), 
-        m_Position(0) {}
+        m_Bits(data, data_size), 
+        m_DataSize(data_size) {}
         
-    AP4_Size BitsLeft() { return 8*m_Data.GetDataSize()-m_Position; }
-    AP4_UI32 ReadBits(unsigned int n) {
-        AP4_UI32 result = 0;
-        const AP4_UI08* data = m_Data.GetData();
-        while (n) {
-            unsigned int bits_avail = 8-(m_Position%8);
-            unsigned int chunk_size = bits_avail >= n ? n : bits_avail;
-            unsigned int chunk_bits = (((unsigned int)(data[m_Position/8]))>>(bits_avail-chunk_size))&((1<<chunk_size)-1);
-            result = (result << chunk_size) | chunk_bits;
-            n -= chunk_size;
-            m_Position += chunk_size;
-        }
-    
-        return result;
+    AP4_Size BitsLeft() { 
+        AP4_Size bits_read = m_Bits.GetBitsRead();
+        return bits_read < 8*m_DataSize ? 8*m_DataSize-bits_read : 0;
     }
+    AP4_UI32 ReadBits(unsigned int n) { return m_Bits.ReadBits(n); }
     
 private:
-    AP4_DataBuffer m_Data;
-    unsigned int   m_Position;
+    AP4_BitReader m_Bits;
+    AP4_Size      m_DataSize;
 };
 
 /*----------------------------------------------------------------------
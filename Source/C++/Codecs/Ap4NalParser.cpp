@@ -32,6 +32,59 @@
 #include "Ap4AvcParser.h"
 #include "Ap4Utils.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AP4_NAL_PARSER_HAVE_SSE2
+#include <emmintrin.h>
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && defined(__GNUC__)
+#define AP4_NAL_PARSER_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+/*----------------------------------------------------------------------
+|   AP4_NalParser_FindZeroPair
+|
+|   Returns the position of the first pair of 0 bytes at or after start,
+|   or data_size if there is none.
++---------------------------------------------------------------------*/
+static AP4_Size
+AP4_NalParser_FindZeroPair(const AP4_UI08* data, AP4_Size start, AP4_Size data_size)
+{
+    AP4_Size i = start;
+#if defined(AP4_NAL_PARSER_HAVE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i+17 <= data_size; i += 16) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data+i)),   zero);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data+i+1)), zero);
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(a, b));
+        if (mask) {
+            while ((mask & 1) == 0) {
+                mask >>= 1;
+                ++i;
+            }
+            return i;
+        }
+    }
+#elif defined(AP4_NAL_PARSER_HAVE_NEON)
+    for (; i+17 <= data_size; i += 16) {
+        uint8x16_t a = vceqq_u8(vld1q_u8(data+i),   vdupq_n_u8(0));
+        uint8x16_t b = vceqq_u8(vld1q_u8(data+i+1), vdupq_n_u8(0));
+        uint64x2_t m = vreinterpretq_u64_u8(vandq_u8(a, b));
+        if (vgetq_lane_u64(m, 0) | vgetq_lane_u64(m, 1)) break;
+    }
+#endif
+    // a pair can't start at i or i+1 if the byte at i+1 is not 0
+    while (i+1 < data_size) {
+        if (data[i+1]) {
+            i += 2;
+        } else if (data[i] == 0) {
+            return i;
+        } else {
+            ++i;
+        }
+    }
+    return data_size;
+}
+
 /*----------------------------------------------------------------------
 |   AP4_NalParser::AP4_NalParser
 +---------------------------------------------------------------------*/
@@ -67,6 +120,40 @@ AP4_NalParser::Unescape(AP4_DataBuffer &data)
     data.SetDataSize(in_size-bytes_removed);
 }
 
+/*----------------------------------------------------------------------
+|   AP4_NalParser::Escape
++---------------------------------------------------------------------*/
+void
+AP4_NalParser::Escape(const AP4_UI08* data, AP4_Size data_size, AP4_DataBuffer& output)
+{
+    // at most one emulation prevention byte can be inserted for every two bytes
+    AP4_Size output_start = output.GetDataSize();
+    if (AP4_FAILED(output.Reserve(output_start+data_size+data_size/2+1))) return;
+    AP4_UI08* out = output.UseData()+output_start;
+    
+    // an emulation prevention byte is needed before any byte <= 3 that
+    // follows a pair of 0 bytes, so only look at the pairs of 0 bytes
+    AP4_Size copied = 0;
+    AP4_Size i      = 0;
+    for (;;) {
+        AP4_Size next = AP4_NalParser_FindZeroPair(data, i, data_size)+2;
+        if (next >= data_size) break;
+        if (data[next] <= 3) {
+            AP4_CopyMemory(out, data+copied, next-copied);
+            out += next-copied;
+            *out++ = 3;
+            copied = next;
+            i      = next;
+        } else {
+            i = next+1;
+        }
+    }
+    AP4_CopyMemory(out, data+copied, data_size-copied);
+    out += data_size-copied;
+    
+    output.SetDataSize((AP4_Size)(out-output.GetData()));
+}
+
 /*----------------------------------------------------------------------
 |   AP4_NalParser::Feed
 +---------------------------------------------------------------------*/
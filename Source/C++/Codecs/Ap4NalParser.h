@@ -43,6 +43,11 @@ class AP4_NalParser {
 public:
     // class methods
     static void Unescape(AP4_DataBuffer& data);
+    /**
+     * Insert emulation prevention bytes in a NAL unit payload, and append
+     * the escaped payload to an output buffer.
+     */
+    static void Escape(const AP4_UI08* data, AP4_Size data_size, AP4_DataBuffer& output);
     
     AP4_NalParser();
     
@@ -230,6 +230,7 @@
 #include "Ap4Results.h"
 #include "Ap4Debug.h"
 #include "Ap4Utils.h"
+#include "Ap4Threads.h"
 #include "Ap4DynamicCast.h"
 #include "Ap4FileByteStream.h"
 #include "Ap4Movie.h"
@@ -237,7 +238,11 @@
 #include "Ap4File.h"
 #include "Ap4FileWriter.h"
 #include "Ap4FileCopier.h"
+#include "Ap4FileUpdater.h"
+#include "Ap4Fragmenter.h"
+#include "Ap4BatchRunner.h"
 #include "Ap4HintTrackReader.h"
+#include "Ap4Instrumentation.h"
 #include "Ap4Processor.h"
 #include "Ap4MetaData.h"
 #include "Ap4AtomFactory.h"
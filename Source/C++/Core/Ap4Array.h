@@ -40,6 +40,9 @@
 #if defined(APT_CONFIG_HAVE_NEW_H)
 #include <new>
 #endif
+#if defined(AP4_CONFIG_HAVE_STRING_H)
+#include <string.h>
+#endif
 #include "Ap4Types.h"
 #include "Ap4Results.h"
 
@@ -48,6 +51,38 @@
 +---------------------------------------------------------------------*/
 const int AP4_ARRAY_INITIAL_COUNT = 64;
 
+/*----------------------------------------------------------------------
+|   AP4_ArrayItemTraits
++---------------------------------------------------------------------*/
+/**
+ * When IS_RELOCATABLE is true for a type, the items of an array of that
+ * type are moved with a plain memory copy when the array grows, instead
+ * of being copy-constructed and destroyed one by one. This is the case
+ * for the built-in types and pointers, and can be declared, with
+ * AP4_DECLARE_RELOCATABLE_TYPE, for classes that do not keep pointers to
+ * themselves nor register their address anywhere.
+ */
+template <typename T> struct AP4_ArrayItemTraits     { enum { IS_RELOCATABLE = 0 }; };
+template <typename T> struct AP4_ArrayItemTraits<T*> { enum { IS_RELOCATABLE = 1 }; };
+
+#define AP4_DECLARE_RELOCATABLE_TYPE(_type) \
+template <> struct AP4_ArrayItemTraits<_type> { enum { IS_RELOCATABLE = 1 }; }
+
+AP4_DECLARE_RELOCATABLE_TYPE(bool);
+AP4_DECLARE_RELOCATABLE_TYPE(char);
+AP4_DECLARE_RELOCATABLE_TYPE(signed char);
+AP4_DECLARE_RELOCATABLE_TYPE(unsigned char);
+AP4_DECLARE_RELOCATABLE_TYPE(short);
+AP4_DECLARE_RELOCATABLE_TYPE(unsigned short);
+AP4_DECLARE_RELOCATABLE_TYPE(int);
+AP4_DECLARE_RELOCATABLE_TYPE(unsigned int);
+AP4_DECLARE_RELOCATABLE_TYPE(long);
+AP4_DECLARE_RELOCATABLE_TYPE(unsigned long);
+AP4_DECLARE_RELOCATABLE_TYPE(long long);
+AP4_DECLARE_RELOCATABLE_TYPE(unsigned long long);
+AP4_DECLARE_RELOCATABLE_TYPE(float);
+AP4_DECLARE_RELOCATABLE_TYPE(double);
+
 /*----------------------------------------------------------------------
 |   AP4_Array
 +---------------------------------------------------------------------*/
@@ -174,9 +209,20 @@ AP4_Array<T>::EnsureCapacity(AP4_Cardinal count)
         return AP4_ERROR_OUT_OF_MEMORY;
     }
     if (m_ItemCount && m_Items) {
-        for (unsigned int i=0; i<m_ItemCount; i++) {
-            new ((void*)&new_items[i]) T(m_Items[i]);
-            m_Items[i].~T();
+        if (AP4_ArrayItemTraits<T>::IS_RELOCATABLE) {
+            // move the items with a plain memory copy
+#if defined(AP4_CONFIG_HAVE_STRING_H)
+            memcpy((void*)new_items, (const void*)m_Items, m_ItemCount*sizeof(T));
+#else
+            const unsigned char* src = (const unsigned char*)(const void*)m_Items;
+            unsigned char*       dst = (unsigned char*)(void*)new_items;
+            for (unsigned int i=0; i<m_ItemCount*sizeof(T); i++) dst[i] = src[i];
+#endif
+        } else {
+            for (unsigned int i=0; i<m_ItemCount; i++) {
+                new ((void*)&new_items[i]) T(m_Items[i]);
+                m_Items[i].~T();
+            }
         }
         ::operator delete((void*)m_Items);
     }
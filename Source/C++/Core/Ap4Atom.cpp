@@ -41,6 +41,7 @@
 |   constants
 +---------------------------------------------------------------------*/
 static const unsigned int AP4_ATOM_MAX_CLONE_SIZE = 1048576; // 1 meg
+static const unsigned int AP4_ATOM_MAX_BUFFERED_WRITE_SIZE = 16*1048576;
 static const unsigned int AP4_UNKNOWN_ATOM_MAX_LOCAL_PAYLOAD_SIZE = 4096;
 
 /*----------------------------------------------------------------------
@@ -181,31 +182,27 @@ AP4_Atom::GetHeaderSize() const
 AP4_Result
 AP4_Atom::WriteHeader(AP4_ByteStream& stream)
 {
-    AP4_Result result;
-
-    // write the size
-    result = stream.WriteUI32(m_Size32);
-    if (AP4_FAILED(result)) return result;
+    // the header is assembled in a local buffer and written in one call
+    AP4_UI08     header[AP4_FULL_ATOM_HEADER_SIZE_64];
+    unsigned int header_size = 8;
 
-    // write the type
-    result = stream.WriteUI32(m_Type);
-    if (AP4_FAILED(result)) return result;
+    // the size and type
+    AP4_BytesFromUInt32BE(&header[0], m_Size32);
+    AP4_BytesFromUInt32BE(&header[4], m_Type);
 
     // handle 64-bit sizes
     if (m_Size32 == 1) {
-        result = stream.WriteUI64(m_Size64);
-        if (AP4_FAILED(result)) return result;
+        AP4_BytesFromUInt64BE(&header[8], m_Size64);
+        header_size += 8;
     }
 
     // for full atoms, write version and flags
     if (m_IsFull) {
-        result = stream.WriteUI08(m_Version);
-        if (AP4_FAILED(result)) return result;
-        result = stream.WriteUI24(m_Flags);
-        if (AP4_FAILED(result)) return result;
+        AP4_BytesFromUInt32BE(&header[header_size], (((AP4_UI32)m_Version)<<24) | (m_Flags&0xFFFFFF));
+        header_size += 4;
     }
 
-    return AP4_SUCCESS;
+    return stream.Write(header, header_size);
 }
 
 /*----------------------------------------------------------------------
@@ -253,6 +250,29 @@ AP4_Atom::Write(AP4_ByteStream& stream)
     return AP4_SUCCESS;
 }
 
+/*----------------------------------------------------------------------
+|   AP4_Atom::WriteBuffered
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Atom::WriteBuffered(AP4_ByteStream& stream)
+{
+    // atoms that are too large are written directly
+    AP4_LargeSize size = GetSize();
+    if (size > AP4_ATOM_MAX_BUFFERED_WRITE_SIZE) return Write(stream);
+
+    // serialize to a memory buffer large enough for the whole atom
+    AP4_DataBuffer buffer;
+    AP4_Result result = buffer.Reserve((AP4_Size)size);
+    if (AP4_FAILED(result)) return result;
+    AP4_MemoryByteStream* mbs = new AP4_MemoryByteStream(buffer);
+    result = Write(*mbs);
+    mbs->Release();
+    if (AP4_FAILED(result)) return result;
+
+    // write the buffer in one call
+    return stream.Write(buffer.GetData(), buffer.GetDataSize());
+}
+
 /*----------------------------------------------------------------------
 |   AP4_Atom::Inspect
 +---------------------------------------------------------------------*/
@@ -512,6 +532,21 @@ AP4_AtomParent::~AP4_AtomParent()
     m_Children.DeleteReferences();
 }
 
+/*----------------------------------------------------------------------
+|   AP4_AtomParent::EndChanges
++---------------------------------------------------------------------*/
+void
+AP4_AtomParent::EndChanges()
+{
+    if (m_ChangeDepth == 0) return;
+    if (--m_ChangeDepth == 0 && m_ChangesDeferred) {
+        m_ChangesDeferred = false;
+        
+        // apply all the deferred changes at once
+        OnChildChanged(NULL);
+    }
+}
+
 /*----------------------------------------------------------------------
 |   AP4_AtomParent::AddChild
 +---------------------------------------------------------------------*/
@@ -546,6 +581,7 @@ AP4_AtomParent::AddChild(AP4_Atom* child, int position)
 
     // notify the child of its parent
     child->SetParent(this);
+    m_ChildIndexValid = false;
 
     // get a chance to update
     OnChildAdded(child);
@@ -568,6 +604,7 @@ AP4_AtomParent::RemoveChild(AP4_Atom* child)
 
     // notify that child that it is orphaned
     child->SetParent(NULL);
+    m_ChildIndexValid = false;
 
     // get a chance to update
     OnChildRemoved(child);
@@ -601,6 +638,30 @@ AP4_AtomParent::DeleteChild(AP4_Atom::Type type, AP4_Ordinal index /* = 0 */)
 AP4_Atom*
 AP4_AtomParent::GetChild(AP4_Atom::Type type, AP4_Ordinal index /* = 0 */) const
 {
+    if (m_ChildIndexEnabled) {
+        // children may have been added directly to the list by subclasses
+        if (!m_ChildIndexValid || m_ChildIndex.ItemCount() != m_Children.ItemCount()) {
+            BuildChildIndex();
+        }
+        
+        // find the first child of that type
+        unsigned int first = 0;
+        unsigned int last  = m_ChildIndex.ItemCount();
+        while (first < last) {
+            unsigned int middle = (first+last)/2;
+            if (m_ChildIndex[middle].m_Type < type) {
+                first = middle+1;
+            } else {
+                last = middle;
+            }
+        }
+        first += index;
+        if (first < m_ChildIndex.ItemCount() && m_ChildIndex[first].m_Type == type) {
+            return m_ChildIndex[first].m_Atom;
+        }
+        return NULL;
+    }
+    
     AP4_Atom* atom;
     AP4_Result result = m_Children.Find(AP4_AtomFinder(type, index), atom);
     if (AP4_SUCCEEDED(result)) {
@@ -631,6 +692,32 @@ AP4_AtomParent::GetChild(const AP4_UI08* uuid, AP4_Ordinal index /* = 0 */) cons
     return NULL;
 }
 
+/*----------------------------------------------------------------------
+|   AP4_AtomParent_FindOrCreateChild
++---------------------------------------------------------------------*/
+static AP4_Atom*
+AP4_AtomParent_FindOrCreateChild(AP4_AtomParent* parent,
+                                 AP4_Atom::Type  type,
+                                 AP4_Ordinal     index,
+                                 bool            auto_create,
+                                 bool            auto_create_full)
+{
+    // look for this atom in the current list
+    AP4_Atom* atom = parent->GetChild(type, index);
+    if (atom == NULL) {
+        // not found
+        if (auto_create && (index == 0)) {
+            if (auto_create_full) {
+                atom = new AP4_ContainerAtom(type, (AP4_UI32)0, (AP4_UI32)0);
+            } else {
+                atom = new AP4_ContainerAtom(type);
+            }
+            parent->AddChild(atom);
+        }
+    }
+    return atom;
+}
+
 /*----------------------------------------------------------------------
 |   AP4_AtomParent::FindChild
 +---------------------------------------------------------------------*/
@@ -643,54 +730,18 @@ AP4_AtomParent::FindChild(const char* path,
     AP4_AtomParent* parent = this;
 
     // walk the path
-    while (path[0] && path[1] && path[2] && path[3]) {
-        // we have 4 valid chars
-        const char* tail;
-        int         index = 0;
-        if (path[4] == '\0') {
-            tail = NULL;
-        } else if (path[4] == '/') {
-            // separator
-            tail = &path[5];
-        } else if (path[4] == '[') {
-            const char* x = &path[5];
-            while (*x >= '0' && *x <= '9') {
-                index = 10*index+(*x++ - '0');
-            }
-            if (x[0] == ']') {
-                if (x[1] == '\0') {
-                    tail = NULL;
-                } else {
-                    tail = x+2;
-                }
-            } else {
-                // malformed path
-                return NULL;
-            }
-        } else {
+    while (path) {
+        AP4_Atom::Type type;
+        AP4_Ordinal    index;
+        if (AP4_FAILED(AP4_AtomPath::ParseElement(path, type, index))) {
             // malformed path
             return NULL;
         }
 
-        // look for this atom in the current list
-        AP4_Atom::Type type = AP4_ATOM_TYPE(path[0], path[1], path[2], path[3]); 
-        AP4_Atom* atom = parent->GetChild(type, index);
-        if (atom == NULL) {
-            // not found
-            if (auto_create && (index == 0)) {
-                if (auto_create_full) {
-                    atom = new AP4_ContainerAtom(type, (AP4_UI32)0, (AP4_UI32)0);
-                } else {
-                    atom = new AP4_ContainerAtom(type);
-                }
-                parent->AddChild(atom);
-            } else {
-                return NULL;
-            }
-        }
+        AP4_Atom* atom = AP4_AtomParent_FindOrCreateChild(parent, type, index, auto_create, auto_create_full);
+        if (atom == NULL) return NULL;
 
-        if (tail) {
-            path = tail;
+        if (path) {
             // if this atom is an atom parent, recurse
             parent = AP4_DYNAMIC_CAST(AP4_ContainerAtom, atom);
             if (parent == NULL) return NULL;
@@ -703,6 +754,131 @@ AP4_AtomParent::FindChild(const char* path,
     return NULL;
 }
 
+/*----------------------------------------------------------------------
+|   AP4_AtomParent::FindChild
++---------------------------------------------------------------------*/
+AP4_Atom*
+AP4_AtomParent::FindChild(const AP4_AtomPath& path,
+                          bool                auto_create,
+                          bool                auto_create_full)
+{
+    if (!path.IsValid()) return NULL;
+
+    // walk the path
+    AP4_AtomParent* parent = this;
+    AP4_Atom*       atom   = NULL;
+    for (unsigned int i=0; i<path.GetElementCount(); i++) {
+        if (i) {
+            // if the previous atom is an atom parent, recurse
+            parent = AP4_DYNAMIC_CAST(AP4_ContainerAtom, atom);
+            if (parent == NULL) return NULL;
+        }
+        atom = AP4_AtomParent_FindOrCreateChild(parent,
+                                                path.GetType(i),
+                                                path.GetIndex(i),
+                                                auto_create,
+                                                auto_create_full);
+        if (atom == NULL) return NULL;
+    }
+
+    return atom;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_AtomParent::EnableChildIndex
++---------------------------------------------------------------------*/
+void
+AP4_AtomParent::EnableChildIndex()
+{
+    m_ChildIndexEnabled = true;
+    m_ChildIndexValid   = false;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_AtomParent::BuildChildIndex
++---------------------------------------------------------------------*/
+void
+AP4_AtomParent::BuildChildIndex() const
+{
+    // list all the children, then sort them by type, keeping the children
+    // of the same type in order (insertion sort, since there are usually
+    // only a few different types, already grouped together)
+    m_ChildIndex.SetItemCount(0);
+    m_ChildIndex.EnsureCapacity(m_Children.ItemCount());
+    for (AP4_List<AP4_Atom>::Item* item = m_Children.FirstItem();
+                                   item;
+                                   item = item->GetNext()) {
+        ChildIndexEntry entry = { item->GetData()->GetType(), item->GetData() };
+        unsigned int i = m_ChildIndex.ItemCount();
+        m_ChildIndex.Append(entry);
+        for (; i && m_ChildIndex[i-1].m_Type > entry.m_Type; i--) {
+            m_ChildIndex[i] = m_ChildIndex[i-1];
+        }
+        m_ChildIndex[i] = entry;
+    }
+    m_ChildIndexValid = true;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_AtomPath::ParseElement
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_AtomPath::ParseElement(const char*&    path, 
+                           AP4_Atom::Type& type, 
+                           AP4_Ordinal&    index)
+{
+    // we need 4 valid chars
+    if (!(path[0] && path[1] && path[2] && path[3])) {
+        return AP4_ERROR_INVALID_PARAMETERS;
+    }
+    type  = AP4_ATOM_TYPE(path[0], path[1], path[2], path[3]);
+    index = 0;
+    
+    if (path[4] == '\0') {
+        path = NULL;
+    } else if (path[4] == '/') {
+        // separator
+        path = &path[5];
+    } else if (path[4] == '[') {
+        const char* x = &path[5];
+        while (*x >= '0' && *x <= '9') {
+            index = 10*index+(*x++ - '0');
+        }
+        if (x[0] == ']') {
+            if (x[1] == '\0') {
+                path = NULL;
+            } else {
+                path = x+2;
+            }
+        } else {
+            // malformed path
+            return AP4_ERROR_INVALID_PARAMETERS;
+        }
+    } else {
+        // malformed path
+        return AP4_ERROR_INVALID_PARAMETERS;
+    }
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_AtomPath::AP4_AtomPath
++---------------------------------------------------------------------*/
+AP4_AtomPath::AP4_AtomPath(const char* path) :
+    m_Valid(true)
+{
+    while (path) {
+        Element element;
+        if (AP4_FAILED(ParseElement(path, element.m_Type, element.m_Index))) {
+            m_Valid = false;
+            m_Elements.Clear();
+            return;
+        }
+        m_Elements.Append(element);
+    }
+}
+
 /*----------------------------------------------------------------------
 |   AP4_AtomParent::CopyChildren
 +---------------------------------------------------------------------*/
@@ -67,6 +67,7 @@ const AP4_UI32 AP4_ATOM_MAX_URI_SIZE        = 512;
 |   forward references
 +---------------------------------------------------------------------*/
 class AP4_AtomParent;
+class AP4_AtomPath;
 
 /*----------------------------------------------------------------------
 |   AP4_AtomInspector
@@ -253,6 +254,13 @@ public:
     AP4_UI64           GetSize64() const { return m_Size64; }
     void               SetSize64(AP4_UI64 size) { m_Size64 = size; }
     virtual AP4_Result Write(AP4_ByteStream& stream);
+    /**
+     * Serialize the atom into a memory buffer of the atom's size, then
+     * write that buffer to the stream in a single call. This is faster
+     * than Write() for atoms made of many small fields, like moof atoms,
+     * when each write to the stream is costly.
+     */
+    AP4_Result         WriteBuffered(AP4_ByteStream& stream);
     virtual AP4_Result WriteHeader(AP4_ByteStream& stream);
     virtual AP4_Result WriteFields(AP4_ByteStream& stream) = 0;
     virtual AP4_Result Inspect(AP4_AtomInspector& inspector);
@@ -302,6 +310,11 @@ public:
     AP4_IMPLEMENT_DYNAMIC_CAST(AP4_AtomParent)
 
     // base methods
+    AP4_AtomParent() : 
+        m_ChangeDepth(0), 
+        m_ChangesDeferred(false),
+        m_ChildIndexEnabled(false),
+        m_ChildIndexValid(false) {}
     virtual ~AP4_AtomParent();
     AP4_List<AP4_Atom>& GetChildren() { return m_Children; }
     AP4_Result          CopyChildren(AP4_AtomParent& destination) const;
@@ -313,6 +326,34 @@ public:
     virtual AP4_Atom*   FindChild(const char* path, 
                                   bool        auto_create = false,
                                   bool        auto_create_full = false);
+    AP4_Atom*           FindChild(const AP4_AtomPath& path,
+                                  bool                auto_create = false,
+                                  bool                auto_create_full = false);
+
+    /**
+     * Maintain an index of the children by type, so that GetChild() by
+     * type does a binary search instead of a scan of the children list.
+     * This is worth it for parents with many children that are looked up
+     * repeatedly. The index is rebuilt lazily after children are added or
+     * removed, so the type of a child must not change while it is attached.
+     */
+    void                EnableChildIndex();
+
+    /**
+     * Start a batch of changes to the children of this parent (or to
+     * their descendants). Until the matching call to EndChanges(), changes
+     * are not propagated to this parent's size and to its ancestors, so
+     * that building or updating a large subtree does not recompute the
+     * sizes up the chain for each individual change.
+     * Batches can be nested. The sizes must not be relied upon, and the
+     * atoms must not be written, until the outermost batch has ended.
+     */
+    void BeginChanges() { ++m_ChangeDepth; }
+    /**
+     * End a batch of changes started with BeginChanges(). When the
+     * outermost batch ends, the deferred changes are applied at once.
+     */
+    void EndChanges();
 
     // methods designed to be overridden
     virtual void OnChildChanged(AP4_Atom* /* child */) {}
@@ -320,8 +361,74 @@ public:
     virtual void OnChildRemoved(AP4_Atom* /* child */) {}
 
 protected:
+    // methods
+    /**
+     * Called by the OnChildXXX() overrides before updating sizes: returns
+     * true if a batch of changes is in progress, in which case the update
+     * is deferred to the end of the batch.
+     */
+    bool DeferChange() {
+        if (m_ChangeDepth == 0) return false;
+        m_ChangesDeferred = true;
+        return true;
+    }
+
+    // types
+    struct ChildIndexEntry {
+        AP4_Atom::Type m_Type;
+        AP4_Atom*      m_Atom;
+    };
+
+    // methods
+    void BuildChildIndex() const;
+
+    // members
+    AP4_List<AP4_Atom>                 m_Children;
+    unsigned int                       m_ChangeDepth;
+    bool                               m_ChangesDeferred;
+    bool                               m_ChildIndexEnabled;
+    mutable bool                       m_ChildIndexValid;
+    mutable AP4_Array<ChildIndexEntry> m_ChildIndex;
+};
+
+/*----------------------------------------------------------------------
+|   AP4_AtomPath
++---------------------------------------------------------------------*/
+/**
+ * Path to a descendant of an atom parent, in the same syntax as the
+ * paths passed to AP4_AtomParent::FindChild() ("moov/trak[1]/mdia/hdlr"),
+ * parsed once so that it can be used for repeated lookups.
+ */
+class AP4_AtomPath {
+public:
+    // class methods
+    /**
+     * Parse the first element of a path, and advance the path to the
+     * next element, or to NULL if this was the last element.
+     */
+    static AP4_Result ParseElement(const char*&    path, 
+                                   AP4_Atom::Type& type, 
+                                   AP4_Ordinal&    index);
+
+    // constructor
+    AP4_AtomPath(const char* path);
+
+    // methods
+    bool           IsValid() const               { return m_Valid;                          }
+    AP4_Cardinal   GetElementCount() const       { return m_Elements.ItemCount();           }
+    AP4_Atom::Type GetType(AP4_Ordinal i) const  { return m_Elements[i].m_Type;             }
+    AP4_Ordinal    GetIndex(AP4_Ordinal i) const { return m_Elements[i].m_Index;            }
+
+private:
+    // types
+    struct Element {
+        AP4_Atom::Type m_Type;
+        AP4_Ordinal    m_Index;
+    };
+
     // members
-    AP4_List<AP4_Atom> m_Children;
+    AP4_Array<Element> m_Elements;
+    bool               m_Valid;
 };
 
 /*----------------------------------------------------------------------
@@ -453,6 +560,7 @@ const AP4_Atom::Type AP4_ATOM_TYPE_HMHD = AP4_ATOM_TYPE('h','m','h','d');
 const AP4_Atom::Type AP4_ATOM_TYPE_FRMA = AP4_ATOM_TYPE('f','r','m','a');
 const AP4_Atom::Type AP4_ATOM_TYPE_MDAT = AP4_ATOM_TYPE('m','d','a','t');
 const AP4_Atom::Type AP4_ATOM_TYPE_FREE = AP4_ATOM_TYPE('f','r','e','e');
+const AP4_Atom::Type AP4_ATOM_TYPE_SKIP = AP4_ATOM_TYPE('s','k','i','p');
 const AP4_Atom::Type AP4_ATOM_TYPE_TIMS = AP4_ATOM_TYPE('t','i','m','s');
 const AP4_Atom::Type AP4_ATOM_TYPE_RTP_ = AP4_ATOM_TYPE('r','t','p',' ');
 const AP4_Atom::Type AP4_ATOM_TYPE_HNTI = AP4_ATOM_TYPE('h','n','t','i');
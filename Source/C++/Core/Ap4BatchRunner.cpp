@@ -0,0 +1,216 @@
+/*****************************************************************
+|
+|    AP4 - Batch Runner
+|
+|    Copyright 2002-2015 Axiomatic Systems, LLC
+|
+|
+|    This file is part of Bento4/AP4 (MP4 Atom Processing Library).
+|
+|    Unless you have obtained Bento4 under a difference license,
+|    this version of Bento4 is Bento4|GPL.
+|    Bento4|GPL is free software; you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation; either version 2, or (at your option)
+|    any later version.
+|
+|    Bento4|GPL is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with Bento4|GPL; see the file COPYING.  If not, write to the
+|    Free Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+|    02111-1307, USA.
+|
+ ****************************************************************/
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "Ap4BatchRunner.h"
+#include "Ap4ByteStream.h"
+#include "Ap4DataBuffer.h"
+#include "Ap4Utils.h"
+
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+const AP4_Size AP4_BATCH_RUNNER_MANIFEST_READ_SIZE = 4096;
+
+/*----------------------------------------------------------------------
+|   AP4_BatchRunner_TrimSpaces
++---------------------------------------------------------------------*/
+static char*
+AP4_BatchRunner_TrimSpaces(char* string)
+{
+    while (*string == ' ' || *string == '\t') ++string;
+    char* end = string+AP4_StringLength(string);
+    while (end != string && (end[-1] == ' ' || end[-1] == '\t')) *--end = '\0';
+    return string;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_BatchRunner_FindChar
++---------------------------------------------------------------------*/
+static char*
+AP4_BatchRunner_FindChar(char* string, char c)
+{
+    for (; *string; string++) {
+        if (*string == c) return string;
+    }
+    return NULL;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_BatchRunner::WorkerThread
++---------------------------------------------------------------------*/
+class AP4_BatchRunner::WorkerThread : public AP4_Runnable {
+public:
+    WorkerThread(AP4_BatchRunner& runner, Worker& worker) :
+        m_Runner(runner),
+        m_Worker(worker),
+        m_Thread(*this) {}
+
+    // AP4_Runnable methods
+    virtual void Run() { m_Runner.RunJobs(m_Worker); }
+
+    // members
+    AP4_BatchRunner& m_Runner;
+    Worker&          m_Worker;
+    AP4_Thread       m_Thread;
+};
+
+/*----------------------------------------------------------------------
+|   AP4_BatchRunner::AddJob
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_BatchRunner::AddJob(const char* input_filename, const char* output_filename)
+{
+    if (input_filename == NULL || output_filename == NULL) {
+        return AP4_ERROR_INVALID_PARAMETERS;
+    }
+    Job job;
+    job.m_InputFilename  = input_filename;
+    job.m_OutputFilename = output_filename;
+    job.m_Result         = AP4_SUCCESS;
+    return m_Jobs.Append(job);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_BatchRunner::ParseManifest
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_BatchRunner::ParseManifest(AP4_ByteStream& stream)
+{
+    // read the whole manifest (the stream may not have a known size)
+    AP4_DataBuffer manifest;
+    for (;;) {
+        AP4_Size size = manifest.GetDataSize();
+        AP4_Result result = manifest.Reserve(size+AP4_BATCH_RUNNER_MANIFEST_READ_SIZE+1);
+        if (AP4_FAILED(result)) return result;
+        AP4_Size bytes_read = 0;
+        result = stream.ReadPartial(manifest.UseData()+size, AP4_BATCH_RUNNER_MANIFEST_READ_SIZE, bytes_read);
+        if (result == AP4_ERROR_EOS || (AP4_SUCCEEDED(result) && bytes_read == 0)) break;
+        if (AP4_FAILED(result)) return result;
+        manifest.SetDataSize(size+bytes_read);
+    }
+    
+    // parse each line
+    char*    chars = (char*)manifest.UseData();
+    AP4_Size size  = manifest.GetDataSize();
+    chars[size] = '\0';
+    for (AP4_Size line_start = 0; line_start < size;) {
+        AP4_Size line_end = line_start;
+        while (line_end < size && chars[line_end] != '\n' && chars[line_end] != '\r') {
+            ++line_end;
+        }
+        chars[line_end] = '\0';
+        char* line = &chars[line_start];
+        line_start = line_end+1;
+        
+        // skip empty lines and comments
+        line = AP4_BatchRunner_TrimSpaces(line);
+        if (line[0] == '\0' || line[0] == '#') continue;
+        
+        // split the line at the first tab, or else at the first space
+        char* separator = AP4_BatchRunner_FindChar(line, '\t');
+        bool  tab_separated = (separator != NULL);
+        if (!tab_separated) separator = AP4_BatchRunner_FindChar(line, ' ');
+        if (separator == NULL) return AP4_ERROR_INVALID_FORMAT;
+        *separator = '\0';
+        char* input_filename  = AP4_BatchRunner_TrimSpaces(line);
+        char* output_filename = AP4_BatchRunner_TrimSpaces(separator+1);
+        if (input_filename[0] == '\0' || output_filename[0] == '\0') {
+            return AP4_ERROR_INVALID_FORMAT;
+        }
+        if (AP4_BatchRunner_FindChar(output_filename, '\t') ||
+            (!tab_separated && AP4_BatchRunner_FindChar(output_filename, ' '))) {
+            return AP4_ERROR_INVALID_FORMAT;
+        }
+        
+        AP4_Result result = AddJob(input_filename, output_filename);
+        if (AP4_FAILED(result)) return result;
+    }
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_BatchRunner::GetNextJob
++---------------------------------------------------------------------*/
+AP4_BatchRunner::Job*
+AP4_BatchRunner::GetNextJob()
+{
+    AP4_AutoLock lock(m_Lock);
+    if (m_NextJob >= m_Jobs.ItemCount()) return NULL;
+    return &m_Jobs[m_NextJob++];
+}
+
+/*----------------------------------------------------------------------
+|   AP4_BatchRunner::RunJobs
++---------------------------------------------------------------------*/
+void
+AP4_BatchRunner::RunJobs(Worker& worker)
+{
+    for (Job* job = GetNextJob(); job; job = GetNextJob()) {
+        job->m_Result = worker.ProcessJob(*job);
+    }
+}
+
+/*----------------------------------------------------------------------
+|   AP4_BatchRunner::Run
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_BatchRunner::Run(AP4_Array<Worker*>& workers)
+{
+    if (workers.ItemCount() == 0 || workers.ItemCount() > AP4_BATCH_RUNNER_MAX_WORKERS) {
+        return AP4_ERROR_INVALID_PARAMETERS;
+    }
+    m_NextJob = 0;
+    
+    if (workers.ItemCount() == 1) {
+        RunJobs(*workers[0]);
+    } else {
+        AP4_Array<WorkerThread*> threads;
+        for (unsigned int i=0; i<workers.ItemCount(); i++) {
+            WorkerThread* thread = new WorkerThread(*this, *workers[i]);
+            threads.Append(thread);
+            if (AP4_FAILED(thread->m_Thread.Start())) {
+                // use the calling thread for this worker instead
+                RunJobs(*workers[i]);
+                break;
+            }
+        }
+        for (unsigned int i=0; i<threads.ItemCount(); i++) {
+            threads[i]->m_Thread.Wait();
+            delete threads[i];
+        }
+    }
+    
+    for (unsigned int i=0; i<m_Jobs.ItemCount(); i++) {
+        if (AP4_FAILED(m_Jobs[i].m_Result)) return m_Jobs[i].m_Result;
+    }
+    return AP4_SUCCESS;
+}
@@ -0,0 +1,110 @@
+/*****************************************************************
+|
+|    AP4 - Batch Runner
+|
+|    Copyright 2002-2015 Axiomatic Systems, LLC
+|
+|
+|    This file is part of Bento4/AP4 (MP4 Atom Processing Library).
+|
+|    Unless you have obtained Bento4 under a difference license,
+|    this version of Bento4 is Bento4|GPL.
+|    Bento4|GPL is free software; you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation; either version 2, or (at your option)
+|    any later version.
+|
+|    Bento4|GPL is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with Bento4|GPL; see the file COPYING.  If not, write to the
+|    Free Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+|    02111-1307, USA.
+|
+ ****************************************************************/
+
+#ifndef _AP4_BATCH_RUNNER_H_
+#define _AP4_BATCH_RUNNER_H_
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "Ap4Types.h"
+#include "Ap4Array.h"
+#include "Ap4String.h"
+#include "Ap4Threads.h"
+
+/*----------------------------------------------------------------------
+|   class references
++---------------------------------------------------------------------*/
+class AP4_ByteStream;
+
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+const unsigned int AP4_BATCH_RUNNER_MAX_WORKERS = 64;
+
+/*----------------------------------------------------------------------
+|   AP4_BatchRunner
++---------------------------------------------------------------------*/
+/**
+ * Runs a list of input/output file jobs on a bounded number of workers,
+ * so that a single process can handle many files without paying the
+ * process startup cost, and the setup cost of the workers, for each file.
+ * Each worker runs on its own thread and processes one job at a time, so
+ * a worker can keep state (atom factory, processor configuration, buffers)
+ * from one job to the next without locking.
+ */
+class AP4_BatchRunner {
+public:
+    // types
+    struct Job {
+        AP4_String m_InputFilename;
+        AP4_String m_OutputFilename;
+        AP4_Result m_Result;
+    };
+    class Worker {
+    public:
+        virtual ~Worker() {}
+        virtual AP4_Result ProcessJob(Job& job) = 0;
+    };
+
+    // constructor
+    AP4_BatchRunner() : m_NextJob(0) {}
+
+    // methods
+    AP4_Result AddJob(const char* input_filename, const char* output_filename);
+    /**
+     * Add the jobs listed in a manifest: one job per line, with the input
+     * and output file names separated by a tab or, when the line has no
+     * tab, by spaces. Empty lines and lines starting with '#' are ignored.
+     */
+    AP4_Result ParseManifest(AP4_ByteStream& stream);
+    AP4_Array<Job>& GetJobs() { return m_Jobs; }
+    /**
+     * Run all the jobs. Each worker runs on its own thread, except when
+     * there is only one worker, in which case the jobs run on the calling
+     * thread. The result of each job is stored in the job.
+     * @return AP4_SUCCESS if all the jobs succeeded, or the result of the
+     * first job that failed, in job order.
+     */
+    AP4_Result Run(AP4_Array<Worker*>& workers);
+
+private:
+    // types
+    class WorkerThread;
+
+    // methods
+    Job* GetNextJob();
+    void RunJobs(Worker& worker);
+
+    // members
+    AP4_Array<Job> m_Jobs;
+    AP4_Mutex      m_Lock;
+    AP4_Ordinal    m_NextJob;
+};
+
+#endif // _AP4_BATCH_RUNNER_H_
@@ -79,9 +79,14 @@ AP4_Co64Atom::AP4_Co64Atom(AP4_UI32        size,
         m_EntryCount = (size-AP4_FULL_ATOM_HEADER_SIZE-4)/8;
     }
     m_Entries = new AP4_UI64[m_EntryCount];
-    for (AP4_Ordinal i=0; i<m_EntryCount; i++) {
-        stream.ReadUI64(m_Entries[i]);
+
+    // read the entries directly in the table and convert them in place
+    AP4_Result result = stream.Read(m_Entries, m_EntryCount*8);
+    if (AP4_FAILED(result)) {
+        AP4_SetMemory(m_Entries, 0, m_EntryCount*8);
+        return;
     }
+    AP4_BytesToUInt64ArrayBE((const unsigned char*)m_Entries, m_Entries, m_EntryCount);
 }
 
 /*----------------------------------------------------------------------
@@ -145,19 +150,23 @@ AP4_Co64Atom::AdjustChunkOffsets(AP4_SI64 delta)
 AP4_Result
 AP4_Co64Atom::WriteFields(AP4_ByteStream& stream)
 {
-    AP4_Result result;
+    // serialize the fields into a single buffer
+    AP4_DataBuffer buffer;
+    AP4_Result result = buffer.SetDataSize(4+8*m_EntryCount);
+    if (AP4_FAILED(result)) return result;
+    AP4_UI08* out = buffer.UseData();
 
     // entry count
-    result = stream.WriteUI32(m_EntryCount);
-    if (AP4_FAILED(result)) return result;
+    AP4_BytesFromUInt32BE(out, m_EntryCount);
+    out += 4;
 
     // entries
     for (AP4_Ordinal i=0; i<m_EntryCount; i++) {
-        result = stream.WriteUI64(m_Entries[i]);
-        if (AP4_FAILED(result)) return result;
+        AP4_BytesFromUInt64BE(out, m_Entries[i]);
+        out += 8;
     }
 
-    return result;
+    return stream.Write(buffer.GetData(), buffer.GetDataSize());
 }
 
 /*----------------------------------------------------------------------
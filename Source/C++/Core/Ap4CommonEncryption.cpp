@@ -53,6 +53,7 @@
 #include "Ap4PsshAtom.h"
 #include "Ap4AvcParser.h"
 #include "Ap4HevcParser.h"
+#include "Ap4Instrumentation.h"
 
 /*----------------------------------------------------------------------
 |   constants
@@ -63,6 +64,9 @@ const AP4_UI08 AP4_EME_COMMON_SYSTEM_ID[16] = {
 
 const unsigned int AP4_CENC_NAL_UNIT_ENCRYPTION_MIN_SIZE = 112;
 
+static const AP4_AtomPath AP4_PATH_MDIA_HDLR("mdia/hdlr");
+static const AP4_AtomPath AP4_PATH_STSD     ("mdia/minf/stbl/stsd");
+
 /*----------------------------------------------------------------------
 |   AP4_CencBasicSubSampleMapper::GetSubSampleMap
 +---------------------------------------------------------------------*/
@@ -223,7 +227,7 @@ AP4_CencCbcsSubSampleMapper::AP4_CencCbcsSubSampleMapper(AP4_Size nalu_length_si
     if (!trak) return;
     
     // get the sample description atom
-    AP4_StsdAtom* stsd = AP4_DYNAMIC_CAST(AP4_StsdAtom, trak->FindChild("mdia/minf/stbl/stsd"));
+    AP4_StsdAtom* stsd = AP4_DYNAMIC_CAST(AP4_StsdAtom, trak->FindChild(AP4_PATH_STSD));
     if (!stsd) return;
     
     if (format == AP4_SAMPLE_FORMAT_AVC1 ||
@@ -1092,7 +1096,11 @@ AP4_CencFragmentEncrypter::ProcessSample(AP4_DataBuffer& data_in,
     
     // encrypt the sample
     AP4_DataBuffer sample_infos;
-    AP4_Result result = m_Encrypter->m_SampleEncrypter->EncryptSampleData(data_in, data_out, sample_infos);
+    AP4_Result result;
+    {
+        AP4_InstrumentationScope scope(AP4_Instrumentation::STAGE_ENCRYPTION, data_in.GetDataSize());
+        result = m_Encrypter->m_SampleEncrypter->EncryptSampleData(data_in, data_out, sample_infos);
+    }
     if (AP4_FAILED(result)) return result;
 
     // update the sample info
@@ -1375,7 +1383,7 @@ AP4_Processor::TrackHandler*
 AP4_CencEncryptingProcessor::CreateTrackHandler(AP4_TrakAtom* trak)
 {
     // find the stsd atom
-    AP4_StsdAtom* stsd = AP4_DYNAMIC_CAST(AP4_StsdAtom, trak->FindChild("mdia/minf/stbl/stsd"));
+    AP4_StsdAtom* stsd = AP4_DYNAMIC_CAST(AP4_StsdAtom, trak->FindChild(AP4_PATH_STSD));
 
     // avoid tracks with no stsd atom (should not happen)
     if (stsd == NULL) return NULL;
@@ -1418,7 +1426,7 @@ AP4_CencEncryptingProcessor::CreateTrackHandler(AP4_TrakAtom* trak)
             
         default: {
             // try to find if this is audio or video
-            AP4_HdlrAtom* hdlr = AP4_DYNAMIC_CAST(AP4_HdlrAtom, trak->FindChild("mdia/hdlr"));
+            AP4_HdlrAtom* hdlr = AP4_DYNAMIC_CAST(AP4_HdlrAtom, trak->FindChild(AP4_PATH_MDIA_HDLR));
             if (hdlr) {
                 switch (hdlr->GetHandlerType()) {
                     case AP4_HANDLER_TYPE_SOUN:
@@ -1697,7 +1705,7 @@ AP4_CencEncryptingProcessor::CreateFragmentHandler(AP4_TrakAtom*      trak,
     if (clear_lead) {
         if (encrypter->m_CurrentFragment < encrypter->m_CleartextFragments) {
             // find the stsd atom
-            AP4_StsdAtom* stsd = AP4_DYNAMIC_CAST(AP4_StsdAtom, trak->FindChild("mdia/minf/stbl/stsd"));
+            AP4_StsdAtom* stsd = AP4_DYNAMIC_CAST(AP4_StsdAtom, trak->FindChild(AP4_PATH_STSD));
             if (stsd) {
                 AP4_UI32 tfhd_flags = tfhd->GetFlags();
                 AP4_UI32 sample_description_index = 0;
@@ -1818,6 +1826,27 @@ AP4_CencSingleSampleDecrypter::DecryptSampleData(AP4_DataBuffer& data_in,
     // the output has the same size as the input
     data_out.SetDataSize(data_in.GetDataSize());
 
+    return DecryptSampleData(data_in.GetData(),
+                             data_in.GetDataSize(),
+                             data_out.UseData(),
+                             iv,
+                             subsample_count,
+                             bytes_of_cleartext_data,
+                             bytes_of_encrypted_data);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_CencSingleSampleDecrypter::DecryptSampleData
++---------------------------------------------------------------------*/
+AP4_Result 
+AP4_CencSingleSampleDecrypter::DecryptSampleData(const AP4_UI08* data_in,
+                                                 AP4_Size        data_size,
+                                                 AP4_UI08*       data_out,
+                                                 const AP4_UI08* iv,
+                                                 unsigned int    subsample_count,
+                                                 const AP4_UI16* bytes_of_cleartext_data,
+                                                 const AP4_UI32* bytes_of_encrypted_data)
+{
     // check input parameters
     if (iv == NULL) return AP4_ERROR_INVALID_PARAMETERS;
     if (subsample_count) {
@@ -1828,20 +1857,21 @@ AP4_CencSingleSampleDecrypter::DecryptSampleData(AP4_DataBuffer& data_in,
     
     // shortcut for NULL ciphers
     if (m_Cipher == NULL) {
-        AP4_CopyMemory(data_out.UseData(), data_in.GetData(), data_in.GetDataSize());
+        AP4_CopyMemory(data_out, data_in, data_size);
         return AP4_SUCCESS;
     }
+    AP4_InstrumentationScope scope(AP4_Instrumentation::STAGE_DECRYPTION, data_size);
     
     // setup direct pointers to the buffers
-    const AP4_UI08* in  = data_in.GetData();
-    AP4_UI08*       out = data_out.UseData();
+    const AP4_UI08* in  = data_in;
+    AP4_UI08*       out = data_out;
 
     // setup the IV
     m_Cipher->SetIV(iv);
 
     if (subsample_count) {
         // process the sample data, one sub-sample at a time
-        const AP4_UI08* in_end = data_in.GetData()+data_in.GetDataSize();
+        const AP4_UI08* in_end = data_in+data_size;
         for (unsigned int i=0; i<subsample_count; i++) {
             AP4_UI16 cleartext_size = bytes_of_cleartext_data[i];
             AP4_UI32 encrypted_size = bytes_of_encrypted_data[i];
@@ -1872,9 +1902,9 @@ AP4_CencSingleSampleDecrypter::DecryptSampleData(AP4_DataBuffer& data_in,
         }
     } else {
         if (m_FullBlocksOnly) {
-            unsigned int block_count = data_in.GetDataSize()/16;
+            unsigned int block_count = data_size/16;
             if (block_count) {
-                AP4_Size out_size = data_out.GetDataSize();
+                AP4_Size out_size = data_size;
                 AP4_Result result = m_Cipher->ProcessBuffer(in, block_count*16, out, &out_size, false);
                 if (AP4_FAILED(result)) return result;
                 AP4_ASSERT(out_size == block_count*16);
@@ -1883,13 +1913,13 @@ AP4_CencSingleSampleDecrypter::DecryptSampleData(AP4_DataBuffer& data_in,
             }
             
             // any partial block at the end remains in the clear
-            unsigned int partial = data_in.GetDataSize()%16;
+            unsigned int partial = data_size%16;
             if (partial) {
                 AP4_CopyMemory(out, in, partial);
             }        
         } else {
             // process the entire sample data at once
-            AP4_Size encrypted_size = data_in.GetDataSize();
+            AP4_Size encrypted_size = data_size;
             AP4_Result result = m_Cipher->ProcessBuffer(in, encrypted_size, out, &encrypted_size, false);
             if (AP4_FAILED(result)) return result;
         }
@@ -2085,6 +2115,71 @@ AP4_CencSampleDecrypter::DecryptSampleData(AP4_DataBuffer& data_in,
     return m_SingleSampleDecrypter->DecryptSampleData(data_in, data_out, iv_block, subsample_count, bytes_of_cleartext_data, bytes_of_encrypted_data);
 }
 
+/*----------------------------------------------------------------------
+|   AP4_CencSampleDecrypter::DecryptSamples
++---------------------------------------------------------------------*/
+AP4_Result 
+AP4_CencSampleDecrypter::DecryptSamples(AP4_Cardinal    sample_count,
+                                        const AP4_UI32* sample_sizes,
+                                        AP4_DataBuffer& data_in,
+                                        AP4_DataBuffer& data_out)
+{
+    // check parameters
+    if (sample_count && sample_sizes == NULL) return AP4_ERROR_INVALID_PARAMETERS;
+    if (m_SampleInfoTable == NULL) return AP4_ERROR_INVALID_STATE;
+    if (m_SampleCursor+sample_count > m_SampleInfoTable->GetSampleCount()) {
+        return AP4_ERROR_OUT_OF_RANGE;
+    }
+    AP4_UI64 total_size = 0;
+    for (unsigned int i=0; i<sample_count; i++) {
+        total_size += sample_sizes[i];
+    }
+    if (total_size > data_in.GetDataSize()) return AP4_ERROR_INVALID_PARAMETERS;
+    
+    // the output has the same size as the input
+    data_out.SetDataSize(data_in.GetDataSize());
+    const AP4_UI08* in  = data_in.GetData();
+    AP4_UI08*       out = data_out.UseData();
+
+    // the IV size is the same for all samples, so only the first
+    // bytes of the IV block change from one sample to the next
+    unsigned char iv_block[16];
+    unsigned int  iv_size = m_SampleInfoTable->GetIvSize();
+    if (iv_size > 16) return AP4_ERROR_INVALID_FORMAT;
+    AP4_SetMemory(iv_block, 0, 16);
+    
+    for (unsigned int i=0; i<sample_count; i++) {
+        unsigned int    sample_cursor = m_SampleCursor+i;
+        const AP4_UI08* iv = m_SampleInfoTable->GetIv(sample_cursor);
+        if (iv == NULL) return AP4_ERROR_INVALID_FORMAT;
+        AP4_CopyMemory(iv_block, iv, iv_size);
+
+        unsigned int    subsample_count = 0;
+        const AP4_UI16* bytes_of_cleartext_data = NULL;
+        const AP4_UI32* bytes_of_encrypted_data = NULL;
+        AP4_Result result = m_SampleInfoTable->GetSampleInfo(sample_cursor, subsample_count, bytes_of_cleartext_data, bytes_of_encrypted_data);
+        if (AP4_FAILED(result)) return result;
+
+        result = m_SingleSampleDecrypter->DecryptSampleData(in,
+                                                            sample_sizes[i],
+                                                            out,
+                                                            iv_block,
+                                                            subsample_count,
+                                                            bytes_of_cleartext_data,
+                                                            bytes_of_encrypted_data);
+        if (AP4_FAILED(result)) return result;
+        in  += sample_sizes[i];
+        out += sample_sizes[i];
+    }
+    m_SampleCursor += sample_count;
+    
+    // anything after the last sample is copied as is
+    AP4_Size tail = data_in.GetDataSize()-(AP4_Size)total_size;
+    if (tail) AP4_CopyMemory(out, in, tail);
+    
+    return AP4_SUCCESS;
+}
+
 /*----------------------------------------------------------------------
 |   AP4_CencTrackDecrypter
 +---------------------------------------------------------------------*/
@@ -2290,7 +2385,7 @@ AP4_Processor::TrackHandler*
 AP4_CencDecryptingProcessor::CreateTrackHandler(AP4_TrakAtom* trak)
 {
     // find the stsd atom
-    AP4_StsdAtom* stsd = AP4_DYNAMIC_CAST(AP4_StsdAtom, trak->FindChild("mdia/minf/stbl/stsd"));
+    AP4_StsdAtom* stsd = AP4_DYNAMIC_CAST(AP4_StsdAtom, trak->FindChild(AP4_PATH_STSD));
 
     // avoid tracks with no stsd atom (should not happen)
     if (stsd == NULL) return NULL;
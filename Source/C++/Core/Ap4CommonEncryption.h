@@ -696,6 +696,15 @@ public:
                                          // array of <subsample_count> integers. NULL if subsample_count is 0
                                          const AP4_UI32* bytes_of_encrypted_data);  
     
+    // same as above, but working directly on memory buffers of <data_size> bytes
+    AP4_Result DecryptSampleData(const AP4_UI08* data_in,
+                                 AP4_Size        data_size,
+                                 AP4_UI08*       data_out,
+                                 const AP4_UI08* iv,
+                                 unsigned int    subsample_count,
+                                 const AP4_UI16* bytes_of_cleartext_data,
+                                 const AP4_UI32* bytes_of_encrypted_data);
+    
 private:
     // constructor
     AP4_CencSingleSampleDecrypter(AP4_StreamCipher* cipher,
@@ -758,6 +767,19 @@ public:
                                          AP4_DataBuffer& data_out,
                                          const AP4_UI08* iv);
     
+    /**
+     * Decrypt a run of consecutive samples, starting at the current sample
+     * index, in a single call. The samples are stored back to back in data_in,
+     * as they are in the mdat of a fragment, and their sizes are given by
+     * sample_sizes (<sample_count> entries). The decrypted samples are written
+     * to data_out with the same layout, and the sample index is advanced past
+     * the last sample. The IVs and subsample maps come from the sample info table.
+     */
+    AP4_Result DecryptSamples(AP4_Cardinal    sample_count,
+                              const AP4_UI32* sample_sizes,
+                              AP4_DataBuffer& data_in,
+                              AP4_DataBuffer& data_out);
+    
 protected:
     AP4_CencSingleSampleDecrypter* m_SingleSampleDecrypter;
     AP4_CencSampleInfoTable*       m_SampleInfoTable;
@@ -238,6 +238,9 @@ AP4_ContainerAtom::WriteFields(AP4_ByteStream& stream)
 void
 AP4_ContainerAtom::OnChildChanged(AP4_Atom*)
 {
+    // deferred to EndChanges() while changes are batched
+    if (DeferChange()) return;
+
     // remcompute our size
     AP4_UI64 size = GetHeaderSize();
     m_Children.Apply(AP4_AtomSizeAdder(size));
@@ -253,6 +256,9 @@ AP4_ContainerAtom::OnChildChanged(AP4_Atom*)
 void
 AP4_ContainerAtom::OnChildAdded(AP4_Atom* child)
 {
+    // deferred to EndChanges() while changes are batched
+    if (DeferChange()) return;
+
     // update our size
     SetSize(GetSize()+child->GetSize());
 
@@ -266,6 +272,9 @@ AP4_ContainerAtom::OnChildAdded(AP4_Atom* child)
 void
 AP4_ContainerAtom::OnChildRemoved(AP4_Atom* child)
 {
+    // deferred to EndChanges() while changes are batched
+    if (DeferChange()) return;
+
     // update our size
     SetSize(GetSize()-child->GetSize());
 
@@ -167,25 +167,25 @@ AP4_CttsAtom::GetCtsOffset(AP4_Ordinal sample, AP4_UI32& cts_offset)
 AP4_Result
 AP4_CttsAtom::WriteFields(AP4_ByteStream& stream)
 {
-    AP4_Result result;
-
-    // write the entry count
+    // serialize the fields into a single buffer
     AP4_Cardinal entry_count = m_Entries.ItemCount();
-    result = stream.WriteUI32(entry_count);
+    AP4_DataBuffer buffer;
+    AP4_Result result = buffer.SetDataSize(4+8*entry_count);
     if (AP4_FAILED(result)) return result;
+    AP4_UI08* out = buffer.UseData();
 
-    // write the entries
-    for (AP4_Ordinal i=0; i<entry_count; i++) {
-        // sample count
-        result = stream.WriteUI32(m_Entries[i].m_SampleCount);
-        if (AP4_FAILED(result)) return result;
+    // the entry count
+    AP4_BytesFromUInt32BE(out, entry_count);
+    out += 4;
 
-        // time offset
-        result = stream.WriteUI32(m_Entries[i].m_SampleOffset);
-        if (AP4_FAILED(result)) return result;
+    // the entries
+    for (AP4_Ordinal i=0; i<entry_count; i++) {
+        AP4_BytesFromUInt32BE(out,   m_Entries[i].m_SampleCount);
+        AP4_BytesFromUInt32BE(out+4, m_Entries[i].m_SampleOffset);
+        out += 8;
     }
 
-    return AP4_SUCCESS;
+    return stream.Write(buffer.GetData(), buffer.GetDataSize());
 }
 
 /*----------------------------------------------------------------------
@@ -57,6 +57,7 @@ class AP4_CttsTableEntry {
     AP4_UI32 m_SampleCount;
     AP4_UI32 m_SampleOffset;
 };
+AP4_DECLARE_RELOCATABLE_TYPE(AP4_CttsTableEntry);
 
 /*----------------------------------------------------------------------
 |   AP4_CttsAtom
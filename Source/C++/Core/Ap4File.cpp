@@ -38,6 +38,7 @@
 #include "Ap4Movie.h"
 #include "Ap4FtypAtom.h"
 #include "Ap4MetaData.h"
+#include "Ap4Instrumentation.h"
 
 /*----------------------------------------------------------------------
 |   AP4_File::AP4_File
@@ -99,9 +100,10 @@ AP4_File::ParseStream(AP4_ByteStream&  stream,
     AP4_Atom*    atom;
     AP4_Position stream_position;
     bool         keep_parsing = true;
-    while (keep_parsing &&
-           AP4_SUCCEEDED(stream.Tell(stream_position)) && 
-           AP4_SUCCEEDED(atom_factory.CreateAtomFromStream(stream, atom))) {
+    while (keep_parsing && AP4_SUCCEEDED(stream.Tell(stream_position))) {
+        AP4_InstrumentationScope scope(AP4_Instrumentation::STAGE_ATOM_PARSING);
+        if (AP4_FAILED(atom_factory.CreateAtomFromStream(stream, atom))) break;
+        if (atom->GetType() != AP4_ATOM_TYPE_MDAT) scope.SetByteCount(atom->GetSize());
         AddChild(atom);
         switch (atom->GetType()) {
             case AP4_ATOM_TYPE_MOOV:
@@ -0,0 +1,212 @@
+/*****************************************************************
+|
+|    AP4 - File Updater
+|
+|    Copyright 2002-2016 Axiomatic Systems, LLC
+|
+|
+|    This file is part of Bento4/AP4 (MP4 Atom Processing Library).
+|
+|    Unless you have obtained Bento4 under a difference license,
+|    this version of Bento4 is Bento4|GPL.
+|    Bento4|GPL is free software; you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation; either version 2, or (at your option)
+|    any later version.
+|
+|    Bento4|GPL is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with Bento4|GPL; see the file COPYING.  If not, write to the
+|    Free Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+|    02111-1307, USA.
+|
+ ****************************************************************/
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "Ap4FileUpdater.h"
+#include "Ap4File.h"
+#include "Ap4Atom.h"
+#include "Ap4ByteStream.h"
+
+/*----------------------------------------------------------------------
+|   AP4_FileUpdaterAtomInfo
++---------------------------------------------------------------------*/
+struct AP4_FileUpdaterAtomInfo {
+    AP4_Atom::Type m_Type;
+    AP4_Position   m_Position;
+    AP4_UI64       m_Size;
+    bool           m_ExtendsToEnd; // the size field is 0
+};
+
+/*----------------------------------------------------------------------
+|   IsPadding
++---------------------------------------------------------------------*/
+static bool
+IsPadding(const AP4_FileUpdaterAtomInfo& info)
+{
+    return info.m_Type == AP4_ATOM_TYPE_FREE || info.m_Type == AP4_ATOM_TYPE_SKIP;
+}
+
+/*----------------------------------------------------------------------
+|   ScanTopLevelAtoms
++---------------------------------------------------------------------*/
+static AP4_Result
+ScanTopLevelAtoms(AP4_ByteStream&                     stream,
+                  AP4_LargeSize                       stream_size,
+                  AP4_Array<AP4_FileUpdaterAtomInfo>& atoms)
+{
+    // only the atom headers are read
+    AP4_Position position = 0;
+    while (position+AP4_ATOM_HEADER_SIZE <= stream_size) {
+        AP4_FileUpdaterAtomInfo info;
+        AP4_UI32 size_32 = 0;
+        AP4_Result result = stream.Seek(position);
+        if (AP4_SUCCEEDED(result)) result = stream.ReadUI32(size_32);
+        if (AP4_SUCCEEDED(result)) result = stream.ReadUI32(info.m_Type);
+        if (AP4_FAILED(result)) return result;
+        info.m_Position     = position;
+        info.m_Size         = size_32;
+        info.m_ExtendsToEnd = (size_32 == 0);
+        if (size_32 == 0) {
+            // last atom, extends to the end of the stream
+            info.m_Size = stream_size-position;
+        } else if (size_32 == 1) {
+            result = stream.ReadUI64(info.m_Size);
+            if (AP4_FAILED(result)) return result;
+            if (info.m_Size < AP4_ATOM_HEADER_SIZE+8) return AP4_ERROR_INVALID_FORMAT;
+        }
+        if (info.m_Size < AP4_ATOM_HEADER_SIZE || position+info.m_Size > stream_size) {
+            return AP4_ERROR_INVALID_FORMAT;
+        }
+        atoms.Append(info);
+        position += info.m_Size;
+    }
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   WriteFreeAtomHeader
++---------------------------------------------------------------------*/
+static AP4_Result
+WriteFreeAtomHeader(AP4_ByteStream& stream, AP4_UI64 size)
+{
+    // the payload of the atom is left as is
+    AP4_Result result;
+    if (size > 0xFFFFFFFF) {
+        result = stream.WriteUI32(1);
+        if (AP4_SUCCEEDED(result)) result = stream.WriteUI32(AP4_ATOM_TYPE_FREE);
+        if (AP4_SUCCEEDED(result)) result = stream.WriteUI64(size);
+    } else {
+        result = stream.WriteUI32((AP4_UI32)size);
+        if (AP4_SUCCEEDED(result)) result = stream.WriteUI32(AP4_ATOM_TYPE_FREE);
+    }
+    return result;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_FileUpdater::Update
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_FileUpdater::Update(AP4_File& file, AP4_ByteStream& stream)
+{
+    // get the (possibly modified) moov atom
+    AP4_Atom* moov = file.GetChild(AP4_ATOM_TYPE_MOOV);
+    if (moov == NULL) return AP4_ERROR_INVALID_STATE;
+    
+    // serialize the new moov atom before anything is written to the stream,
+    // because some of its atoms still read their payload from the old one
+    AP4_MemoryByteStream* moov_stream = new AP4_MemoryByteStream();
+    AP4_Result result = moov->Write(*moov_stream);
+    if (AP4_FAILED(result)) {
+        moov_stream->Release();
+        return result;
+    }
+    result = UpdateFromBuffer(moov_stream->GetData(), moov_stream->GetDataSize(), stream);
+    moov_stream->Release();
+    
+    return result;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_FileUpdater::UpdateFromBuffer
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_FileUpdater::UpdateFromBuffer(const AP4_UI08* moov, AP4_Size moov_size, AP4_ByteStream& stream)
+{
+    // find where the moov atom currently is in the stream
+    AP4_LargeSize stream_size = 0;
+    AP4_Result result = stream.GetSize(stream_size);
+    if (AP4_FAILED(result)) return result;
+    AP4_Array<AP4_FileUpdaterAtomInfo> atoms;
+    result = ScanTopLevelAtoms(stream, stream_size, atoms);
+    if (AP4_FAILED(result)) return result;
+    unsigned int moov_index = 0;
+    while (moov_index < atoms.ItemCount() && atoms[moov_index].m_Type != AP4_ATOM_TYPE_MOOV) {
+        ++moov_index;
+    }
+    if (moov_index == atoms.ItemCount()) return AP4_ERROR_INVALID_FORMAT;
+    
+    // the space available includes the padding atoms before and after the moov atom
+    unsigned int first = moov_index;
+    unsigned int last  = moov_index;
+    while (first > 0 && IsPadding(atoms[first-1])) --first;
+    while (last+1 < atoms.ItemCount() && IsPadding(atoms[last+1])) ++last;
+    AP4_Position space_position = atoms[first].m_Position;
+    AP4_UI64     space_size     = atoms[last].m_Position+atoms[last].m_Size-space_position;
+    bool         space_at_end   = (last+1 == atoms.ItemCount());
+    
+    if (moov_size == space_size || moov_size+AP4_ATOM_HEADER_SIZE <= space_size || space_at_end) {
+        // write the moov atom in place
+        result = stream.Seek(space_position);
+        if (AP4_FAILED(result)) return result;
+        result = stream.Write(moov, moov_size);
+        if (AP4_FAILED(result)) return result;
+        
+        // mark what's left over as free space
+        if (moov_size < space_size) {
+            AP4_UI64 free_size = space_size-moov_size;
+            AP4_UI64 padding   = 0;
+            if (free_size < AP4_ATOM_HEADER_SIZE) {
+                // at the end of the file, we can extend the free atom beyond
+                // the old end, but the bytes must then be written
+                padding    = free_size;
+                free_size += AP4_ATOM_HEADER_SIZE;
+            }
+            result = WriteFreeAtomHeader(stream, free_size);
+            if (AP4_FAILED(result)) return result;
+            if (padding) {
+                AP4_UI08 zeros[AP4_ATOM_HEADER_SIZE] = {0};
+                result = stream.Write(zeros, (AP4_Size)padding);
+                if (AP4_FAILED(result)) return result;
+            }
+        }
+    } else {
+        // the moov atom can't be moved after the movie fragments
+        for (unsigned int i=last+1; i<atoms.ItemCount(); i++) {
+            if (atoms[i].m_Type == AP4_ATOM_TYPE_MOOF) return AP4_ERROR_NOT_SUPPORTED;
+        }
+        
+        // an atom without a size would swallow the new moov atom
+        if (atoms[atoms.ItemCount()-1].m_ExtendsToEnd) return AP4_ERROR_NOT_SUPPORTED;
+
+        // append the moov atom at the end, before releasing the old space,
+        // so that the file always has a valid moov atom
+        result = stream.Seek(stream_size);
+        if (AP4_FAILED(result)) return result;
+        result = stream.Write(moov, moov_size);
+        if (AP4_FAILED(result)) return result;
+        result = stream.Seek(space_position);
+        if (AP4_FAILED(result)) return result;
+        result = WriteFreeAtomHeader(stream, space_size);
+        if (AP4_FAILED(result)) return result;
+    }
+    
+    return stream.Flush();
+}
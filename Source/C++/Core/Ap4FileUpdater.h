@@ -0,0 +1,77 @@
+/*****************************************************************
+|
+|    AP4 - File Updater
+|
+|    Copyright 2002-2016 Axiomatic Systems, LLC
+|
+|
+|    This file is part of Bento4/AP4 (MP4 Atom Processing Library).
+|
+|    Unless you have obtained Bento4 under a difference license,
+|    this version of Bento4 is Bento4|GPL.
+|    Bento4|GPL is free software; you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation; either version 2, or (at your option)
+|    any later version.
+|
+|    Bento4|GPL is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with Bento4|GPL; see the file COPYING.  If not, write to the
+|    Free Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+|    02111-1307, USA.
+|
+ ****************************************************************/
+
+#ifndef _AP4_FILE_UPDATER_H_
+#define _AP4_FILE_UPDATER_H_
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "Ap4Types.h"
+
+/*----------------------------------------------------------------------
+|   class references
++---------------------------------------------------------------------*/
+class AP4_ByteStream;
+class AP4_File;
+
+/*----------------------------------------------------------------------
+|   AP4_FileUpdater
++---------------------------------------------------------------------*/
+/**
+ * Writes a modified moov atom back into the file it was parsed from,
+ * without copying the media data.
+ * The stream must be the (read/write) stream from which the file was
+ * parsed, and only the moov atom and its children may have been modified.
+ * If the new moov atom fits in the space of the old one, including any
+ * 'free' or 'skip' atoms around it, it is written in place, and the
+ * space left over is marked as a 'free' atom. Otherwise, the new moov atom
+ * is appended at the end of the file, and the old one is turned into a
+ * 'free' atom. The media data never moves, so the chunk offsets remain valid.
+ * Fragmented files can't be updated when the new moov atom doesn't fit,
+ * because it would end up after the movie fragments, and neither can files
+ * whose last atom has no size (it extends to the end of the file): in that
+ * case AP4_ERROR_NOT_SUPPORTED is returned and the file is left untouched,
+ * and the caller should write a new file instead.
+ */
+class AP4_FileUpdater {
+public:
+    // class methods
+    static AP4_Result Update(AP4_File& file, AP4_ByteStream& stream);
+
+private:
+    // class methods
+    static AP4_Result UpdateFromBuffer(const AP4_UI08* moov,
+                                       AP4_Size        moov_size,
+                                       AP4_ByteStream& stream);
+
+    // don't instantiate this class
+    AP4_FileUpdater() {};
+};
+
+#endif // _AP4_FILE_UPDATER_H_
@@ -39,12 +39,195 @@
 #include "Ap4DataBuffer.h"
 #include "Ap4FtypAtom.h"
 #include "Ap4SampleTable.h"
+#include "Ap4ContainerAtom.h"
+#include "Ap4StcoAtom.h"
+#include "Ap4Co64Atom.h"
+#include "Ap4StscAtom.h"
+#include "Ap4Utils.h"
+
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+const AP4_Size AP4_FILE_WRITER_IO_BUFFER_SIZE = 1024*1024;
+
+/*----------------------------------------------------------------------
+|   AP4_FileWriterChunk
++---------------------------------------------------------------------*/
+struct AP4_FileWriterChunk {
+    AP4_Ordinal  m_TrackIndex;
+    AP4_Ordinal  m_ChunkIndex;       // index of the chunk in its track
+    AP4_Ordinal  m_FirstSample;
+    AP4_Cardinal m_SampleCount;
+    AP4_Ordinal  m_DescriptionIndex; // 0-based
+    AP4_UI64     m_StartDts;         // in the media timescale
+    AP4_UI64     m_StartTime;        // in microseconds
+    AP4_UI64     m_Size;
+};
+
+/*----------------------------------------------------------------------
+|   AP4_FileWriterTrack
++---------------------------------------------------------------------*/
+struct AP4_FileWriterTrack {
+    AP4_FileWriterTrack(AP4_Track* track) :
+        m_Track(track),
+        m_Stbl(NULL),
+        m_OriginalChunkOffsetAtom(NULL),
+        m_OriginalStscAtom(NULL),
+        m_ChunkOffsetAtom(NULL),
+        m_StscAtom(NULL),
+        m_NextChunk(0) {}
+    ~AP4_FileWriterTrack() {
+        delete m_ChunkOffsetAtom;
+        delete m_StscAtom;
+    }
+
+    AP4_Track*                     m_Track;
+    AP4_ContainerAtom*             m_Stbl;
+    AP4_Atom*                      m_OriginalChunkOffsetAtom; // stco or co64
+    AP4_Atom*                      m_OriginalStscAtom;
+    AP4_Atom*                      m_ChunkOffsetAtom;         // replacement, if any
+    AP4_StscAtom*                  m_StscAtom;                // replacement, if any
+    AP4_Array<AP4_UI64>            m_ChunkOffsetsBackup;
+    AP4_Array<AP4_UI64>            m_ChunkOffsets;
+    AP4_Array<AP4_FileWriterChunk> m_Chunks;
+    AP4_Ordinal                    m_NextChunk;
+};
+
+/*----------------------------------------------------------------------
+|   ReplaceChild
++---------------------------------------------------------------------*/
+static AP4_Result
+ReplaceChild(AP4_ContainerAtom* parent, AP4_Atom* child, AP4_Atom* replacement)
+{
+    // find the position of the child, so that the replacement takes its place
+    int position = 0;
+    for (AP4_List<AP4_Atom>::Item* item = parent->GetChildren().FirstItem();
+         item && item->GetData() != child;
+         item = item->GetNext()) {
+        ++position;
+    }
+    AP4_Result result = parent->RemoveChild(child);
+    if (AP4_FAILED(result)) return result;
+    return parent->AddChild(replacement, position);
+}
+
+/*----------------------------------------------------------------------
+|   CreateChunkOffsetAtom
++---------------------------------------------------------------------*/
+static AP4_Atom*
+CreateChunkOffsetAtom(AP4_Cardinal chunk_count, bool use_64_bits)
+{
+    // the actual offsets are set later, with AP4_TrakAtom::SetChunkOffsets
+    AP4_Atom* atom;
+    if (use_64_bits) {
+        AP4_UI64* offsets = new AP4_UI64[chunk_count];
+        AP4_SetMemory(offsets, 0, chunk_count*sizeof(AP4_UI64));
+        atom = new AP4_Co64Atom(offsets, chunk_count);
+        delete[] offsets;
+    } else {
+        AP4_UI32* offsets = new AP4_UI32[chunk_count];
+        AP4_SetMemory(offsets, 0, chunk_count*sizeof(AP4_UI32));
+        atom = new AP4_StcoAtom(offsets, chunk_count);
+        delete[] offsets;
+    }
+    return atom;
+}
+
+/*----------------------------------------------------------------------
+|   BuildChunks
++---------------------------------------------------------------------*/
+static AP4_Result
+BuildChunks(AP4_FileWriterTrack&         writer_track,
+            AP4_Ordinal                  track_index,
+            AP4_FileWriter::Interleaving interleaving,
+            AP4_UI32                     chunk_duration_ms)
+{
+    AP4_Track*       track        = writer_track.m_Track;
+    AP4_SampleTable* sample_table = track->GetSampleTable();
+    AP4_Cardinal     sample_count = track->GetSampleCount();
+    AP4_UI32         timescale    = track->GetMediaTimeScale();
+    AP4_Sample       sample;
+    AP4_Result       result;
+    
+    AP4_FileWriterChunk chunk;
+    AP4_SetMemory(&chunk, 0, sizeof(chunk));
+    chunk.m_TrackIndex = track_index;
+    for (AP4_Ordinal i=0; i<sample_count; i++) {
+        result = sample_table->GetSample(i, sample);
+        if (AP4_FAILED(result)) return result;
+
+        // decide if this sample starts a new chunk
+        bool new_chunk = false;
+        if (interleaving == AP4_FileWriter::INTERLEAVING_INTERLEAVED) {
+            new_chunk = chunk.m_SampleCount == 0                               ||
+                        sample.GetDescriptionIndex() != chunk.m_DescriptionIndex ||
+                        AP4_ConvertTime(sample.GetDts()-chunk.m_StartDts,
+                                        timescale,
+                                        1000) >= chunk_duration_ms;
+        } else {
+            // keep the existing chunks
+            AP4_Ordinal chunk_index = 0;
+            AP4_Ordinal position_in_chunk = 0;
+            result = sample_table->GetSampleChunkPosition(i, chunk_index, position_in_chunk);
+            if (AP4_FAILED(result)) return result;
+            if (position_in_chunk == 0) {
+                if (chunk_index != writer_track.m_Chunks.ItemCount()+(chunk.m_SampleCount?1:0)) {
+                    return AP4_ERROR_INTERNAL;
+                }
+                new_chunk = true;
+            }
+        }
+        if (new_chunk) {
+            if (chunk.m_SampleCount) {
+                writer_track.m_Chunks.Append(chunk);
+                ++chunk.m_ChunkIndex;
+            }
+            chunk.m_FirstSample      = i;
+            chunk.m_SampleCount      = 0;
+            chunk.m_DescriptionIndex = sample.GetDescriptionIndex();
+            chunk.m_StartDts         = sample.GetDts();
+            chunk.m_StartTime        = timescale?AP4_ConvertTime(sample.GetDts(), timescale, 1000000):0;
+            chunk.m_Size             = 0;
+        }
+        ++chunk.m_SampleCount;
+        chunk.m_Size += sample.GetSize();
+    }
+    if (chunk.m_SampleCount) {
+        writer_track.m_Chunks.Append(chunk);
+    }
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   ReadRun
++---------------------------------------------------------------------*/
+static AP4_Result
+ReadRun(AP4_ByteStream*& stream, AP4_Position offset, AP4_Size size, AP4_DataBuffer& buffer)
+{
+    if (stream == NULL) return AP4_SUCCESS;
+    
+    // append the data of the run to the buffer
+    AP4_Size   buffer_size = buffer.GetDataSize();
+    AP4_Result result = buffer.SetDataSize(buffer_size+size);
+    if (AP4_SUCCEEDED(result)) result = stream->Seek(offset);
+    if (AP4_SUCCEEDED(result)) result = stream->Read(buffer.UseData()+buffer_size, size);
+    
+    // we're done with this stream
+    stream->Release();
+    stream = NULL;
+    
+    return result;
+}
 
 /*----------------------------------------------------------------------
 |   AP4_FileWriter::Write
 +---------------------------------------------------------------------*/
 AP4_Result
-AP4_FileWriter::Write(AP4_File& file, AP4_ByteStream& stream, Interleaving /* interleaving */)
+AP4_FileWriter::Write(AP4_File&       file, 
+                      AP4_ByteStream& stream, 
+                      Interleaving    interleaving,
+                      AP4_UI32        chunk_duration_ms)
 {
     // get the file type
     AP4_FtypAtom* file_type = file.GetFileType();
@@ -72,78 +255,242 @@ AP4_FileWriter::Write(AP4_File& file, AP4_ByteStream& stream, Interleaving /* in
     AP4_Position position;
     stream.Tell(position);
     
-    // backup and recompute all the chunk offsets
-    unsigned int t=0;
-    AP4_Result result = AP4_SUCCESS;
-    AP4_UI64   mdat_size = AP4_ATOM_HEADER_SIZE;
-    AP4_UI64   mdat_position = position+movie->GetMoovAtom()->GetSize();
-    AP4_Array<AP4_Array<AP4_UI64>*> trak_chunk_offsets_backup;
-    AP4_Array<AP4_UI64>             chunk_offsets;
+    // don't accept a chunk duration of 0
+    if (chunk_duration_ms == 0) chunk_duration_ms = AP4_FILE_WRITER_DEFAULT_CHUNK_DURATION;
+    
+    // compute the chunks of each track and backup the chunk offsets
+    AP4_Result                            result = AP4_SUCCESS;
+    AP4_Array<AP4_FileWriterTrack*>       tracks;
+    AP4_Array<const AP4_FileWriterChunk*> chunks;
+    AP4_UI64                              mdat_payload_size = 0;
+    AP4_UI64                              mdat_header_size  = AP4_ATOM_HEADER_SIZE;
+    bool                                  layout_done = false;
+    AP4_ByteStream*                       run_stream = NULL;
+    AP4_Position                          run_offset = 0;
+    AP4_Size                              run_size   = 0;
+    AP4_DataBuffer                        buffer;
     for (AP4_List<AP4_Track>::Item* track_item = movie->GetTracks().FirstItem();
                                     track_item;
                                     track_item = track_item->GetNext()) {
-        AP4_Track*    track = track_item->GetData();
-        AP4_TrakAtom* trak  = track->UseTrakAtom();
+        AP4_Track*           track = track_item->GetData();
+        AP4_TrakAtom*        trak  = track->UseTrakAtom();
+        AP4_FileWriterTrack* writer_track = new AP4_FileWriterTrack(track);
+        tracks.Append(writer_track);
         
         // backup the chunk offsets
-        AP4_Array<AP4_UI64>* chunk_offsets_backup = new AP4_Array<AP4_UI64>();
-        trak_chunk_offsets_backup.Append(chunk_offsets_backup);
-        result = trak->GetChunkOffsets(*chunk_offsets_backup);
+        result = trak->GetChunkOffsets(writer_track->m_ChunkOffsetsBackup);
         if (AP4_FAILED(result)) goto end;
 
+        // keep a pointer to the atoms we may replace
+        writer_track->m_Stbl = AP4_DYNAMIC_CAST(AP4_ContainerAtom, trak->FindChild("mdia/minf/stbl"));
+        if (writer_track->m_Stbl == NULL) {
+            result = AP4_ERROR_INVALID_FORMAT;
+            goto end;
+        }
+        writer_track->m_OriginalChunkOffsetAtom = writer_track->m_Stbl->GetChild(AP4_ATOM_TYPE_STCO);
+        if (writer_track->m_OriginalChunkOffsetAtom == NULL) {
+            writer_track->m_OriginalChunkOffsetAtom = writer_track->m_Stbl->GetChild(AP4_ATOM_TYPE_CO64);
+        }
+        writer_track->m_OriginalStscAtom = writer_track->m_Stbl->GetChild(AP4_ATOM_TYPE_STSC);
+        if (writer_track->m_OriginalChunkOffsetAtom == NULL || writer_track->m_OriginalStscAtom == NULL) {
+            result = AP4_ERROR_INVALID_FORMAT;
+            goto end;
+        }
+        
+        // compute the chunks
+        result = BuildChunks(*writer_track, tracks.ItemCount()-1, interleaving, chunk_duration_ms);
+        if (AP4_FAILED(result)) goto end;
+        for (unsigned int i=0; i<writer_track->m_Chunks.ItemCount(); i++) {
+            mdat_payload_size += writer_track->m_Chunks[i].m_Size;
+        }
+        
         // allocate space for the new chunk offsets
-        chunk_offsets.SetItemCount(chunk_offsets_backup->ItemCount());
+        if (interleaving != INTERLEAVING_INTERLEAVED &&
+            writer_track->m_Chunks.ItemCount() > writer_track->m_ChunkOffsetsBackup.ItemCount()) {
+            result = AP4_ERROR_INTERNAL;
+            goto end;
+        }
+        writer_track->m_ChunkOffsets.SetItemCount(interleaving == INTERLEAVING_INTERLEAVED ?
+                                                  writer_track->m_Chunks.ItemCount()       :
+                                                  writer_track->m_ChunkOffsetsBackup.ItemCount());
+    }
+    
+    // decide on the order in which the chunks will be written
+    if (interleaving == INTERLEAVING_INTERLEAVED) {
+        // merge the chunks of all the tracks by start time
+        for (;;) {
+            AP4_FileWriterTrack* next = NULL;
+            for (unsigned int t=0; t<tracks.ItemCount(); t++) {
+                AP4_FileWriterTrack* writer_track = tracks[t];
+                if (writer_track->m_NextChunk >= writer_track->m_Chunks.ItemCount()) continue;
+                if (next == NULL ||
+                    writer_track->m_Chunks[writer_track->m_NextChunk].m_StartTime <
+                    next->m_Chunks[next->m_NextChunk].m_StartTime) {
+                    next = writer_track;
+                }
+            }
+            if (next == NULL) break;
+            chunks.Append(&next->m_Chunks[next->m_NextChunk++]);
+        }
         
-        // compute the new chunk offsets
-        AP4_Cardinal     sample_count = track->GetSampleCount();
-        AP4_SampleTable* sample_table = track->GetSampleTable();
-        AP4_Sample       sample;
-        for (AP4_Ordinal i=0; i<sample_count; i++) {
-            AP4_Ordinal chunk_index = 0;
-            AP4_Ordinal position_in_chunk = 0;
-            sample_table->GetSampleChunkPosition(i, chunk_index, position_in_chunk);
-            sample_table->GetSample(i, sample);
-            if (position_in_chunk == 0) {
-                // this sample is the first sample in a chunk, so this is the start of a chunk
-                if (chunk_index >= chunk_offsets.ItemCount()) return AP4_ERROR_INTERNAL;
-                chunk_offsets[chunk_index] = mdat_position+mdat_size;
+        // replace the stsc and chunk offset atoms to match the new chunks
+        for (unsigned int t=0; t<tracks.ItemCount(); t++) {
+            AP4_FileWriterTrack*                  writer_track = tracks[t];
+            const AP4_Array<AP4_FileWriterChunk>& track_chunks = writer_track->m_Chunks;
+            writer_track->m_StscAtom = new AP4_StscAtom();
+            for (unsigned int i=0; i<track_chunks.ItemCount();) {
+                // group consecutive chunks with the same layout
+                unsigned int run = 1;
+                while (i+run < track_chunks.ItemCount() &&
+                       track_chunks[i+run].m_SampleCount      == track_chunks[i].m_SampleCount &&
+                       track_chunks[i+run].m_DescriptionIndex == track_chunks[i].m_DescriptionIndex) {
+                    ++run;
+                }
+                writer_track->m_StscAtom->AddEntry(run,
+                                                   track_chunks[i].m_SampleCount,
+                                                   track_chunks[i].m_DescriptionIndex+1);
+                i += run;
+            }
+            result = ReplaceChild(writer_track->m_Stbl, writer_track->m_OriginalStscAtom, writer_track->m_StscAtom);
+            if (AP4_FAILED(result)) goto end;
+            
+            writer_track->m_ChunkOffsetAtom = CreateChunkOffsetAtom(track_chunks.ItemCount(),
+                writer_track->m_OriginalChunkOffsetAtom->GetType() == AP4_ATOM_TYPE_CO64);
+            result = ReplaceChild(writer_track->m_Stbl, writer_track->m_OriginalChunkOffsetAtom, writer_track->m_ChunkOffsetAtom);
+            if (AP4_FAILED(result)) goto end;
+        }
+    } else {
+        // one track after the other
+        for (unsigned int t=0; t<tracks.ItemCount(); t++) {
+            for (unsigned int i=0; i<tracks[t]->m_Chunks.ItemCount(); i++) {
+                chunks.Append(&tracks[t]->m_Chunks[i]);
             }
-            mdat_size += sample.GetSize();
-        }        
-        result = trak->SetChunkOffsets(chunk_offsets);
+        }
+    }
+    
+    // compute the new chunk offsets, switching to 64-bit offsets and
+    // a 64-bit mdat header when the file gets too large for 32 bits
+    if (mdat_payload_size+AP4_ATOM_HEADER_SIZE > 0xFFFFFFFF) {
+        mdat_header_size = AP4_ATOM_HEADER_SIZE+8;
+    }
+    while (!layout_done) {
+        AP4_UI64 offset = position+movie->GetMoovAtom()->GetSize()+mdat_header_size;
+        for (unsigned int i=0; i<chunks.ItemCount(); i++) {
+            tracks[chunks[i]->m_TrackIndex]->m_ChunkOffsets[chunks[i]->m_ChunkIndex] = offset;
+            offset += chunks[i]->m_Size;
+        }
+        
+        layout_done = true;
+        for (unsigned int t=0; t<tracks.ItemCount(); t++) {
+            AP4_FileWriterTrack* writer_track = tracks[t];
+            AP4_Atom* chunk_offset_atom = writer_track->m_ChunkOffsetAtom ?
+                                          writer_track->m_ChunkOffsetAtom :
+                                          writer_track->m_OriginalChunkOffsetAtom;
+            if (chunk_offset_atom->GetType() == AP4_ATOM_TYPE_CO64) continue;
+            const AP4_Array<AP4_UI64>& offsets = writer_track->m_ChunkOffsets;
+            if (offsets.ItemCount() == 0 || offsets[offsets.ItemCount()-1] <= 0xFFFFFFFF) continue;
+            
+            // this changes the size of the moov atom, so we need another pass
+            AP4_Atom* co64 = CreateChunkOffsetAtom(offsets.ItemCount(), true);
+            result = ReplaceChild(writer_track->m_Stbl, chunk_offset_atom, co64);
+            if (AP4_FAILED(result)) {
+                delete co64;
+                goto end;
+            }
+            delete writer_track->m_ChunkOffsetAtom; // NULL or detached by ReplaceChild
+            writer_track->m_ChunkOffsetAtom = co64;
+            layout_done = false;
+        }
+    }
+    for (unsigned int t=0; t<tracks.ItemCount(); t++) {
+        result = tracks[t]->m_Track->UseTrakAtom()->SetChunkOffsets(tracks[t]->m_ChunkOffsets);
+        if (AP4_FAILED(result)) goto end;
     }
     
     // write the moov atom
-    movie->GetMoovAtom()->Write(stream);
+    result = movie->GetMoovAtom()->Write(stream);
+    if (AP4_FAILED(result)) goto end;
     
-    // create and write the media data (mdat)
-    // FIXME: this only supports 32-bit mdat size
-    stream.WriteUI32((AP4_UI32)mdat_size);
-    stream.WriteUI32(AP4_ATOM_TYPE_MDAT);
+    // write the mdat header
+    if (mdat_header_size == AP4_ATOM_HEADER_SIZE) {
+        stream.WriteUI32((AP4_UI32)(mdat_payload_size+mdat_header_size));
+        stream.WriteUI32(AP4_ATOM_TYPE_MDAT);
+    } else {
+        stream.WriteUI32(1);
+        stream.WriteUI32(AP4_ATOM_TYPE_MDAT);
+        stream.WriteUI64(mdat_payload_size+mdat_header_size);
+    }
     
-    // write all tracks and restore the chunk offsets to their backed-up values
-    for (AP4_List<AP4_Track>::Item* track_item = movie->GetTracks().FirstItem();
-         track_item;
-         track_item = track_item->GetNext(), ++t) {
-        AP4_Track*    track = track_item->GetData();
-        AP4_TrakAtom* trak  = track->UseTrakAtom();
-        
-        // restore the backed-up chunk offsets
-        result = trak->SetChunkOffsets(*trak_chunk_offsets_backup[t]);
-
-        // write all the track's samples
-        AP4_Cardinal   sample_count = track->GetSampleCount();
-        AP4_Sample     sample;
-        AP4_DataBuffer sample_data;
-        for (AP4_Ordinal i=0; i<sample_count; i++) {
-            track->ReadSample(i, sample, sample_data);
-            stream.Write(sample_data.GetData(), sample_data.GetDataSize());
+    // restore the original atoms, since the samples may be read through them
+    for (unsigned int t=0; t<tracks.ItemCount(); t++) {
+        AP4_FileWriterTrack* writer_track = tracks[t];
+        if (writer_track->m_ChunkOffsetAtom) {
+            ReplaceChild(writer_track->m_Stbl, writer_track->m_ChunkOffsetAtom, writer_track->m_OriginalChunkOffsetAtom);
         }
+        if (writer_track->m_StscAtom) {
+            ReplaceChild(writer_track->m_Stbl, writer_track->m_StscAtom, writer_track->m_OriginalStscAtom);
+        }
+        result = writer_track->m_Track->UseTrakAtom()->SetChunkOffsets(writer_track->m_ChunkOffsetsBackup);
+        if (AP4_FAILED(result)) goto end;
+    }
+    
+    // write the chunks, reading runs of contiguous samples with a single read
+    buffer.Reserve(2*AP4_FILE_WRITER_IO_BUFFER_SIZE);
+    for (unsigned int i=0; i<chunks.ItemCount(); i++) {
+        const AP4_FileWriterChunk* chunk = chunks[i];
+        AP4_Track*                 track = tracks[chunk->m_TrackIndex]->m_Track;
+        AP4_Sample                 sample;
+        for (AP4_Ordinal s=chunk->m_FirstSample; s<chunk->m_FirstSample+chunk->m_SampleCount; s++) {
+            result = track->GetSample(s, sample);
+            if (AP4_FAILED(result)) goto end;
+            AP4_ByteStream* sample_stream = sample.GetDataStream();
+            if (sample_stream == NULL) {
+                result = AP4_ERROR_INVALID_STATE;
+                goto end;
+            }
+            if (sample_stream == run_stream                  &&
+                run_offset+run_size == sample.GetOffset()    &&
+                run_size+sample.GetSize() <= AP4_FILE_WRITER_IO_BUFFER_SIZE) {
+                run_size += sample.GetSize();
+                sample_stream->Release();
+            } else {
+                result = ReadRun(run_stream, run_offset, run_size, buffer);
+                if (AP4_FAILED(result)) {
+                    sample_stream->Release();
+                    goto end;
+                }
+                run_stream = sample_stream;
+                run_offset = sample.GetOffset();
+                run_size   = sample.GetSize();
+            }
+            if (buffer.GetDataSize() >= AP4_FILE_WRITER_IO_BUFFER_SIZE) {
+                result = stream.Write(buffer.GetData(), buffer.GetDataSize());
+                if (AP4_FAILED(result)) goto end;
+                buffer.SetDataSize(0);
+            }
+        }
+        
+        // a run never spans more than one chunk
+        result = ReadRun(run_stream, run_offset, run_size, buffer);
+        if (AP4_FAILED(result)) goto end;
+    }
+    if (buffer.GetDataSize()) {
+        result = stream.Write(buffer.GetData(), buffer.GetDataSize());
     }
 
 end:
-    for (unsigned int i=0; i<trak_chunk_offsets_backup.ItemCount(); i++) {
-        delete trak_chunk_offsets_backup[i];
+    if (run_stream) run_stream->Release();
+    for (unsigned int t=0; t<tracks.ItemCount(); t++) {
+        AP4_FileWriterTrack* writer_track = tracks[t];
+        
+        // put the original atoms back in place if we failed before doing so
+        if (writer_track->m_ChunkOffsetAtom && writer_track->m_ChunkOffsetAtom->GetParent()) {
+            ReplaceChild(writer_track->m_Stbl, writer_track->m_ChunkOffsetAtom, writer_track->m_OriginalChunkOffsetAtom);
+        }
+        if (writer_track->m_StscAtom && writer_track->m_StscAtom->GetParent()) {
+            ReplaceChild(writer_track->m_Stbl, writer_track->m_StscAtom, writer_track->m_OriginalStscAtom);
+        }
+        delete writer_track;
     }
     
     return result;
@@ -40,6 +40,11 @@
 class AP4_ByteStream;
 class AP4_File;
 
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+const AP4_UI32 AP4_FILE_WRITER_DEFAULT_CHUNK_DURATION = 500; // milliseconds
+
 /*----------------------------------------------------------------------
 |   AP4_FileWriter
 +---------------------------------------------------------------------*/
@@ -47,13 +52,23 @@ class AP4_FileWriter {
 public:
     // types
     typedef enum {
-        INTERLEAVING_SEQUENTIAL
+        INTERLEAVING_SEQUENTIAL, // all the samples of a track, one track after the other
+        INTERLEAVING_INTERLEAVED // chunks of chunk_duration_ms, ordered by time across tracks
     } Interleaving;
     
     // class methods
+    /**
+     * Write a file to a stream, with the moov atom before the mdat atom.
+     * With INTERLEAVING_SEQUENTIAL, the chunk layout of the tracks is kept
+     * as is. With INTERLEAVING_INTERLEAVED, the samples are re-chunked so
+     * that each chunk spans at most chunk_duration_ms milliseconds, and the
+     * chunks of all the tracks are written in increasing time order.
+     * A 64-bit mdat header, and co64 chunk offsets, are used when needed.
+     */
     static AP4_Result Write(AP4_File&       file, 
                             AP4_ByteStream& stream, 
-                            Interleaving    interleaving = INTERLEAVING_SEQUENTIAL);
+                            Interleaving    interleaving = INTERLEAVING_SEQUENTIAL,
+                            AP4_UI32        chunk_duration_ms = AP4_FILE_WRITER_DEFAULT_CHUNK_DURATION);
                             
 private:
     // don't instantiate this class
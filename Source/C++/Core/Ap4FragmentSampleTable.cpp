@@ -198,6 +198,7 @@ AP4_FragmentSampleTable::AddTrun(AP4_TrunAtom*   trun,
         }
         if ((sample_flags & AP4_FRAG_FLAG_SAMPLE_IS_DIFFERENCE) == 0) {
             sample.SetSync(true);
+            m_SyncSamples.Append(start+i);
         } else {
             sample.SetSync(false);
         }
@@ -291,10 +292,30 @@ AP4_FragmentSampleTable::GetSampleChunkPosition(AP4_Ordinal  sample_index,
 |   AP4_FragmentSampleTable::GetSampleIndexForTimeStamp
 +---------------------------------------------------------------------*/
 AP4_Result 
-AP4_FragmentSampleTable::GetSampleIndexForTimeStamp(AP4_UI64     /*ts*/, 
+AP4_FragmentSampleTable::GetSampleIndexForTimeStamp(AP4_UI64     ts, 
                                                     AP4_Ordinal& sample_index)
 {
-    sample_index = 0; // FIXME
+    sample_index = 0;
+    
+    // check that the timestamp is in the range of the fragment
+    AP4_Cardinal sample_count = m_Samples.ItemCount();
+    if (sample_count == 0 || ts < m_Samples[0].GetDts()) return AP4_FAILURE;
+    const AP4_Sample& last = m_Samples[sample_count-1];
+    if (ts >= last.GetDts()+last.GetDuration()) return AP4_FAILURE;
+    
+    // binary search for the last sample with a dts <= ts
+    AP4_Ordinal lo = 0;
+    AP4_Ordinal hi = sample_count;
+    while (hi-lo > 1) {
+        AP4_Ordinal mid = lo+(hi-lo)/2;
+        if (m_Samples[mid].GetDts() <= ts) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    sample_index = lo;
+    
     return AP4_SUCCESS;
 }
 
@@ -302,8 +323,29 @@ AP4_FragmentSampleTable::GetSampleIndexForTimeStamp(AP4_UI64     /*ts*/,
 |   AP4_FragmentSampleTable::GetNearestSyncSampleIndex
 +---------------------------------------------------------------------*/
 AP4_Ordinal  
-AP4_FragmentSampleTable::GetNearestSyncSampleIndex(AP4_Ordinal /*sample_index*/, bool /*before*/)
+AP4_FragmentSampleTable::GetNearestSyncSampleIndex(AP4_Ordinal sample_index, bool before)
 {
-    return 0; // FIXME
+    // binary search for the first sync sample >= sample_index
+    AP4_Cardinal sync_count = m_SyncSamples.ItemCount();
+    AP4_Ordinal  lo = 0;
+    AP4_Ordinal  hi = sync_count;
+    while (lo < hi) {
+        AP4_Ordinal mid = lo+(hi-lo)/2;
+        if (m_SyncSamples[mid] < sample_index) {
+            lo = mid+1;
+        } else {
+            hi = mid;
+        }
+    }
+    
+    if (before) {
+        if (lo < sync_count && m_SyncSamples[lo] == sample_index) return sample_index;
+        
+        // not found?
+        return lo ? m_SyncSamples[lo-1] : 0;
+    } else {
+        // not found?
+        return lo < sync_count ? m_SyncSamples[lo] : m_Samples.ItemCount();
+    }
 }
 
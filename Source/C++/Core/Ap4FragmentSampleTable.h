@@ -76,8 +76,9 @@ class AP4_FragmentSampleTable : public AP4_SampleTable
     
 private:
     // members
-    AP4_Array<AP4_Sample> m_Samples;
-    AP4_UI64              m_Duration;
+    AP4_Array<AP4_Sample>  m_Samples;      // in increasing dts order
+    AP4_Array<AP4_Ordinal> m_SyncSamples;  // indexes of the sync samples, in increasing order
+    AP4_UI64               m_Duration;
     
     // methods
     AP4_Result AddTrun(AP4_TrunAtom*   trun, 
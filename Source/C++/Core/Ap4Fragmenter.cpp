@@ -0,0 +1,1151 @@
+/*****************************************************************
+|
+|    AP4 - MP4 Fragmenter
+|
+|    Copyright 2002-2015 Axiomatic Systems, LLC
+|
+|
+|    This file is part of Bento4/AP4 (MP4 Atom Processing Library).
+|
+|    Unless you have obtained Bento4 under a difference license,
+|    this version of Bento4 is Bento4|GPL.
+|    Bento4|GPL is free software; you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation; either version 2, or (at your option)
+|    any later version.
+|
+|    Bento4|GPL is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with Bento4|GPL; see the file COPYING.  If not, write to the
+|    Free Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+|    02111-1307, USA.
+|
+ ****************************************************************/
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "Ap4Fragmenter.h"
+#include "Ap4File.h"
+#include "Ap4Movie.h"
+#include "Ap4Track.h"
+#include "Ap4Sample.h"
+#include "Ap4ByteStream.h"
+#include "Ap4DataBuffer.h"
+#include "Ap4Utils.h"
+#include "Ap4LinearReader.h"
+#include "Ap4AtomFactory.h"
+#include "Ap4ContainerAtom.h"
+#include "Ap4SyntheticSampleTable.h"
+#include "Ap4SampleDescription.h"
+#include "Ap4FtypAtom.h"
+#include "Ap4MehdAtom.h"
+#include "Ap4TrexAtom.h"
+#include "Ap4TrakAtom.h"
+#include "Ap4ElstAtom.h"
+#include "Ap4MfhdAtom.h"
+#include "Ap4TfhdAtom.h"
+#include "Ap4TfdtAtom.h"
+#include "Ap4TrunAtom.h"
+#include "Ap4TfraAtom.h"
+#include "Ap4MfroAtom.h"
+#include "Ap4SidxAtom.h"
+
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+static const AP4_AtomPath AP4_PATH_TRAF_TFHD("traf/tfhd");
+static const AP4_AtomPath AP4_PATH_TRAF_TRUN("traf/trun");
+
+/*----------------------------------------------------------------------
+|   AP4_Fragmenter::SampleArray
++---------------------------------------------------------------------*/
+class AP4_Fragmenter::SampleArray {
+public:
+    SampleArray(AP4_Track* track) :
+        m_Track(track) {
+        m_SampleCount = m_Track->GetSampleCount();
+        if (m_SampleCount) {
+            m_ForcedSync = new bool[m_SampleCount];
+            for (unsigned int i=0; i<m_SampleCount; i++) {
+                m_ForcedSync[i] = false;
+            }
+        } else {
+            m_ForcedSync = NULL;
+        }
+    }
+    virtual ~SampleArray() {
+        delete[] m_ForcedSync;
+    }
+
+    virtual AP4_Cardinal GetSampleCount() {
+        return m_SampleCount;
+    }
+    virtual AP4_Result GetSample(AP4_Ordinal index, AP4_Sample& sample) {
+        AP4_Result result = m_Track->GetSample(index, sample);
+        if (AP4_SUCCEEDED(result)) {
+            if (m_ForcedSync[index]) {
+                sample.SetSync(true);
+            }
+        }
+        return result;
+    }
+    virtual AP4_Result AddSample(AP4_Sample& /*sample*/) {
+        return AP4_ERROR_NOT_SUPPORTED;
+    }
+    virtual void ForceSync(AP4_Ordinal index) {
+        if (index < m_SampleCount) {
+            m_ForcedSync[index] = true;
+        }
+    }
+
+protected:
+    AP4_Track*   m_Track;
+    AP4_Cardinal m_SampleCount;
+    bool*        m_ForcedSync;
+};
+
+/*----------------------------------------------------------------------
+|   AP4_Fragmenter::CachedSampleArray
++---------------------------------------------------------------------*/
+class AP4_Fragmenter::CachedSampleArray : public AP4_Fragmenter::SampleArray {
+public:
+    CachedSampleArray(AP4_Track* track) :
+        SampleArray(track) {}
+
+    virtual AP4_Cardinal GetSampleCount() {
+        return m_Samples.ItemCount();
+    }
+    virtual AP4_Result GetSample(AP4_Ordinal index, AP4_Sample& sample) {
+        if (index >= m_Samples.ItemCount()) {
+            return AP4_ERROR_OUT_OF_RANGE;
+        } else {
+            sample = m_Samples[index];
+            return AP4_SUCCESS;
+        }
+    }
+    virtual AP4_Result AddSample(AP4_Sample& sample) {
+        return m_Samples.Append(sample);
+    }
+
+protected:
+    AP4_Array<AP4_Sample> m_Samples;
+};
+
+/*----------------------------------------------------------------------
+|   AP4_Fragmenter::TrackCursor
++---------------------------------------------------------------------*/
+class AP4_Fragmenter::TrackCursor
+{
+public:
+    TrackCursor(AP4_Track* track, SampleArray* samples);
+    ~TrackCursor();
+
+    AP4_Result    Init();
+    AP4_Result    SetSampleIndex(AP4_Ordinal sample_index);
+
+    AP4_Track*    m_Track;
+    SampleArray*  m_Samples;
+    AP4_Ordinal   m_SampleIndex;
+    AP4_Ordinal   m_FragmentIndex;
+    AP4_Sample    m_Sample;
+    AP4_UI64      m_Timestamp;
+    AP4_UI64      m_UnscaledTimestamp;
+    bool          m_Eos;
+    AP4_TfraAtom* m_Tfra;
+};
+
+/*----------------------------------------------------------------------
+|   AP4_Fragmenter::TrackCursor::TrackCursor
++---------------------------------------------------------------------*/
+AP4_Fragmenter::TrackCursor::TrackCursor(AP4_Track* track, SampleArray* samples) :
+    m_Track(track),
+    m_Samples(samples),
+    m_SampleIndex(0),
+    m_FragmentIndex(0),
+    m_Timestamp(0),
+    m_UnscaledTimestamp(0),
+    m_Eos(false),
+    m_Tfra(new AP4_TfraAtom(0))
+{
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Fragmenter::TrackCursor::~TrackCursor
++---------------------------------------------------------------------*/
+AP4_Fragmenter::TrackCursor::~TrackCursor()
+{
+    delete m_Tfra;
+    delete m_Samples;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Fragmenter::TrackCursor::Init
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Fragmenter::TrackCursor::Init()
+{
+    return m_Samples->GetSample(0, m_Sample);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Fragmenter::TrackCursor::SetSampleIndex
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Fragmenter::TrackCursor::SetSampleIndex(AP4_Ordinal sample_index)
+{
+    m_SampleIndex = sample_index;
+
+    // check if we're at the end
+    if (sample_index >= m_Samples->GetSampleCount()) {
+        AP4_UI64 end_dts = m_Sample.GetDts()+m_Sample.GetDuration();
+        m_Sample.Reset();
+        m_Sample.SetDts(end_dts);
+        m_Eos = true;
+    } else {
+        return m_Samples->GetSample(m_SampleIndex, m_Sample);
+    }
+
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Fragmenter::FragmentInfo
++---------------------------------------------------------------------*/
+class AP4_Fragmenter::FragmentInfo {
+public:
+    FragmentInfo(SampleArray* samples, AP4_TfraAtom* tfra, AP4_UI64 timestamp, AP4_ContainerAtom* moof) :
+        m_Samples(samples),
+        m_Tfra(tfra),
+        m_Timestamp(timestamp),
+        m_Duration(0),
+        m_Moof(moof),
+        m_MoofPosition(0),
+        m_MdatSize(0) {}
+    ~FragmentInfo() { delete m_Moof; }
+
+    SampleArray*        m_Samples;
+    AP4_TfraAtom*       m_Tfra;
+    AP4_UI64            m_Timestamp;
+    AP4_UI32            m_Duration;
+    AP4_Array<AP4_UI32> m_SampleIndexes;
+    AP4_ContainerAtom*  m_Moof;
+    AP4_Position        m_MoofPosition;
+    AP4_UI32            m_MdatSize;
+};
+
+/*----------------------------------------------------------------------
+|   IsIFrame
++---------------------------------------------------------------------*/
+static bool
+IsIFrame(AP4_Sample& sample, AP4_AvcSampleDescription* avc_desc) {
+    AP4_DataBuffer sample_data;
+    if (AP4_FAILED(sample.ReadData(sample_data))) {
+        return false;
+    }
+
+    const unsigned char* data = sample_data.GetData();
+    AP4_Size             size = sample_data.GetDataSize();
+
+    while (size >= avc_desc->GetNaluLengthSize()) {
+        unsigned int nalu_length = 0;
+        if (avc_desc->GetNaluLengthSize() == 1) {
+            nalu_length = *data++;
+            --size;
+        } else if (avc_desc->GetNaluLengthSize() == 2) {
+            nalu_length = AP4_BytesToUInt16BE(data);
+            data += 2;
+            size -= 2;
+        } else if (avc_desc->GetNaluLengthSize() == 4) {
+            nalu_length = AP4_BytesToUInt32BE(data);
+            data += 4;
+            size -= 4;
+        } else {
+            return false;
+        }
+        if (nalu_length <= size) {
+            size -= nalu_length;
+        } else {
+            size = 0;
+        }
+
+        switch (*data & 0x1F) {
+            case 1: {
+                AP4_BitReader bits(data+1, 8);
+                bits.ReadGolomb();
+                unsigned int slice_type = bits.ReadGolomb();
+                if (slice_type == 2 || slice_type == 7) {
+                    return true;
+                } else {
+                    return false; // only show first slice type
+                }
+            }
+
+            case 5:
+                return true;
+        }
+
+        data += nalu_length;
+    }
+
+    return false;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Fragmenter::AP4_Fragmenter
++---------------------------------------------------------------------*/
+AP4_Fragmenter::AP4_Fragmenter(AP4_File& input_file, AP4_ByteStream& input_stream) :
+    m_InputFile(input_file),
+    m_InputStream(input_stream),
+    m_FragmentDuration(0),
+    m_Timescale(0),
+    m_TrackId(0),
+    m_CreateSegmentIndex(false),
+    m_Trim(false),
+    m_NoTfdt(false),
+    m_TfdtStart(0.0),
+    m_SequenceNumberStart(1),
+    m_ForceSyncMode(FORCE_SYNC_MODE_NONE),
+    m_Listener(NULL),
+    m_Prepared(false),
+    m_FragmentsPosition(0),
+    m_VideoCursor(NULL),
+    m_AudioCursor(NULL)
+{
+    m_InputStream.AddReference();
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Fragmenter::~AP4_Fragmenter
++---------------------------------------------------------------------*/
+AP4_Fragmenter::~AP4_Fragmenter()
+{
+    for (unsigned int i=0; i<m_Cursors.ItemCount(); i++) {
+        delete m_Cursors[i];
+    }
+    m_InputStream.Release();
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Fragmenter::Prepare
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Fragmenter::Prepare()
+{
+    // start from scratch
+    for (unsigned int i=0; i<m_Cursors.ItemCount(); i++) {
+        delete m_Cursors[i];
+    }
+    m_Cursors.Clear();
+    m_VideoCursor = NULL;
+    m_AudioCursor = NULL;
+    m_Prepared    = false;
+
+    AP4_Movie* movie = m_InputFile.GetMovie();
+    if (movie == NULL) return AP4_ERROR_INVALID_FORMAT;
+
+    // create a cursor for each track we will read from
+    for (AP4_List<AP4_Track>::Item* track_item = movie->GetTracks().FirstItem();
+                                    track_item;
+                                    track_item = track_item->GetNext()) {
+        AP4_Track* track = track_item->GetData();
+
+        // skip tracks without samples
+        if (track->GetSampleCount() == 0 && !movie->HasFragments()) continue;
+
+        // create a sample array for this track
+        SampleArray* sample_array;
+        if (movie->HasFragments()) {
+            sample_array = new CachedSampleArray(track);
+        } else {
+            sample_array = new SampleArray(track);
+        }
+
+        // create a cursor for the track
+        TrackCursor* cursor = new TrackCursor(track, sample_array);
+        cursor->m_Tfra->SetTrackId(track->GetId());
+        m_Cursors.Append(cursor);
+
+        if (track->GetType() == AP4_Track::TYPE_VIDEO) {
+            if (m_VideoCursor == NULL) m_VideoCursor = cursor;
+        } else if (track->GetType() == AP4_Track::TYPE_AUDIO) {
+            if (m_AudioCursor == NULL) m_AudioCursor = cursor;
+        }
+    }
+    if (m_Cursors.ItemCount() == 0) return AP4_ERROR_INVALID_FORMAT;
+
+    // check that the selected track is there
+    if (m_TrackId) {
+        bool found = false;
+        for (unsigned int i=0; i<m_Cursors.ItemCount(); i++) {
+            if (m_Cursors[i]->m_Track->GetId() == m_TrackId) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) return AP4_ERROR_NO_SUCH_ITEM;
+    }
+
+    // forcing the sync flag is only supported for AVC
+    AP4_AvcSampleDescription* avc_desc = NULL;
+    if (m_VideoCursor && m_ForceSyncMode != FORCE_SYNC_MODE_NONE) {
+        AP4_SampleDescription* sdesc = m_VideoCursor->m_Track->GetSampleDescription(0);
+        if (sdesc) {
+            avc_desc = AP4_DYNAMIC_CAST(AP4_AvcSampleDescription, sdesc);
+        }
+        if (avc_desc == NULL) return AP4_ERROR_NOT_SUPPORTED;
+    }
+
+    // the fragments, if any, start right after the moov atom
+    m_FragmentsPosition = 0;
+    for (AP4_List<AP4_Atom>::Item* item = m_InputFile.GetChildren().FirstItem();
+                                   item;
+                                   item = item->GetNext()) {
+        m_FragmentsPosition += item->GetData()->GetSize();
+        if (item->GetData()->GetType() == AP4_ATOM_TYPE_MOOV) break;
+    }
+
+    // remember where the stream was
+    AP4_Position position = 0;
+    m_InputStream.Tell(position);
+
+    // for fragmented input files, we need to populate the sample arrays
+    if (movie->HasFragments()) {
+        m_InputStream.Seek(m_FragmentsPosition);
+        AP4_LinearReader reader(*movie, &m_InputStream);
+        for (unsigned int i=0; i<m_Cursors.ItemCount(); i++) {
+            reader.EnableTrack(m_Cursors[i]->m_Track->GetId());
+        }
+        AP4_UI32   track_id;
+        AP4_Sample sample;
+        AP4_Result result;
+        do {
+            result = reader.GetNextSample(sample, track_id);
+            if (AP4_SUCCEEDED(result)) {
+                for (unsigned int i=0; i<m_Cursors.ItemCount(); i++) {
+                    if (m_Cursors[i]->m_Track->GetId() == track_id) {
+                        m_Cursors[i]->m_Samples->AddSample(sample);
+                        break;
+                    }
+                }
+            }
+        } while (AP4_SUCCEEDED(result));
+    } else if (avc_desc) {
+        ForceSync(m_VideoCursor, avc_desc);
+    }
+
+    // return the stream to its original position
+    m_InputStream.Seek(position);
+
+    m_Prepared = true;
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Fragmenter::ForceSync
++---------------------------------------------------------------------*/
+void
+AP4_Fragmenter::ForceSync(TrackCursor* cursor, AP4_AvcSampleDescription* avc_desc)
+{
+    AP4_Sample sample;
+    if (m_ForceSyncMode == FORCE_SYNC_MODE_AUTO) {
+        // detect if this looks like an open-gop source
+        for (unsigned int i=1; i<cursor->m_Samples->GetSampleCount(); i++) {
+            if (AP4_SUCCEEDED(cursor->m_Samples->GetSample(i, sample))) {
+                if (sample.IsSync()) {
+                    // we found a sync i-frame, assume this is *not* an open-gop source
+                    return;
+                }
+            }
+        }
+    }
+    for (unsigned int i=0; i<cursor->m_Samples->GetSampleCount(); i++) {
+        if (AP4_SUCCEEDED(cursor->m_Samples->GetSample(i, sample))) {
+            if (IsIFrame(sample, avc_desc)) {
+                cursor->m_Samples->ForceSync(i);
+            }
+        }
+    }
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Fragmenter::DetectFragmentDuration
++---------------------------------------------------------------------*/
+unsigned int
+AP4_Fragmenter::DetectFragmentDuration()
+{
+    if (!m_Prepared && AP4_FAILED(Prepare())) return 0;
+
+    if (m_VideoCursor) {
+        return DetectVideoFragmentDuration(m_VideoCursor);
+    } else if (m_AudioCursor && m_InputFile.GetMovie()->HasFragments()) {
+        return DetectAudioFragmentDuration(m_AudioCursor);
+    }
+
+    return 0;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Fragmenter::DetectVideoFragmentDuration
++---------------------------------------------------------------------*/
+unsigned int
+AP4_Fragmenter::DetectVideoFragmentDuration(TrackCursor* cursor)
+{
+    AP4_Sample   sample;
+    unsigned int sample_count = cursor->m_Samples->GetSampleCount();
+
+    // get the first sample as the starting point
+    AP4_Result result = cursor->m_Samples->GetSample(0, sample);
+    if (AP4_FAILED(result)) return 0;
+    if (!sample.IsSync()) return 0; // the first sample is not an I frame
+
+    for (unsigned int interval = 1; interval < sample_count; interval++) {
+        bool irregular = false;
+        unsigned int sync_count = 0;
+        unsigned int i;
+        for (i = 0; i < sample_count; i += interval) {
+            result = cursor->m_Samples->GetSample(i, sample);
+            if (AP4_FAILED(result)) return 0;
+            if (!sample.IsSync()) {
+                irregular = true;
+                break;
+            }
+            ++sync_count;
+        }
+        if (sync_count < 1) continue;
+        if (!irregular) {
+            // found a pattern
+            AP4_UI64 duration = sample.GetDts();
+            double fps = (double)(interval*(sync_count-1))/((double)duration/(double)cursor->m_Track->GetMediaTimeScale());
+            if (m_Listener) m_Listener->OnIFrameInterval(interval, fps);
+            return (unsigned int)(1000.0*(double)interval/fps);
+        }
+    }
+
+    return 0;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Fragmenter::DetectAudioFragmentDuration
++---------------------------------------------------------------------*/
+unsigned int
+AP4_Fragmenter::DetectAudioFragmentDuration(TrackCursor* cursor)
+{
+    // remember where we are in the stream
+    AP4_Position where = 0;
+    m_InputStream.Tell(where);
+    AP4_LargeSize stream_size = 0;
+    m_InputStream.GetSize(stream_size);
+    if (stream_size < m_FragmentsPosition) return 0;
+    AP4_LargeSize bytes_available = stream_size-m_FragmentsPosition;
+    m_InputStream.Seek(m_FragmentsPosition);
+
+    AP4_UI64  fragment_count = 0;
+    AP4_UI32  last_fragment_size = 0;
+    AP4_Atom* atom = NULL;
+    AP4_DefaultAtomFactory atom_factory;
+    while (AP4_SUCCEEDED(atom_factory.CreateAtomFromStream(m_InputStream, bytes_available, atom))) {
+        if (atom && atom->GetType() == AP4_ATOM_TYPE_MOOF) {
+            AP4_ContainerAtom* moof = AP4_DYNAMIC_CAST(AP4_ContainerAtom, atom);
+            AP4_TfhdAtom* tfhd = AP4_DYNAMIC_CAST(AP4_TfhdAtom, moof->FindChild(AP4_PATH_TRAF_TFHD));
+            if (tfhd && tfhd->GetTrackId() == cursor->m_Track->GetId()) {
+                ++fragment_count;
+                AP4_TrunAtom* trun = AP4_DYNAMIC_CAST(AP4_TrunAtom, moof->FindChild(AP4_PATH_TRAF_TRUN));
+                if (trun) {
+                    last_fragment_size = trun->GetEntries().ItemCount();
+                }
+            }
+        }
+        delete atom;
+        atom = NULL;
+    }
+
+    // restore the stream to its original position
+    m_InputStream.Seek(where);
+
+    // decide if we can infer an fragment size
+    if (fragment_count == 0 || cursor->m_Samples->GetSampleCount() == 0) {
+        return 0;
+    }
+    // don't count the last fragment if we have more than one
+    if (fragment_count > 1 && last_fragment_size) {
+        --fragment_count;
+    }
+    if (fragment_count <= 1 || cursor->m_Samples->GetSampleCount() < last_fragment_size) {
+        last_fragment_size = 0;
+    }
+    AP4_Sample sample;
+    AP4_UI64 total_duration = 0;
+    for (unsigned int i=0; i<cursor->m_Samples->GetSampleCount()-last_fragment_size; i++) {
+        cursor->m_Samples->GetSample(i, sample);
+        total_duration += sample.GetDuration();
+    }
+    return (unsigned int)AP4_ConvertTime(total_duration/fragment_count, cursor->m_Track->GetMediaTimeScale(), 1000);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Fragmenter::Fragment
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Fragmenter::Fragment(AP4_ByteStream& output_stream)
+{
+    // select the tracks and load the samples if that hasn't been done yet
+    if (!m_Prepared) {
+        AP4_Result result = Prepare();
+        if (AP4_FAILED(result)) return result;
+    }
+
+    // decide on the fragment duration
+    unsigned int fragment_duration = m_FragmentDuration;
+    if (fragment_duration == 0) {
+        fragment_duration = DetectFragmentDuration();
+        if (fragment_duration == 0 || fragment_duration > AP4_FRAGMENTER_MAX_AUTO_FRAGMENT_DURATION) {
+            fragment_duration = AP4_FRAGMENTER_DEFAULT_FRAGMENT_DURATION;
+        }
+    }
+
+    AP4_Result result = WriteFragments(output_stream, fragment_duration);
+
+    // the cursors have been consumed, start over if called again
+    for (unsigned int i=0; i<m_Cursors.ItemCount(); i++) {
+        delete m_Cursors[i];
+    }
+    m_Cursors.Clear();
+    m_VideoCursor = NULL;
+    m_AudioCursor = NULL;
+    m_Prepared    = false;
+
+    return result;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Fragmenter::WriteFragments
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Fragmenter::WriteFragments(AP4_ByteStream& output_stream, unsigned int fragment_duration)
+{
+    AP4_List<FragmentInfo> fragments;
+    TrackCursor*           index_cursor = NULL;
+    AP4_Result             result;
+
+    AP4_Movie* input_movie = m_InputFile.GetMovie();
+    if (input_movie == NULL) return AP4_ERROR_INVALID_FORMAT;
+
+    // create the output file object
+    AP4_Movie* output_movie = new AP4_Movie(AP4_FRAGMENTER_OUTPUT_MOVIE_TIMESCALE);
+
+    // create an mvex container
+    AP4_ContainerAtom* mvex = new AP4_ContainerAtom(AP4_ATOM_TYPE_MVEX);
+    AP4_MehdAtom*      mehd = new AP4_MehdAtom(0);
+    mvex->AddChild(mehd);
+
+    // add an output track for each track in the input file
+    for (unsigned int i=0; i<m_Cursors.ItemCount(); i++) {
+        AP4_Track* track = m_Cursors[i]->m_Track;
+
+        // skip non matching tracks if we have a selector
+        if (m_TrackId && track->GetId() != m_TrackId) {
+            continue;
+        }
+
+        result = m_Cursors[i]->Init();
+        if (AP4_FAILED(result)) {
+            delete mvex;
+            delete output_movie;
+            return result;
+        }
+
+        // create a sample table (with no samples) to hold the sample description
+        AP4_SyntheticSampleTable* sample_table = new AP4_SyntheticSampleTable();
+        for (unsigned int j=0; j<track->GetSampleDescriptionCount(); j++) {
+            AP4_SampleDescription* sample_description = track->GetSampleDescription(j);
+            sample_table->AddSampleDescription(sample_description, false);
+        }
+
+        // create the track
+        AP4_Track* output_track = new AP4_Track(sample_table,
+                                                track->GetId(),
+                                                m_Timescale?m_Timescale:AP4_FRAGMENTER_OUTPUT_MOVIE_TIMESCALE,
+                                                AP4_ConvertTime(track->GetDuration(),
+                                                                input_movie->GetTimeScale(),
+                                                                m_Timescale?m_Timescale:AP4_FRAGMENTER_OUTPUT_MOVIE_TIMESCALE),
+                                                m_Timescale?m_Timescale:track->GetMediaTimeScale(),
+                                                0,//track->GetMediaDuration(),
+                                                track);
+
+        // add an edit list if needed
+        if (const AP4_TrakAtom* trak = track->GetTrakAtom()) {
+            AP4_ContainerAtom* edts = AP4_DYNAMIC_CAST(AP4_ContainerAtom, trak->GetChild(AP4_ATOM_TYPE_EDTS));
+            if (edts) {
+                // create an 'edts' container
+                AP4_ContainerAtom* new_edts = new AP4_ContainerAtom(AP4_ATOM_TYPE_EDTS);
+
+                // create a new 'edts' for each original 'edts'
+                for (AP4_List<AP4_Atom>::Item* edts_entry = edts->GetChildren().FirstItem();
+                     edts_entry;
+                     edts_entry = edts_entry->GetNext()) {
+                    AP4_ElstAtom* elst = AP4_DYNAMIC_CAST(AP4_ElstAtom, edts_entry->GetData());
+                    AP4_ElstAtom* new_elst = new AP4_ElstAtom();
+
+                    // adjust the fields to match the correct timescale
+                    for (unsigned int j=0; j<elst->GetEntries().ItemCount(); j++) {
+                        AP4_ElstEntry new_elst_entry = elst->GetEntries()[j];
+                        new_elst_entry.m_SegmentDuration = AP4_ConvertTime(new_elst_entry.m_SegmentDuration,
+                                                                           input_movie->GetTimeScale(),
+                                                                           AP4_FRAGMENTER_OUTPUT_MOVIE_TIMESCALE);
+                        if (new_elst_entry.m_MediaTime > 0 && m_Timescale) {
+                            new_elst_entry.m_MediaTime = (AP4_SI64)AP4_ConvertTime(new_elst_entry.m_MediaTime,
+                                                                                   track->GetMediaTimeScale(),
+                                                                                   m_Timescale);
+
+                        }
+                        new_elst->AddEntry(new_elst_entry);
+                    }
+
+                    // add the 'elst' to the 'edts' container
+                    new_edts->AddChild(new_elst);
+                }
+
+                // add the edit list to the output track (just after the 'tkhd' atom)
+                output_track->UseTrakAtom()->AddChild(new_edts, 1);
+            }
+        }
+
+        // add the track to the output
+        output_movie->AddTrack(output_track);
+
+        // add a trex entry to the mvex container
+        AP4_TrexAtom* trex = new AP4_TrexAtom(track->GetId(),
+                                              1,
+                                              0,
+                                              0,
+                                              0);
+        mvex->AddChild(trex);
+    }
+
+    // select the anchor cursor
+    TrackCursor* anchor_cursor = NULL;
+    for (unsigned int i=0; i<m_Cursors.ItemCount(); i++) {
+        if (m_Cursors[i]->m_Track->GetId() == m_TrackId) {
+            anchor_cursor = m_Cursors[i];
+        }
+    }
+    if (anchor_cursor == NULL) {
+        for (unsigned int i=0; i<m_Cursors.ItemCount(); i++) {
+            // use this as the anchor track if it is the first video track
+            if (m_Cursors[i]->m_Track->GetType() == AP4_Track::TYPE_VIDEO) {
+                anchor_cursor = m_Cursors[i];
+                break;
+            }
+        }
+    }
+    if (anchor_cursor == NULL) {
+        // no video track to anchor with, pick the first audio track
+        for (unsigned int i=0; i<m_Cursors.ItemCount(); i++) {
+            if (m_Cursors[i]->m_Track->GetType() == AP4_Track::TYPE_AUDIO) {
+                anchor_cursor = m_Cursors[i];
+                break;
+            }
+        }
+        // no audio track to anchor with, pick the first subtitles track
+        for (unsigned int i=0; i<m_Cursors.ItemCount(); i++) {
+            if (m_Cursors[i]->m_Track->GetType() == AP4_Track::TYPE_SUBTITLES) {
+                anchor_cursor = m_Cursors[i];
+                break;
+            }
+        }
+    }
+    if (anchor_cursor == NULL) {
+        // no audio, video or subtitles track
+        delete mvex;
+        delete output_movie;
+        return AP4_ERROR_INVALID_FORMAT;
+    }
+    if (m_CreateSegmentIndex) {
+        index_cursor = anchor_cursor;
+    }
+    if (m_Listener) m_Listener->OnAnchorTrack(anchor_cursor->m_Track->GetId(), true);
+
+    // update the mehd duration
+    mehd->SetDuration(output_movie->GetDuration());
+
+    // add the mvex container to the moov container
+    output_movie->GetMoovAtom()->AddChild(mvex);
+
+    // compute all the fragments
+    unsigned int sequence_number = m_SequenceNumberStart;
+    for(;;) {
+        TrackCursor* cursor = NULL;
+
+        // pick the first track with a fragment index lower than the anchor's
+        for (unsigned int i=0; i<m_Cursors.ItemCount(); i++) {
+            if (m_TrackId && m_Cursors[i]->m_Track->GetId() != m_TrackId) continue;
+            if (m_Cursors[i]->m_Eos) continue;
+            if (m_Cursors[i]->m_FragmentIndex < anchor_cursor->m_FragmentIndex) {
+                cursor = m_Cursors[i];
+                break;
+            }
+        }
+
+        // check if we found a non-anchor cursor to use
+        if (cursor == NULL) {
+            // the anchor should be used in this round, check if we can use it
+            if (anchor_cursor->m_Eos) {
+                // the anchor is done, pick a new anchor unless we need to trim
+                anchor_cursor = NULL;
+                if (!m_Trim) {
+                    for (unsigned int i=0; i<m_Cursors.ItemCount(); i++) {
+                        if (m_TrackId && m_Cursors[i]->m_Track->GetId() != m_TrackId) continue;
+                        if (m_Cursors[i]->m_Eos) continue;
+                        if (anchor_cursor == NULL ||
+                            m_Cursors[i]->m_Track->GetType() == AP4_Track::TYPE_VIDEO ||
+                            m_Cursors[i]->m_Track->GetType() == AP4_Track::TYPE_AUDIO) {
+                            anchor_cursor = m_Cursors[i];
+                            if (m_Listener) m_Listener->OnAnchorTrack(anchor_cursor->m_Track->GetId(), false);
+                        }
+                    }
+                }
+            }
+            cursor = anchor_cursor;
+        }
+        if (cursor == NULL) break; // all done
+
+        // decide how many samples go into this fragment
+        AP4_UI64 target_dts;
+        if (cursor == anchor_cursor) {
+            // compute the current dts in milliseconds
+            AP4_UI64 anchor_dts_ms = AP4_ConvertTime(cursor->m_Sample.GetDts(),
+                                                     cursor->m_Track->GetMediaTimeScale(),
+                                                     1000);
+            // round to the nearest multiple of fragment_duration
+            AP4_UI64 anchor_position = (anchor_dts_ms + (fragment_duration/2))/fragment_duration;
+
+            // pick the next fragment_duration multiple at our target
+            target_dts = AP4_ConvertTime(fragment_duration*(anchor_position+1),
+                                         1000,
+                                         cursor->m_Track->GetMediaTimeScale());
+        } else {
+            target_dts = AP4_ConvertTime(anchor_cursor->m_Sample.GetDts(),
+                                         anchor_cursor->m_Track->GetMediaTimeScale(),
+                                         cursor->m_Track->GetMediaTimeScale());
+            if (target_dts <= cursor->m_Sample.GetDts()) {
+                // we must be at the end, past the last anchor sample, just use the target duration
+                target_dts = AP4_ConvertTime(fragment_duration*(cursor->m_FragmentIndex+1),
+                                            1000,
+                                            cursor->m_Track->GetMediaTimeScale());
+
+                if (target_dts <= cursor->m_Sample.GetDts()) {
+                    // we're still behind, there may have been an alignment/rounding error, just advance by one segment duration
+                    target_dts = cursor->m_Sample.GetDts()+AP4_ConvertTime(fragment_duration,
+                                                                           1000,
+                                                                           cursor->m_Track->GetMediaTimeScale());
+                }
+            }
+        }
+
+        unsigned int end_sample_index = cursor->m_Samples->GetSampleCount();
+        AP4_UI64 smallest_diff = (AP4_UI64)(0xFFFFFFFFFFFFFFFFULL);
+        AP4_Sample sample;
+        for (unsigned int i=cursor->m_SampleIndex+1; i<=cursor->m_Samples->GetSampleCount(); i++) {
+            AP4_UI64 dts;
+            if (i < cursor->m_Samples->GetSampleCount()) {
+                result = cursor->m_Samples->GetSample(i, sample);
+                if (AP4_FAILED(result)) goto end;
+                if (!sample.IsSync()) continue; // only look for sync samples
+                dts = sample.GetDts();
+            } else {
+                result = cursor->m_Samples->GetSample(i-1, sample);
+                if (AP4_FAILED(result)) goto end;
+                dts = sample.GetDts()+sample.GetDuration();
+            }
+            AP4_SI64 diff = dts-target_dts;
+            AP4_UI64 abs_diff = diff<0?-diff:diff;
+            if (abs_diff < smallest_diff) {
+                // this sample is the closest to the target so far
+                end_sample_index = i;
+                smallest_diff = abs_diff;
+            }
+            if (diff >= 0) {
+                // this sample is past the target, it is not going to get any better, stop looking
+                break;
+            }
+        }
+        if (cursor->m_Eos) continue;
+        if (m_Listener) {
+            m_Listener->OnFragmentStart(cursor->m_Track->GetId(),
+                                        cursor == anchor_cursor,
+                                        cursor->m_Sample.GetDts(),
+                                        target_dts,
+                                        cursor->m_SampleIndex,
+                                        end_sample_index,
+                                        cursor->m_Track->GetSampleCount());
+        }
+
+        // decide which sample description index to use
+        // (this is not very sophisticated, we only look at the sample description
+        // index of the first sample in the group, which may not be correct. This
+        // should be fixed later)
+        unsigned int sample_desc_index = cursor->m_Sample.GetDescriptionIndex();
+        unsigned int tfhd_flags = AP4_TFHD_FLAG_DEFAULT_BASE_IS_MOOF;
+        if (sample_desc_index > 0) {
+            tfhd_flags |= AP4_TFHD_FLAG_SAMPLE_DESCRIPTION_INDEX_PRESENT;
+        }
+        if (cursor->m_Track->GetType() == AP4_Track::TYPE_VIDEO) {
+            tfhd_flags |= AP4_TFHD_FLAG_DEFAULT_SAMPLE_FLAGS_PRESENT;
+        }
+
+        // setup the moof structure
+        AP4_ContainerAtom* moof = new AP4_ContainerAtom(AP4_ATOM_TYPE_MOOF);
+        moof->BeginChanges();
+        AP4_MfhdAtom* mfhd = new AP4_MfhdAtom(sequence_number++);
+        moof->AddChild(mfhd);
+        AP4_ContainerAtom* traf = new AP4_ContainerAtom(AP4_ATOM_TYPE_TRAF);
+        AP4_TfhdAtom* tfhd = new AP4_TfhdAtom(tfhd_flags,
+                                              cursor->m_Track->GetId(),
+                                              0,
+                                              sample_desc_index+1,
+                                              0,
+                                              0,
+                                              0);
+        if (tfhd_flags & AP4_TFHD_FLAG_DEFAULT_SAMPLE_FLAGS_PRESENT) {
+            tfhd->SetDefaultSampleFlags(0x1010000); // sample_is_non_sync_sample=1, sample_depends_on=1 (not I frame)
+        }
+
+        traf->AddChild(tfhd);
+        if (!m_NoTfdt) {
+            AP4_TfdtAtom* tfdt = new AP4_TfdtAtom(1, cursor->m_Timestamp + (AP4_UI64)(m_TfdtStart * (double)cursor->m_Track->GetMediaTimeScale()));
+            traf->AddChild(tfdt);
+        }
+        AP4_UI32 trun_flags = AP4_TRUN_FLAG_DATA_OFFSET_PRESENT |
+                              AP4_TRUN_FLAG_SAMPLE_SIZE_PRESENT;
+        AP4_UI32 first_sample_flags = 0;
+        if (cursor->m_Track->GetType() == AP4_Track::TYPE_VIDEO) {
+            trun_flags |= AP4_TRUN_FLAG_FIRST_SAMPLE_FLAGS_PRESENT;
+            first_sample_flags = 0x2000000; // sample_depends_on=2 (I frame)
+        }
+        AP4_TrunAtom* trun = new AP4_TrunAtom(trun_flags, 0, first_sample_flags);
+
+        traf->AddChild(trun);
+        moof->AddChild(traf);
+
+        // create a new FragmentInfo object to store the fragment details
+        FragmentInfo* fragment = new FragmentInfo(cursor->m_Samples, cursor->m_Tfra, cursor->m_Timestamp, moof);
+        fragments.Add(fragment);
+
+        // add samples to the fragment
+        unsigned int sample_count = 0;
+        AP4_Array<AP4_TrunAtom::Entry> trun_entries;
+        fragment->m_MdatSize = AP4_ATOM_HEADER_SIZE;
+        AP4_UI32 constant_sample_duration = 0;
+        bool all_segment_durations_equal = true;
+        for (;;) {
+            // if we have one non-zero CTS delta, we'll need to express it
+            if (cursor->m_Sample.GetCtsDelta()) {
+                trun->SetFlags(trun->GetFlags() | AP4_TRUN_FLAG_SAMPLE_COMPOSITION_TIME_OFFSET_PRESENT);
+            }
+
+            // add one sample
+            trun_entries.Append(AP4_TrunAtom::Entry());
+            AP4_TrunAtom::Entry& trun_entry = trun_entries[sample_count];
+            AP4_UI64 next_unscaled_timestamp = cursor->m_UnscaledTimestamp+cursor->m_Sample.GetDuration();
+            AP4_UI64 next_scaled_timestamp   = m_Timescale?
+                                               AP4_ConvertTime(next_unscaled_timestamp,
+                                                               cursor->m_Track->GetMediaTimeScale(),
+                                                               m_Timescale):
+                                               next_unscaled_timestamp;
+            trun_entry.sample_duration                = (AP4_UI32)(next_scaled_timestamp-cursor->m_Timestamp);
+            trun_entry.sample_size                    = cursor->m_Sample.GetSize();
+            trun_entry.sample_composition_time_offset = m_Timescale?
+                                                        (AP4_UI32)AP4_ConvertTime(cursor->m_Sample.GetCtsDelta(),
+                                                                                  cursor->m_Track->GetMediaTimeScale(),
+                                                                                  m_Timescale):
+                                                        cursor->m_Sample.GetCtsDelta();
+
+            fragment->m_SampleIndexes.Append(cursor->m_SampleIndex);
+            fragment->m_MdatSize += trun_entry.sample_size;
+            fragment->m_Duration += trun_entry.sample_duration;
+
+            // check if the durations are all the same
+            if (all_segment_durations_equal) {
+                if (constant_sample_duration == 0) {
+                    constant_sample_duration = trun_entry.sample_duration;
+                } else {
+                    if (constant_sample_duration != trun_entry.sample_duration) {
+                        all_segment_durations_equal = false;
+                    }
+                }
+            }
+
+            // next sample
+            cursor->m_UnscaledTimestamp = next_unscaled_timestamp;
+            cursor->m_Timestamp         = next_scaled_timestamp;
+            result = cursor->SetSampleIndex(cursor->m_SampleIndex+1);
+            if (AP4_FAILED(result)) goto end;
+            sample_count++;
+            if (cursor->m_Eos) {
+                if (m_Listener) m_Listener->OnTrackEnd(cursor->m_Track->GetId());
+                break;
+            }
+            if (cursor->m_SampleIndex >= end_sample_index) {
+                break; // done with this fragment
+            }
+        }
+        if (m_Listener) {
+            m_Listener->OnFragmentEnd(cursor->m_Track->GetId(), sample_count, all_segment_durations_equal);
+        }
+
+        // update the 'trun' flags if needed
+        if (all_segment_durations_equal) {
+            tfhd->SetDefaultSampleDuration(constant_sample_duration);
+            tfhd->UpdateFlags(tfhd->GetFlags() | AP4_TFHD_FLAG_DEFAULT_SAMPLE_DURATION_PRESENT);
+        } else {
+            trun->SetFlags(trun->GetFlags() | AP4_TRUN_FLAG_SAMPLE_DURATION_PRESENT);
+        }
+
+        // update moof and children
+        trun->SetEntries(trun_entries);
+        moof->EndChanges();
+        trun->SetDataOffset((AP4_UI32)moof->GetSize()+AP4_ATOM_HEADER_SIZE);
+
+        // advance the cursor's fragment index
+        ++cursor->m_FragmentIndex;
+    }
+
+    {
+        // write the ftyp atom
+        AP4_FtypAtom* ftyp = m_InputFile.GetFileType();
+        if (ftyp) {
+            // keep the existing brand and compatible brands
+            AP4_Array<AP4_UI32> compatible_brands;
+            compatible_brands.EnsureCapacity(ftyp->GetCompatibleBrands().ItemCount()+1);
+            for (unsigned int i=0; i<ftyp->GetCompatibleBrands().ItemCount(); i++) {
+                compatible_brands.Append(ftyp->GetCompatibleBrands()[i]);
+            }
+
+            // add the compatible brand if it is not already there
+            if (!ftyp->HasCompatibleBrand(AP4_FILE_BRAND_ISO5)) {
+                compatible_brands.Append(AP4_FILE_BRAND_ISO5);
+            }
+
+            // create a replacement
+            AP4_FtypAtom* new_ftyp = new AP4_FtypAtom(ftyp->GetMajorBrand(),
+                                                      ftyp->GetMinorVersion(),
+                                                      &compatible_brands[0],
+                                                      compatible_brands.ItemCount());
+            ftyp = new_ftyp;
+        } else {
+            AP4_UI32 compat = AP4_FILE_BRAND_ISO5;
+            ftyp = new AP4_FtypAtom(AP4_FTYP_BRAND_MP42, 0, &compat, 1);
+        }
+        result = ftyp->Write(output_stream);
+        delete ftyp;
+        if (AP4_FAILED(result)) goto end;
+
+        // write the moov atom
+        result = output_movie->GetMoovAtom()->Write(output_stream);
+        if (AP4_FAILED(result)) goto end;
+
+        // write the (not-yet fully computed) index if needed
+        AP4_SidxAtom* sidx = NULL;
+        AP4_Position  sidx_position = 0;
+        output_stream.Tell(sidx_position);
+        if (m_CreateSegmentIndex) {
+            sidx = new AP4_SidxAtom(index_cursor->m_Track->GetId(),
+                                    m_Timescale?m_Timescale:index_cursor->m_Track->GetMediaTimeScale(),
+                                    0,
+                                    0);
+            // reserve space for the entries now, but they will be computed and updated later
+            sidx->SetReferenceCount(fragments.ItemCount());
+            result = sidx->Write(output_stream);
+            if (AP4_FAILED(result)) {
+                delete sidx;
+                goto end;
+            }
+        }
+
+        // write all fragments
+        AP4_DataBuffer sample_data;
+        AP4_Sample     sample;
+        for (AP4_List<FragmentInfo>::Item* item = fragments.FirstItem();
+                                           item;
+                                           item = item->GetNext()) {
+            FragmentInfo* fragment = item->GetData();
+
+            // remember the time and position of this fragment
+            output_stream.Tell(fragment->m_MoofPosition);
+            fragment->m_Tfra->AddEntry(fragment->m_Timestamp, fragment->m_MoofPosition);
+
+            // write the moof
+            result = fragment->m_Moof->WriteBuffered(output_stream);
+            if (AP4_FAILED(result)) break;
+
+            // write mdat
+            output_stream.WriteUI32(fragment->m_MdatSize);
+            output_stream.WriteUI32(AP4_ATOM_TYPE_MDAT);
+            for (unsigned int i=0; i<fragment->m_SampleIndexes.ItemCount(); i++) {
+                // get the sample
+                result = fragment->m_Samples->GetSample(fragment->m_SampleIndexes[i], sample);
+                if (AP4_FAILED(result)) break;
+
+                // read the sample data
+                result = sample.ReadData(sample_data);
+                if (AP4_FAILED(result)) break;
+
+                // write the sample data
+                result = output_stream.Write(sample_data.GetData(), sample_data.GetDataSize());
+                if (AP4_FAILED(result)) break;
+            }
+            if (AP4_FAILED(result)) break;
+        }
+        if (AP4_FAILED(result)) {
+            delete sidx;
+            goto end;
+        }
+
+        // update the index and re-write it if needed
+        if (m_CreateSegmentIndex) {
+            unsigned int segment_index = 0;
+            AP4_SidxAtom::Reference reference;
+            for (AP4_List<FragmentInfo>::Item* item = fragments.FirstItem();
+                                               item;
+                                               item = item->GetNext()) {
+                FragmentInfo* fragment = item->GetData();
+                reference.m_ReferencedSize     = (AP4_UI32)(fragment->m_Moof->GetSize()+fragment->m_MdatSize);
+                reference.m_SubsegmentDuration = fragment->m_Duration;
+                reference.m_StartsWithSap      = true;
+                sidx->SetReference(segment_index++, reference);
+            }
+            AP4_Position here = 0;
+            output_stream.Tell(here);
+            output_stream.Seek(sidx_position);
+            result = sidx->Write(output_stream);
+            output_stream.Seek(here);
+            delete sidx;
+            if (AP4_FAILED(result)) goto end;
+        }
+
+        // create an mfra container and write out the index
+        AP4_ContainerAtom mfra(AP4_ATOM_TYPE_MFRA);
+        for (unsigned int i=0; i<m_Cursors.ItemCount(); i++) {
+            if (m_TrackId && m_Cursors[i]->m_Track->GetId() != m_TrackId) {
+                continue;
+            }
+            mfra.AddChild(m_Cursors[i]->m_Tfra);
+            m_Cursors[i]->m_Tfra = NULL;
+        }
+        AP4_MfroAtom* mfro = new AP4_MfroAtom((AP4_UI32)mfra.GetSize()+16);
+        mfra.AddChild(mfro);
+        result = mfra.Write(output_stream);
+    }
+
+end:
+    // cleanup
+    fragments.DeleteReferences();
+    delete output_movie;
+
+    return result;
+}
@@ -0,0 +1,191 @@
+/*****************************************************************
+|
+|    AP4 - MP4 Fragmenter
+|
+|    Copyright 2002-2015 Axiomatic Systems, LLC
+|
+|
+|    This file is part of Bento4/AP4 (MP4 Atom Processing Library).
+|
+|    Unless you have obtained Bento4 under a difference license,
+|    this version of Bento4 is Bento4|GPL.
+|    Bento4|GPL is free software; you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation; either version 2, or (at your option)
+|    any later version.
+|
+|    Bento4|GPL is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with Bento4|GPL; see the file COPYING.  If not, write to the
+|    Free Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+|    02111-1307, USA.
+|
+ ****************************************************************/
+
+#ifndef _AP4_FRAGMENTER_H_
+#define _AP4_FRAGMENTER_H_
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "Ap4Types.h"
+#include "Ap4Array.h"
+
+/*----------------------------------------------------------------------
+|   class references
++---------------------------------------------------------------------*/
+class AP4_ByteStream;
+class AP4_File;
+class AP4_AvcSampleDescription;
+
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+const unsigned int AP4_FRAGMENTER_DEFAULT_FRAGMENT_DURATION   = 2000; // ms
+const unsigned int AP4_FRAGMENTER_MAX_AUTO_FRAGMENT_DURATION  = 40000;
+const unsigned int AP4_FRAGMENTER_OUTPUT_MOVIE_TIMESCALE      = 1000;
+
+/*----------------------------------------------------------------------
+|   AP4_Fragmenter
++---------------------------------------------------------------------*/
+/**
+ * Writes a fragmented version of a parsed MP4 file (one moof+mdat pair
+ * per fragment, followed by an mfra index, and optionally preceded by a
+ * sidx index). Already fragmented files are re-fragmented.
+ * The stream must be the stream from which the file was parsed.
+ * This is the engine used by the mp4fragment application, so that other
+ * programs can fragment a file they have already parsed.
+ */
+class AP4_Fragmenter {
+public:
+    // types
+    typedef enum {
+        FORCE_SYNC_MODE_NONE,
+        FORCE_SYNC_MODE_AUTO, // only if the source looks like open-gop
+        FORCE_SYNC_MODE_ALL
+    } ForceSyncMode;
+
+    /**
+     * Interface implemented by clients that want to trace the decisions
+     * made by the fragmenter. All the methods do nothing by default.
+     */
+    class Listener {
+    public:
+        virtual ~Listener() {}
+
+        /**
+         * Called when a regular I-frame interval was found in the video
+         * track while detecting the fragment duration.
+         */
+        virtual void OnIFrameInterval(unsigned int /* interval */,
+                                      double       /* frames_per_second */) {}
+        /**
+         * Called when a track is selected as the anchor track, either
+         * at the start (first is true), or when the previous anchor
+         * track has reached its end.
+         */
+        virtual void OnAnchorTrack(AP4_UI32 /* track_id */, bool /* first */) {}
+        /**
+         * Called before a fragment is emitted for a track, with the dts of
+         * its first sample, the target dts of its end, and the index of
+         * its first and end samples.
+         */
+        virtual void OnFragmentStart(AP4_UI32     /* track_id */,
+                                     bool         /* anchor */,
+                                     AP4_UI64     /* dts */,
+                                     AP4_UI64     /* target_dts */,
+                                     AP4_Ordinal  /* start_sample_index */,
+                                     AP4_Ordinal  /* end_sample_index */,
+                                     AP4_Cardinal /* track_sample_count */) {}
+        /**
+         * Called when the last sample of a track was added to a fragment.
+         */
+        virtual void OnTrackEnd(AP4_UI32 /* track_id */) {}
+        /**
+         * Called after the samples of a fragment have been added.
+         */
+        virtual void OnFragmentEnd(AP4_UI32     /* track_id */,
+                                   AP4_Cardinal /* sample_count */,
+                                   bool         /* constant_sample_duration */) {}
+    };
+
+    // constructor and destructor
+    AP4_Fragmenter(AP4_File& input_file, AP4_ByteStream& input_stream);
+    ~AP4_Fragmenter();
+
+    // options
+    /**
+     * Set the target fragment duration, in milliseconds.
+     * 0 (the default) means that the duration is detected automatically.
+     */
+    void SetFragmentDuration(unsigned int fragment_duration) { m_FragmentDuration = fragment_duration; }
+    /**
+     * Set the output media timescale (0, the default, means keep the
+     * timescale of each track).
+     */
+    void SetTimescale(AP4_UI32 timescale) { m_Timescale = timescale; }
+    /**
+     * Only include media from one track (0, the default, means all tracks).
+     */
+    void SetTrackId(AP4_UI32 track_id)        { m_TrackId = track_id; }
+    void SetCreateSegmentIndex(bool create)   { m_CreateSegmentIndex = create; }
+    void SetTrim(bool trim)                   { m_Trim = trim; }
+    void SetNoTfdt(bool no_tfdt)              { m_NoTfdt = no_tfdt; }
+    void SetTfdtStart(double tfdt_start)      { m_TfdtStart = tfdt_start; }
+    void SetSequenceNumberStart(unsigned int start) { m_SequenceNumberStart = start; }
+    void SetForceSyncMode(ForceSyncMode mode) { m_ForceSyncMode = mode; }
+    void SetListener(Listener* listener)      { m_Listener = listener; }
+
+    // methods
+    /**
+     * Select the tracks and load the samples of fragmented inputs.
+     * This is called by Fragment() if it has not been called before.
+     */
+    AP4_Result   Prepare();
+    /**
+     * Detect the fragment duration from the I-frame interval of the video
+     * track or, for fragmented inputs without video, from the existing
+     * audio fragments.
+     * Returns 0 if no duration could be detected.
+     */
+    unsigned int DetectFragmentDuration();
+    AP4_Result   Fragment(AP4_ByteStream& output_stream);
+
+private:
+    // types
+    class SampleArray;
+    class CachedSampleArray;
+    class TrackCursor;
+    class FragmentInfo;
+
+    // methods
+    unsigned int DetectVideoFragmentDuration(TrackCursor* cursor);
+    unsigned int DetectAudioFragmentDuration(TrackCursor* cursor);
+    void         ForceSync(TrackCursor* cursor, AP4_AvcSampleDescription* avc_desc);
+    AP4_Result   WriteFragments(AP4_ByteStream& output_stream, unsigned int fragment_duration);
+
+    // members
+    AP4_File&               m_InputFile;
+    AP4_ByteStream&         m_InputStream;
+    unsigned int            m_FragmentDuration;
+    AP4_UI32                m_Timescale;
+    AP4_UI32                m_TrackId;
+    bool                    m_CreateSegmentIndex;
+    bool                    m_Trim;
+    bool                    m_NoTfdt;
+    double                  m_TfdtStart;
+    unsigned int            m_SequenceNumberStart;
+    ForceSyncMode           m_ForceSyncMode;
+    Listener*               m_Listener;
+    bool                    m_Prepared;
+    AP4_Position            m_FragmentsPosition;
+    AP4_Array<TrackCursor*> m_Cursors;
+    TrackCursor*            m_VideoCursor;
+    TrackCursor*            m_AudioCursor;
+};
+
+#endif // _AP4_FRAGMENTER_H_
@@ -0,0 +1,190 @@
+/*****************************************************************
+|
+|    AP4 - Instrumentation
+|
+|    Copyright 2002-2015 Axiomatic Systems, LLC
+|
+|
+|    This file is part of Bento4/AP4 (MP4 Atom Processing Library).
+|
+|    Unless you have obtained Bento4 under a difference license,
+|    this version of Bento4 is Bento4|GPL.
+|    Bento4|GPL is free software; you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation; either version 2, or (at your option)
+|    any later version.
+|
+|    Bento4|GPL is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with Bento4|GPL; see the file COPYING.  If not, write to the
+|    Free Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+|    02111-1307, USA.
+|
+ ****************************************************************/
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "Ap4Instrumentation.h"
+#include "Ap4ByteStream.h"
+#include "Ap4Utils.h"
+
+/*----------------------------------------------------------------------
+|   AP4_Instrumentation::Instance
++---------------------------------------------------------------------*/
+AP4_Instrumentation* AP4_Instrumentation::Instance = NULL;
+
+/*----------------------------------------------------------------------
+|   AP4_Instrumentation::GetStageName
++---------------------------------------------------------------------*/
+const char*
+AP4_Instrumentation::GetStageName(Stage stage)
+{
+    switch (stage) {
+        case STAGE_ATOM_PARSING:      return "atom_parsing";
+        case STAGE_SAMPLE_READ:       return "sample_read";
+        case STAGE_SAMPLE_PROCESSING: return "sample_processing";
+        case STAGE_ENCRYPTION:        return "encryption";
+        case STAGE_DECRYPTION:        return "decryption";
+        case STAGE_STREAM_READ:       return "stream_read";
+        case STAGE_STREAM_WRITE:      return "stream_write";
+        default:                      return "unknown";
+    }
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Instrumentation::GetGaugeName
++---------------------------------------------------------------------*/
+const char*
+AP4_Instrumentation::GetGaugeName(Gauge gauge)
+{
+    switch (gauge) {
+        case GAUGE_LINEAR_READER_BUFFER_FULLNESS: return "linear_reader_buffer_fullness";
+        case GAUGE_SAMPLE_SIZE:                   return "sample_size";
+        default:                                  return "unknown";
+    }
+}
+
+/*----------------------------------------------------------------------
+|   AP4_InstrumentationCounters::AP4_InstrumentationCounters
++---------------------------------------------------------------------*/
+AP4_InstrumentationCounters::AP4_InstrumentationCounters()
+{
+    Reset();
+}
+
+/*----------------------------------------------------------------------
+|   AP4_InstrumentationCounters::Reset
++---------------------------------------------------------------------*/
+void
+AP4_InstrumentationCounters::Reset()
+{
+    AP4_AutoLock lock(m_Lock);
+    AP4_SetMemory(m_Stages, 0, sizeof(m_Stages));
+    AP4_SetMemory(m_GaugePeaks, 0, sizeof(m_GaugePeaks));
+}
+
+/*----------------------------------------------------------------------
+|   AP4_InstrumentationCounters::GetStageCounters
++---------------------------------------------------------------------*/
+AP4_InstrumentationCounters::StageCounters
+AP4_InstrumentationCounters::GetStageCounters(Stage stage)
+{
+    AP4_AutoLock lock(m_Lock);
+    if ((unsigned int)stage >= STAGE_COUNT) {
+        StageCounters none = {0, 0, 0, 0};
+        return none;
+    }
+    return m_Stages[stage];
+}
+
+/*----------------------------------------------------------------------
+|   AP4_InstrumentationCounters::GetGaugePeak
++---------------------------------------------------------------------*/
+AP4_UI64
+AP4_InstrumentationCounters::GetGaugePeak(Gauge gauge)
+{
+    AP4_AutoLock lock(m_Lock);
+    if ((unsigned int)gauge >= GAUGE_COUNT) return 0;
+    return m_GaugePeaks[gauge];
+}
+
+/*----------------------------------------------------------------------
+|   AP4_InstrumentationCounters::OnStage
++---------------------------------------------------------------------*/
+void
+AP4_InstrumentationCounters::OnStage(Stage    stage,
+                                     AP4_UI64 wall_time,
+                                     AP4_UI64 cpu_time,
+                                     AP4_UI64 byte_count)
+{
+    if ((unsigned int)stage >= STAGE_COUNT) return;
+    AP4_AutoLock lock(m_Lock);
+    StageCounters& counters = m_Stages[stage];
+    ++counters.m_CallCount;
+    counters.m_ByteCount += byte_count;
+    counters.m_WallTime  += wall_time;
+    counters.m_CpuTime   += cpu_time;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_InstrumentationCounters::OnGauge
++---------------------------------------------------------------------*/
+void
+AP4_InstrumentationCounters::OnGauge(Gauge gauge, AP4_UI64 value)
+{
+    if ((unsigned int)gauge >= GAUGE_COUNT) return;
+    AP4_AutoLock lock(m_Lock);
+    if (value > m_GaugePeaks[gauge]) m_GaugePeaks[gauge] = value;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_InstrumentationCounters::WriteJson
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_InstrumentationCounters::WriteJson(AP4_ByteStream& stream)
+{
+    // take a snapshot, so that the lock is not held while writing, since the
+    // stream may itself report to this instance
+    StageCounters stages[STAGE_COUNT];
+    AP4_UI64      gauge_peaks[GAUGE_COUNT];
+    {
+        AP4_AutoLock lock(m_Lock);
+        AP4_CopyMemory(stages, m_Stages, sizeof(stages));
+        AP4_CopyMemory(gauge_peaks, m_GaugePeaks, sizeof(gauge_peaks));
+    }
+    
+    char line[256];
+
+    AP4_Result result = stream.WriteString("{\n  \"stages\": {\n");
+    if (AP4_FAILED(result)) return result;
+    for (unsigned int i=0; i<STAGE_COUNT; i++) {
+        const StageCounters& counters = stages[i];
+        AP4_FormatString(line, sizeof(line),
+                         "    \"%s\": {\"calls\": %llu, \"bytes\": %llu, \"wall_time_us\": %llu, \"cpu_time_us\": %llu}%s\n",
+                         GetStageName((Stage)i),
+                         (unsigned long long)counters.m_CallCount,
+                         (unsigned long long)counters.m_ByteCount,
+                         (unsigned long long)counters.m_WallTime,
+                         (unsigned long long)counters.m_CpuTime,
+                         i+1 < STAGE_COUNT ? "," : "");
+        result = stream.WriteString(line);
+        if (AP4_FAILED(result)) return result;
+    }
+    result = stream.WriteString("  },\n  \"high_water_marks\": {\n");
+    if (AP4_FAILED(result)) return result;
+    for (unsigned int i=0; i<GAUGE_COUNT; i++) {
+        AP4_FormatString(line, sizeof(line),
+                         "    \"%s\": %llu%s\n",
+                         GetGaugeName((Gauge)i),
+                         (unsigned long long)gauge_peaks[i],
+                         i+1 < GAUGE_COUNT ? "," : "");
+        result = stream.WriteString(line);
+        if (AP4_FAILED(result)) return result;
+    }
+    return stream.WriteString("  }\n}\n");
+}
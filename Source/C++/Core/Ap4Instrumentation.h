@@ -0,0 +1,198 @@
+/*****************************************************************
+|
+|    AP4 - Instrumentation
+|
+|    Copyright 2002-2015 Axiomatic Systems, LLC
+|
+|
+|    This file is part of Bento4/AP4 (MP4 Atom Processing Library).
+|
+|    Unless you have obtained Bento4 under a difference license,
+|    this version of Bento4 is Bento4|GPL.
+|    Bento4|GPL is free software; you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation; either version 2, or (at your option)
+|    any later version.
+|
+|    Bento4|GPL is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with Bento4|GPL; see the file COPYING.  If not, write to the
+|    Free Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+|    02111-1307, USA.
+|
+ ****************************************************************/
+
+#ifndef _AP4_INSTRUMENTATION_H_
+#define _AP4_INSTRUMENTATION_H_
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "Ap4Types.h"
+#include "Ap4Threads.h"
+
+/*----------------------------------------------------------------------
+|   class references
++---------------------------------------------------------------------*/
+class AP4_ByteStream;
+
+/*----------------------------------------------------------------------
+|   AP4_Instrumentation
++---------------------------------------------------------------------*/
+/**
+ * Receives timing and size measurements from the hot paths of the library:
+ * parsing of top-level atoms in AP4_File, AP4_Processor and AP4_LinearReader,
+ * sample reads, track handler sample processing, CENC encryption and
+ * decryption, and reads and writes of file byte streams.
+ * Instrumentation is opt-in: nothing is measured until an instance is
+ * installed with SetInstance(). Stages may nest (for example, file reads
+ * happen during sample reads, and encryption during sample processing),
+ * so the times of different stages should not be added up.
+ * Measurements can be reported from several threads at the same time.
+ */
+class AP4_Instrumentation {
+public:
+    // types
+    typedef enum {
+        STAGE_ATOM_PARSING,
+        STAGE_SAMPLE_READ,
+        STAGE_SAMPLE_PROCESSING,
+        STAGE_ENCRYPTION,
+        STAGE_DECRYPTION,
+        STAGE_STREAM_READ,
+        STAGE_STREAM_WRITE,
+        STAGE_COUNT
+    } Stage;
+    typedef enum {
+        GAUGE_LINEAR_READER_BUFFER_FULLNESS,
+        GAUGE_SAMPLE_SIZE,
+        GAUGE_COUNT
+    } Gauge;
+
+    // class methods
+    static AP4_Instrumentation* GetInstance() { return Instance; }
+    /**
+     * Install the instance that measurements are reported to, or NULL to
+     * stop measuring. The caller keeps ownership of the instance.
+     */
+    static void SetInstance(AP4_Instrumentation* instrumentation) { Instance = instrumentation; }
+    static void ReportGauge(Gauge gauge, AP4_UI64 value) {
+        if (Instance) Instance->OnGauge(gauge, value);
+    }
+    static const char* GetStageName(Stage stage);
+    static const char* GetGaugeName(Gauge gauge);
+
+    // destructor
+    virtual ~AP4_Instrumentation() {}
+
+    // methods
+    /**
+     * Called each time a stage completes.
+     * @param wall_time Elapsed wall clock time, in microseconds.
+     * @param cpu_time CPU time used by the calling thread, in microseconds.
+     * @param byte_count Number of bytes handled by the stage.
+     */
+    virtual void OnStage(Stage    stage,
+                         AP4_UI64 wall_time,
+                         AP4_UI64 cpu_time,
+                         AP4_UI64 byte_count) = 0;
+    /**
+     * Called with the current value of a gauge, typically when it reaches
+     * a new high-water mark.
+     */
+    virtual void OnGauge(Gauge gauge, AP4_UI64 value) = 0;
+
+private:
+    // class members
+    static AP4_Instrumentation* Instance;
+};
+
+/*----------------------------------------------------------------------
+|   AP4_InstrumentationScope
++---------------------------------------------------------------------*/
+/**
+ * Measures a stage from construction to destruction, and reports it to the
+ * installed AP4_Instrumentation, if any. When no instance is installed, no
+ * clocks are read.
+ */
+class AP4_InstrumentationScope {
+public:
+    AP4_InstrumentationScope(AP4_Instrumentation::Stage stage, AP4_UI64 byte_count = 0) :
+        m_Instrumentation(AP4_Instrumentation::GetInstance()),
+        m_Stage(stage),
+        m_ByteCount(byte_count),
+        m_WallTime(0),
+        m_CpuTime(0) {
+        if (m_Instrumentation) {
+            m_WallTime = AP4_System_GetWallClockTime();
+            m_CpuTime  = AP4_System_GetThreadCpuTime();
+        }
+    }
+    ~AP4_InstrumentationScope() {
+        if (m_Instrumentation) {
+            m_Instrumentation->OnStage(m_Stage,
+                                       AP4_System_GetWallClockTime()-m_WallTime,
+                                       AP4_System_GetThreadCpuTime()-m_CpuTime,
+                                       m_ByteCount);
+        }
+    }
+    void SetByteCount(AP4_UI64 byte_count) { m_ByteCount = byte_count; }
+
+private:
+    // members
+    AP4_Instrumentation*       m_Instrumentation;
+    AP4_Instrumentation::Stage m_Stage;
+    AP4_UI64                   m_ByteCount;
+    AP4_UI64                   m_WallTime;
+    AP4_UI64                   m_CpuTime;
+};
+
+/*----------------------------------------------------------------------
+|   AP4_InstrumentationCounters
++---------------------------------------------------------------------*/
+/**
+ * Instrumentation that accumulates, for each stage, the number of calls,
+ * the number of bytes and the wall clock and CPU times, and keeps the peak
+ * value of each gauge.
+ */
+class AP4_InstrumentationCounters : public AP4_Instrumentation {
+public:
+    // types
+    struct StageCounters {
+        AP4_UI64 m_CallCount;
+        AP4_UI64 m_ByteCount;
+        AP4_UI64 m_WallTime; // microseconds
+        AP4_UI64 m_CpuTime;  // microseconds
+    };
+
+    // constructor
+    AP4_InstrumentationCounters();
+
+    // methods
+    void          Reset();
+    StageCounters GetStageCounters(Stage stage);
+    AP4_UI64      GetGaugePeak(Gauge gauge);
+    /**
+     * Write all the counters to a stream, as a JSON object.
+     */
+    AP4_Result    WriteJson(AP4_ByteStream& stream);
+
+    // AP4_Instrumentation methods
+    virtual void OnStage(Stage    stage,
+                         AP4_UI64 wall_time,
+                         AP4_UI64 cpu_time,
+                         AP4_UI64 byte_count);
+    virtual void OnGauge(Gauge gauge, AP4_UI64 value);
+
+private:
+    // members
+    AP4_Mutex     m_Lock;
+    StageCounters m_Stages[STAGE_COUNT];
+    AP4_UI64      m_GaugePeaks[GAUGE_COUNT];
+};
+
+#endif // _AP4_INSTRUMENTATION_H_
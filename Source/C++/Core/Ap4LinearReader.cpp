@@ -36,6 +36,13 @@
 #include "Ap4FragmentSampleTable.h"
 #include "Ap4AtomFactory.h"
 #include "Ap4TfraAtom.h"
+#include "Ap4SidxAtom.h"
+#include "Ap4Instrumentation.h"
+
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+const unsigned int AP4_LINEAR_READER_MAX_SIDX_DEPTH = 16;
 
 /*----------------------------------------------------------------------
 |   AP4_LinearReader::AP4_LinearReader
@@ -51,13 +58,18 @@ AP4_LinearReader::AP4_LinearReader(AP4_Movie&      movie,
     m_BufferFullness(0),
     m_BufferFullnessPeak(0),
     m_MaxBufferFullness(max_buffer),
-    m_Mfra(NULL)
+    m_Mfra(NULL),
+    m_FragmentsStart(0),
+    m_SeekIndexType(SEEK_INDEX_NONE),
+    m_SeekScanPosition(0),
+    m_SeekScanDone(true)
 {
     m_HasFragments = movie.HasFragments();
     if (fragment_stream) {
         fragment_stream->AddReference();
         fragment_stream->Tell(m_CurrentFragmentPosition);
         m_NextFragmentPosition = m_CurrentFragmentPosition;
+        m_FragmentsStart       = m_CurrentFragmentPosition;
     }
 }
 
@@ -69,6 +81,9 @@ AP4_LinearReader::~AP4_LinearReader()
     for (unsigned int i=0; i<m_Trackers.ItemCount(); i++) {
         delete m_Trackers[i];
     }
+    for (unsigned int i=0; i<m_SeekIndexes.ItemCount(); i++) {
+        delete m_SeekIndexes[i];
+    }
     delete m_Fragment;
     delete m_Mfra;
     if (m_FragmentStream) m_FragmentStream->Release();
@@ -159,101 +174,73 @@ AP4_LinearReader::SeekTo(AP4_UI32 time_ms, AP4_UI32* actual_time_ms)
     
     // we only support fragmented sources for now
     if (!m_HasFragments) return AP4_ERROR_NOT_SUPPORTED;
+    if (m_FragmentStream == NULL) return AP4_ERROR_NOT_SUPPORTED;
     
-    // look for a fragment index
-    if (m_Mfra == NULL) {
-        if (m_FragmentStream) {
-            // get the size of the stream (needed)
-            AP4_LargeSize stream_size = 0;
-            m_FragmentStream->GetSize(stream_size);
-
-            if (stream_size > 12) {
-                // remember where we are
-                AP4_Position here;
-                m_FragmentStream->Tell(here);
-                
-                // read the last 12 bytes
-                unsigned char mfro[12];
-                AP4_Result result = m_FragmentStream->Seek(stream_size-12);
-                if (AP4_SUCCEEDED(result)) {
-                    result = m_FragmentStream->Read(mfro, 12);
-                }
-                if (AP4_SUCCEEDED(result) && mfro[0] == 'm' && mfro[1] == 'f' && mfro[2] == 'r' && mfro[3] == 'o') {
-                    AP4_UI32 mfra_size = AP4_BytesToUInt32BE(&mfro[8]);
-                    if ((AP4_LargeSize)mfra_size < stream_size) {
-                        result = m_FragmentStream->Seek(stream_size-mfra_size);
-                        if (AP4_SUCCEEDED(result)) {
-                            AP4_Atom* mfra = NULL;
-                            AP4_LargeSize available = mfra_size;
-                            AP4_DefaultAtomFactory atom_factory;
-                            atom_factory.CreateAtomFromStream(*m_FragmentStream, available, mfra);
-                            m_Mfra = AP4_DYNAMIC_CAST(AP4_ContainerAtom, mfra);
-                        }
-                    }
-                }
-                if (AP4_SUCCEEDED(result)) {
-                    result = m_FragmentStream->Seek(here);
-                }
-            }
+    // remember where we are
+    AP4_Position here = 0;
+    m_FragmentStream->Tell(here);
+    
+    // find or build an index the first time around
+    AP4_Result result;
+    if (m_SeekIndexType == SEEK_INDEX_NONE) {
+        result = LoadSeekIndexes();
+        if (AP4_FAILED(result)) {
+            m_FragmentStream->Seek(here);
+            return result;
         }
     }
     
-    // return now if we have not found an index
-    if (m_Mfra == NULL) {
-        return AP4_ERROR_NOT_SUPPORTED;
+    // when scanning, make sure the index covers the requested time
+    if (!m_SeekScanDone) {
+        result = ScanSeekIndexes(time_ms);
+        if (AP4_FAILED(result)) {
+            m_FragmentStream->Seek(here);
+            return result;
+        }
     }
+    m_FragmentStream->Seek(here);
     
     // look for the earliest fragment referenced by an entry with the largest timestamp that's
     // before or equal to the requested time
-    int best_entry = -1;
+    const SeekIndex::Entry* best_entry = NULL;
+    AP4_UI32                best_timescale = 0;
+    AP4_Array<AP4_UI64>     start_dts;
     for (unsigned t=0; t<m_Trackers.ItemCount(); t++) {
-        // find the tfra index for this track
-        AP4_TfraAtom* tfra = NULL;
-        for (AP4_List<AP4_Atom>::Item* item = m_Mfra->GetChildren().FirstItem();
-                                       item;
-                                       item = item->GetNext()) {
-            if (item->GetData()->GetType() == AP4_ATOM_TYPE_TFRA) {
-                AP4_TfraAtom* tfra_ = (AP4_TfraAtom*)item->GetData();
-                if (tfra_->GetTrackId() == m_Trackers[t]->m_Track->GetId()) {
-                    tfra = tfra_;
-                    break;
-                }
-            }
-        }
-        if (tfra == NULL) {
+        start_dts.Append(0);
+        SeekIndex* index = FindSeekIndex(m_Trackers[t]->m_Track->GetId());
+        if (index == NULL) {
             return AP4_ERROR_NOT_SUPPORTED;
         }
-        AP4_Array<AP4_TfraAtom::Entry>& entries = tfra->GetEntries();
-
-        AP4_UI64 media_time = AP4_ConvertTime(time_ms, 1000, m_Trackers[t]->m_Track->GetMediaTimeScale());
-        int entry = -1;
-        for (int i=0; i<(int)entries.ItemCount(); i++) {
-            if (entries[i].m_Time > media_time) break;
-            entry = i;
-        }
-        if (entry >= 0) {
-            if (best_entry == -1) {
-                best_entry = entry;
-            } else if (entries[entry].m_MoofOffset < entries[best_entry].m_MoofOffset) {
-                best_entry = entry;
-            }
-
-            // update our position
-            if (best_entry >= 0) {
-                if (actual_time_ms) {
-                    // report the actual time we found (in milliseconds)
-                    *actual_time_ms = (AP4_UI32)AP4_ConvertTime(entries[best_entry].m_Time, m_Trackers[t]->m_Track->GetMediaTimeScale(), 1000);
-                }
-                m_NextFragmentPosition = entries[best_entry].m_MoofOffset;
-            }
+        int entry = index->FindEntry(AP4_ConvertTime(time_ms, 1000, index->m_TimeScale));
+        if (entry < 0) continue;
+        
+        const SeekIndex::Entry& found = index->m_Entries[entry];
+        start_dts[t] = AP4_ConvertTime(found.m_Time, index->m_TimeScale, m_Trackers[t]->m_Track->GetMediaTimeScale());
+        if (best_entry == NULL || found.m_Offset < best_entry->m_Offset) {
+            best_entry     = &found;
+            best_timescale = index->m_TimeScale;
         }
     }
     
     // check that we found something
-    if (best_entry == -1) {
+    if (best_entry == NULL) {
         return AP4_FAILURE;
     }
     
+    // sidx times are presentation times, the trackers need decode times
+    if (m_SeekIndexType == SEEK_INDEX_SIDX) {
+        result = GetSidxStartDts(best_entry->m_Offset, best_entry->m_Time, best_timescale, start_dts);
+        m_FragmentStream->Seek(here);
+        if (AP4_FAILED(result)) return result;
+    }
+    
+    // update our position
+    if (actual_time_ms) {
+        // report the actual time we found (in milliseconds)
+        *actual_time_ms = (AP4_UI32)AP4_ConvertTime(best_entry->m_Time, best_timescale, 1000);
+    }
+    m_NextFragmentPosition = best_entry->m_Offset;
+    
     // flush any queued samples
     FlushQueues();
     
@@ -266,12 +253,422 @@ AP4_LinearReader::SeekTo(AP4_UI32 time_ms, AP4_UI32* actual_time_ms)
         m_Trackers[i]->m_SampleTable     = NULL;
         m_Trackers[i]->m_NextSample      = NULL;
         m_Trackers[i]->m_NextSampleIndex = 0;
+        m_Trackers[i]->m_NextDts         = start_dts[i];
         m_Trackers[i]->m_Eos             = false;
     }
         
     return AP4_SUCCESS;
 }
 
+/*----------------------------------------------------------------------
+|   AP4_LinearReader::LoadSeekIndexes
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_LinearReader::LoadSeekIndexes()
+{
+    // get the size of the stream (needed)
+    AP4_LargeSize stream_size = 0;
+    m_FragmentStream->GetSize(stream_size);
+
+    // look for sidx atoms before the first fragment
+    AP4_Position position = m_FragmentsStart;
+    AP4_Position indexed_end = 0;
+    while (position+8 <= stream_size) {
+        AP4_UI32 size = 0;
+        AP4_UI32 type = 0;
+        AP4_UI64 size_64 = 0;
+        if (AP4_FAILED(m_FragmentStream->Seek(position))     ||
+            AP4_FAILED(m_FragmentStream->ReadUI32(size))     ||
+            AP4_FAILED(m_FragmentStream->ReadUI32(type))) {
+            break;
+        }
+        if (size == 1) {
+            if (AP4_FAILED(m_FragmentStream->ReadUI64(size_64))) break;
+        } else {
+            size_64 = size;
+        }
+        if (type == AP4_ATOM_TYPE_MOOF || type == AP4_ATOM_TYPE_MDAT) break;
+        if (type == AP4_ATOM_TYPE_SIDX) {
+            SeekIndex* index = NULL;
+            AP4_Result result = LoadSidx(position, 0, index, indexed_end);
+            if (AP4_FAILED(result)) break;
+        }
+        if (size_64 < 8) break;
+        position += size_64;
+    }
+    
+    // a sidx that only describes the first segment of a file made of
+    // several segments can't be used to seek in the whole file
+    if (m_SeekIndexes.ItemCount()) {
+        bool complete = true;
+        AP4_UI32 size = 0;
+        AP4_UI32 type = 0;
+        if (indexed_end+8 <= stream_size                          &&
+            AP4_SUCCEEDED(m_FragmentStream->Seek(indexed_end))    &&
+            AP4_SUCCEEDED(m_FragmentStream->ReadUI32(size))       &&
+            AP4_SUCCEEDED(m_FragmentStream->ReadUI32(type))) {
+            complete = (type != AP4_ATOM_TYPE_MOOF &&
+                        type != AP4_ATOM_TYPE_SIDX &&
+                        type != AP4_ATOM_TYPE('s','t','y','p'));
+        }
+        if (complete) {
+            m_SeekIndexType = SEEK_INDEX_SIDX;
+            return AP4_SUCCESS;
+        }
+        for (unsigned int i=0; i<m_SeekIndexes.ItemCount(); i++) {
+            delete m_SeekIndexes[i];
+        }
+        m_SeekIndexes.Clear();
+    }
+    
+    // then look for a fragment random access index
+    if (AP4_SUCCEEDED(LoadMfra())) {
+        m_SeekIndexType = SEEK_INDEX_TFRA;
+        return AP4_SUCCESS;
+    }
+    
+    // fall back to an index of the moof atoms, built as needed
+    m_SeekIndexType = SEEK_INDEX_SCAN;
+    AddScannedSeekIndexes();
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_LinearReader::LoadSidx
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_LinearReader::LoadSidx(AP4_Position  position,
+                           unsigned int  depth,
+                           SeekIndex*&   index,
+                           AP4_Position& indexed_end)
+{
+    // guard against loops
+    if (depth > AP4_LINEAR_READER_MAX_SIDX_DEPTH) return AP4_ERROR_INVALID_FORMAT;
+    
+    // parse the sidx atom
+    AP4_Result result = m_FragmentStream->Seek(position);
+    if (AP4_FAILED(result)) return result;
+    AP4_Atom* atom = NULL;
+    AP4_DefaultAtomFactory atom_factory;
+    result = atom_factory.CreateAtomFromStream(*m_FragmentStream, atom);
+    if (AP4_FAILED(result)) return result;
+    AP4_SidxAtom* sidx = AP4_DYNAMIC_CAST(AP4_SidxAtom, atom);
+    if (sidx == NULL || sidx->GetTimeScale() == 0) {
+        delete atom;
+        return AP4_ERROR_INVALID_FORMAT;
+    }
+    
+    // offsets are relative to the first byte after the sidx atom
+    AP4_Position anchor = 0;
+    m_FragmentStream->Tell(anchor);
+    
+    if (index == NULL) {
+        index = new SeekIndex(sidx->GetReferenceId(), sidx->GetTimeScale());
+        m_SeekIndexes.Append(index);
+    }
+    
+    // add one entry per media reference, and recurse into index references
+    AP4_Position offset = anchor+sidx->GetFirstOffset();
+    AP4_UI64     time   = sidx->GetEarliestPresentationTime();
+    const AP4_Array<AP4_SidxAtom::Reference>& references = sidx->GetReferences();
+    for (unsigned int i=0; i<references.ItemCount(); i++) {
+        if (references[i].m_ReferenceType == 1) {
+            result = LoadSidx(offset, depth+1, index, indexed_end);
+            if (AP4_FAILED(result)) break;
+        } else {
+            SeekIndex::Entry entry;
+            entry.m_Time   = AP4_ConvertTime(time, sidx->GetTimeScale(), index->m_TimeScale);
+            entry.m_Offset = offset;
+            index->m_Entries.Append(entry);
+        }
+        offset += references[i].m_ReferencedSize;
+        time   += references[i].m_SubsegmentDuration;
+    }
+    if (offset > indexed_end) indexed_end = offset;
+    delete sidx;
+    
+    return result;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_LinearReader::GetSidxStartDts
+|
+|   compute the decode time of the first sample of each track in the
+|   segment at position, which starts at presentation time time
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_LinearReader::GetSidxStartDts(AP4_Position         position,
+                                  AP4_UI64             time,
+                                  AP4_UI32             timescale,
+                                  AP4_Array<AP4_UI64>& start_dts)
+{
+    // find the first moof of the segment (it may be preceded by a styp)
+    AP4_DefaultAtomFactory atom_factory;
+    AP4_ContainerAtom*     moof = NULL;
+    AP4_Position           moof_offset = position;
+    AP4_Result             result = m_FragmentStream->Seek(position);
+    while (AP4_SUCCEEDED(result) && moof == NULL) {
+        m_FragmentStream->Tell(moof_offset);
+        AP4_Atom* atom = NULL;
+        result = atom_factory.CreateAtomFromStream(*m_FragmentStream, atom);
+        if (AP4_FAILED(result)) break;
+        if (atom->GetType() == AP4_ATOM_TYPE_MOOF) {
+            moof = AP4_DYNAMIC_CAST(AP4_ContainerAtom, atom);
+        }
+        if (moof == NULL) {
+            bool is_mdat = (atom->GetType() == AP4_ATOM_TYPE_MDAT);
+            delete atom;
+            if (is_mdat) result = AP4_ERROR_INVALID_FORMAT;
+        }
+    }
+    if (moof == NULL) return AP4_FAILED(result) ? result : AP4_ERROR_INVALID_FORMAT;
+    
+    // subtract the composition offset of the first sample of each track
+    AP4_MovieFragment fragment(moof);
+    for (unsigned int t=0; t<m_Trackers.ItemCount(); t++) {
+        AP4_Track* track = m_Trackers[t]->m_Track;
+        AP4_UI64   dts   = AP4_ConvertTime(time, timescale, track->GetMediaTimeScale());
+        AP4_FragmentSampleTable* sample_table = NULL;
+        result = fragment.CreateSampleTable(&m_Movie,
+                                            track->GetId(),
+                                            m_FragmentStream,
+                                            moof_offset,
+                                            moof_offset+moof->GetSize()+8,
+                                            0,
+                                            sample_table);
+        if (AP4_SUCCEEDED(result)) {
+            AP4_Sample sample;
+            if (sample_table->GetSampleCount() && AP4_SUCCEEDED(sample_table->GetSample(0, sample))) {
+                AP4_SI32 cts_offset = (AP4_SI32)sample.GetCtsDelta();
+                if (cts_offset >= 0) {
+                    dts = (AP4_UI64)cts_offset < dts ? dts-cts_offset : 0;
+                } else {
+                    dts += (AP4_UI64)(-(AP4_SI64)cts_offset);
+                }
+            }
+            delete sample_table;
+        }
+        start_dts[t] = dts;
+    }
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_LinearReader::LoadMfra
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_LinearReader::LoadMfra()
+{
+    if (m_Mfra == NULL) {
+        // get the size of the stream (needed)
+        AP4_LargeSize stream_size = 0;
+        m_FragmentStream->GetSize(stream_size);
+
+        if (stream_size > 12) {
+            // read the last 12 bytes
+            unsigned char mfro[12];
+            AP4_Result result = m_FragmentStream->Seek(stream_size-12);
+            if (AP4_SUCCEEDED(result)) {
+                result = m_FragmentStream->Read(mfro, 12);
+            }
+            if (AP4_SUCCEEDED(result) && mfro[0] == 'm' && mfro[1] == 'f' && mfro[2] == 'r' && mfro[3] == 'o') {
+                AP4_UI32 mfra_size = AP4_BytesToUInt32BE(&mfro[8]);
+                if ((AP4_LargeSize)mfra_size < stream_size) {
+                    result = m_FragmentStream->Seek(stream_size-mfra_size);
+                    if (AP4_SUCCEEDED(result)) {
+                        AP4_Atom* mfra = NULL;
+                        AP4_LargeSize available = mfra_size;
+                        AP4_DefaultAtomFactory atom_factory;
+                        atom_factory.CreateAtomFromStream(*m_FragmentStream, available, mfra);
+                        m_Mfra = AP4_DYNAMIC_CAST(AP4_ContainerAtom, mfra);
+                        if (m_Mfra == NULL) delete mfra;
+                    }
+                }
+            }
+        }
+    }
+    if (m_Mfra == NULL) return AP4_ERROR_NOT_SUPPORTED;
+    
+    // make one index for each tfra
+    for (AP4_List<AP4_Atom>::Item* item = m_Mfra->GetChildren().FirstItem();
+                                   item;
+                                   item = item->GetNext()) {
+        if (item->GetData()->GetType() != AP4_ATOM_TYPE_TFRA) continue;
+        AP4_TfraAtom* tfra = (AP4_TfraAtom*)item->GetData();
+        AP4_Track* track = m_Movie.GetTrack(tfra->GetTrackId());
+        if (track == NULL) continue;
+        SeekIndex* index = new SeekIndex(tfra->GetTrackId(), track->GetMediaTimeScale());
+        AP4_Array<AP4_TfraAtom::Entry>& entries = tfra->GetEntries();
+        index->m_Entries.EnsureCapacity(entries.ItemCount());
+        for (unsigned int i=0; i<entries.ItemCount(); i++) {
+            SeekIndex::Entry entry;
+            entry.m_Time   = entries[i].m_Time;
+            entry.m_Offset = entries[i].m_MoofOffset;
+            index->m_Entries.Append(entry);
+        }
+        m_SeekIndexes.Append(index);
+    }
+    if (m_SeekIndexes.ItemCount() == 0) return AP4_ERROR_NOT_SUPPORTED;
+    
+    // the tracks that have no tfra are indexed by scanning the moofs
+    AddScannedSeekIndexes();
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_LinearReader::AddScannedSeekIndexes
++---------------------------------------------------------------------*/
+void
+AP4_LinearReader::AddScannedSeekIndexes()
+{
+    AP4_List<AP4_Track>& tracks = m_Movie.GetTracks();
+    for (AP4_List<AP4_Track>::Item* item = tracks.FirstItem(); item; item = item->GetNext()) {
+        AP4_Track* track = item->GetData();
+        if (FindSeekIndex(track->GetId())) continue;
+        m_SeekIndexes.Append(new SeekIndex(track->GetId(), track->GetMediaTimeScale(), true));
+        m_SeekScanPosition = m_FragmentsStart;
+        m_SeekScanDone     = false;
+    }
+}
+
+/*----------------------------------------------------------------------
+|   AP4_LinearReader::ScanSeekIndexes
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_LinearReader::ScanSeekIndexes(AP4_UI32 time_ms)
+{
+    AP4_LargeSize stream_size = 0;
+    m_FragmentStream->GetSize(stream_size);
+    
+    while (!m_SeekScanDone) {
+        // stop as soon as the index of each scanned track goes past the requested time
+        bool covered = true;
+        for (unsigned int i=0; i<m_Trackers.ItemCount(); i++) {
+            SeekIndex* index = FindSeekIndex(m_Trackers[i]->m_Track->GetId());
+            if (index == NULL || !index->m_Scanned) continue;
+            AP4_Cardinal count = index->m_Entries.ItemCount();
+            if (count == 0 ||
+                index->m_Entries[count-1].m_Time <= AP4_ConvertTime(time_ms, 1000, index->m_TimeScale)) {
+                covered = false;
+                break;
+            }
+        }
+        if (covered) break;
+        
+        // read the next top-level atom header
+        AP4_Position position = m_SeekScanPosition;
+        AP4_UI32     size = 0;
+        AP4_UI32     type = 0;
+        AP4_UI64     size_64 = 0;
+        if (position+8 > stream_size                     ||
+            AP4_FAILED(m_FragmentStream->Seek(position)) ||
+            AP4_FAILED(m_FragmentStream->ReadUI32(size)) ||
+            AP4_FAILED(m_FragmentStream->ReadUI32(type))) {
+            m_SeekScanDone = true;
+            break;
+        }
+        if (size == 0) {
+            size_64 = stream_size-position;
+        } else if (size == 1) {
+            if (AP4_FAILED(m_FragmentStream->ReadUI64(size_64))) {
+                m_SeekScanDone = true;
+                break;
+            }
+        } else {
+            size_64 = size;
+        }
+        if (size_64 < 8) {
+            m_SeekScanDone = true;
+            break;
+        }
+        m_SeekScanPosition = position+size_64;
+        if (type != AP4_ATOM_TYPE_MOOF) continue;
+        
+        // parse the moof and compute the start time of each of its tracks
+        m_FragmentStream->Seek(position);
+        AP4_Atom* atom = NULL;
+        AP4_DefaultAtomFactory atom_factory;
+        AP4_Result result = atom_factory.CreateAtomFromStream(*m_FragmentStream, atom);
+        if (AP4_FAILED(result)) return result;
+        AP4_ContainerAtom* moof = AP4_DYNAMIC_CAST(AP4_ContainerAtom, atom);
+        if (moof == NULL) {
+            delete atom;
+            continue;
+        }
+        AP4_MovieFragment fragment(moof);
+        AP4_Array<AP4_UI32> ids;
+        fragment.GetTrackIds(ids);
+        for (unsigned int i=0; i<ids.ItemCount(); i++) {
+            SeekIndex* index = FindSeekIndex(ids[i]);
+            if (index == NULL || !index->m_Scanned) continue;
+            AP4_FragmentSampleTable* sample_table = NULL;
+            result = fragment.CreateSampleTable(&m_Movie,
+                                                ids[i],
+                                                m_FragmentStream,
+                                                position,
+                                                position+size_64+8,
+                                                index->m_ScanDts,
+                                                sample_table);
+            if (AP4_FAILED(result)) return result;
+            SeekIndex::Entry entry;
+            entry.m_Time   = index->m_ScanDts;
+            entry.m_Offset = position;
+            AP4_Sample sample;
+            if (sample_table->GetSampleCount() && AP4_SUCCEEDED(sample_table->GetSample(0, sample))) {
+                entry.m_Time = sample.GetDts();
+            }
+            index->m_ScanDts = entry.m_Time+sample_table->GetDuration();
+            index->m_Entries.Append(entry);
+            delete sample_table;
+        }
+        if (size == 0) m_SeekScanDone = true;
+    }
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_LinearReader::FindSeekIndex
++---------------------------------------------------------------------*/
+AP4_LinearReader::SeekIndex*
+AP4_LinearReader::FindSeekIndex(AP4_UI32 track_id)
+{
+    for (unsigned int i=0; i<m_SeekIndexes.ItemCount(); i++) {
+        if (m_SeekIndexes[i]->m_TrackId == track_id) return m_SeekIndexes[i];
+    }
+    
+    // segments referenced by a sidx contain the fragments of all the tracks
+    if (m_SeekIndexType == SEEK_INDEX_SIDX && m_SeekIndexes.ItemCount()) {
+        return m_SeekIndexes[0];
+    }
+    
+    // not found
+    return NULL;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_LinearReader::SeekIndex::FindEntry
++---------------------------------------------------------------------*/
+int
+AP4_LinearReader::SeekIndex::FindEntry(AP4_UI64 time)
+{
+    // binary search for the last entry with a time <= to the requested time
+    int lo = 0;
+    int hi = (int)m_Entries.ItemCount();
+    while (lo < hi) {
+        int mid = lo+(hi-lo)/2;
+        if (m_Entries[mid].m_Time <= time) {
+            lo = mid+1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo-1;
+}
+
 /*----------------------------------------------------------------------
 |   AP4_LinearReader::ProcessTrack
 +---------------------------------------------------------------------*/
@@ -351,7 +748,13 @@ AP4_LinearReader::AdvanceFragment()
         AP4_Atom* atom = NULL;
         AP4_Position last_position = 0;
         m_FragmentStream->Tell(last_position);
-        result = atom_factory.CreateAtomFromStream(*m_FragmentStream, atom);
+        {
+            AP4_InstrumentationScope scope(AP4_Instrumentation::STAGE_ATOM_PARSING);
+            result = atom_factory.CreateAtomFromStream(*m_FragmentStream, atom);
+            if (AP4_SUCCEEDED(result) && atom->GetType() != AP4_ATOM_TYPE_MDAT) {
+                scope.SetByteCount(atom->GetSize());
+            }
+        }
         if (AP4_SUCCEEDED(result)) {
             if (atom->GetType() == AP4_ATOM_TYPE_MOOF) {
                 AP4_ContainerAtom* moof = AP4_DYNAMIC_CAST(AP4_ContainerAtom, atom);
@@ -480,6 +883,7 @@ AP4_LinearReader::Advance(bool read_data)
         m_BufferFullness += buffer->m_Data.GetDataSize();
         if (m_BufferFullness > m_BufferFullnessPeak) {
             m_BufferFullnessPeak = m_BufferFullness;
+            AP4_Instrumentation::ReportGauge(AP4_Instrumentation::GAUGE_LINEAR_READER_BUFFER_FULLNESS, m_BufferFullnessPeak);
         }
         next_tracker->m_NextSample = NULL;
         next_tracker->m_NextSampleIndex++;
@@ -86,6 +86,21 @@ public:
                             
     AP4_Result SetSampleIndex(AP4_UI32 track_id, AP4_UI32 sample_index);
     
+    /**
+     * Seek to the start of the fragment that is closest to, but not after,
+     * the requested time, for all enabled tracks.
+     * The fragment is located with the file's sidx index if there is one,
+     * or with its tfra index, or else with an index of the moof atoms that
+     * is built as needed while scanning the file (the fragments that have
+     * already been scanned are not scanned again on subsequent seeks).
+     * The tracks that have no tfra in the mfra index are located by
+     * scanning the moof atoms as well.
+     * Only fragmented sources are supported.
+     * With a sidx index, the requested time is compared with the earliest
+     * presentation time of each segment, and the decode times of the
+     * tracks are derived from the composition offset of the first sample
+     * of the segment.
+     */
     AP4_Result SeekTo(AP4_UI32 time_ms, AP4_UI32* actual_time_ms = 0);
     
     // accessors
@@ -157,6 +172,35 @@ protected:
         } m_SeekPoint;
     };
     
+    class SeekIndex {
+    public:
+        // for sidx indexes, m_Time is the earliest presentation time of the
+        // referenced segment, for the other indexes it is the decode time
+        // of the first sample of the fragment
+        struct Entry {
+            AP4_UI64     m_Time;   // in units of the index timescale
+            AP4_Position m_Offset; // position of the fragment in the stream
+        };
+        SeekIndex(AP4_UI32 track_id, AP4_UI32 timescale, bool scanned = false) :
+            m_TrackId(track_id),
+            m_TimeScale(timescale),
+            m_Scanned(scanned),
+            m_ScanDts(0) {}
+        int FindEntry(AP4_UI64 time); // last entry at or before time, or -1
+        AP4_UI32         m_TrackId;
+        AP4_UI32         m_TimeScale;
+        bool             m_Scanned; // built by scanning the moofs
+        AP4_UI64         m_ScanDts; // next decode time while scanning moofs
+        AP4_Array<Entry> m_Entries;
+    };
+    
+    typedef enum {
+        SEEK_INDEX_NONE,
+        SEEK_INDEX_SIDX,
+        SEEK_INDEX_TFRA,
+        SEEK_INDEX_SCAN
+    } SeekIndexType;
+    
     // methods that can be overridden
     virtual AP4_Result ProcessTrack(AP4_Track* track);
     virtual AP4_Result ProcessMoof(AP4_ContainerAtom* moof, 
@@ -173,19 +217,37 @@ protected:
                               AP4_UI32&       track_id);
     void       FlushQueue(Tracker* tracker);
     void       FlushQueues();
+    AP4_Result LoadSeekIndexes();
+    AP4_Result LoadSidx(AP4_Position  position,
+                        unsigned int  depth,
+                        SeekIndex*&   index,
+                        AP4_Position& indexed_end);
+    AP4_Result LoadMfra();
+    AP4_Result GetSidxStartDts(AP4_Position          position,
+                               AP4_UI64              time,
+                               AP4_UI32              timescale,
+                               AP4_Array<AP4_UI64>&  start_dts);
+    void       AddScannedSeekIndexes();
+    AP4_Result ScanSeekIndexes(AP4_UI32 time_ms);
+    SeekIndex* FindSeekIndex(AP4_UI32 track_id);
     
     // members
-    AP4_Movie&          m_Movie;
-    bool                m_HasFragments;
-    AP4_MovieFragment*  m_Fragment;
-    AP4_ByteStream*     m_FragmentStream;
-    AP4_Position        m_CurrentFragmentPosition;
-    AP4_Position        m_NextFragmentPosition;
-    AP4_Array<Tracker*> m_Trackers;
-    AP4_Size            m_BufferFullness;
-    AP4_Size            m_BufferFullnessPeak;
-    AP4_Size            m_MaxBufferFullness;
-    AP4_ContainerAtom*  m_Mfra;
+    AP4_Movie&            m_Movie;
+    bool                  m_HasFragments;
+    AP4_MovieFragment*    m_Fragment;
+    AP4_ByteStream*       m_FragmentStream;
+    AP4_Position          m_CurrentFragmentPosition;
+    AP4_Position          m_NextFragmentPosition;
+    AP4_Array<Tracker*>   m_Trackers;
+    AP4_Size              m_BufferFullness;
+    AP4_Size              m_BufferFullnessPeak;
+    AP4_Size              m_MaxBufferFullness;
+    AP4_ContainerAtom*    m_Mfra;
+    AP4_Position          m_FragmentsStart;
+    SeekIndexType         m_SeekIndexType;
+    AP4_Array<SeekIndex*> m_SeekIndexes;
+    AP4_Position          m_SeekScanPosition;
+    bool                  m_SeekScanDone;
 };
 
 /*----------------------------------------------------------------------
@@ -37,6 +37,14 @@
 #include "Ap4Mp4AudioInfo.h"
 #include "Ap4AvcParser.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AP4_MPEG2TS_HAVE_SSE2
+#include <emmintrin.h>
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && defined(__GNUC__)
+#define AP4_MPEG2TS_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
 /*----------------------------------------------------------------------
 |   constants
 +---------------------------------------------------------------------*/
@@ -44,6 +52,12 @@ const unsigned int AP4_MPEG2TS_PACKET_SIZE         = 188;
 const unsigned int AP4_MPEG2TS_PACKET_PAYLOAD_SIZE = 184;
 const unsigned int AP4_MPEG2TS_SYNC_BYTE           = 0x47;
 const unsigned int AP4_MPEG2TS_PCR_ADAPTATION_SIZE = 6;
+const unsigned int AP4_MPEG2TS_MAX_SECTION_SIZE    = 1024;
+const AP4_UI16     AP4_MPEG2TS_PID_PAT             = 0;
+const AP4_UI08     AP4_MPEG2TS_TABLE_ID_PAT        = 0x00;
+const AP4_UI08     AP4_MPEG2TS_TABLE_ID_PMT        = 0x02;
+const AP4_UI08     AP4_MPEG2TS_DESCRIPTOR_TAG_AC3  = 0x6A;
+const AP4_UI08     AP4_MPEG2TS_DESCRIPTOR_TAG_EAC3 = 0x7A;
 
 static unsigned char const StuffingBytes[AP4_MPEG2TS_PACKET_SIZE] = 
 {
@@ -921,3 +935,698 @@ AP4_Mpeg2TsWriter::SampleStream::WriteSample(AP4_Sample&            sample,
 }
 
 
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsReader::Stream::Stream
++---------------------------------------------------------------------*/
+AP4_Mpeg2TsReader::Stream::Stream(AP4_UI16        pid,
+                                  AP4_UI08        stream_type,
+                                  const AP4_UI08* descriptor,
+                                  AP4_Size        descriptor_length) :
+    m_PID(pid),
+    m_StreamType(stream_type),
+    m_Enabled(false),
+    m_HasContinuityCounter(false),
+    m_ContinuityCounter(0),
+    m_PesSize(0),
+    m_PesSkipped(false)
+{
+    if (descriptor && descriptor_length) {
+        m_Descriptor.SetData(descriptor, descriptor_length);
+    }
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsReader::FindSync
++---------------------------------------------------------------------*/
+AP4_Size
+AP4_Mpeg2TsReader::FindSync(const AP4_UI08* data, AP4_Size data_size)
+{
+    AP4_Size i = 0;
+    
+    // look for a sync byte at the same position in two consecutive packets,
+    // 16 positions at a time
+#if defined(AP4_MPEG2TS_HAVE_SSE2)
+    const __m128i sync = _mm_set1_epi8((char)AP4_MPEG2TS_SYNC_BYTE);
+    for (; i+AP4_MPEG2TS_PACKET_SIZE+16 <= data_size; i += 16) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data+i)), sync);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data+i+AP4_MPEG2TS_PACKET_SIZE)), sync);
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(a, b));
+        if (mask) {
+            while ((mask & 1) == 0) {
+                mask >>= 1;
+                ++i;
+            }
+            return i;
+        }
+    }
+#elif defined(AP4_MPEG2TS_HAVE_NEON)
+    const uint8x16_t sync = vdupq_n_u8(AP4_MPEG2TS_SYNC_BYTE);
+    for (; i+AP4_MPEG2TS_PACKET_SIZE+16 <= data_size; i += 16) {
+        uint8x16_t a = vceqq_u8(vld1q_u8(data+i), sync);
+        uint8x16_t b = vceqq_u8(vld1q_u8(data+i+AP4_MPEG2TS_PACKET_SIZE), sync);
+        uint64x2_t m = vreinterpretq_u64_u8(vandq_u8(a, b));
+        if (vgetq_lane_u64(m, 0) | vgetq_lane_u64(m, 1)) break;
+    }
+#endif
+    for (; i<data_size; i++) {
+        if (data[i] == AP4_MPEG2TS_SYNC_BYTE &&
+            (i+AP4_MPEG2TS_PACKET_SIZE >= data_size || data[i+AP4_MPEG2TS_PACKET_SIZE] == AP4_MPEG2TS_SYNC_BYTE)) {
+            return i;
+        }
+    }
+    return data_size;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsReader::AP4_Mpeg2TsReader
++---------------------------------------------------------------------*/
+AP4_Mpeg2TsReader::AP4_Mpeg2TsReader(Listener& listener, AP4_Size max_pes_size) :
+    m_Listener(listener),
+    m_MaxPesSize(max_pes_size),
+    m_InSync(false),
+    m_PmtPid(0),
+    m_SyncLossCount(0),
+    m_DiscontinuityCount(0),
+    m_DroppedPesCount(0)
+{
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsReader::~AP4_Mpeg2TsReader
++---------------------------------------------------------------------*/
+AP4_Mpeg2TsReader::~AP4_Mpeg2TsReader()
+{
+    for (unsigned int i=0; i<m_Streams.ItemCount(); i++) {
+        delete m_Streams[i];
+    }
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsReader::FindStream
++---------------------------------------------------------------------*/
+AP4_Mpeg2TsReader::Stream*
+AP4_Mpeg2TsReader::FindStream(AP4_UI16 pid)
+{
+    for (unsigned int i=0; i<m_Streams.ItemCount(); i++) {
+        if (m_Streams[i]->m_PID == pid) return m_Streams[i];
+    }
+    return NULL;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsReader::Feed
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mpeg2TsReader::Feed(const void* data, AP4_Size data_size, AP4_Size& bytes_consumed)
+{
+    const AP4_UI08* bytes = (const AP4_UI08*)data;
+    bytes_consumed = 0;
+    
+    while (bytes_consumed+AP4_MPEG2TS_PACKET_SIZE <= data_size) {
+        const AP4_UI08* packet = bytes+bytes_consumed;
+        if (!m_InSync || packet[0] != AP4_MPEG2TS_SYNC_BYTE) {
+            // (re)synchronize on the packet boundaries
+            if (m_InSync) {
+                m_InSync = false;
+                ++m_SyncLossCount;
+            }
+            bytes_consumed += FindSync(packet, data_size-bytes_consumed);
+            if (bytes_consumed+AP4_MPEG2TS_PACKET_SIZE >= data_size) {
+                // the next packet is needed to confirm the sync byte
+                break;
+            }
+            m_InSync = true;
+            continue;
+        }
+        
+        AP4_Result result = ParsePacket(packet);
+        bytes_consumed += AP4_MPEG2TS_PACKET_SIZE;
+        if (AP4_FAILED(result)) return result;
+    }
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsReader::Flush
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mpeg2TsReader::Flush()
+{
+    for (unsigned int i=0; i<m_Streams.ItemCount(); i++) {
+        Stream* stream = m_Streams[i];
+        if (stream->m_Pes.GetDataSize() && !stream->m_PesSkipped) {
+            if (stream->m_PesSize == 0) {
+                AP4_Result result = EmitPes(*stream);
+                if (AP4_FAILED(result)) return result;
+            } else {
+                // the packet was cut short
+                ++m_DroppedPesCount;
+            }
+        }
+        stream->m_Pes.SetDataSize(0);
+        stream->m_PesSize = 0;
+    }
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsReader::ParsePacket
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mpeg2TsReader::ParsePacket(const AP4_UI08* packet)
+{
+    // skip packets with a transport error
+    if (packet[1] & 0x80) return AP4_SUCCESS;
+    
+    bool         payload_start            = (packet[1] & 0x40) != 0;
+    AP4_UI16     pid                      = (AP4_UI16)(((packet[1]&0x1F)<<8) | packet[2]);
+    unsigned int adaptation_field_control = (packet[3]>>4) & 3;
+    unsigned int continuity_counter       = packet[3] & 0x0F;
+    
+    // locate the payload
+    if ((adaptation_field_control & 1) == 0) return AP4_SUCCESS;
+    unsigned int payload_offset = 4;
+    if (adaptation_field_control & 2) {
+        payload_offset += 1+packet[4];
+        if (payload_offset >= AP4_MPEG2TS_PACKET_SIZE) return AP4_SUCCESS;
+    }
+    const AP4_UI08* payload      = packet+payload_offset;
+    AP4_Size        payload_size = AP4_MPEG2TS_PACKET_SIZE-payload_offset;
+    
+    if (pid == AP4_MPEG2TS_PID_PAT) {
+        return OnSectionData(m_PatSection, payload_start, payload, payload_size);
+    } else if (m_PmtPid && pid == m_PmtPid) {
+        return OnSectionData(m_PmtSection, payload_start, payload, payload_size);
+    }
+    Stream* stream = FindStream(pid);
+    if (stream == NULL || !stream->m_Enabled) return AP4_SUCCESS;
+    
+    return OnPesData(*stream, payload_start, continuity_counter, payload, payload_size);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsReader::OnSectionData
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mpeg2TsReader::OnSectionData(AP4_DataBuffer& section,
+                                 bool            payload_start,
+                                 const AP4_UI08* payload,
+                                 AP4_Size        payload_size)
+{
+    if (payload_start) {
+        unsigned int pointer = payload[0];
+        if (1+pointer > payload_size) {
+            section.SetDataSize(0);
+            return AP4_SUCCESS;
+        }
+        
+        // the bytes before the pointed section finish the previous one
+        if (section.GetDataSize()) {
+            section.AppendData(payload+1, pointer);
+            AP4_Result result = ParseSection(section);
+            if (AP4_FAILED(result)) return result;
+        }
+        section.SetData(payload+1+pointer, payload_size-1-pointer);
+    } else {
+        // continue the current section, if any
+        if (section.GetDataSize() == 0) return AP4_SUCCESS;
+        if (section.GetDataSize()+payload_size > AP4_MPEG2TS_MAX_SECTION_SIZE+AP4_MPEG2TS_PACKET_PAYLOAD_SIZE) {
+            section.SetDataSize(0);
+            return AP4_SUCCESS;
+        }
+        section.AppendData(payload, payload_size);
+    }
+    
+    return ParseSection(section);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsReader::ParseSection
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mpeg2TsReader::ParseSection(AP4_DataBuffer& section)
+{
+    // wait until the section is complete
+    const AP4_UI08* data = section.GetData();
+    if (section.GetDataSize() < 3) return AP4_SUCCESS;
+    if (data[0] == 0xFF) {
+        // stuffing
+        section.SetDataSize(0);
+        return AP4_SUCCESS;
+    }
+    AP4_Size section_size = 3+(((data[1]&0x0F)<<8) | data[2]);
+    if (section_size > AP4_MPEG2TS_MAX_SECTION_SIZE || section_size < 12) {
+        section.SetDataSize(0);
+        return AP4_SUCCESS;
+    }
+    if (section.GetDataSize() < section_size) return AP4_SUCCESS;
+    
+    // only consider valid sections that are currently applicable
+    AP4_Result result = AP4_SUCCESS;
+    if (ComputeCRC(data, section_size) == 0 && (data[5] & 1)) {
+        if (data[0] == AP4_MPEG2TS_TABLE_ID_PAT) {
+            result = ParsePat(data, section_size);
+        } else if (data[0] == AP4_MPEG2TS_TABLE_ID_PMT) {
+            result = ParsePmt(data, section_size);
+        }
+    }
+    section.SetDataSize(0);
+    
+    return result;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsReader::ParsePat
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mpeg2TsReader::ParsePat(const AP4_UI08* section, AP4_Size section_size)
+{
+    // look for the first program (program 0 is the network PID)
+    for (unsigned int i=8; i+4 <= section_size-4; i += 4) {
+        unsigned int program_number = (section[i]<<8) | section[i+1];
+        AP4_UI16     pid            = (AP4_UI16)(((section[i+2]&0x1F)<<8) | section[i+3]);
+        if (program_number != 0) {
+            if (pid != m_PmtPid) {
+                m_PmtPid = pid;
+                m_PmtSection.SetDataSize(0);
+            }
+            break;
+        }
+    }
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsReader::ParsePmt
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mpeg2TsReader::ParsePmt(const AP4_UI08* section, AP4_Size section_size)
+{
+    AP4_Size end = section_size-4; // CRC
+    unsigned int program_info_length = ((section[10]&0x0F)<<8) | section[11];
+    for (AP4_Size offset = 12+program_info_length; offset+5 <= end;) {
+        AP4_UI08        stream_type       = section[offset];
+        AP4_UI16        pid               = (AP4_UI16)(((section[offset+1]&0x1F)<<8) | section[offset+2]);
+        unsigned int    es_info_length    = ((section[offset+3]&0x0F)<<8) | section[offset+4];
+        const AP4_UI08* descriptors       = section+offset+5;
+        if (offset+5+es_info_length > end) break;
+        offset += 5+es_info_length;
+        if (FindStream(pid)) continue;
+        
+        // identify DVB AC-3 and E-AC-3 streams from their descriptor
+        if (stream_type == AP4_MPEG2_STREAM_TYPE_ISO_IEC_13818_1_PES) {
+            for (unsigned int i=0; i+2 <= es_info_length; i += 2+descriptors[i+1]) {
+                if (descriptors[i] == AP4_MPEG2TS_DESCRIPTOR_TAG_AC3) {
+                    stream_type = AP4_MPEG2_STREAM_TYPE_ATSC_AC3;
+                    break;
+                } else if (descriptors[i] == AP4_MPEG2TS_DESCRIPTOR_TAG_EAC3) {
+                    stream_type = AP4_MPEG2_STREAM_TYPE_ATSC_EAC3;
+                    break;
+                }
+            }
+        }
+        
+        // add a new stream and let the listener decide if it is demuxed
+        Stream* stream = new Stream(pid, stream_type, descriptors, es_info_length);
+        m_Streams.Append(stream);
+        stream->m_Enabled = AP4_SUCCEEDED(m_Listener.OnStream(*stream));
+    }
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsReader::OnPesData
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mpeg2TsReader::OnPesData(Stream&         stream,
+                             bool            payload_start,
+                             unsigned int    continuity_counter,
+                             const AP4_UI08* payload,
+                             AP4_Size        payload_size)
+{
+    // check the continuity counter
+    if (stream.m_HasContinuityCounter) {
+        if (continuity_counter == stream.m_ContinuityCounter) {
+            // duplicate packet
+            return AP4_SUCCESS;
+        }
+        if (continuity_counter != ((stream.m_ContinuityCounter+1) & 0x0F)) {
+            // packets were lost, so the current PES packet is incomplete
+            ++m_DiscontinuityCount;
+            if (stream.m_Pes.GetDataSize() && !stream.m_PesSkipped) {
+                ++m_DroppedPesCount;
+                stream.m_PesSkipped = true;
+            }
+        }
+    }
+    stream.m_ContinuityCounter    = continuity_counter;
+    stream.m_HasContinuityCounter = true;
+    
+    if (payload_start) {
+        // the previous PES packet is complete
+        if (stream.m_Pes.GetDataSize() && !stream.m_PesSkipped) {
+            AP4_Result result = EmitPes(stream);
+            if (AP4_FAILED(result)) return result;
+        }
+        stream.m_Pes.SetDataSize(0);
+        stream.m_PesSize    = 0;
+        stream.m_PesSkipped = false;
+    } else if (stream.m_Pes.GetDataSize() == 0 || stream.m_PesSkipped) {
+        // not in a PES packet
+        return AP4_SUCCESS;
+    }
+    
+    // accumulate the data, within the limit
+    if (stream.m_Pes.GetDataSize()+payload_size > m_MaxPesSize) {
+        ++m_DroppedPesCount;
+        stream.m_PesSkipped = true;
+        return AP4_SUCCESS;
+    }
+    stream.m_Pes.AppendData(payload, payload_size);
+    
+    // emit the packet as soon as it is complete if its size is known
+    if (stream.m_PesSize == 0 && stream.m_Pes.GetDataSize() >= 6) {
+        const AP4_UI08* pes = stream.m_Pes.GetData();
+        unsigned int pes_packet_length = (pes[4]<<8) | pes[5];
+        if (pes_packet_length) stream.m_PesSize = 6+pes_packet_length;
+    }
+    if (stream.m_PesSize && stream.m_Pes.GetDataSize() >= stream.m_PesSize) {
+        AP4_Result result = EmitPes(stream);
+        stream.m_Pes.SetDataSize(0);
+        stream.m_PesSize = 0;
+        if (AP4_FAILED(result)) return result;
+    }
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsReader_ReadTimestamp
++---------------------------------------------------------------------*/
+static AP4_UI64
+AP4_Mpeg2TsReader_ReadTimestamp(const AP4_UI08* data)
+{
+    return ((AP4_UI64)((data[0]>>1) & 7) << 30) |
+           ((AP4_UI64)data[1]            << 22) |
+           ((AP4_UI64)(data[2]>>1)       << 15) |
+           ((AP4_UI64)data[3]            <<  7) |
+           ((AP4_UI64)(data[4]>>1));
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsReader::EmitPes
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mpeg2TsReader::EmitPes(Stream& stream)
+{
+    const AP4_UI08* pes      = stream.m_Pes.GetData();
+    AP4_Size        pes_size = stream.m_Pes.GetDataSize();
+    if (stream.m_PesSize && pes_size > stream.m_PesSize) pes_size = stream.m_PesSize;
+    
+    // check the PES header
+    if (pes_size < 9 || pes[0] != 0 || pes[1] != 0 || pes[2] != 1 || (pes[6] & 0xC0) != 0x80) {
+        ++m_DroppedPesCount;
+        return AP4_SUCCESS;
+    }
+    unsigned int header_data_length = pes[8];
+    if (9+header_data_length > pes_size) {
+        ++m_DroppedPesCount;
+        return AP4_SUCCESS;
+    }
+    
+    // get the timestamps
+    unsigned int pts_dts_flags = pes[7]>>6;
+    bool         has_pts       = false;
+    AP4_UI64     pts           = 0;
+    AP4_UI64     dts           = 0;
+    if ((pts_dts_flags & 2) && header_data_length >= 5) {
+        has_pts = true;
+        pts = dts = AP4_Mpeg2TsReader_ReadTimestamp(pes+9);
+        if (pts_dts_flags == 3 && header_data_length >= 10) {
+            dts = AP4_Mpeg2TsReader_ReadTimestamp(pes+14);
+        }
+    }
+    
+    return m_Listener.OnPesPacket(stream,
+                                  pes+9+header_data_length,
+                                  pes_size-9-header_data_length,
+                                  has_pts,
+                                  pts,
+                                  dts);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsRemuxer::AP4_Mpeg2TsRemuxer
++---------------------------------------------------------------------*/
+AP4_Mpeg2TsRemuxer::AP4_Mpeg2TsRemuxer(AP4_SegmentBuilder::ChunkListener& listener,
+                                       unsigned int                       fragment_duration_ms,
+                                       double                             frames_per_second) :
+    m_Reader(*this),
+    m_ChunkListener(listener),
+    m_FragmentDuration(fragment_duration_ms),
+    m_FramesPerSecond(frames_per_second),
+    m_VideoPid(0),
+    m_AudioPid(0),
+    m_VideoBuilder(NULL),
+    m_AudioBuilder(NULL),
+    m_HasPendingVideoData(false),
+    m_PendingVideoHasDts(false),
+    m_PendingVideoDts(0),
+    m_HasVideoFirstPts(false),
+    m_VideoFirstPts(0),
+    m_HasAudioFirstPts(false),
+    m_AudioFirstPts(0),
+    m_ChunkResult(AP4_SUCCESS),
+    m_InvalidPesCount(0)
+{
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsRemuxer::~AP4_Mpeg2TsRemuxer
++---------------------------------------------------------------------*/
+AP4_Mpeg2TsRemuxer::~AP4_Mpeg2TsRemuxer()
+{
+    delete m_VideoBuilder;
+    delete m_AudioBuilder;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsRemuxer::Feed
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mpeg2TsRemuxer::Feed(const void* data, AP4_Size data_size, AP4_Size& bytes_consumed)
+{
+    return m_Reader.Feed(data, data_size, bytes_consumed);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsRemuxer::GetFirstPts
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mpeg2TsRemuxer::GetFirstPts(AP4_UI32 track_id, AP4_UI64& pts)
+{
+    if (track_id == AP4_MPEG2_TS_REMUXER_VIDEO_TRACK_ID && m_HasVideoFirstPts) {
+        pts = m_VideoFirstPts;
+        return AP4_SUCCESS;
+    }
+    if (track_id == AP4_MPEG2_TS_REMUXER_AUDIO_TRACK_ID && m_HasAudioFirstPts) {
+        pts = m_AudioFirstPts;
+        return AP4_SUCCESS;
+    }
+    
+    return AP4_ERROR_NO_SUCH_ITEM;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsRemuxer::Finish
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mpeg2TsRemuxer::Finish()
+{
+    AP4_Result result = m_Reader.Flush();
+    if (AP4_FAILED(result)) return result;
+    
+    // a video stream with a single PES packet has no detectable frame rate
+    if (m_HasPendingVideoData) {
+        result = CreateVideoBuilder(AP4_MPEG2_TS_REMUXER_DEFAULT_FRAME_RATE);
+        if (AP4_FAILED(result)) return result;
+    }
+    
+    if (m_VideoBuilder) {
+        result = DrainBuilder(*m_VideoBuilder);
+        if (AP4_FAILED(result)) return result;
+    }
+    if (m_AudioBuilder) {
+        result = DrainBuilder(*m_AudioBuilder);
+        if (AP4_FAILED(result)) return result;
+    }
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsRemuxer::OnStream
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mpeg2TsRemuxer::OnStream(AP4_Mpeg2TsReader::Stream& stream)
+{
+    // only one AVC and one AAC stream can be remuxed, since those are the
+    // formats supported by the segment builders
+    if (stream.GetStreamType() == AP4_MPEG2_STREAM_TYPE_AVC && m_VideoPid == 0) {
+        m_VideoPid = stream.GetPID();
+        if (m_FramesPerSecond != 0.0) {
+            return CreateVideoBuilder(m_FramesPerSecond);
+        }
+        return AP4_SUCCESS;
+    } else if (stream.GetStreamType() == AP4_MPEG2_STREAM_TYPE_ISO_IEC_13818_7 && m_AudioPid == 0) {
+        m_AudioPid = stream.GetPID();
+        m_AudioBuilder = new AP4_AacSegmentBuilder(AP4_MPEG2_TS_REMUXER_AUDIO_TRACK_ID);
+        m_AudioBuilder->EnableChunking(this, 0, m_FragmentDuration);
+        return AP4_SUCCESS;
+    }
+    
+    return AP4_ERROR_NOT_SUPPORTED;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsRemuxer::OnPesPacket
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mpeg2TsRemuxer::OnPesPacket(AP4_Mpeg2TsReader::Stream& stream,
+                                const AP4_UI08*            data,
+                                AP4_Size                   data_size,
+                                bool                       has_pts,
+                                AP4_UI64                   pts,
+                                AP4_UI64                   dts)
+{
+    if (stream.GetPID() == m_AudioPid) {
+        if (has_pts && !m_HasAudioFirstPts) {
+            m_AudioFirstPts    = pts;
+            m_HasAudioFirstPts = true;
+        }
+        return FeedBuilder(*m_AudioBuilder, data, data_size);
+    }
+    if (stream.GetPID() != m_VideoPid) return AP4_SUCCESS;
+    if (has_pts && !m_HasVideoFirstPts) {
+        m_VideoFirstPts    = pts;
+        m_HasVideoFirstPts = true;
+    }
+    
+    if (m_VideoBuilder == NULL) {
+        // keep the first packet until the frame rate can be computed from
+        // the difference between the first two decoding timestamps
+        if (!m_HasPendingVideoData) {
+            m_PendingVideoData.SetData(data, data_size);
+            m_PendingVideoHasDts  = has_pts;
+            m_PendingVideoDts     = dts;
+            m_HasPendingVideoData = true;
+            return AP4_SUCCESS;
+        }
+        double frames_per_second = AP4_MPEG2_TS_REMUXER_DEFAULT_FRAME_RATE;
+        AP4_UI64 delta = (dts-m_PendingVideoDts) & 0x1FFFFFFFFULL; // 33-bit wrap around
+        if (has_pts && m_PendingVideoHasDts && delta && delta < 90000) {
+            frames_per_second = 90000.0/(double)delta;
+        }
+        AP4_Result result = CreateVideoBuilder(frames_per_second);
+        if (AP4_FAILED(result)) return result;
+    }
+    
+    return FeedBuilder(*m_VideoBuilder, data, data_size);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsRemuxer::CreateVideoBuilder
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mpeg2TsRemuxer::CreateVideoBuilder(double frames_per_second)
+{
+    m_VideoBuilder = new AP4_AvcSegmentBuilder(AP4_MPEG2_TS_REMUXER_VIDEO_TRACK_ID, frames_per_second);
+    m_VideoBuilder->EnableChunking(this, 0, m_FragmentDuration);
+    
+    // feed the packet that was kept while the frame rate was unknown
+    if (m_HasPendingVideoData) {
+        m_HasPendingVideoData = false;
+        AP4_Result result = FeedBuilder(*m_VideoBuilder,
+                                        m_PendingVideoData.GetData(),
+                                        m_PendingVideoData.GetDataSize());
+        m_PendingVideoData.SetBufferSize(0);
+        if (AP4_FAILED(result)) return result;
+    }
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsRemuxer::FeedBuilder
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mpeg2TsRemuxer::FeedBuilder(AP4_FeedSegmentBuilder& builder,
+                                const AP4_UI08*         data,
+                                AP4_Size                data_size)
+{
+    // feed until all the data is consumed and no more access units come out
+    AP4_Size   offset = 0;
+    AP4_Result result;
+    do {
+        AP4_Size bytes_consumed = 0;
+        result = builder.Feed(data+offset, data_size-offset, bytes_consumed);
+        if (result < 0) {
+            // errors returned by the chunk listener are fatal
+            if (AP4_FAILED(m_ChunkResult)) return m_ChunkResult;
+            
+            // the payload can't be parsed, drop what's left of the packet
+            ++m_InvalidPesCount;
+            return AP4_SUCCESS;
+        }
+        offset += bytes_consumed;
+    } while (offset < data_size || result > 0);
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsRemuxer::DrainBuilder
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mpeg2TsRemuxer::DrainBuilder(AP4_FeedSegmentBuilder& builder)
+{
+    // the first pass signals the end of the stream to the frame parser,
+    // the second one gets the access units that it still holds
+    AP4_Result result;
+    for (unsigned int pass=0; pass<2; pass++) {
+        do {
+            AP4_Size bytes_consumed = 0;
+            result = builder.Feed(NULL, 0, bytes_consumed);
+            if (result < 0) {
+                if (AP4_FAILED(m_ChunkResult)) return m_ChunkResult;
+                ++m_InvalidPesCount;
+                break;
+            }
+        } while (result > 0);
+    }
+    
+    return builder.EndSegment();
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsRemuxer::OnChunk
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mpeg2TsRemuxer::OnChunk(AP4_SegmentBuilder& builder,
+                            const AP4_UI08*     data,
+                            AP4_Size            data_size,
+                            unsigned int        sequence_number,
+                            bool                starts_segment)
+{
+    // remember the errors of the listener, so they are not taken for
+    // parsing errors
+    AP4_Result result = m_ChunkListener.OnChunk(builder, data, data_size, sequence_number, starts_segment);
+    if (AP4_FAILED(result)) m_ChunkResult = result;
+    
+    return result;
+}
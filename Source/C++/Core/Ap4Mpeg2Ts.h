@@ -33,7 +33,9 @@
 |   includes
 +---------------------------------------------------------------------*/
 #include "Ap4Types.h"
+#include "Ap4Array.h"
 #include "Ap4DataBuffer.h"
+#include "Ap4SegmentBuilder.h"
 
 /*----------------------------------------------------------------------
 |   classes
@@ -59,6 +61,11 @@ const AP4_UI08 AP4_MPEG2_STREAM_TYPE_HEVC                = 0x24;
 const AP4_UI08 AP4_MPEG2_STREAM_TYPE_ATSC_AC3            = 0x81;
 const AP4_UI08 AP4_MPEG2_STREAM_TYPE_ATSC_EAC3           = 0x81;
 
+const AP4_Size AP4_MPEG2_TS_READER_DEFAULT_MAX_PES_SIZE   = 4*1024*1024;
+const double   AP4_MPEG2_TS_REMUXER_DEFAULT_FRAME_RATE    = 25.0;
+const AP4_UI32 AP4_MPEG2_TS_REMUXER_VIDEO_TRACK_ID        = 1;
+const AP4_UI32 AP4_MPEG2_TS_REMUXER_AUDIO_TRACK_ID        = 2;
+
 /*----------------------------------------------------------------------
 |   AP4_Mpeg2TsWriter
 +---------------------------------------------------------------------*/
@@ -164,4 +171,239 @@ private:
     SampleStream* m_Video;
 };
 
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsReader
++---------------------------------------------------------------------*/
+/**
+ * Streaming demuxer for MPEG2 transport streams.
+ * The reader parses the PAT and the PMT of the first program, and
+ * reassembles the PES packets of the elementary streams listed in the
+ * PMT, which it passes to a listener as soon as they are complete.
+ * Data is fed in chunks of any size: only whole packets are consumed, and
+ * the bytes that are not consumed must be fed again, followed by more
+ * data (feeding at least two packets at a time lets the reader find the
+ * packet boundaries). Memory use is bounded: apart from the PSI sections,
+ * the only data kept is the PES packet being assembled for each stream,
+ * which is limited to a maximum size.
+ * DVB AC-3 and E-AC-3 streams (private PES streams with an AC-3 or
+ * enhanced AC-3 descriptor) are reported with the ATSC stream types.
+ */
+class AP4_Mpeg2TsReader
+{
+public:
+    // classes
+    class Stream {
+    public:
+        Stream(AP4_UI16        pid,
+               AP4_UI08        stream_type,
+               const AP4_UI08* descriptor,
+               AP4_Size        descriptor_length);
+        AP4_UI16              GetPID()        { return m_PID;        }
+        AP4_UI08              GetStreamType() { return m_StreamType; }
+        const AP4_DataBuffer& GetDescriptor() { return m_Descriptor; }
+        bool                  IsEnabled()     { return m_Enabled;    }
+
+    private:
+        // members
+        AP4_UI16       m_PID;
+        AP4_UI08       m_StreamType;
+        AP4_DataBuffer m_Descriptor;
+        bool           m_Enabled;
+        bool           m_HasContinuityCounter;
+        unsigned int   m_ContinuityCounter;
+        AP4_DataBuffer m_Pes;
+        AP4_Size       m_PesSize;     // 0 if not known yet or unbounded
+        bool           m_PesSkipped;  // the rest of the PES packet is skipped
+        
+        // friends
+        friend class AP4_Mpeg2TsReader;
+    };
+
+    class Listener {
+    public:
+        virtual ~Listener() {}
+        
+        /**
+         * Called when the PMT lists a new elementary stream.
+         * Return AP4_SUCCESS to demux the stream, or an error to skip its
+         * packets.
+         */
+        virtual AP4_Result OnStream(Stream& stream) = 0;
+        
+        /**
+         * Called for each complete PES packet of a demuxed stream, with
+         * the payload of the packet (elementary stream data).
+         * Timestamps are in 90kHz units, dts is equal to pts when the
+         * packet has no DTS. The data is only valid for the duration of
+         * the call. Errors are returned by Feed() and Flush().
+         */
+        virtual AP4_Result OnPesPacket(Stream&         stream,
+                                       const AP4_UI08* data,
+                                       AP4_Size        data_size,
+                                       bool            has_pts,
+                                       AP4_UI64        pts,
+                                       AP4_UI64        dts) = 0;
+    };
+    
+    // class methods
+    /**
+     * Returns the offset of the first sync byte that is followed, one
+     * packet later, by another sync byte (or by the end of the data),
+     * or data_size if there is none.
+     */
+    static AP4_Size FindSync(const AP4_UI08* data, AP4_Size data_size);
+
+    // constructor and destructor
+    AP4_Mpeg2TsReader(Listener& listener,
+                      AP4_Size  max_pes_size = AP4_MPEG2_TS_READER_DEFAULT_MAX_PES_SIZE);
+    ~AP4_Mpeg2TsReader();
+    
+    // methods
+    AP4_Result Feed(const void* data, AP4_Size data_size, AP4_Size& bytes_consumed);
+    /**
+     * Pass the PES packets that are still being assembled to the listener.
+     * This should be called at the end of the stream.
+     */
+    AP4_Result Flush();
+    
+    // accessors
+    AP4_Array<Stream*>& GetStreams()              { return m_Streams;            }
+    unsigned int        GetSyncLossCount()        { return m_SyncLossCount;      }
+    unsigned int        GetDiscontinuityCount()   { return m_DiscontinuityCount; }
+    unsigned int        GetDroppedPesCount()      { return m_DroppedPesCount;    }
+
+private:
+    // methods
+    Stream*    FindStream(AP4_UI16 pid);
+    AP4_Result ParsePacket(const AP4_UI08* packet);
+    AP4_Result OnSectionData(AP4_DataBuffer& section,
+                             bool            payload_start,
+                             const AP4_UI08* payload,
+                             AP4_Size        payload_size);
+    AP4_Result ParseSection(AP4_DataBuffer& section);
+    AP4_Result ParsePat(const AP4_UI08* section, AP4_Size section_size);
+    AP4_Result ParsePmt(const AP4_UI08* section, AP4_Size section_size);
+    AP4_Result OnPesData(Stream&         stream,
+                         bool            payload_start,
+                         unsigned int    continuity_counter,
+                         const AP4_UI08* payload,
+                         AP4_Size        payload_size);
+    AP4_Result EmitPes(Stream& stream);
+    
+    // members
+    Listener&          m_Listener;
+    AP4_Size           m_MaxPesSize;
+    bool               m_InSync;
+    AP4_UI16           m_PmtPid; // 0 until the PAT has been parsed
+    AP4_DataBuffer     m_PatSection;
+    AP4_DataBuffer     m_PmtSection;
+    AP4_Array<Stream*> m_Streams;
+    unsigned int       m_SyncLossCount;
+    unsigned int       m_DiscontinuityCount;
+    unsigned int       m_DroppedPesCount;
+};
+
+/*----------------------------------------------------------------------
+|   AP4_Mpeg2TsRemuxer
++---------------------------------------------------------------------*/
+/**
+ * Converts an MPEG2 transport stream to fragmented MP4 without going
+ * through an intermediate file: the PES packets of the first AVC video
+ * stream and of the first AAC (ADTS) audio stream are fed directly to an
+ * AP4_AvcSegmentBuilder (track ID 1) and an AP4_AacSegmentBuilder
+ * (track ID 2), in chunked mode, so each fragment is passed to the chunk
+ * listener as soon as it is complete. The listener can get the init
+ * segment of a track from the builder once its first chunk is out.
+ * As with the builders, sample timing is derived from the frame rate and
+ * the AAC frame size. If the frame rate is not specified, it is computed
+ * from the timestamps of the first two video PES packets.
+ * Apart from that, the PES timestamps are not used: both tracks start at
+ * time 0, and gaps or timestamp discontinuities in the input are not
+ * reflected in the output. GetFirstPts() returns the timestamp of the
+ * first PES packet of each track, so that callers can offset the 'tfdt'
+ * values or add an edit list to keep the tracks in sync.
+ * PES packets with a payload that can't be parsed are dropped (from the
+ * first error on), and counted, and the remuxing goes on.
+ */
+class AP4_Mpeg2TsRemuxer : public AP4_Mpeg2TsReader::Listener,
+                           public AP4_SegmentBuilder::ChunkListener
+{
+public:
+    // constructor and destructor
+    AP4_Mpeg2TsRemuxer(AP4_SegmentBuilder::ChunkListener& listener,
+                       unsigned int                       fragment_duration_ms,
+                       double                             frames_per_second = 0.0);
+    ~AP4_Mpeg2TsRemuxer();
+    
+    // accessors
+    AP4_Mpeg2TsReader&     GetReader()       { return m_Reader;       }
+    AP4_AvcSegmentBuilder* GetVideoBuilder() { return m_VideoBuilder; }
+    AP4_AacSegmentBuilder* GetAudioBuilder() { return m_AudioBuilder; }
+    /**
+     * Number of PES packets that were dropped, in full or in part, because
+     * their payload could not be parsed.
+     */
+    unsigned int           GetInvalidPesCount() { return m_InvalidPesCount; }
+    /**
+     * Get the presentation timestamp (90kHz clock) of the first PES packet
+     * of a track (AP4_MPEG2_TS_REMUXER_VIDEO_TRACK_ID or
+     * AP4_MPEG2_TS_REMUXER_AUDIO_TRACK_ID).
+     * Returns AP4_ERROR_NO_SUCH_ITEM if no PES packet with a timestamp has
+     * been seen yet for that track.
+     */
+    AP4_Result GetFirstPts(AP4_UI32 track_id, AP4_UI64& pts);
+    
+    // methods
+    AP4_Result Feed(const void* data, AP4_Size data_size, AP4_Size& bytes_consumed);
+    /**
+     * Flush the reader and the builders, and emit the last fragments.
+     * This must be called at the end of the stream.
+     */
+    AP4_Result Finish();
+    
+    // AP4_Mpeg2TsReader::Listener methods
+    virtual AP4_Result OnStream(AP4_Mpeg2TsReader::Stream& stream);
+    virtual AP4_Result OnPesPacket(AP4_Mpeg2TsReader::Stream& stream,
+                                   const AP4_UI08*            data,
+                                   AP4_Size                   data_size,
+                                   bool                       has_pts,
+                                   AP4_UI64                   pts,
+                                   AP4_UI64                   dts);
+
+    // AP4_SegmentBuilder::ChunkListener methods
+    virtual AP4_Result OnChunk(AP4_SegmentBuilder& builder,
+                               const AP4_UI08*     data,
+                               AP4_Size            data_size,
+                               unsigned int        sequence_number,
+                               bool                starts_segment);
+
+private:
+    // methods
+    AP4_Result CreateVideoBuilder(double frames_per_second);
+    AP4_Result FeedBuilder(AP4_FeedSegmentBuilder& builder,
+                           const AP4_UI08*         data,
+                           AP4_Size                data_size);
+    AP4_Result DrainBuilder(AP4_FeedSegmentBuilder& builder);
+    
+    // members
+    AP4_Mpeg2TsReader                  m_Reader;
+    AP4_SegmentBuilder::ChunkListener& m_ChunkListener;
+    unsigned int                       m_FragmentDuration;
+    double                             m_FramesPerSecond;
+    AP4_UI16                           m_VideoPid;
+    AP4_UI16                           m_AudioPid;
+    AP4_AvcSegmentBuilder*             m_VideoBuilder;
+    AP4_AacSegmentBuilder*             m_AudioBuilder;
+    AP4_DataBuffer                     m_PendingVideoData;
+    bool                               m_HasPendingVideoData;
+    bool                               m_PendingVideoHasDts;
+    AP4_UI64                           m_PendingVideoDts;
+    bool                               m_HasVideoFirstPts;
+    AP4_UI64                           m_VideoFirstPts;
+    bool                               m_HasAudioFirstPts;
+    AP4_UI64                           m_AudioFirstPts;
+    AP4_Result                         m_ChunkResult;
+    unsigned int                       m_InvalidPesCount;
+};
+
 #endif // _AP4_MPEG2_TS_H_
@@ -120,6 +120,9 @@ AP4_OdheAtom::InspectFields(AP4_AtomInspector& inspector)
 void
 AP4_OdheAtom::OnChildChanged(AP4_Atom*)
 {
+    // deferred to EndChanges() while changes are batched
+    if (DeferChange()) return;
+
     // remcompute our size
     AP4_UI64 size = GetHeaderSize()+1+m_ContentType.GetLength();
     m_Children.Apply(AP4_AtomSizeAdder(size));
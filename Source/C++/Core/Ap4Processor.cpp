@@ -46,6 +46,30 @@
 #include "Ap4SidxAtom.h"
 #include "Ap4DataBuffer.h"
 #include "Ap4Debug.h"
+#include "Ap4Instrumentation.h"
+
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+static const AP4_AtomPath AP4_PATH_MDIA_MINF_STBL("mdia/minf/stbl");
+
+/*----------------------------------------------------------------------
+|   AP4_Processor_CreateAtomFromStream
++---------------------------------------------------------------------*/
+static AP4_Result
+AP4_Processor_CreateAtomFromStream(AP4_AtomFactory& atom_factory,
+                                   AP4_ByteStream&  stream,
+                                   AP4_Atom*&       atom)
+{
+    AP4_InstrumentationScope scope(AP4_Instrumentation::STAGE_ATOM_PARSING);
+    AP4_Result result = atom_factory.CreateAtomFromStream(stream, atom);
+    
+    // the payload of mdat atoms is skipped, not parsed
+    if (AP4_SUCCEEDED(result) && atom->GetType() != AP4_ATOM_TYPE_MDAT) {
+        scope.SetByteCount(atom->GetSize());
+    }
+    return result;
+}
 
 /*----------------------------------------------------------------------
 |   types
@@ -172,7 +196,12 @@ AP4_Processor::ProcessFragments(AP4_MoovAtom*              moov,
         AP4_ContainerAtom* moof = AP4_DYNAMIC_CAST(AP4_ContainerAtom, atom);
         AP4_MovieFragment* fragment = new AP4_MovieFragment(moof);
 
-        // process all the traf atoms
+        // the traf atoms are looked up by index below, so index the children
+        moof->EnableChildIndex();
+
+        // process all the traf atoms, updating the moof size only once
+        // all the handlers have made their changes
+        moof->BeginChanges();
         AP4_Array<AP4_Processor::FragmentHandler*> handlers;
         AP4_Array<AP4_FragmentSampleTable*> sample_tables;
         for (;AP4_Atom* child = moof->GetChild(AP4_ATOM_TYPE_TRAF, handlers.ItemCount());) {
@@ -235,10 +264,12 @@ AP4_Processor::ProcessFragments(AP4_MoovAtom*              moov,
             if (AP4_FAILED(result)) return result;
         }
              
+        moof->EndChanges();
+             
         // write the moof
         AP4_UI64 moof_out_start = 0;
         output.Tell(moof_out_start);
-        moof->Write(output);
+        moof->WriteBuffered(output);
         
         // remember the location of this fragment
         FragmentMapEntry map_entry = {atom_offset, moof_out_start};
@@ -300,7 +331,10 @@ AP4_Processor::ProcessFragments(AP4_MoovAtom*              moov,
                 
                 // process the sample data
                 if (handler) {
-                    result = handler->ProcessSample(sample_data_in, sample_data_out);
+                    {
+                        AP4_InstrumentationScope scope(AP4_Instrumentation::STAGE_SAMPLE_PROCESSING, sample_data_in.GetDataSize());
+                        result = handler->ProcessSample(sample_data_in, sample_data_out);
+                    }
                     if (AP4_FAILED(result)) return result;
 
                     // write the sample data
@@ -348,7 +382,7 @@ AP4_Processor::ProcessFragments(AP4_MoovAtom*              moov,
         
         // update the moof if needed
         output.Seek(moof_out_start);
-        moof->Write(output);
+        moof->WriteBuffered(output);
         output.Seek(mdat_out_end);
         
         // update the sidx if we have one
@@ -438,7 +472,7 @@ AP4_Processor::Process(AP4_ByteStream&   input,
     bool                        in_fragments = false;
     unsigned int                sidx_count = 0;
     for (AP4_Atom* atom = NULL;
-        AP4_SUCCEEDED(atom_factory.CreateAtomFromStream(input, atom));
+        AP4_SUCCEEDED(AP4_Processor_CreateAtomFromStream(atom_factory, input, atom));
         input.Tell(stream_offset)) {
         if (atom->GetType() == AP4_ATOM_TYPE_MDAT) {
             delete atom;
@@ -481,7 +515,7 @@ AP4_Processor::Process(AP4_ByteStream&   input,
     if (fragments) {
         stream_offset = 0;
         for (AP4_Atom* atom = NULL;
-            AP4_SUCCEEDED(atom_factory.CreateAtomFromStream(*fragments, atom));
+            AP4_SUCCEEDED(AP4_Processor_CreateAtomFromStream(atom_factory, *fragments, atom));
             fragments->Tell(stream_offset)) {
             if (atom->GetType() == AP4_ATOM_TYPE_MDAT) {
                 delete atom;
@@ -518,7 +552,7 @@ AP4_Processor::Process(AP4_ByteStream&   input,
             AP4_TrakAtom* trak = item->GetData();
 
             // find the stsd atom
-            AP4_ContainerAtom* stbl = AP4_DYNAMIC_CAST(AP4_ContainerAtom, trak->FindChild("mdia/minf/stbl"));
+            AP4_ContainerAtom* stbl = AP4_DYNAMIC_CAST(AP4_ContainerAtom, trak->FindChild(AP4_PATH_MDIA_MINF_STBL));
             if (stbl == NULL) continue;
             
             // see if there's an external data source for this track
@@ -673,7 +707,10 @@ AP4_Processor::Process(AP4_ByteStream&   input,
                 locator.m_Sample.ReadData(data_in);
                 TrackHandler* handler = m_TrackHandlers[locator.m_TrakIndex];
                 if (handler) {
-                    result = handler->ProcessSample(data_in, data_out);
+                    {
+                        AP4_InstrumentationScope scope(AP4_Instrumentation::STAGE_SAMPLE_PROCESSING, data_in.GetDataSize());
+                        result = handler->ProcessSample(data_in, data_out);
+                    }
                     if (AP4_FAILED(result)) return result;
                     output.Write(data_out.GetData(), data_out.GetDataSize());
                 } else {
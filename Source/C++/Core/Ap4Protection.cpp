@@ -48,6 +48,7 @@
 #include "Ap4Marlin.h"
 #include "Ap4Piff.h"
 #include "Ap4CommonEncryption.h"
+#include "Ap4Threads.h"
 
 /*----------------------------------------------------------------------
 |   dynamic cast support
@@ -917,7 +918,33 @@ AP4_StandardDecryptingProcessor::CreateTrackHandler(AP4_TrakAtom* trak)
 }
 
 /*----------------------------------------------------------------------
-|   AP4_DecryptingStream::AP4_DecryptingStream
+|   AP4_DecryptingStream::Prefetcher
++---------------------------------------------------------------------*/
+class AP4_DecryptingStream::Prefetcher : public AP4_Runnable
+{
+public:
+    Prefetcher(AP4_DecryptingStream& stream) :
+        m_Stream(stream),
+        m_Thread(*this),
+        m_Position(0),
+        m_Result(AP4_SUCCESS),
+        m_Pending(false) {}
+
+    // AP4_Runnable methods
+    virtual void Run() {
+        m_Result = m_Stream.FillWindow(*m_Stream.m_NextWindow, m_Position);
+    }
+
+    // members
+    AP4_DecryptingStream& m_Stream;
+    AP4_Thread            m_Thread;
+    AP4_Position          m_Position;
+    AP4_Result            m_Result;
+    bool                  m_Pending;
+};
+
+/*----------------------------------------------------------------------
+|   AP4_DecryptingStream::Create
 +---------------------------------------------------------------------*/
 AP4_Result
 AP4_DecryptingStream::Create(AP4_BlockCipher::CipherMode mode,
@@ -928,7 +955,9 @@ AP4_DecryptingStream::Create(AP4_BlockCipher::CipherMode mode,
                              const AP4_UI08*             key,
                              AP4_Size                    key_size,
                              AP4_BlockCipherFactory*     block_cipher_factory,
-                             AP4_ByteStream*&            stream)
+                             AP4_ByteStream*&            stream,
+                             AP4_Size                    window_size,
+                             bool                        prefetch)
 {
     // default return value
     stream = NULL;
@@ -962,7 +991,7 @@ AP4_DecryptingStream::Create(AP4_BlockCipher::CipherMode mode,
         return AP4_ERROR_NOT_SUPPORTED;
     }
         
-    // create the stream cipher
+    // create the block cipher
     AP4_BlockCipher* block_cipher;
     result = block_cipher_factory->CreateCipher(AP4_BlockCipher::AES_128,
                                                 AP4_BlockCipher::DECRYPT,
@@ -976,38 +1005,57 @@ AP4_DecryptingStream::Create(AP4_BlockCipher::CipherMode mode,
     // keep a reference to the source stream
     encrypted_stream.AddReference();
 
-    // create the cipher according to the mode
-    AP4_StreamCipher* stream_cipher = NULL;
-    switch (mode) {
-        case AP4_BlockCipher::CBC:
-            stream_cipher = new AP4_CbcStreamCipher(block_cipher);
-            break;
-        case AP4_BlockCipher::CTR:
-            stream_cipher = new AP4_CtrStreamCipher(block_cipher, AP4_CIPHER_BLOCK_SIZE);
-            break;
-        default:
-            // should never occur
-            return AP4_ERROR_NOT_SUPPORTED;
-    }
+    // the window size must be a whole number of blocks
+    if (window_size == 0) window_size = AP4_DECRYPTING_STREAM_DEFAULT_WINDOW_SIZE;
+    window_size = (window_size+AP4_CIPHER_BLOCK_SIZE-1)-(window_size+AP4_CIPHER_BLOCK_SIZE-1)%AP4_CIPHER_BLOCK_SIZE;
     
-    // set the IV
-    stream_cipher->SetIV(iv);
-
     // create the stream
-    stream = new AP4_DecryptingStream(cleartext_size, 
+    stream = new AP4_DecryptingStream(mode,
+                                      cleartext_size, 
                                       &encrypted_stream,
                                       encrypted_size,
-                                      stream_cipher);
+                                      block_cipher,
+                                      iv,
+                                      window_size,
+                                      prefetch);
     
     return AP4_SUCCESS;
 }
 
+/*----------------------------------------------------------------------
+|   AP4_DecryptingStream::AP4_DecryptingStream
++---------------------------------------------------------------------*/
+AP4_DecryptingStream::AP4_DecryptingStream(AP4_BlockCipher::CipherMode mode,
+                                           AP4_LargeSize               cleartext_size,
+                                           AP4_ByteStream*             encrypted_stream,
+                                           AP4_LargeSize               encrypted_size,
+                                           AP4_BlockCipher*            block_cipher,
+                                           const AP4_UI08*             iv,
+                                           AP4_Size                    window_size,
+                                           bool                        prefetch) :
+    m_CipherMode(mode),
+    m_CleartextSize(cleartext_size),
+    m_CleartextPosition(0),
+    m_EncryptedStream(encrypted_stream),
+    m_EncryptedSize(encrypted_size),
+    m_BlockCipher(block_cipher),
+    m_WindowSize(window_size),
+    m_Window(&m_Windows[0]),
+    m_NextWindow(&m_Windows[1]),
+    m_Prefetcher(prefetch ? new Prefetcher(*this) : NULL),
+    m_ReferenceCount(1)
+{
+    AP4_CopyMemory(m_Iv, iv, 16);
+}
+
 /*----------------------------------------------------------------------
 |   AP4_DecryptingStream::~AP4_DecryptingStream
 +---------------------------------------------------------------------*/
 AP4_DecryptingStream::~AP4_DecryptingStream()
 {
-    delete m_StreamCipher;
+    // the prefetcher's thread must be done before anything goes away
+    delete m_Prefetcher;
+    delete m_BlockCipher;
     m_EncryptedStream->Release();
 }
 
@@ -1029,6 +1077,101 @@ AP4_DecryptingStream::Release()
     if (--m_ReferenceCount == 0) delete this;
 }
 
+/*----------------------------------------------------------------------
+|   AP4_DecryptingStream::FillWindow
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_DecryptingStream::FillWindow(Window& window, AP4_Position position)
+{
+    // the window always starts on a block boundary
+    AP4_ASSERT(position%AP4_CIPHER_BLOCK_SIZE == 0);
+    window.m_Position = position;
+    window.m_Offset   = 0;
+    window.m_Size     = 0;
+    if (position >= m_EncryptedSize) return AP4_ERROR_EOS;
+    AP4_Size size = m_WindowSize;
+    if (size > m_EncryptedSize-position) size = (AP4_Size)(m_EncryptedSize-position);
+    
+    // in CBC mode, the previous ciphertext block is the chaining block
+    AP4_Size preroll = (m_CipherMode == AP4_BlockCipher::CBC && position) ? AP4_CIPHER_BLOCK_SIZE : 0;
+    
+    // read the encrypted data
+    AP4_CHECK(window.m_Data.SetDataSize(preroll+size));
+    AP4_UI08* data = window.m_Data.UseData();
+    AP4_CHECK(m_EncryptedStream->Seek(position-preroll));
+    AP4_CHECK(m_EncryptedStream->Read(data, preroll+size));
+    
+    // decrypt in place
+    if (m_CipherMode == AP4_BlockCipher::CBC) {
+        AP4_CHECK(m_BlockCipher->Process(data+preroll, size, data+preroll, preroll ? data : m_Iv));
+        
+        // check the padding of the last block
+        if (position+size == m_EncryptedSize) {
+            AP4_UI08 pad_byte = data[preroll+size-1];
+            if (pad_byte > AP4_CIPHER_BLOCK_SIZE) return AP4_ERROR_INVALID_FORMAT;
+        }
+    } else {
+        // the counter is the IV plus the block index
+        AP4_UI64 block_index = position/AP4_CIPHER_BLOCK_SIZE;
+        AP4_UI08 counter[AP4_CIPHER_BLOCK_SIZE];
+        unsigned int carry = 0;
+        for (int i=AP4_CIPHER_BLOCK_SIZE-1; i>=0; i--) {
+            unsigned int sum = m_Iv[i]+(unsigned int)(block_index&0xFF)+carry;
+            counter[i]   = (AP4_UI08)sum;
+            carry        = sum>>8;
+            block_index >>= 8;
+        }
+        AP4_CHECK(m_BlockCipher->Process(data, size, data, counter));
+    }
+    
+    window.m_Offset = preroll;
+    window.m_Size   = size;
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_DecryptingStream::LoadWindow
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_DecryptingStream::LoadWindow(AP4_Position position)
+{
+    AP4_Position window_position = position-position%AP4_CIPHER_BLOCK_SIZE;
+    
+    // use the prefetched window if it is the one we need
+    bool loaded = false;
+    if (m_Prefetcher && m_Prefetcher->m_Pending) {
+        m_Prefetcher->m_Thread.Wait();
+        m_Prefetcher->m_Pending = false;
+        if (m_Prefetcher->m_Position == window_position && AP4_SUCCEEDED(m_Prefetcher->m_Result)) {
+            Window* window = m_Window;
+            m_Window       = m_NextWindow;
+            m_NextWindow   = window;
+            loaded         = true;
+        }
+    }
+    if (!loaded) {
+        AP4_Result result = FillWindow(*m_Window, window_position);
+        if (AP4_FAILED(result)) {
+            m_Window->m_Size = 0;
+            return result;
+        }
+    }
+    
+    // start decrypting the next window in the background
+    if (m_Prefetcher) {
+        AP4_Position next_position = m_Window->m_Position+m_Window->m_Size;
+        if (next_position < m_EncryptedSize && next_position < m_CleartextSize) {
+            m_Prefetcher->m_Position = next_position;
+            if (AP4_SUCCEEDED(m_Prefetcher->m_Thread.Start())) {
+                m_Prefetcher->m_Pending = true;
+            }
+        }
+    }
+    
+    return AP4_SUCCESS;
+}
+
 /*----------------------------------------------------------------------
 |   AP4_DecryptingStream::ReadPartial
 +---------------------------------------------------------------------*/
@@ -1048,60 +1191,24 @@ AP4_DecryptingStream::ReadPartial(void*     buffer,
         bytes_to_read = (AP4_Size)available;
     }
     
-    if (m_BufferFullness) {
-        // we have some leftovers
-        AP4_Size chunk = bytes_to_read;
-        if (chunk > m_BufferFullness) chunk = m_BufferFullness;
-        AP4_CopyMemory(buffer, &m_Buffer[m_BufferOffset], chunk);
-        buffer = (char*)buffer+chunk;
-        m_CleartextPosition += chunk;
-        available           -= chunk;
-        bytes_to_read       -= chunk;
-        m_BufferFullness    -= chunk;
-        m_BufferOffset      += chunk;
-        bytes_read          += chunk;
-    }
-    if (bytes_to_read == 0) return AP4_SUCCESS;
-    
-    // seek to the right place in the input
-    m_EncryptedStream->Seek(m_EncryptedPosition);
-
     while (bytes_to_read) {
-        // read from the source
-        AP4_UI08 encrypted[1024];
-        AP4_Size encrypted_read = 0;
-        AP4_Result result = m_EncryptedStream->ReadPartial(encrypted, sizeof(encrypted), encrypted_read);
-        if (result == AP4_ERROR_EOS) {
-            if (bytes_read == 0) {
-                return AP4_ERROR_EOS;
-            } else {
-                return AP4_SUCCESS;
+        // make sure that the current window covers the current position
+        if (m_CleartextPosition <  m_Window->m_Position ||
+            m_CleartextPosition >= m_Window->m_Position+m_Window->m_Size) {
+            AP4_Result result = LoadWindow(m_CleartextPosition);
+            if (AP4_FAILED(result)) {
+                return (bytes_read && result == AP4_ERROR_EOS) ? AP4_SUCCESS : result;
             }
-        } else if (result != AP4_SUCCESS) {
-            return result;
-        } else {
-            m_EncryptedPosition += encrypted_read;
         }
-        bool is_last_buffer = (m_EncryptedPosition >= m_EncryptedSize);
-        AP4_Size buffer_size = sizeof(m_Buffer);
-        result = m_StreamCipher->ProcessBuffer(encrypted, 
-                                               encrypted_read, 
-                                               m_Buffer, 
-                                               &buffer_size,
-                                               is_last_buffer);
-        if (AP4_FAILED(result)) return result;
-        m_BufferOffset   = 0;
-        m_BufferFullness = buffer_size;
-
-        AP4_Size chunk = bytes_to_read;
-        if (chunk > m_BufferFullness) chunk = m_BufferFullness;
-        if (chunk) AP4_CopyMemory(buffer, &m_Buffer[m_BufferOffset], chunk);
+        
+        // copy from the window
+        AP4_Size offset = (AP4_Size)(m_CleartextPosition-m_Window->m_Position);
+        AP4_Size chunk  = m_Window->m_Size-offset;
+        if (chunk > bytes_to_read) chunk = bytes_to_read;
+        AP4_CopyMemory(buffer, m_Window->m_Data.GetData()+m_Window->m_Offset+offset, chunk);
         buffer = (char*)buffer+chunk;
         m_CleartextPosition += chunk;
-        available           -= chunk;
         bytes_to_read       -= chunk;
-        m_BufferFullness    -= chunk;
-        m_BufferOffset      += chunk;
         bytes_read          += chunk;
     }
 
@@ -1125,39 +1232,13 @@ AP4_DecryptingStream::WritePartial(const void* /* buffer         */,
 AP4_Result 
 AP4_DecryptingStream::Seek(AP4_Position position)
 {
-    AP4_Cardinal preroll = 0;
-    
-    // check for no-op seek requests
-    if (position == m_CleartextPosition) {
-        return AP4_SUCCESS;
-    }
-    
     // check bounds
     if (position > m_CleartextSize) {
         return AP4_ERROR_INVALID_PARAMETERS;
     }
     
-    // try to put the stream cipher at the right offset
-    AP4_CHECK(m_StreamCipher->SetStreamOffset(position, &preroll));
-
-    // seek in the source stream
-    AP4_CHECK(m_EncryptedStream->Seek(position-preroll));
-    
-    // if we need to, process the preroll bytes
-    if (preroll > 0) {
-        AP4_Size out_size = 0;
-        AP4_UI08 buffer[2*AP4_CIPHER_BLOCK_SIZE]; // bigger than preroll
-        AP4_CHECK(m_EncryptedStream->Read(buffer, preroll));
-        AP4_CHECK(m_StreamCipher->ProcessBuffer(buffer, preroll, buffer, &out_size));
-        AP4_ASSERT(out_size == 0); // we're just feeding prerolled bytes, 
-                                   // there can be no output
-    }
-    
-    // update the counters
+    // the window that covers the new position will be loaded on the next read
     m_CleartextPosition = position;
-    m_EncryptedPosition = position;
-    m_BufferFullness    = 0;
-    m_BufferOffset      = 0;
     
     return AP4_SUCCESS;
 }
@@ -53,6 +53,8 @@ const unsigned int AP4_PROTECTION_KEY_LENGTH = 16;
 
 const AP4_UI32 AP4_PROTECTION_SCHEME_TYPE_ITUNES = AP4_ATOM_TYPE('i','t','u','n');
 
+const AP4_Size AP4_DECRYPTING_STREAM_DEFAULT_WINDOW_SIZE = 1024*1024;
+
 /*----------------------------------------------------------------------
 |   AP4_EncaSampleEntry
 +---------------------------------------------------------------------*/
@@ -426,6 +428,18 @@ private:
 /*----------------------------------------------------------------------
 |   AP4_DecryptingStream
 +---------------------------------------------------------------------*/
+/**
+ * Read-only stream that decrypts an AES-128 CBC or CTR encrypted stream.
+ * The encrypted data is read and decrypted in place, one window at a time.
+ * Seeking is random-access: a window starts at the cipher block that
+ * contains the seek position, with the counter computed from the block
+ * index in CTR mode, and the chaining block taken from the previous
+ * ciphertext block in CBC mode.
+ * When prefetching is enabled, the next window is read and decrypted by
+ * a background thread while the current window is consumed. In that case,
+ * the encrypted stream must not be accessed by anyone else while the
+ * decrypting stream is in use.
+ */
 class AP4_DecryptingStream : public AP4_ByteStream 
 {
 public:
@@ -437,7 +451,9 @@ public:
                              const AP4_UI08*             key,
                              AP4_Size                    key_size,
                              AP4_BlockCipherFactory*     block_cipher_factory,
-                             AP4_ByteStream*&            stream);
+                             AP4_ByteStream*&            stream,
+                             AP4_Size                    window_size = AP4_DECRYPTING_STREAM_DEFAULT_WINDOW_SIZE,
+                             bool                        prefetch = false);
 
     // AP4_ByteStream methods
     virtual AP4_Result ReadPartial(void*     buffer, 
@@ -455,35 +471,44 @@ public:
     virtual void Release();
 
 private:
+    // types
+    class Prefetcher;
+    struct Window {
+        Window() : m_Position(0), m_Offset(0), m_Size(0) {}
+        AP4_DataBuffer m_Data;     // chaining block (CBC only) + decrypted data
+        AP4_Position   m_Position; // position of the first decrypted byte
+        AP4_Size       m_Offset;   // offset of the first decrypted byte in m_Data
+        AP4_Size       m_Size;     // number of decrypted bytes
+    };
+
     // private constructor, use the factory instead
-    AP4_DecryptingStream(AP4_LargeSize               cleartext_size,
+    AP4_DecryptingStream(AP4_BlockCipher::CipherMode mode,
+                         AP4_LargeSize               cleartext_size,
                          AP4_ByteStream*             encrypted_stream,
                          AP4_LargeSize               encrypted_size,
-                         AP4_StreamCipher*           stream_cipher) :
-        m_CleartextSize(cleartext_size),
-        m_CleartextPosition(0),
-        m_EncryptedStream(encrypted_stream),
-        m_EncryptedSize(encrypted_size),
-        m_EncryptedPosition(0),
-        m_StreamCipher(stream_cipher),
-        m_BufferFullness(0),
-        m_BufferOffset(0),
-        m_ReferenceCount(1)
-        { 
-            AP4_SetMemory(m_Buffer, 0, sizeof(m_Buffer)); 
-        } 
+                         AP4_BlockCipher*            block_cipher,
+                         const AP4_UI08*             iv,
+                         AP4_Size                    window_size,
+                         bool                        prefetch);
     ~AP4_DecryptingStream();
 
+    // methods
+    AP4_Result LoadWindow(AP4_Position position);
+    AP4_Result FillWindow(Window& window, AP4_Position position);
+
     // members
+    AP4_BlockCipher::CipherMode m_CipherMode;
     AP4_LargeSize               m_CleartextSize;
     AP4_Position                m_CleartextPosition;
     AP4_ByteStream*             m_EncryptedStream;
     AP4_LargeSize               m_EncryptedSize;
-    AP4_Position                m_EncryptedPosition;
-    AP4_StreamCipher*           m_StreamCipher;
-    AP4_UI08                    m_Buffer[1024];
-    AP4_Size                    m_BufferFullness;
-    AP4_Size                    m_BufferOffset;
+    AP4_BlockCipher*            m_BlockCipher;
+    AP4_UI08                    m_Iv[16];
+    AP4_Size                    m_WindowSize;
+    Window                      m_Windows[2];
+    Window*                     m_Window;
+    Window*                     m_NextWindow;
+    Prefetcher*                 m_Prefetcher;
     AP4_Cardinal                m_ReferenceCount;
 };
 
@@ -132,26 +132,31 @@ AP4_SaioAtom::AP4_SaioAtom(AP4_UI32        size,
 AP4_Result
 AP4_SaioAtom::WriteFields(AP4_ByteStream& stream)
 {
-    AP4_Result result;
+    // serialize the fields into a single buffer
+    AP4_Cardinal entry_count = m_Entries.ItemCount();
+    AP4_DataBuffer buffer;
+    AP4_Result result = buffer.SetDataSize(((m_Flags&1) ? 12 : 4)+(m_Version == 0 ? 4 : 8)*entry_count);
+    if (AP4_FAILED(result)) return result;
+    AP4_UI08* out = buffer.UseData();
+
     if (m_Flags&1) {
-        result = stream.WriteUI32(m_AuxInfoType);
-        if (AP4_FAILED(result)) return result;
-        result = stream.WriteUI32(m_AuxInfoTypeParameter);
-        if (AP4_FAILED(result)) return result;
+        AP4_BytesFromUInt32BE(out,   m_AuxInfoType);
+        AP4_BytesFromUInt32BE(out+4, m_AuxInfoTypeParameter);
+        out += 8;
     }
-    result = stream.WriteUI32(m_Entries.ItemCount());
-    if (AP4_FAILED(result)) return result;
-    for (unsigned int i=0; i<m_Entries.ItemCount(); i++) {
+    AP4_BytesFromUInt32BE(out, entry_count);
+    out += 4;
+    for (unsigned int i=0; i<entry_count; i++) {
         if (m_Version == 0) {
-            result = stream.WriteUI32((AP4_UI32)m_Entries[i]);
-            if (AP4_FAILED(result)) return result;
+            AP4_BytesFromUInt32BE(out, (AP4_UI32)m_Entries[i]);
+            out += 4;
         } else {
-            result = stream.WriteUI64(m_Entries[i]);
-            if (AP4_FAILED(result)) return result;
+            AP4_BytesFromUInt64BE(out, m_Entries[i]);
+            out += 8;
         }
     }
     
-    return AP4_SUCCESS;
+    return stream.Write(buffer.GetData(), buffer.GetDataSize());
 }
 
 /*----------------------------------------------------------------------
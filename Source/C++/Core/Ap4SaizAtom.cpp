@@ -89,16 +89,12 @@ AP4_SaizAtom::AP4_SaizAtom(AP4_UI32        size,
         if (m_SampleCount > remains) m_SampleCount = remains; // sanity check
         AP4_Cardinal sample_count = m_SampleCount;
         m_Entries.SetItemCount(sample_count);
-        unsigned char* buffer = new AP4_UI08[sample_count];
-        AP4_Result result = stream.Read(buffer, sample_count);
+        if (sample_count == 0) return;
+        AP4_Result result = stream.Read(&m_Entries[0], sample_count);
         if (AP4_FAILED(result)) {
-            delete[] buffer;
+            AP4_SetMemory(&m_Entries[0], 0, sample_count);
             return;
         }
-        for (unsigned int i=0; i<sample_count; i++) {
-            m_Entries[i] = buffer[i];
-        }
-        delete[] buffer;
     }
 }
 
@@ -186,26 +182,27 @@ AP4_SaizAtom::SetSampleInfoSize(AP4_Ordinal sample, AP4_UI08 sample_info_size)
 AP4_Result
 AP4_SaizAtom::WriteFields(AP4_ByteStream& stream)
 {
-    AP4_Result result;
+    // serialize the fields into a single buffer
+    AP4_Size entry_count = (m_DefaultSampleInfoSize == 0) ? m_SampleCount : 0;
+    AP4_DataBuffer buffer;
+    AP4_Result result = buffer.SetDataSize(((m_Flags&1) ? 13 : 5)+entry_count);
+    if (AP4_FAILED(result)) return result;
+    AP4_UI08* out = buffer.UseData();
+
     if (m_Flags&1) {
-        result = stream.WriteUI32(m_AuxInfoType);
-        if (AP4_FAILED(result)) return result;
-        result = stream.WriteUI32(m_AuxInfoTypeParameter);
-        if (AP4_FAILED(result)) return result;
+        AP4_BytesFromUInt32BE(out,   m_AuxInfoType);
+        AP4_BytesFromUInt32BE(out+4, m_AuxInfoTypeParameter);
+        out += 8;
     }
-    result = stream.WriteUI08(m_DefaultSampleInfoSize);
-    if (AP4_FAILED(result)) return result;
-    result = stream.WriteUI32(m_SampleCount);
-    if (AP4_FAILED(result)) return result;
+    out[0] = m_DefaultSampleInfoSize;
+    AP4_BytesFromUInt32BE(out+1, m_SampleCount);
+    out += 5;
     
-    if (m_DefaultSampleInfoSize == 0) {
-        for (AP4_UI32 i=0; i<m_SampleCount; i++) {
-            result = stream.WriteUI08(m_Entries[i]);
-            if (AP4_FAILED(result)) return result;
-        }
+    if (entry_count) {
+        AP4_CopyMemory(out, &m_Entries[0], entry_count);
     }
     
-    return AP4_SUCCESS;
+    return stream.Write(buffer.GetData(), buffer.GetDataSize());
 }
 
 /*----------------------------------------------------------------------
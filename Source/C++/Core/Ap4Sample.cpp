@@ -35,6 +35,7 @@
 #include "Ap4Interfaces.h"
 #include "Ap4ByteStream.h"
 #include "Ap4Atom.h"
+#include "Ap4Instrumentation.h"
 
 /*----------------------------------------------------------------------
 |   AP4_Sample::AP4_Sample
@@ -148,6 +149,8 @@ AP4_Sample::ReadData(AP4_DataBuffer& data, AP4_Size size, AP4_Size offset)
     if (AP4_FAILED(result)) return result;
 
     // get the data from the stream
+    AP4_InstrumentationScope scope(AP4_Instrumentation::STAGE_SAMPLE_READ, size);
+    AP4_Instrumentation::ReportGauge(AP4_Instrumentation::GAUGE_SAMPLE_SIZE, size);
     result = m_DataStream->Seek(m_Offset+offset);
     if (AP4_FAILED(result)) return result;
     return m_DataStream->Read(data.UseData(), size);
@@ -33,6 +33,7 @@
 |   includes
 +---------------------------------------------------------------------*/
 #include "Ap4Types.h"
+#include "Ap4Array.h"
 
 /*----------------------------------------------------------------------
 |   class references
@@ -171,4 +172,7 @@ private:
     bool            m_IsSync;
 };
 
+// the stream reference is simply carried over when a sample is moved
+AP4_DECLARE_RELOCATABLE_TYPE(AP4_Sample);
+
 #endif // _AP4_SAMPLE_H_
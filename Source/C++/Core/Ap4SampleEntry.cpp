@@ -214,6 +214,9 @@ AP4_SampleEntry::Inspect(AP4_AtomInspector& inspector)
 void
 AP4_SampleEntry::OnChildChanged(AP4_Atom*)
 {
+    // deferred to EndChanges() while changes are batched
+    if (DeferChange()) return;
+
     // recompute our size
     AP4_UI64 size = GetHeaderSize()+GetFieldsSize();
     m_Children.Apply(AP4_AtomSizeAdder(size));
@@ -62,7 +62,12 @@ AP4_SegmentBuilder::AP4_SegmentBuilder(AP4_Track::Type track_type,
     m_SampleStartNumber(0),
     m_MediaTimeOrigin(media_time_origin),
     m_MediaStartTime(0),
-    m_MediaDuration(0)
+    m_MediaDuration(0),
+    m_ChunkListener(NULL),
+    m_ChunkMaxSampleCount(0),
+    m_ChunkMaxDuration(0),
+    m_ChunkSequenceNumber(1),
+    m_ChunkStartsSegment(true)
 {
 }
 
@@ -79,6 +84,21 @@ AP4_SegmentBuilder::~AP4_SegmentBuilder()
 +---------------------------------------------------------------------*/
 AP4_Result
 AP4_SegmentBuilder::AddSample(AP4_Sample& sample)
+{
+    // in chunked mode, emit the pending samples first if they make a full chunk
+    if (m_ChunkListener && ChunkIsFull()) {
+        AP4_Result result = FlushChunk();
+        if (AP4_FAILED(result)) return result;
+    }
+    
+    return AppendSample(sample);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_SegmentBuilder::AppendSample
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_SegmentBuilder::AppendSample(AP4_Sample& sample)
 {
     AP4_Result result = m_Samples.Append(sample);
     if (AP4_FAILED(result)) return result;
@@ -87,6 +107,79 @@ AP4_SegmentBuilder::AddSample(AP4_Sample& sample)
     return AP4_SUCCESS;
 }
 
+/*----------------------------------------------------------------------
+|   AP4_SegmentBuilder::EnableChunking
++---------------------------------------------------------------------*/
+void
+AP4_SegmentBuilder::EnableChunking(ChunkListener* listener,
+                                   unsigned int   max_chunk_sample_count,
+                                   unsigned int   max_chunk_duration_ms,
+                                   unsigned int   first_sequence_number)
+{
+    m_ChunkListener       = listener;
+    m_ChunkMaxSampleCount = max_chunk_sample_count;
+    m_ChunkMaxDuration    = max_chunk_duration_ms;
+    m_ChunkSequenceNumber = first_sequence_number;
+    m_ChunkStartsSegment  = true;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_SegmentBuilder::ChunkIsFull
++---------------------------------------------------------------------*/
+bool
+AP4_SegmentBuilder::ChunkIsFull()
+{
+    if (m_Samples.ItemCount() == 0) return false;
+    if (m_ChunkMaxSampleCount && m_Samples.ItemCount() >= m_ChunkMaxSampleCount) {
+        return true;
+    }
+    if (m_ChunkMaxDuration && m_Timescale &&
+        m_MediaDuration*1000 >= (AP4_UI64)m_ChunkMaxDuration*m_Timescale) {
+        return true;
+    }
+    
+    return false;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_SegmentBuilder::FlushChunk
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_SegmentBuilder::FlushChunk()
+{
+    if (m_ChunkListener == NULL) return AP4_ERROR_INVALID_STATE;
+    if (m_Samples.ItemCount() == 0) return AP4_SUCCESS;
+    
+    // serialize the chunk in memory
+    m_ChunkBuffer.SetDataSize(0);
+    AP4_MemoryByteStream* chunk_stream = new AP4_MemoryByteStream(m_ChunkBuffer);
+    AP4_Result result = WriteFragment(*chunk_stream, m_ChunkSequenceNumber);
+    chunk_stream->Release();
+    if (AP4_FAILED(result)) return result;
+    
+    // notify the listener
+    bool starts_segment = m_ChunkStartsSegment;
+    m_ChunkStartsSegment = false;
+    return m_ChunkListener->OnChunk(*this,
+                                    m_ChunkBuffer.GetData(),
+                                    m_ChunkBuffer.GetDataSize(),
+                                    m_ChunkSequenceNumber++,
+                                    starts_segment);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_SegmentBuilder::EndSegment
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_SegmentBuilder::EndSegment()
+{
+    AP4_Result result = FlushChunk();
+    if (AP4_FAILED(result)) return result;
+    m_ChunkStartsSegment = true;
+    
+    return AP4_SUCCESS;
+}
+
 /*----------------------------------------------------------------------
 |   AP4_FeedSegmentBuilder::AP4_FeedSegmentBuilder
 +---------------------------------------------------------------------*/
@@ -104,7 +197,8 @@ AP4_AvcSegmentBuilder::AP4_AvcSegmentBuilder(AP4_UI32 track_id,
                                              double   frames_per_second,
                                              AP4_UI64 media_time_origin) :
     AP4_FeedSegmentBuilder(AP4_Track::TYPE_VIDEO, track_id, media_time_origin),
-    m_FramesPerSecond(frames_per_second)
+    m_FramesPerSecond(frames_per_second),
+    m_MaxCtsDelta(0)
 {
     m_Timescale = (unsigned int)(frames_per_second*1000.0);
 }
@@ -115,6 +209,18 @@ AP4_AvcSegmentBuilder::AP4_AvcSegmentBuilder(AP4_UI32 track_id,
 AP4_Result
 AP4_SegmentBuilder::WriteMediaSegment(AP4_ByteStream& stream, unsigned int sequence_number)
 {
+    return WriteFragment(stream, sequence_number);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_SegmentBuilder::WriteFragment
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_SegmentBuilder::WriteFragment(AP4_ByteStream& stream, unsigned int sequence_number)
+{
+    // give subclasses a chance to compute the final sample timing
+    FinalizeSamples();
+    
     unsigned int tfhd_flags = AP4_TFHD_FLAG_DEFAULT_BASE_IS_MOOF;
     if (m_TrackType == AP4_Track::TYPE_VIDEO) {
         tfhd_flags |= AP4_TFHD_FLAG_DEFAULT_SAMPLE_FLAGS_PRESENT;
@@ -122,6 +228,7 @@ AP4_SegmentBuilder::WriteMediaSegment(AP4_ByteStream& stream, unsigned int seque
         
     // setup the moof structure
     AP4_ContainerAtom* moof = new AP4_ContainerAtom(AP4_ATOM_TYPE_MOOF);
+    moof->BeginChanges();
     AP4_MfhdAtom* mfhd = new AP4_MfhdAtom(sequence_number);
     moof->AddChild(mfhd);
     AP4_ContainerAtom* traf = new AP4_ContainerAtom(AP4_ATOM_TYPE_TRAF);
@@ -144,8 +251,13 @@ AP4_SegmentBuilder::WriteMediaSegment(AP4_ByteStream& stream, unsigned int seque
                           AP4_TRUN_FLAG_SAMPLE_SIZE_PRESENT;
     AP4_UI32 first_sample_flags = 0;
     if (m_TrackType == AP4_Track::TYPE_VIDEO) {
+        // chunks don't always start with a sync sample
         trun_flags |= AP4_TRUN_FLAG_FIRST_SAMPLE_FLAGS_PRESENT;
-        first_sample_flags = 0x2000000; // sample_depends_on=2 (I frame)
+        if (m_Samples.ItemCount() && m_Samples[0].IsSync()) {
+            first_sample_flags = 0x2000000; // sample_depends_on=2 (I frame)
+        } else {
+            first_sample_flags = 0x10000; // sample_is_non_sync_sample=1
+        }
     }
     AP4_TrunAtom* trun = new AP4_TrunAtom(trun_flags, 0, first_sample_flags);
     
@@ -174,10 +286,11 @@ AP4_SegmentBuilder::WriteMediaSegment(AP4_ByteStream& stream, unsigned int seque
     
     // update moof and children
     trun->SetEntries(trun_entries);
+    moof->EndChanges();
     trun->SetDataOffset((AP4_UI32)moof->GetSize()+AP4_ATOM_HEADER_SIZE);
     
     // write moof
-    moof->Write(stream);
+    moof->WriteBuffered(stream);
     
     // write mdat
     stream.WriteUI32(mdat_size);
@@ -240,6 +353,35 @@ AP4_AvcSegmentBuilder::Feed(const void* data,
             sample_data->Write(access_unit_info.nal_units[i]->GetData(), access_unit_info.nal_units[i]->GetDataSize());
         }
         
+        // in chunked mode, emit the pending samples if they make a full chunk.
+        // A chunk can only end before an anchor picture (one that is displayed
+        // after all the pending pictures), so that the composition time of each
+        // pending picture is final, and the first chunk must include at least
+        // one complete group of pictures so that the reordering delay is known
+        if (m_ChunkListener && ChunkIsFull()) {
+            bool is_anchor = true;
+            bool has_anchor = false;
+            AP4_UI32 max_display_order = 0;
+            for (unsigned int i=0; i<m_SampleOrders.ItemCount(); i++) {
+                if (m_SampleOrders[i].m_DisplayOrder == 0 ||
+                    m_SampleOrders[i].m_DisplayOrder > max_display_order) {
+                    if (i) has_anchor = true;
+                }
+                if (m_SampleOrders[i].m_DisplayOrder == 0) {
+                    max_display_order = 0;
+                } else if (m_SampleOrders[i].m_DisplayOrder > max_display_order) {
+                    max_display_order = m_SampleOrders[i].m_DisplayOrder;
+                }
+            }
+            if (access_unit_info.display_order && access_unit_info.display_order <= max_display_order) {
+                is_anchor = false;
+            }
+            if (is_anchor && (has_anchor || m_SampleStartNumber)) {
+                result = FlushChunk();
+                if (AP4_FAILED(result)) return result;
+            }
+        }
+        
         // compute the timestamp in a drift-less manner
         AP4_UI32 duration = 0;
         AP4_UI64 dts      = 0;
@@ -252,7 +394,7 @@ AP4_AvcSegmentBuilder::Feed(const void* data,
 
         // create a new sample and add it to the list
         AP4_Sample sample(*sample_data, 0, sample_data_size, duration, 0, dts, 0, access_unit_info.is_idr);
-        AddSample(sample);
+        AppendSample(sample);
         sample_data->Release();
         
         // remember the sample order
@@ -305,7 +447,21 @@ AP4_AvcSegmentBuilder::SortSamples(SampleOrder* array, unsigned int n)
 AP4_Result
 AP4_AvcSegmentBuilder::WriteMediaSegment(AP4_ByteStream& stream, unsigned int sequence_number)
 {
-    if (m_SampleOrders.ItemCount() > 1) {
+    AP4_Result result = AP4_SegmentBuilder::WriteMediaSegment(stream, sequence_number);
+    
+    // each segment computes its own reordering delay
+    m_MaxCtsDelta = 0;
+    
+    return result;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_AvcSegmentBuilder::FinalizeSamples
++---------------------------------------------------------------------*/
+void
+AP4_AvcSegmentBuilder::FinalizeSamples()
+{
+    if (m_SampleOrders.ItemCount()) {
         // rebase the decode order
         AP4_UI32 decode_order_base = m_SampleOrders[0].m_DecodeOrder;
         for (unsigned int i=0; i<m_SampleOrders.ItemCount(); i++) {
@@ -334,6 +490,13 @@ AP4_AvcSegmentBuilder::WriteMediaSegment(AP4_ByteStream& stream, unsigned int se
                 }
             }
         }
+        
+        // in chunked mode, the delay must not decrease from one chunk to the next
+        if (max_delta < m_MaxCtsDelta) {
+            max_delta = m_MaxCtsDelta;
+        } else {
+            m_MaxCtsDelta = max_delta;
+        }
 
         // set the CTS for all samples
         for (unsigned int i=0; i<m_SampleOrders.ItemCount(); i++) {
@@ -345,11 +508,8 @@ AP4_AvcSegmentBuilder::WriteMediaSegment(AP4_ByteStream& stream, unsigned int se
                 m_Samples[m_SampleOrders[i].m_DecodeOrder].SetCts(dts);
             }
         }
-    
-        m_SampleOrders.Clear();
     }
-    
-    return AP4_SegmentBuilder::WriteMediaSegment(stream, sequence_number);
+    m_SampleOrders.Clear();
 }
 
 /*----------------------------------------------------------------------
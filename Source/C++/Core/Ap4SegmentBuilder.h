@@ -37,6 +37,7 @@
 #include "Ap4AdtsParser.h"
 #include "Ap4List.h"
 #include "Ap4Sample.h"
+#include "Ap4DataBuffer.h"
 #include "Ap4String.h"
 #include "Ap4Track.h"
 
@@ -52,6 +53,27 @@ class AP4_MpegAudioSampleDescription;
 class AP4_SegmentBuilder
 {
 public:
+    // types
+    /**
+     * Interface implemented by clients that want to receive the output
+     * of a builder in chunked (low latency) mode.
+     */
+    class ChunkListener {
+    public:
+        virtual ~ChunkListener() {}
+        
+        /**
+         * Called each time a chunk (one moof+mdat pair) is ready.
+         * The data is only valid for the duration of the call.
+         * starts_segment is true for the first chunk of a segment.
+         */
+        virtual AP4_Result OnChunk(AP4_SegmentBuilder& builder,
+                                   const AP4_UI08*     data,
+                                   AP4_Size            data_size,
+                                   unsigned int        sequence_number,
+                                   bool                starts_segment) = 0;
+    };
+    
     // constructor and destructor
     AP4_SegmentBuilder(AP4_Track::Type track_type,
                        AP4_UI32        track_id,
@@ -70,8 +92,30 @@ public:
     virtual AP4_Result WriteMediaSegment(AP4_ByteStream& stream, unsigned int sequence_number);
     virtual AP4_Result WriteInitSegment(AP4_ByteStream& stream) = 0;
     
+    // chunked mode
+    /**
+     * Switch to chunked mode: instead of waiting for WriteMediaSegment()
+     * to be called, the builder emits a chunk to the listener as soon as
+     * max_chunk_sample_count samples or max_chunk_duration_ms milliseconds
+     * worth of samples are pending (0 means no limit for either).
+     * Chunks get consecutive sequence numbers, starting at
+     * first_sequence_number, and consecutive base media decode times.
+     */
+    void       EnableChunking(ChunkListener* listener,
+                              unsigned int   max_chunk_sample_count,
+                              unsigned int   max_chunk_duration_ms,
+                              unsigned int   first_sequence_number = 1);
+    AP4_Result FlushChunk();
+    AP4_Result EndSegment();
+    
 protected:
     // methods
+    AP4_Result   AppendSample(AP4_Sample& sample);
+    bool         ChunkIsFull();
+    AP4_Result   WriteFragment(AP4_ByteStream& stream, unsigned int sequence_number);
+    virtual void FinalizeSamples() {}
+    
+    // members
     AP4_Track::Type       m_TrackType;
     AP4_UI32              m_TrackId;
     AP4_String            m_TrackLanguage;
@@ -81,6 +125,12 @@ protected:
     AP4_UI64              m_MediaStartTime;
     AP4_UI64              m_MediaDuration;
     AP4_Array<AP4_Sample> m_Samples;
+    ChunkListener*        m_ChunkListener;
+    unsigned int          m_ChunkMaxSampleCount;
+    unsigned int          m_ChunkMaxDuration;
+    unsigned int          m_ChunkSequenceNumber;
+    bool                  m_ChunkStartsSegment;
+    AP4_DataBuffer        m_ChunkBuffer;
 };
 
 /*----------------------------------------------------------------------
@@ -132,11 +182,15 @@ protected:
     
     // methods
     void SortSamples(SampleOrder* array, unsigned int n);
+    
+    // AP4_SegmentBuilder methods
+    virtual void FinalizeSamples();
 
     // members
     AP4_AvcFrameParser     m_FrameParser;
     double                 m_FramesPerSecond;
     AP4_Array<SampleOrder> m_SampleOrders;
+    unsigned int           m_MaxCtsDelta;
 };
 
 /*----------------------------------------------------------------------
@@ -121,27 +121,39 @@ AP4_SidxAtom::AP4_SidxAtom(AP4_UI32        size,
 AP4_Result
 AP4_SidxAtom::WriteFields(AP4_ByteStream& stream)
 {
-    stream.WriteUI32(m_ReferenceId);
-    stream.WriteUI32(m_TimeScale);
+    // serialize the fields into a single buffer
+    AP4_Cardinal reference_count = m_References.ItemCount();
+    AP4_DataBuffer buffer;
+    AP4_Result result = buffer.SetDataSize((m_Version == 0 ? 20 : 28)+12*reference_count);
+    if (AP4_FAILED(result)) return result;
+    AP4_UI08* out = buffer.UseData();
+    
+    AP4_BytesFromUInt32BE(out,   m_ReferenceId);
+    AP4_BytesFromUInt32BE(out+4, m_TimeScale);
+    out += 8;
     if (m_Version == 0) {
-        stream.WriteUI32((AP4_UI32)m_EarliestPresentationTime);
-        stream.WriteUI32((AP4_UI32)m_FirstOffset);
+        AP4_BytesFromUInt32BE(out,   (AP4_UI32)m_EarliestPresentationTime);
+        AP4_BytesFromUInt32BE(out+4, (AP4_UI32)m_FirstOffset);
+        out += 8;
     } else {
-        stream.WriteUI64(m_EarliestPresentationTime);
-        stream.WriteUI64(m_FirstOffset);
+        AP4_BytesFromUInt64BE(out,   m_EarliestPresentationTime);
+        AP4_BytesFromUInt64BE(out+8, m_FirstOffset);
+        out += 16;
     }
-    stream.WriteUI16(0);
-    stream.WriteUI16((AP4_UI16)m_References.ItemCount());
-    for (unsigned int i=0; i<m_References.ItemCount(); i++) {
-        stream.WriteUI32((m_References[i].m_ReferenceType<<31) |
-                          m_References[i].m_ReferencedSize);
-        stream.WriteUI32(m_References[i].m_SubsegmentDuration);
-        stream.WriteUI32(((m_References[i].m_StartsWithSap?1:0)<<31) |
-                          (m_References[i].m_SapType << 28) |
-                           m_References[i].m_SapDeltaTime);
+    AP4_BytesFromUInt16BE(out,   0);
+    AP4_BytesFromUInt16BE(out+2, (AP4_UI16)reference_count);
+    out += 4;
+    for (unsigned int i=0; i<reference_count; i++) {
+        AP4_BytesFromUInt32BE(out,   (m_References[i].m_ReferenceType<<31) |
+                                      m_References[i].m_ReferencedSize);
+        AP4_BytesFromUInt32BE(out+4, m_References[i].m_SubsegmentDuration);
+        AP4_BytesFromUInt32BE(out+8, ((m_References[i].m_StartsWithSap?1:0)<<31) |
+                                      (m_References[i].m_SapType << 28) |
+                                       m_References[i].m_SapDeltaTime);
+        out += 12;
     }
     
-    return AP4_SUCCESS;
+    return stream.Write(buffer.GetData(), buffer.GetDataSize());
 }
 
 /*----------------------------------------------------------------------
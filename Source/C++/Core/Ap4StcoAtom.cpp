@@ -79,16 +79,14 @@ AP4_StcoAtom::AP4_StcoAtom(AP4_UI32        size,
         m_EntryCount = (size-AP4_FULL_ATOM_HEADER_SIZE-4)/4;
     }
     m_Entries = new AP4_UI32[m_EntryCount];
-    unsigned char* buffer = new unsigned char[m_EntryCount*4];
-    AP4_Result result = stream.Read(buffer, m_EntryCount*4);
+
+    // read the entries directly in the table and convert them in place
+    AP4_Result result = stream.Read(m_Entries, m_EntryCount*4);
     if (AP4_FAILED(result)) {
-        delete[] buffer;
+        AP4_SetMemory(m_Entries, 0, m_EntryCount*4);
         return;
     }
-    for (AP4_Ordinal i=0; i<m_EntryCount; i++) {
-        m_Entries[i] = AP4_BytesToUInt32BE(&buffer[i*4]);
-    }
-    delete[] buffer;
+    AP4_BytesToUInt32ArrayBE((const unsigned char*)m_Entries, m_Entries, m_EntryCount);
 }
 
 /*----------------------------------------------------------------------
@@ -152,19 +150,23 @@ AP4_StcoAtom::AdjustChunkOffsets(int delta)
 AP4_Result
 AP4_StcoAtom::WriteFields(AP4_ByteStream& stream)
 {
-    AP4_Result result;
+    // serialize the fields into a single buffer
+    AP4_DataBuffer buffer;
+    AP4_Result result = buffer.SetDataSize(4+4*m_EntryCount);
+    if (AP4_FAILED(result)) return result;
+    AP4_UI08* out = buffer.UseData();
 
     // entry count
-    result = stream.WriteUI32(m_EntryCount);
-    if (AP4_FAILED(result)) return result;
+    AP4_BytesFromUInt32BE(out, m_EntryCount);
+    out += 4;
 
     // entries
     for (AP4_Ordinal i=0; i<m_EntryCount; i++) {
-        result = stream.WriteUI32(m_Entries[i]);
-        if (AP4_FAILED(result)) return result;
+        AP4_BytesFromUInt32BE(out, m_Entries[i]);
+        out += 4;
     }
 
-    return result;
+    return stream.Write(buffer.GetData(), buffer.GetDataSize());
 }
 
 /*----------------------------------------------------------------------
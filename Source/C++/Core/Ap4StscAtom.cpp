@@ -109,23 +109,26 @@ AP4_StscAtom::AP4_StscAtom(AP4_UI32        size,
 AP4_Result
 AP4_StscAtom::WriteFields(AP4_ByteStream& stream)
 {
-    AP4_Result result;
+    // serialize the fields into a single buffer
+    AP4_Cardinal entry_count = m_Entries.ItemCount();
+    AP4_DataBuffer buffer;
+    AP4_Result result = buffer.SetDataSize(4+12*entry_count);
+    if (AP4_FAILED(result)) return result;
+    AP4_UI08* out = buffer.UseData();
 
     // entry count
-    AP4_Cardinal entry_count = m_Entries.ItemCount();
-    result = stream.WriteUI32(entry_count);
+    AP4_BytesFromUInt32BE(out, entry_count);
+    out += 4;
 
     // entries
     for (AP4_Ordinal i=0; i<entry_count; i++) {
-        stream.WriteUI32(m_Entries[i].m_FirstChunk);
-        if (AP4_FAILED(result)) return result;
-        stream.WriteUI32(m_Entries[i].m_SamplesPerChunk);
-        if (AP4_FAILED(result)) return result;
-        stream.WriteUI32(m_Entries[i].m_SampleDescriptionIndex);
-        if (AP4_FAILED(result)) return result;
+        AP4_BytesFromUInt32BE(out,   m_Entries[i].m_FirstChunk);
+        AP4_BytesFromUInt32BE(out+4, m_Entries[i].m_SamplesPerChunk);
+        AP4_BytesFromUInt32BE(out+8, m_Entries[i].m_SampleDescriptionIndex);
+        out += 12;
     }
 
-    return result;
+    return stream.Write(buffer.GetData(), buffer.GetDataSize());
 }
 
 /*----------------------------------------------------------------------
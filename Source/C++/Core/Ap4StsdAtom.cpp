@@ -148,6 +148,9 @@ AP4_StsdAtom::WriteFields(AP4_ByteStream& stream)
 void
 AP4_StsdAtom::OnChildChanged(AP4_Atom*)
 {
+    // deferred to EndChanges() while changes are batched
+    if (DeferChange()) return;
+
     // remcompute our size
     AP4_UI64 size = GetHeaderSize()+4;
     m_Children.Apply(AP4_AtomSizeAdder(size));
@@ -77,18 +77,16 @@ AP4_StssAtom::AP4_StssAtom(AP4_UI32        size,
     // check for bogus values
     if ((size - AP4_ATOM_HEADER_SIZE - 4) / 4 < entry_count) return;
     
-    // read the table into a local array for conversion
-    unsigned char* buffer = new unsigned char[entry_count*4];
-    AP4_Result result = stream.Read(buffer, entry_count*4);
+    // read the entries directly in the table and convert them in place
+    if (entry_count == 0) return;
+    m_Entries.SetItemCount(entry_count);
+    AP4_UI32* entries = &m_Entries[0];
+    AP4_Result result = stream.Read(entries, entry_count*4);
     if (AP4_FAILED(result)) {
-        delete[] buffer;
+        m_Entries.SetItemCount(0);
         return;
     }
-    m_Entries.SetItemCount(entry_count);
-    for (unsigned int i=0; i<entry_count; i++) {
-        m_Entries[i] = AP4_BytesToUInt32BE(&buffer[i*4]);
-    }
-    delete[] buffer;
+    AP4_BytesToUInt32ArrayBE((const unsigned char*)entries, entries, entry_count);
 }
 
 /*----------------------------------------------------------------------
@@ -97,20 +95,24 @@ AP4_StssAtom::AP4_StssAtom(AP4_UI32        size,
 AP4_Result
 AP4_StssAtom::WriteFields(AP4_ByteStream& stream)
 {
-    AP4_Result result;
-
-    // entry count
+    // serialize the fields into a single buffer
     AP4_Cardinal entry_count = m_Entries.ItemCount();
-    result = stream.WriteUI32(entry_count);
+    AP4_DataBuffer buffer;
+    AP4_Result result = buffer.SetDataSize(4+4*entry_count);
     if (AP4_FAILED(result)) return result;
+    AP4_UI08* out = buffer.UseData();
+
+    // entry count
+    AP4_BytesFromUInt32BE(out, entry_count);
+    out += 4;
 
     // entries
     for (AP4_Ordinal i=0; i<entry_count; i++) {
-        result = stream.WriteUI32(m_Entries[i]);
-        if (AP4_FAILED(result)) return result;
+        AP4_BytesFromUInt32BE(out, m_Entries[i]);
+        out += 4;
     }
 
-    return result;
+    return stream.Write(buffer.GetData(), buffer.GetDataSize());
 }
 
 /*----------------------------------------------------------------------
@@ -80,19 +80,17 @@ AP4_StszAtom::AP4_StszAtom(AP4_UI32        size,
             return;
         }
         
-        // read the entries
+        // read the entries directly in the table and convert them in place
         AP4_Cardinal sample_count = m_SampleCount;
         m_Entries.SetItemCount(sample_count);
-        unsigned char* buffer = new unsigned char[sample_count*4];
-        AP4_Result result = stream.Read(buffer, sample_count*4);
+        if (sample_count == 0) return;
+        AP4_UI32* entries = &m_Entries[0];
+        AP4_Result result = stream.Read(entries, sample_count*4);
         if (AP4_FAILED(result)) {
-            delete[] buffer;
+            AP4_SetMemory(entries, 0, sample_count*4);
             return;
         }
-        for (unsigned int i=0; i<sample_count; i++) {
-            m_Entries[i] = AP4_BytesToUInt32BE(&buffer[i*4]);
-        }
-        delete[] buffer;
+        AP4_BytesToUInt32ArrayBE((const unsigned char*)entries, entries, sample_count);
     }
 }
 
@@ -102,25 +100,25 @@ AP4_StszAtom::AP4_StszAtom(AP4_UI32        size,
 AP4_Result
 AP4_StszAtom::WriteFields(AP4_ByteStream& stream)
 {
-    AP4_Result result;
-
-    // sample size
-    result = stream.WriteUI32(m_SampleSize);
+    // serialize the fields into a single buffer
+    AP4_Size entry_count = (m_SampleSize == 0) ? m_SampleCount : 0;
+    AP4_DataBuffer buffer;
+    AP4_Result result = buffer.SetDataSize(8+4*entry_count);
     if (AP4_FAILED(result)) return result;
+    AP4_UI08* out = buffer.UseData();
 
-    // sample count
-    result = stream.WriteUI32(m_SampleCount);
-    if (AP4_FAILED(result)) return result;
+    // sample size and sample count
+    AP4_BytesFromUInt32BE(out,   m_SampleSize);
+    AP4_BytesFromUInt32BE(out+4, m_SampleCount);
+    out += 8;
 
     // entries if needed (the samples have different sizes)
-    if (m_SampleSize == 0) {
-        for (AP4_UI32 i=0; i<m_SampleCount; i++) {
-            result = stream.WriteUI32(m_Entries[i]);
-            if (AP4_FAILED(result)) return result;
-        }
+    for (AP4_UI32 i=0; i<entry_count; i++) {
+        AP4_BytesFromUInt32BE(out, m_Entries[i]);
+        out += 4;
     }
 
-    return result;
+    return stream.Write(buffer.GetData(), buffer.GetDataSize());
 }
 
 /*----------------------------------------------------------------------
@@ -76,16 +76,25 @@ AP4_SttsAtom::AP4_SttsAtom(AP4_UI32        size,
     m_LookupCache.sample      = 0;
     m_LookupCache.dts         = 0;
 
-    AP4_UI32 entry_count;
+    if (size < AP4_FULL_ATOM_HEADER_SIZE+4) return;
+    AP4_UI32 entry_count = 0;
     stream.ReadUI32(entry_count);
-    while (entry_count--) {
-        AP4_UI32 sample_count;
-        AP4_UI32 sample_duration;
-        if (stream.ReadUI32(sample_count)    == AP4_SUCCESS &&
-            stream.ReadUI32(sample_duration) == AP4_SUCCESS) {
-            m_Entries.Append(AP4_SttsTableEntry(sample_count,
-                                                sample_duration));
-        }
+    
+    // only keep the entries that fit in the atom
+    if (entry_count > (size-AP4_FULL_ATOM_HEADER_SIZE-4)/8) {
+        entry_count = (size-AP4_FULL_ATOM_HEADER_SIZE-4)/8;
+    }
+    if (entry_count == 0) return;
+
+    // read the table in one call
+    AP4_DataBuffer buffer;
+    if (AP4_FAILED(buffer.SetDataSize(entry_count*8))) return;
+    if (AP4_FAILED(stream.Read(buffer.UseData(), entry_count*8))) return;
+    const AP4_UI08* data = buffer.GetData();
+    m_Entries.SetItemCount(entry_count);
+    for (unsigned int i=0; i<entry_count; i++) {
+        m_Entries[i].m_SampleCount    = AP4_BytesToUInt32BE(&data[i*8  ]);
+        m_Entries[i].m_SampleDuration = AP4_BytesToUInt32BE(&data[i*8+4]);
     }
 }
 
@@ -159,25 +168,25 @@ AP4_SttsAtom::AddEntry(AP4_UI32 sample_count, AP4_UI32 sample_duration)
 AP4_Result
 AP4_SttsAtom::WriteFields(AP4_ByteStream& stream)
 {
-    AP4_Result result;
-
-    // write the entry count
+    // serialize the fields into a single buffer
     AP4_Cardinal entry_count = m_Entries.ItemCount();
-    result = stream.WriteUI32(entry_count);
+    AP4_DataBuffer buffer;
+    AP4_Result result = buffer.SetDataSize(4+8*entry_count);
     if (AP4_FAILED(result)) return result;
+    AP4_UI08* out = buffer.UseData();
 
-    // write the entries
-    for (AP4_Ordinal i=0; i<entry_count; i++) {
-        // sample count
-        result = stream.WriteUI32(m_Entries[i].m_SampleCount);
-        if (AP4_FAILED(result)) return result;
+    // the entry count
+    AP4_BytesFromUInt32BE(out, entry_count);
+    out += 4;
 
-        // time offset
-        result = stream.WriteUI32(m_Entries[i].m_SampleDuration);
-        if (AP4_FAILED(result)) return result;
+    // the entries
+    for (AP4_Ordinal i=0; i<entry_count; i++) {
+        AP4_BytesFromUInt32BE(out,   m_Entries[i].m_SampleCount);
+        AP4_BytesFromUInt32BE(out+4, m_Entries[i].m_SampleDuration);
+        out += 8;
     }
 
-    return AP4_SUCCESS;
+    return stream.Write(buffer.GetData(), buffer.GetDataSize());
 }
 
 /*----------------------------------------------------------------------
@@ -51,6 +51,7 @@ class AP4_SttsTableEntry {
     AP4_UI32 m_SampleCount;
     AP4_UI32 m_SampleDuration;
 };
+AP4_DECLARE_RELOCATABLE_TYPE(AP4_SttsTableEntry);
 
 /*----------------------------------------------------------------------
 |   AP4_SttsAtom
@@ -33,6 +33,14 @@
 #include "Ap4Atom.h"
 #include "Ap4SyntheticSampleTable.h"
 #include "Ap4Sample.h"
+#include "Ap4ByteStream.h"
+
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+const AP4_UI32 AP4_SYNTHETIC_SAMPLE_INFO_SYNC_FLAG        = 0x80000000;
+const AP4_UI32 AP4_SYNTHETIC_SAMPLE_INFO_MAX_DESCRIPTION  = 0xFFFF;
+const AP4_UI32 AP4_SYNTHETIC_SAMPLE_TABLE_MIN_STREAM_SLOTS = 16;
 
 /*----------------------------------------------------------------------
 |   AP4_SyntheticSampleTable::AP4_SyntheticSampleTable()
@@ -50,6 +58,9 @@ AP4_SyntheticSampleTable::AP4_SyntheticSampleTable(AP4_Cardinal chunk_size) :
 AP4_SyntheticSampleTable::~AP4_SyntheticSampleTable()
 {
     m_SampleDescriptions.DeleteReferences();
+    for (unsigned int i=0; i<m_DataStreams.ItemCount(); i++) {
+        AP4_RELEASE(m_DataStreams[i]);
+    }
 }
 
 /*----------------------------------------------------------------------
@@ -58,9 +69,20 @@ AP4_SyntheticSampleTable::~AP4_SyntheticSampleTable()
 AP4_Result
 AP4_SyntheticSampleTable::GetSample(AP4_Ordinal sample_index, AP4_Sample& sample)
 {
-    if (sample_index >= m_Samples.ItemCount()) return AP4_ERROR_OUT_OF_RANGE;
+    if (sample_index >= m_SampleInfos.ItemCount()) return AP4_ERROR_OUT_OF_RANGE;
 
-    sample = m_Samples[sample_index];
+    AP4_UI32        info        = m_SampleInfos[sample_index];
+    AP4_ByteStream* data_stream = m_DataStreams[m_SampleStreams[sample_index]];
+    sample.Reset();
+    if (data_stream) sample.SetDataStream(*data_stream);
+    sample.SetOffset(m_SampleOffsets[sample_index]);
+    sample.SetSize(m_SampleSizes[sample_index]);
+    sample.SetDuration(m_SampleDurations[sample_index]);
+    sample.SetDescriptionIndex(info&AP4_SYNTHETIC_SAMPLE_INFO_MAX_DESCRIPTION);
+    sample.SetDts(m_SampleDts[sample_index]);
+    sample.SetCtsDelta(m_SampleCtsDeltas[sample_index]);
+    sample.SetSync((info&AP4_SYNTHETIC_SAMPLE_INFO_SYNC_FLAG) != 0);
+    
     return AP4_SUCCESS;
 }
 
@@ -70,7 +92,7 @@ AP4_SyntheticSampleTable::GetSample(AP4_Ordinal sample_index, AP4_Sample& sample
 AP4_Cardinal 
 AP4_SyntheticSampleTable::GetSampleCount()
 {
-    return m_Samples.ItemCount();
+    return m_SampleInfos.ItemCount();
 }
 
 /*----------------------------------------------------------------------
@@ -87,7 +109,7 @@ AP4_SyntheticSampleTable::GetSampleChunkPosition(
     position_in_chunk = 0;
     
     // check parameters
-    if (sample_index >= m_Samples.ItemCount()) return AP4_ERROR_OUT_OF_RANGE;
+    if (sample_index >= m_SampleInfos.ItemCount()) return AP4_ERROR_OUT_OF_RANGE;
     
     // look for the chunk 
     AP4_Ordinal sample_cursor = 0;
@@ -157,34 +179,28 @@ AP4_SyntheticSampleTable::AddSample(AP4_ByteStream& data_stream,
                                     AP4_UI32        cts_delta,
                                     bool            sync)
 {
-    // decide if we need to start a new chunk or increment the last one
-    if (m_SamplesInChunk.ItemCount() == 0 ||
-        m_SamplesInChunk[m_SamplesInChunk.ItemCount()-1] >= m_ChunkSize ||
-        m_Samples.ItemCount() == 0 ||
-        m_Samples[m_Samples.ItemCount()-1].GetDescriptionIndex() != description_index) {
-        m_SamplesInChunk.Append(1);
-    } else {
-        ++m_SamplesInChunk[m_SamplesInChunk.ItemCount()-1];
-    }
-    
+    AP4_Cardinal sample_count = m_SampleInfos.ItemCount();
+
     // compute the timestamps
-    if (m_Samples.ItemCount() > 0) {
-        AP4_Sample* prev_sample = &m_Samples[m_Samples.ItemCount()-1];
+    AP4_UI32 prev_duration = 0;
+    if (sample_count > 0) {
+        AP4_UI64 prev_dts = m_SampleDts[sample_count-1];
+        prev_duration = m_SampleDurations[sample_count-1];
         if (dts == 0) {
-            if (prev_sample->GetDuration() == 0) {
+            if (prev_duration == 0) {
                 // can't compute the DTS for this sample
                 return AP4_ERROR_INVALID_PARAMETERS;
             }
-            dts = prev_sample->GetDts()+prev_sample->GetDuration();
+            dts = prev_dts+prev_duration;
         } else {
-            if (prev_sample->GetDuration() == 0) {
-                // update the previous sample
-                if (dts <= prev_sample->GetDts()) {
+            if (prev_duration == 0) {
+                // the duration of the previous sample is updated below
+                if (dts <= prev_dts) {
                     return AP4_ERROR_INVALID_PARAMETERS;
                 }
-                prev_sample->SetDuration((AP4_UI32)(dts-prev_sample->GetDts()));
+                prev_duration = (AP4_UI32)(dts-prev_dts);
             } else {
-                if (dts != prev_sample->GetDts()+prev_sample->GetDuration()) {
+                if (dts != prev_dts+prev_duration) {
                     // mismatch
                     return AP4_ERROR_INVALID_PARAMETERS;
                 }
@@ -192,9 +208,26 @@ AP4_SyntheticSampleTable::AddSample(AP4_ByteStream& data_stream,
         }
     }
     
+    // decide if we need to start a new chunk or increment the last one
+    bool new_chunk = (m_SamplesInChunk.ItemCount() == 0 ||
+                      m_SamplesInChunk[m_SamplesInChunk.ItemCount()-1] >= m_ChunkSize ||
+                      sample_count == 0 ||
+                      (m_SampleInfos[sample_count-1]&AP4_SYNTHETIC_SAMPLE_INFO_MAX_DESCRIPTION) != description_index);
+    if (new_chunk) {
+        AP4_Result result = m_SamplesInChunk.Append(0);
+        if (AP4_FAILED(result)) return result;
+    }
+    
     // add the sample to the table
-    AP4_Sample sample(data_stream, offset, size, duration, description_index, dts, cts_delta, sync);
-    return m_Samples.Append(sample);
+    AP4_Result result = AppendSample(&data_stream, offset, size, duration, description_index, dts, cts_delta, sync);
+    if (AP4_FAILED(result)) {
+        if (new_chunk) m_SamplesInChunk.RemoveLast();
+        return result;
+    }
+    if (sample_count > 0) m_SampleDurations[sample_count-1] = prev_duration;
+    ++m_SamplesInChunk[m_SamplesInChunk.ItemCount()-1];
+    
+    return AP4_SUCCESS;
 }
 
 /*----------------------------------------------------------------------
@@ -203,7 +236,168 @@ AP4_SyntheticSampleTable::AddSample(AP4_ByteStream& data_stream,
 AP4_Result
 AP4_SyntheticSampleTable::AddSample(const AP4_Sample& sample)
 {
-    return m_Samples.Append(sample);
+    AP4_Sample      copy(sample);
+    AP4_ByteStream* data_stream = copy.GetDataStream();
+    AP4_Result result = AppendSample(data_stream,
+                                     copy.GetOffset(),
+                                     copy.GetSize(),
+                                     copy.GetDuration(),
+                                     copy.GetDescriptionIndex(),
+                                     copy.GetDts(),
+                                     copy.GetCtsDelta(),
+                                     copy.IsSync());
+    AP4_RELEASE(data_stream);
+    return result;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_SyntheticSampleTable::AppendSample
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_SyntheticSampleTable::AppendSample(AP4_ByteStream* data_stream,
+                                       AP4_Position    offset,
+                                       AP4_Size        size,
+                                       AP4_UI32        duration,
+                                       AP4_Ordinal     description_index,
+                                       AP4_UI64        dts,
+                                       AP4_UI32        cts_delta,
+                                       bool            sync)
+{
+    if (description_index > AP4_SYNTHETIC_SAMPLE_INFO_MAX_DESCRIPTION) {
+        return AP4_ERROR_OUT_OF_RANGE;
+    }
+
+    // find the data stream, starting with the one used by the last sample
+    AP4_Cardinal sample_count = m_SampleInfos.ItemCount();
+    AP4_UI32     stream_index = 0;
+    if (sample_count) {
+        stream_index = m_SampleStreams[sample_count-1];
+    }
+    if (stream_index >= m_DataStreams.ItemCount() || m_DataStreams[stream_index] != data_stream) {
+        AP4_Result result = FindDataStream(data_stream, stream_index);
+        if (AP4_FAILED(result)) return result;
+    }
+    
+    // store the fields
+    AP4_UI32 info = (sync?AP4_SYNTHETIC_SAMPLE_INFO_SYNC_FLAG:0) | description_index;
+    AP4_Result result;
+    if (AP4_FAILED(result = m_SampleOffsets.Append(offset))      ||
+        AP4_FAILED(result = m_SampleDts.Append(dts))             ||
+        AP4_FAILED(result = m_SampleSizes.Append(size))          ||
+        AP4_FAILED(result = m_SampleDurations.Append(duration))  ||
+        AP4_FAILED(result = m_SampleCtsDeltas.Append(cts_delta)) ||
+        AP4_FAILED(result = m_SampleStreams.Append(stream_index)) ||
+        AP4_FAILED(result = m_SampleInfos.Append(info))) {
+        // keep the columns aligned
+        m_SampleOffsets.SetItemCount(sample_count);
+        m_SampleDts.SetItemCount(sample_count);
+        m_SampleSizes.SetItemCount(sample_count);
+        m_SampleDurations.SetItemCount(sample_count);
+        m_SampleCtsDeltas.SetItemCount(sample_count);
+        m_SampleStreams.SetItemCount(sample_count);
+        m_SampleInfos.SetItemCount(sample_count);
+        return result;
+    }
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_SyntheticSampleTable_HashStream
++---------------------------------------------------------------------*/
+static AP4_UI32
+AP4_SyntheticSampleTable_HashStream(AP4_ByteStream* data_stream)
+{
+    AP4_UI64 value = (AP4_UI64)(size_t)data_stream;
+    value ^= value>>29;
+    value *= 0x9E3779B97F4A7C15ULL;
+    return (AP4_UI32)(value>>32);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_SyntheticSampleTable::FindDataStream
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_SyntheticSampleTable::FindDataStream(AP4_ByteStream* data_stream, AP4_UI32& stream_index)
+{
+    // look for the stream in the hash table
+    AP4_Cardinal slot_count = m_DataStreamSlots.ItemCount();
+    if (slot_count) {
+        for (AP4_UI32 slot = AP4_SyntheticSampleTable_HashStream(data_stream)&(slot_count-1);
+             m_DataStreamSlots[slot];
+             slot = (slot+1)&(slot_count-1)) {
+            if (m_DataStreams[m_DataStreamSlots[slot]-1] == data_stream) {
+                stream_index = m_DataStreamSlots[slot]-1;
+                return AP4_SUCCESS;
+            }
+        }
+    }
+    
+    // first sample with this stream: grow the hash table to keep it at most
+    // half full, and add the stream
+    if (2*(m_DataStreams.ItemCount()+1) > slot_count) {
+        AP4_Cardinal new_slot_count = slot_count ? 2*slot_count : AP4_SYNTHETIC_SAMPLE_TABLE_MIN_STREAM_SLOTS;
+        AP4_Result result = m_DataStreamSlots.SetItemCount(new_slot_count);
+        if (AP4_FAILED(result)) return result;
+        slot_count = new_slot_count;
+        for (unsigned int i=0; i<slot_count; i++) m_DataStreamSlots[i] = 0;
+        for (unsigned int i=0; i<m_DataStreams.ItemCount(); i++) {
+            AP4_UI32 slot = AP4_SyntheticSampleTable_HashStream(m_DataStreams[i])&(slot_count-1);
+            while (m_DataStreamSlots[slot]) slot = (slot+1)&(slot_count-1);
+            m_DataStreamSlots[slot] = i+1;
+        }
+    }
+    stream_index = m_DataStreams.ItemCount();
+    AP4_Result result = m_DataStreams.Append(data_stream);
+    if (AP4_FAILED(result)) return result;
+    AP4_ADD_REFERENCE(data_stream);
+    AP4_UI32 slot = AP4_SyntheticSampleTable_HashStream(data_stream)&(slot_count-1);
+    while (m_DataStreamSlots[slot]) slot = (slot+1)&(slot_count-1);
+    m_DataStreamSlots[slot] = stream_index+1;
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_SyntheticSampleTable::SetSampleCts
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_SyntheticSampleTable::SetSampleCts(AP4_Ordinal index, AP4_UI64 cts)
+{
+    if (index >= m_SampleInfos.ItemCount()) return AP4_ERROR_OUT_OF_RANGE;
+    
+    AP4_UI64 dts = m_SampleDts[index];
+    m_SampleCtsDeltas[index] = (cts > dts) ? (AP4_UI32)(cts-dts) : 0;
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_SyntheticSampleTable::SetSampleSize
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_SyntheticSampleTable::SetSampleSize(AP4_Ordinal index, AP4_Size size)
+{
+    if (index >= m_SampleInfos.ItemCount()) return AP4_ERROR_OUT_OF_RANGE;
+    m_SampleSizes[index] = size;
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_SyntheticSampleTable::SetSampleSync
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_SyntheticSampleTable::SetSampleSync(AP4_Ordinal index, bool sync)
+{
+    if (index >= m_SampleInfos.ItemCount()) return AP4_ERROR_OUT_OF_RANGE;
+    if (sync) {
+        m_SampleInfos[index] |= AP4_SYNTHETIC_SAMPLE_INFO_SYNC_FLAG;
+    } else {
+        m_SampleInfos[index] &= ~AP4_SYNTHETIC_SAMPLE_INFO_SYNC_FLAG;
+    }
+    
+    return AP4_SUCCESS;
 }
 
 /*----------------------------------------------------------------------
@@ -224,16 +418,16 @@ AP4_SyntheticSampleTable::GetNearestSyncSampleIndex(AP4_Ordinal sample_index, bo
 {
     if (before) {
         for (int i=sample_index; i>=0; i--) {
-            if (m_Samples[i].IsSync()) return i;
+            if (m_SampleInfos[i]&AP4_SYNTHETIC_SAMPLE_INFO_SYNC_FLAG) return i;
         }
         // not found?
         return 0;
     } else {
-        AP4_Cardinal entry_count = m_Samples.ItemCount();
+        AP4_Cardinal entry_count = m_SampleInfos.ItemCount();
         for (unsigned int i=sample_index; i<entry_count; i++) {
-            if (m_Samples[i].IsSync()) return i;
+            if (m_SampleInfos[i]&AP4_SYNTHETIC_SAMPLE_INFO_SYNC_FLAG) return i;
         }
         // not found?
-        return m_Samples.ItemCount();
+        return m_SampleInfos.ItemCount();
     }
 }
@@ -122,9 +122,22 @@ class AP4_SyntheticSampleTable : public AP4_SampleTable
     virtual AP4_Result AddSample(const AP4_Sample& sample);
 
     /**
-     * Get a reference to a sample for the purpose of modifying it
+     * Set the CTS (composition/display timestamp) of a sample that has already
+     * been added to the table. The CTS delta of the sample is set to the 
+     * difference between the CTS and the DTS of the sample, or 0 if the CTS is
+     * before the DTS.
      */
-    AP4_Sample& UseSample(AP4_Ordinal index) { return m_Samples[index]; }
+    AP4_Result SetSampleCts(AP4_Ordinal index, AP4_UI64 cts);
+
+    /**
+     * Set the size of a sample that has already been added to the table.
+     */
+    AP4_Result SetSampleSize(AP4_Ordinal index, AP4_Size size);
+
+    /**
+     * Set the sync flag of a sample that has already been added to the table.
+     */
+    AP4_Result SetSampleSync(AP4_Ordinal index, bool sync);
 
 private:
     // classes
@@ -137,8 +150,32 @@ private:
         bool                   m_IsOwned;
     };
         
+    // methods
+    AP4_Result FindDataStream(AP4_ByteStream* data_stream, AP4_UI32& stream_index);
+    AP4_Result AppendSample(AP4_ByteStream* data_stream,
+                            AP4_Position    offset,
+                            AP4_Size        size,
+                            AP4_UI32        duration,
+                            AP4_Ordinal     description_index,
+                            AP4_UI64        dts,
+                            AP4_UI32        cts_delta,
+                            bool            sync);
+
     // members
-    AP4_Array<AP4_Sample>             m_Samples;
+    // the samples are stored by column, and each sample refers to its data 
+    // stream by an index in m_DataStreams, which holds one reference to
+    // each of the streams (m_SampleInfos has the sync flag in bit 31 and
+    // the description index in bits 0 to 15). m_DataStreamSlots is an open
+    // addressing hash table that maps a stream to its index (plus one)
+    AP4_Array<AP4_ByteStream*>        m_DataStreams;
+    AP4_Array<AP4_UI32>               m_DataStreamSlots;
+    AP4_Array<AP4_UI32>               m_SampleStreams;
+    AP4_Array<AP4_UI64>               m_SampleOffsets;
+    AP4_Array<AP4_UI64>               m_SampleDts;
+    AP4_Array<AP4_UI32>               m_SampleSizes;
+    AP4_Array<AP4_UI32>               m_SampleDurations;
+    AP4_Array<AP4_UI32>               m_SampleCtsDeltas;
+    AP4_Array<AP4_UI32>               m_SampleInfos;
     AP4_List<SampleDescriptionHolder> m_SampleDescriptions;
     AP4_Cardinal                      m_ChunkSize;
     AP4_Array<AP4_UI32>               m_SamplesInChunk;
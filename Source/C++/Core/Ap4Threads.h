@@ -0,0 +1,127 @@
+/*****************************************************************
+|
+|    AP4 - Threads
+|
+|    Copyright 2002-2016 Axiomatic Systems, LLC
+|
+|
+|    This file is part of Bento4/AP4 (MP4 Atom Processing Library).
+|
+|    Unless you have obtained Bento4 under a difference license,
+|    this version of Bento4 is Bento4|GPL.
+|    Bento4|GPL is free software; you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation; either version 2, or (at your option)
+|    any later version.
+|
+|    Bento4|GPL is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with Bento4|GPL; see the file COPYING.  If not, write to the
+|    Free Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+|    02111-1307, USA.
+|
+ ****************************************************************/
+
+#ifndef _AP4_THREADS_H_
+#define _AP4_THREADS_H_
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "Ap4Types.h"
+#include "Ap4Results.h"
+
+/*----------------------------------------------------------------------
+|   AP4_Runnable
++---------------------------------------------------------------------*/
+/**
+ * Interface implemented by objects whose Run() method is executed
+ * by an AP4_Thread.
+ */
+class AP4_Runnable
+{
+public:
+    virtual ~AP4_Runnable() {}
+    virtual void Run() = 0;
+};
+
+/*----------------------------------------------------------------------
+|   AP4_Thread
++---------------------------------------------------------------------*/
+/**
+ * Minimal portable thread. The thread is not started until Start()
+ * is called, and the destructor waits for a started thread to terminate.
+ * The implementation is provided by the System/<platform> layer.
+ */
+class AP4_Thread
+{
+public:
+    // constructor and destructor
+    AP4_Thread(AP4_Runnable& target);
+    ~AP4_Thread();
+
+    // methods
+    AP4_Result Start();
+    AP4_Result Wait();
+
+private:
+    // members
+    AP4_Runnable& m_Target;
+    void*         m_Handle;
+};
+
+/*----------------------------------------------------------------------
+|   AP4_Mutex
++---------------------------------------------------------------------*/
+/**
+ * Minimal portable non-recursive mutex.
+ * The implementation is provided by the System/<platform> layer.
+ */
+class AP4_Mutex
+{
+public:
+    // constructor and destructor
+    AP4_Mutex();
+    ~AP4_Mutex();
+
+    // methods
+    AP4_Result Lock();
+    AP4_Result Unlock();
+
+private:
+    // members
+    void* m_Handle;
+};
+
+/*----------------------------------------------------------------------
+|   AP4_AutoLock
++---------------------------------------------------------------------*/
+class AP4_AutoLock
+{
+public:
+    AP4_AutoLock(AP4_Mutex& mutex) : m_Mutex(mutex) { m_Mutex.Lock();   }
+    ~AP4_AutoLock()                                 { m_Mutex.Unlock(); }
+
+private:
+    AP4_Mutex& m_Mutex;
+};
+
+/*----------------------------------------------------------------------
+|   clocks
++---------------------------------------------------------------------*/
+/**
+ * Get the value of a monotonic wall clock, in microseconds.
+ * The origin is arbitrary, so only differences are meaningful.
+ */
+AP4_UI64 AP4_System_GetWallClockTime();
+
+/**
+ * Get the CPU time consumed so far by the calling thread, in microseconds.
+ */
+AP4_UI64 AP4_System_GetThreadCpuTime();
+
+#endif // _AP4_THREADS_H_
@@ -44,6 +44,13 @@
 #include "Ap4MdhdAtom.h"
 #include "Ap4SyntheticSampleTable.h"
 
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+static const AP4_AtomPath AP4_PATH_MDIA_HDLR     ("mdia/hdlr");
+static const AP4_AtomPath AP4_PATH_MDIA_MDHD     ("mdia/mdhd");
+static const AP4_AtomPath AP4_PATH_MDIA_MINF_STBL("mdia/minf/stbl");
+
 /*----------------------------------------------------------------------
 |   AP4_Track::AP4_Track
 +---------------------------------------------------------------------*/
@@ -210,7 +217,7 @@ AP4_Track::AP4_Track(AP4_TrakAtom&   atom,
     m_MovieTimeScale(movie_time_scale)
 {
     // find the handler type
-    AP4_Atom* sub = atom.FindChild("mdia/hdlr");
+    AP4_Atom* sub = atom.FindChild(AP4_PATH_MDIA_HDLR);
     if (sub) {
         AP4_HdlrAtom* hdlr = AP4_DYNAMIC_CAST(AP4_HdlrAtom, sub);
         if (hdlr) {
@@ -237,7 +244,7 @@ AP4_Track::AP4_Track(AP4_TrakAtom&   atom,
     }
 
     // create a facade for the stbl atom
-    AP4_ContainerAtom* stbl = AP4_DYNAMIC_CAST(AP4_ContainerAtom, atom.FindChild("mdia/minf/stbl"));
+    AP4_ContainerAtom* stbl = AP4_DYNAMIC_CAST(AP4_ContainerAtom, atom.FindChild(AP4_PATH_MDIA_MINF_STBL));
     if (stbl) {
         m_SampleTable = new AP4_AtomSampleTable(stbl, sample_stream);
     }
@@ -319,7 +326,7 @@ AP4_UI32
 AP4_Track::GetFlags() const
 {
     if (m_TrakAtom) {
-        AP4_TkhdAtom* tkhd = AP4_DYNAMIC_CAST(AP4_TkhdAtom, m_TrakAtom->FindChild("tkhd"));
+        AP4_TkhdAtom* tkhd = AP4_DYNAMIC_CAST(AP4_TkhdAtom, m_TrakAtom->GetChild(AP4_ATOM_TYPE_TKHD));
         if (tkhd) {
             return tkhd->GetFlags();
         }
@@ -334,7 +341,7 @@ AP4_Result
 AP4_Track::SetFlags(AP4_UI32 flags)
 {
     if (m_TrakAtom) {
-        AP4_TkhdAtom* tkhd = AP4_DYNAMIC_CAST(AP4_TkhdAtom, m_TrakAtom->FindChild("tkhd"));
+        AP4_TkhdAtom* tkhd = AP4_DYNAMIC_CAST(AP4_TkhdAtom, m_TrakAtom->GetChild(AP4_ATOM_TYPE_TKHD));
         if (tkhd) {
             tkhd->SetFlags(flags);
             return AP4_SUCCESS;
@@ -350,7 +357,7 @@ AP4_UI32
 AP4_Track::GetHandlerType() const
 {
     if (m_TrakAtom) {
-        AP4_HdlrAtom* hdlr = AP4_DYNAMIC_CAST(AP4_HdlrAtom, m_TrakAtom->FindChild("mdia/hdlr"));
+        AP4_HdlrAtom* hdlr = AP4_DYNAMIC_CAST(AP4_HdlrAtom, m_TrakAtom->FindChild(AP4_PATH_MDIA_HDLR));
         if (hdlr) {
             return hdlr->GetHandlerType();
         }
@@ -539,7 +546,7 @@ AP4_Track::GetMediaDuration() const
 const char*
 AP4_Track::GetTrackName() const
 {
-    if (AP4_HdlrAtom* hdlr = AP4_DYNAMIC_CAST(AP4_HdlrAtom, m_TrakAtom->FindChild("mdia/hdlr"))) {
+    if (AP4_HdlrAtom* hdlr = AP4_DYNAMIC_CAST(AP4_HdlrAtom, m_TrakAtom->FindChild(AP4_PATH_MDIA_HDLR))) {
         return hdlr->GetHandlerName().GetChars();
     }
     return NULL;
@@ -551,7 +558,7 @@ AP4_Track::GetTrackName() const
 const char*
 AP4_Track::GetTrackLanguage() const
 {
-    if (AP4_MdhdAtom* mdhd = AP4_DYNAMIC_CAST(AP4_MdhdAtom, m_TrakAtom->FindChild("mdia/mdhd"))) {
+    if (AP4_MdhdAtom* mdhd = AP4_DYNAMIC_CAST(AP4_MdhdAtom, m_TrakAtom->FindChild(AP4_PATH_MDIA_MDHD))) {
         return mdhd->GetLanguage().GetChars();
     }
     return NULL;
@@ -46,6 +46,13 @@
 #include "Ap4SampleTable.h"
 #include "Ap4Utils.h"
 
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+static const AP4_AtomPath AP4_PATH_MDIA_MDHD("mdia/mdhd");
+static const AP4_AtomPath AP4_PATH_STCO     ("mdia/minf/stbl/stco");
+static const AP4_AtomPath AP4_PATH_CO64     ("mdia/minf/stbl/co64");
+
 /*----------------------------------------------------------------------
 |   dynamic cast support
 +---------------------------------------------------------------------*/
@@ -164,8 +171,8 @@ AP4_TrakAtom::AP4_TrakAtom(AP4_UI32         size,
                            AP4_AtomFactory& atom_factory) :
     AP4_ContainerAtom(AP4_ATOM_TYPE_TRAK, size, false, stream, atom_factory)
 {
-    m_TkhdAtom = AP4_DYNAMIC_CAST(AP4_TkhdAtom, FindChild("tkhd"));
-    m_MdhdAtom = AP4_DYNAMIC_CAST(AP4_MdhdAtom, FindChild("mdia/mdhd"));
+    m_TkhdAtom = AP4_DYNAMIC_CAST(AP4_TkhdAtom, GetChild(AP4_ATOM_TYPE_TKHD));
+    m_MdhdAtom = AP4_DYNAMIC_CAST(AP4_MdhdAtom, FindChild(AP4_PATH_MDIA_MDHD));
 }
 
 /*----------------------------------------------------------------------
@@ -313,10 +320,10 @@ AP4_Result
 AP4_TrakAtom::AdjustChunkOffsets(AP4_SI64 delta)
 {
     AP4_Atom* atom;
-    if ((atom = FindChild("mdia/minf/stbl/stco")) != NULL) {
+    if ((atom = FindChild(AP4_PATH_STCO)) != NULL) {
         AP4_StcoAtom* stco = AP4_DYNAMIC_CAST(AP4_StcoAtom, atom);
         return stco->AdjustChunkOffsets((int)delta);
-    } else if ((atom = FindChild("mdia/minf/stbl/co64")) != NULL) {
+    } else if ((atom = FindChild(AP4_PATH_CO64)) != NULL) {
         AP4_Co64Atom* co64 = AP4_DYNAMIC_CAST(AP4_Co64Atom, atom);
         return co64->AdjustChunkOffsets(delta);
     } else {
@@ -331,7 +338,7 @@ AP4_Result
 AP4_TrakAtom::GetChunkOffsets(AP4_Array<AP4_UI64>& chunk_offsets)
 {
     AP4_Atom* atom;
-    if ((atom = FindChild("mdia/minf/stbl/stco")) != NULL) {
+    if ((atom = FindChild(AP4_PATH_STCO)) != NULL) {
         AP4_StcoAtom* stco = AP4_DYNAMIC_CAST(AP4_StcoAtom, atom);
         if (stco == NULL) return AP4_ERROR_INTERNAL;
         AP4_Cardinal    stco_chunk_count   = stco->GetChunkCount();
@@ -341,7 +348,7 @@ AP4_TrakAtom::GetChunkOffsets(AP4_Array<AP4_UI64>& chunk_offsets)
             chunk_offsets[i] = stco_chunk_offsets[i];
         }
         return AP4_SUCCESS;
-    } else if ((atom = FindChild("mdia/minf/stbl/co64")) != NULL) {
+    } else if ((atom = FindChild(AP4_PATH_CO64)) != NULL) {
         AP4_Co64Atom* co64 = AP4_DYNAMIC_CAST(AP4_Co64Atom, atom);
         if (co64 == NULL) return AP4_ERROR_INTERNAL;
         AP4_Cardinal    co64_chunk_count   = co64->GetChunkCount();
@@ -363,7 +370,7 @@ AP4_Result
 AP4_TrakAtom::SetChunkOffsets(const AP4_Array<AP4_UI64>& chunk_offsets)
 {
     AP4_Atom* atom;
-    if ((atom = FindChild("mdia/minf/stbl/stco")) != NULL) {
+    if ((atom = FindChild(AP4_PATH_STCO)) != NULL) {
         AP4_StcoAtom* stco = AP4_DYNAMIC_CAST(AP4_StcoAtom, atom);
         if (stco == NULL) return AP4_ERROR_INTERNAL;
         AP4_Cardinal stco_chunk_count   = stco->GetChunkCount();
@@ -375,7 +382,7 @@ AP4_TrakAtom::SetChunkOffsets(const AP4_Array<AP4_UI64>& chunk_offsets)
             stco_chunk_offsets[i] = (AP4_UI32)chunk_offsets[i];
         }
         return AP4_SUCCESS;
-    } else if ((atom = FindChild("mdia/minf/stbl/co64")) != NULL) {
+    } else if ((atom = FindChild(AP4_PATH_CO64)) != NULL) {
         AP4_Co64Atom* co64 = AP4_DYNAMIC_CAST(AP4_Co64Atom, atom);
         if (co64 == NULL) return AP4_ERROR_INTERNAL;
         AP4_Cardinal co64_chunk_count   = co64->GetChunkCount();
@@ -32,6 +32,53 @@
 #include "Ap4TrunAtom.h"
 #include "Ap4Utils.h"
 
+/*----------------------------------------------------------------------
+|   AP4_TrunAtom_DecodeEntries
++---------------------------------------------------------------------*/
+template <unsigned int FIELDS> static void
+AP4_TrunAtom_DecodeEntries(const AP4_UI08*      data, 
+                           unsigned int         record_size,
+                           AP4_TrunAtom::Entry* entries,
+                           AP4_Cardinal         entry_count)
+{
+    // FIELDS is bits 8 to 11 of the flags, shifted down, so that the tests 
+    // below are resolved at compile time
+    for (AP4_Ordinal i=0; i<entry_count; i++, data += record_size) {
+        const AP4_UI08* field = data;
+        AP4_TrunAtom::Entry& entry = entries[i];
+        if (FIELDS & (AP4_TRUN_FLAG_SAMPLE_DURATION_PRESENT>>8)) {
+            entry.sample_duration = AP4_BytesToUInt32BE(field);
+            field += 4;
+        }
+        if (FIELDS & (AP4_TRUN_FLAG_SAMPLE_SIZE_PRESENT>>8)) {
+            entry.sample_size = AP4_BytesToUInt32BE(field);
+            field += 4;
+        }
+        if (FIELDS & (AP4_TRUN_FLAG_SAMPLE_FLAGS_PRESENT>>8)) {
+            entry.sample_flags = AP4_BytesToUInt32BE(field);
+            field += 4;
+        }
+        if (FIELDS & (AP4_TRUN_FLAG_SAMPLE_COMPOSITION_TIME_OFFSET_PRESENT>>8)) {
+            entry.sample_composition_time_offset = AP4_BytesToUInt32BE(field);
+        }
+    }
+}
+
+typedef void (*AP4_TrunAtom_EntryDecoder)(const AP4_UI08*      data,
+                                          unsigned int         record_size,
+                                          AP4_TrunAtom::Entry* entries,
+                                          AP4_Cardinal         entry_count);
+static const AP4_TrunAtom_EntryDecoder AP4_TrunAtom_EntryDecoders[16] = {
+    AP4_TrunAtom_DecodeEntries<0x0>, AP4_TrunAtom_DecodeEntries<0x1>,
+    AP4_TrunAtom_DecodeEntries<0x2>, AP4_TrunAtom_DecodeEntries<0x3>,
+    AP4_TrunAtom_DecodeEntries<0x4>, AP4_TrunAtom_DecodeEntries<0x5>,
+    AP4_TrunAtom_DecodeEntries<0x6>, AP4_TrunAtom_DecodeEntries<0x7>,
+    AP4_TrunAtom_DecodeEntries<0x8>, AP4_TrunAtom_DecodeEntries<0x9>,
+    AP4_TrunAtom_DecodeEntries<0xA>, AP4_TrunAtom_DecodeEntries<0xB>,
+    AP4_TrunAtom_DecodeEntries<0xC>, AP4_TrunAtom_DecodeEntries<0xD>,
+    AP4_TrunAtom_DecodeEntries<0xE>, AP4_TrunAtom_DecodeEntries<0xF>
+};
+
 /*----------------------------------------------------------------------
 |   dynamic cast support
 +---------------------------------------------------------------------*/
@@ -99,55 +146,49 @@ AP4_TrunAtom::AP4_TrunAtom(AP4_UI32        size,
                            AP4_UI08        version,
                            AP4_UI32        flags,
                            AP4_ByteStream& stream) :
-    AP4_Atom(AP4_ATOM_TYPE_TRUN, size, version, flags)
+    AP4_Atom(AP4_ATOM_TYPE_TRUN, size, version, flags),
+    m_DataOffset(0),
+    m_FirstSampleFlags(0)
 {
     AP4_UI32 sample_count = 0;
-    stream.ReadUI32(sample_count);
+    if (AP4_FAILED(stream.ReadUI32(sample_count))) return;
+
+    // compute the layout of the payload
+    AP4_UI32 optional_fields_size = 4*ComputeOptionalFieldsCount(flags);
+    AP4_UI32 record_size          = 4*ComputeRecordFieldsCount(flags);
+    AP4_UI32 available            = (size > AP4_FULL_ATOM_HEADER_SIZE+4)?
+                                    size-AP4_FULL_ATOM_HEADER_SIZE-4 : 0;
+    if (optional_fields_size > available) return;
+    if (record_size && sample_count > (available-optional_fields_size)/record_size) {
+        // not enough space for all the records, something's wrong
+        sample_count = (available-optional_fields_size)/record_size;
+    }
+    m_Entries.SetItemCount(sample_count);
+
+    // read the optional fields and all the records in one call
+    AP4_DataBuffer payload;
+    AP4_UI32 payload_size = optional_fields_size+sample_count*record_size;
+    if (payload_size == 0) return;
+    if (AP4_FAILED(payload.SetDataSize(payload_size))) return;
+    if (AP4_FAILED(stream.Read(payload.UseData(), payload_size))) return;
+    const AP4_UI08* data = payload.GetData();
 
-    // read optional fields
-    int optional_fields_count = (int)ComputeOptionalFieldsCount(flags);
+    // optional fields (unknown optional fields are skipped)
+    const AP4_UI08* field = data;
     if (flags & AP4_TRUN_FLAG_DATA_OFFSET_PRESENT) {
-        AP4_UI32 offset = 0;
-        stream.ReadUI32(offset);
-        m_DataOffset = (AP4_SI32)offset;
-        --optional_fields_count;
+        m_DataOffset = (AP4_SI32)AP4_BytesToUInt32BE(field);
+        field += 4;
     }
     if (flags & AP4_TRUN_FLAG_FIRST_SAMPLE_FLAGS_PRESENT) {
-        stream.ReadUI32(m_FirstSampleFlags);
-        --optional_fields_count;
+        m_FirstSampleFlags = AP4_BytesToUInt32BE(field);
     }
-    
-    // discard unknown optional fields 
-    for (int i=0; i<optional_fields_count; i++) {
-        AP4_UI32 discard;
-        stream.ReadUI32(discard);
-    }
-    
-    int record_fields_count = (int)ComputeRecordFieldsCount(flags);
-    m_Entries.SetItemCount(sample_count);
-    for (unsigned int i=0; i<sample_count; i++) {
-        if (flags & AP4_TRUN_FLAG_SAMPLE_DURATION_PRESENT) {
-            stream.ReadUI32(m_Entries[i].sample_duration);
-            --record_fields_count;
-        }
-        if (flags & AP4_TRUN_FLAG_SAMPLE_SIZE_PRESENT) {
-            stream.ReadUI32(m_Entries[i].sample_size);
-            --record_fields_count;
-        }
-        if (flags & AP4_TRUN_FLAG_SAMPLE_FLAGS_PRESENT) {
-            stream.ReadUI32(m_Entries[i].sample_flags);
-            --record_fields_count;
-        }
-        if (flags & AP4_TRUN_FLAG_SAMPLE_COMPOSITION_TIME_OFFSET_PRESENT) {
-            stream.ReadUI32(m_Entries[i].sample_composition_time_offset);
-            --record_fields_count;
-        }
-    
-        // skip unknown fields 
-        for (int j=0;j<record_fields_count; j++) {
-            AP4_UI32 discard;
-            stream.ReadUI32(discard);
-        }
+
+    // records, with a loop specialized for the fields that are present
+    if (sample_count) {
+        AP4_TrunAtom_EntryDecoders[(flags>>8)&0xF](data+optional_fields_size,
+                                                   record_size,
+                                                   &m_Entries[0],
+                                                   sample_count);
     }
 }
 
@@ -182,39 +223,53 @@ AP4_TrunAtom::SetEntries(const AP4_Array<Entry>& entries)
 AP4_Result
 AP4_TrunAtom::WriteFields(AP4_ByteStream& stream)
 {
-    AP4_Result result;
-    
-    result = stream.WriteUI32(m_Entries.ItemCount());
+    // serialize the fields into a single buffer, so that a large table
+    // is written with one stream write instead of one write per field
+    AP4_UI32     sample_count = m_Entries.ItemCount();
+    unsigned int fields_size  = 4;
+    if (m_Flags & AP4_TRUN_FLAG_DATA_OFFSET_PRESENT)       fields_size += 4;
+    if (m_Flags & AP4_TRUN_FLAG_FIRST_SAMPLE_FLAGS_PRESENT) fields_size += 4;
+    unsigned int record_size = 0;
+    if (m_Flags & AP4_TRUN_FLAG_SAMPLE_DURATION_PRESENT)                record_size += 4;
+    if (m_Flags & AP4_TRUN_FLAG_SAMPLE_SIZE_PRESENT)                    record_size += 4;
+    if (m_Flags & AP4_TRUN_FLAG_SAMPLE_FLAGS_PRESENT)                   record_size += 4;
+    if (m_Flags & AP4_TRUN_FLAG_SAMPLE_COMPOSITION_TIME_OFFSET_PRESENT) record_size += 4;
+    AP4_DataBuffer buffer;
+    AP4_Result result = buffer.SetDataSize(fields_size+sample_count*record_size);
     if (AP4_FAILED(result)) return result;
+    AP4_UI08* out = buffer.UseData();
+    
+    AP4_BytesFromUInt32BE(out, sample_count);
+    out += 4;
     if (m_Flags & AP4_TRUN_FLAG_DATA_OFFSET_PRESENT) {
-        result = stream.WriteUI32((AP4_UI32)m_DataOffset);
-        if (AP4_FAILED(result)) return result;
+        AP4_BytesFromUInt32BE(out, (AP4_UI32)m_DataOffset);
+        out += 4;
     }
     if (m_Flags & AP4_TRUN_FLAG_FIRST_SAMPLE_FLAGS_PRESENT) {
-        result = stream.WriteUI32(m_FirstSampleFlags);
-        if (AP4_FAILED(result)) return result;
+        AP4_BytesFromUInt32BE(out, m_FirstSampleFlags);
+        out += 4;
     }
-    AP4_UI32 sample_count = m_Entries.ItemCount();
     for (unsigned int i=0; i<sample_count; i++) {
+        const Entry& entry = m_Entries[i];
         if (m_Flags & AP4_TRUN_FLAG_SAMPLE_DURATION_PRESENT) {
-            result = stream.WriteUI32(m_Entries[i].sample_duration);
-            if (AP4_FAILED(result)) return result;
+            AP4_BytesFromUInt32BE(out, entry.sample_duration);
+            out += 4;
         }
         if (m_Flags & AP4_TRUN_FLAG_SAMPLE_SIZE_PRESENT) {
-            result = stream.WriteUI32(m_Entries[i].sample_size);
-            if (AP4_FAILED(result)) return result;
+            AP4_BytesFromUInt32BE(out, entry.sample_size);
+            out += 4;
         }
         if (m_Flags & AP4_TRUN_FLAG_SAMPLE_FLAGS_PRESENT) {
-            result = stream.WriteUI32(m_Entries[i].sample_flags);
-            if (AP4_FAILED(result)) return result;
+            AP4_BytesFromUInt32BE(out, entry.sample_flags);
+            out += 4;
         }
         if (m_Flags & AP4_TRUN_FLAG_SAMPLE_COMPOSITION_TIME_OFFSET_PRESENT) {
-            stream.WriteUI32(m_Entries[i].sample_composition_time_offset);
-            if (AP4_FAILED(result)) return result;
+            AP4_BytesFromUInt32BE(out, entry.sample_composition_time_offset);
+            out += 4;
         }
     }
     
-    return AP4_SUCCESS;
+    return stream.Write(buffer.GetData(), buffer.GetDataSize());
 }
 
 /*----------------------------------------------------------------------
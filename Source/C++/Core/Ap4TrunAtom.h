@@ -94,5 +94,6 @@ private:
     AP4_UI32         m_FirstSampleFlags;
     AP4_Array<Entry> m_Entries;
 };
+AP4_DECLARE_RELOCATABLE_TYPE(AP4_TrunAtom::Entry);
 
 #endif // _AP4_TRUN_ATOM_H_
@@ -31,10 +31,27 @@
 +---------------------------------------------------------------------*/
 #include "Ap4Utils.h"
 
+/*----------------------------------------------------------------------
+|   vector byte swapping
+|   Define AP4_CONFIG_NO_VECTOR_BYTE_SWAP to only use the C code.
++---------------------------------------------------------------------*/
+#if !defined(AP4_CONFIG_NO_VECTOR_BYTE_SWAP)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AP4_UTILS_HAVE_SSE2
+#include <emmintrin.h>
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && defined(__GNUC__) && !defined(__ARM_BIG_ENDIAN)
+#define AP4_UTILS_HAVE_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
 /*----------------------------------------------------------------------
 |   AP4_GlobalOptions::g_Entry
+|
+|   A static object rather than a lazily allocated one, so that the
+|   options can be read from several threads at once.
 +---------------------------------------------------------------------*/
-AP4_List<AP4_GlobalOptions::Entry>* AP4_GlobalOptions::g_Entries = NULL;
+AP4_List<AP4_GlobalOptions::Entry> AP4_GlobalOptions::g_Entries;
 
 /*----------------------------------------------------------------------
 |   AP4_GlobalOptions::GetEntry
@@ -42,10 +59,7 @@ AP4_List<AP4_GlobalOptions::Entry>* AP4_GlobalOptions::g_Entries = NULL;
 AP4_GlobalOptions::Entry*
 AP4_GlobalOptions::GetEntry(const char* name, bool autocreate)
 {
-    if (g_Entries == NULL) {
-        g_Entries = new AP4_List<Entry>;
-    }
-    for (AP4_List<Entry>::Item* item = g_Entries->FirstItem();
+    for (AP4_List<Entry>::Item* item = g_Entries.FirstItem();
                                 item;
                                 item = item->GetNext()) {
         if (item->GetData()->m_Name == name) return item->GetData();
@@ -54,7 +68,7 @@ AP4_GlobalOptions::GetEntry(const char* name, bool autocreate)
     if (autocreate) {
         Entry* new_entry = new Entry();
         new_entry->m_Name = name;
-        g_Entries->Add(new_entry);
+        g_Entries.Add(new_entry);
         return new_entry;
     } else {
         return NULL;
@@ -152,19 +166,55 @@ AP4_BytesFromDoubleBE(unsigned char* bytes, double value)
 }
 
 /*----------------------------------------------------------------------
-|   AP4_BytesFromUInt64BE
+|   AP4_BytesToUInt32ArrayBE
 +---------------------------------------------------------------------*/
 void
-AP4_BytesFromUInt64BE(unsigned char* bytes, AP4_UI64 value)
+AP4_BytesToUInt32ArrayBE(const unsigned char* bytes, AP4_UI32* values, AP4_Cardinal count)
 {
-    bytes[0] = (unsigned char)((value >> 56) & 0xFF);
-    bytes[1] = (unsigned char)((value >> 48) & 0xFF);
-    bytes[2] = (unsigned char)((value >> 40) & 0xFF);
-    bytes[3] = (unsigned char)((value >> 32) & 0xFF);
-    bytes[4] = (unsigned char)((value >> 24) & 0xFF);
-    bytes[5] = (unsigned char)((value >> 16) & 0xFF);
-    bytes[6] = (unsigned char)((value >>  8) & 0xFF);
-    bytes[7] = (unsigned char)((value      ) & 0xFF);
+    AP4_Cardinal i = 0;
+#if defined(AP4_UTILS_HAVE_SSE2)
+    for (; i+4 <= count; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(bytes+4*i));
+        x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+        x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+        x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+        _mm_storeu_si128((__m128i*)(values+i), x);
+    }
+#elif defined(AP4_UTILS_HAVE_NEON)
+    for (; i+4 <= count; i += 4) {
+        uint8x16_t x = vrev32q_u8(vld1q_u8(bytes+4*i));
+        vst1q_u8((uint8_t*)(values+i), x);
+    }
+#endif
+    for (; i<count; i++) {
+        values[i] = AP4_BytesToUInt32BE(bytes+4*i);
+    }
+}
+
+/*----------------------------------------------------------------------
+|   AP4_BytesToUInt64ArrayBE
++---------------------------------------------------------------------*/
+void
+AP4_BytesToUInt64ArrayBE(const unsigned char* bytes, AP4_UI64* values, AP4_Cardinal count)
+{
+    AP4_Cardinal i = 0;
+#if defined(AP4_UTILS_HAVE_SSE2)
+    for (; i+2 <= count; i += 2) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(bytes+8*i));
+        x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+        x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+        x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+        _mm_storeu_si128((__m128i*)(values+i), x);
+    }
+#elif defined(AP4_UTILS_HAVE_NEON)
+    for (; i+2 <= count; i += 2) {
+        uint8x16_t x = vrev64q_u8(vld1q_u8(bytes+8*i));
+        vst1q_u8((uint8_t*)(values+i), x);
+    }
+#endif
+    for (; i<count; i++) {
+        values[i] = AP4_BytesToUInt64BE(bytes+8*i);
+    }
 }
 
 /*----------------------------------------------------------------------
@@ -365,31 +415,40 @@ AP4_ParseIntegerU(const char* str)
 }
 
 /*----------------------------------------------------------------------
-|   types and macros
+|   AP4_CountLeadingZeros
 +---------------------------------------------------------------------*/
-#define AP4_WORD_BITS  32
-#define AP4_WORD_BYTES 4
-
-#define AP4_BIT_MASK(_n) ((1<<(_n))-1)
-
-#if AP4_WORD_BITS != 32
-#error unsupported word size /* 64 and other word size not yet implemented */
+static inline unsigned int
+AP4_CountLeadingZeros(AP4_UI64 x)
+{
+    // x must not be 0
+#if defined(__GNUC__)
+    return (unsigned int)__builtin_clzll(x);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanReverse64(&index, x);
+    return 63-(unsigned int)index;
+#else
+    unsigned int count = 0;
+    if ((x >> 32) == 0) { count += 32; x <<= 32; }
+    if ((x >> 48) == 0) { count += 16; x <<= 16; }
+    if ((x >> 56) == 0) { count +=  8; x <<=  8; }
+    if ((x >> 60) == 0) { count +=  4; x <<=  4; }
+    if ((x >> 62) == 0) { count +=  2; x <<=  2; }
+    if ((x >> 63) == 0) { count +=  1;           }
+    return count;
 #endif
+}
 
 /*----------------------------------------------------------------------
 |   AP4_BitReader::AP4_BitReader
 +---------------------------------------------------------------------*/
 AP4_BitReader::AP4_BitReader(const AP4_UI08* data, unsigned int data_size) :
+    m_Data(data),
+    m_DataSize(data_size),
     m_Position(0),
     m_Cache(0),
     m_BitsCached(0)
 {
-    // make the buffer an integral mulitple of the word size
-    m_Buffer.SetBufferSize(AP4_WORD_BYTES*((data_size+AP4_WORD_BYTES-1)/AP4_WORD_BYTES));
-    m_Buffer.SetData(data, data_size);
-    if (m_Buffer.GetDataSize() != m_Buffer.GetBufferSize()) {
-        AP4_SetMemory(m_Buffer.UseData()+m_Buffer.GetDataSize(), 0, m_Buffer.GetBufferSize()-m_Buffer.GetDataSize());
-    }
 }
 
 /*----------------------------------------------------------------------
@@ -422,16 +481,30 @@ AP4_BitReader::GetBitsRead()
 }
 
 /*----------------------------------------------------------------------
-|   AP4_BitReader::ReadCache
+|   AP4_BitReader::Refill
 +---------------------------------------------------------------------*/
-AP4_BitReader::BitsWord
-AP4_BitReader::ReadCache() const
+void
+AP4_BitReader::Refill()
 {
-    const AP4_UI08* out_ptr = m_Buffer.GetData()+m_Position;
-    return (((AP4_BitReader::BitsWord) out_ptr[0]) << 24) |
-           (((AP4_BitReader::BitsWord) out_ptr[1]) << 16) |
-           (((AP4_BitReader::BitsWord) out_ptr[2]) <<  8) |
-           (((AP4_BitReader::BitsWord) out_ptr[3])      );
+    // bits below the cached ones are always either 0 or the actual next
+    // bits of the data, so OR-ing more data in is always safe
+    if (m_Position < m_DataSize && m_DataSize-m_Position >= 8) {
+        // fast path: load 8 bytes at once and keep as many whole bytes as fit
+        BitsWord word = AP4_BytesToUInt64BE(m_Data+m_Position);
+        m_Cache |= word >> m_BitsCached;
+        unsigned int byte_count = (64-m_BitsCached)/8;
+        m_Position   += byte_count;
+        m_BitsCached += 8*byte_count;
+    } else {
+        // near or past the end: one byte at a time, padding with 0s
+        while (m_BitsCached <= 56) {
+            if (m_Position < m_DataSize) {
+                m_Cache |= ((BitsWord)m_Data[m_Position]) << (56-m_BitsCached);
+            }
+            ++m_Position;
+            m_BitsCached += 8;
+        }
+    }
 }
 
 /*----------------------------------------------------------------------
@@ -441,24 +514,11 @@ AP4_UI32
 AP4_BitReader::ReadBits(unsigned int n)
 {
     if (n == 0) return 0;
-    AP4_BitReader::BitsWord result;
-    if (m_BitsCached >= n) {
-        /* we have enough bits in the cache to satisfy the request */
-        m_BitsCached -= n;
-        result = (m_Cache >> m_BitsCached) & AP4_BIT_MASK(n);
-    } else {
-        /* not enough bits in the cache */
-        AP4_BitReader::BitsWord word = ReadCache();
-        m_Position += AP4_WORD_BYTES;
-
-        /* combine the new word and the cache, and update the state */
-        AP4_BitReader::BitsWord cache = m_Cache & AP4_BIT_MASK(m_BitsCached);
-        n -= m_BitsCached;
-        m_BitsCached = AP4_WORD_BITS - n;
-        result = (word >> m_BitsCached) | (cache << n);
-        m_Cache = word;
-    }
-
+    if (m_BitsCached < n) Refill();
+    AP4_UI32 result = (AP4_UI32)(m_Cache >> (64-n));
+    m_Cache <<= n;
+    m_BitsCached -= n;
+    
     return result;
 }
 
@@ -468,21 +528,11 @@ AP4_BitReader::ReadBits(unsigned int n)
 int
 AP4_BitReader::ReadBit()
 {
-    AP4_BitReader::BitsWord result;
-    if (m_BitsCached == 0) {
-        /* the cache is empty */
-
-        /* read the next word into the cache */
-        m_Cache = ReadCache();
-        m_Position += AP4_WORD_BYTES;
-        m_BitsCached = AP4_WORD_BITS - 1;
-
-        /* return the first bit */
-        result = m_Cache >> (AP4_WORD_BITS - 1);
-    } else {
-        /* get the bit from the cache */
-        result = (m_Cache >> (--m_BitsCached)) & 1;
-    }
+    if (m_BitsCached == 0) Refill();
+    int result = (int)(m_Cache >> 63);
+    m_Cache <<= 1;
+    --m_BitsCached;
+    
     return result;
 }
 
@@ -492,18 +542,9 @@ AP4_BitReader::ReadBit()
 AP4_UI32
 AP4_BitReader::PeekBits(unsigned int n)
 {
-   /* we have enough bits in the cache to satisfy the request */
-   if (m_BitsCached >= n) {
-      return (m_Cache >> (m_BitsCached - n)) & AP4_BIT_MASK(n);
-   } else {
-      /* not enough bits in the cache, read the next word */
-      AP4_BitReader::BitsWord word = ReadCache();
-
-      /* combine the new word and the cache, and update the state */
-      AP4_BitReader::BitsWord   cache = m_Cache & AP4_BIT_MASK(m_BitsCached);
-      n -= m_BitsCached;
-      return (word >> (AP4_WORD_BITS - n)) | (cache << n);
-   }
+    if (n == 0) return 0;
+    if (m_BitsCached < n) Refill();
+    return (AP4_UI32)(m_Cache >> (64-n));
 }
 
 /*----------------------------------------------------------------------
@@ -512,17 +553,8 @@ AP4_BitReader::PeekBits(unsigned int n)
 int
 AP4_BitReader::PeekBit()
 {
-   /* the cache is empty */
-   if (m_BitsCached == 0) {
-      /* read the next word into the cache */
-      AP4_BitReader::BitsWord cache = ReadCache();
-
-      /* return the first bit */
-      return cache >> (AP4_WORD_BITS - 1);
-   } else {
-      /* get the bit from the cache */
-      return (m_Cache >> (m_BitsCached-1)) & 1;
-   }
+    if (m_BitsCached == 0) Refill();
+    return (int)(m_Cache >> 63);
 }
 
 /*----------------------------------------------------------------------
@@ -531,23 +563,18 @@ AP4_BitReader::PeekBit()
 void
 AP4_BitReader::SkipBits(unsigned int n)
 {
-   if (n <= m_BitsCached) {
-      m_BitsCached -= n;
-   } else {
-      n -= m_BitsCached;
-      while (n >= AP4_WORD_BITS) {
-         m_Position += AP4_WORD_BYTES;
-         n -= AP4_WORD_BITS;
-      }
-      if (n) {
-         m_Cache = ReadCache();
-         m_BitsCached = AP4_WORD_BITS-n;
-         m_Position += AP4_WORD_BYTES;
-      } else {
-         m_BitsCached = 0;
-         m_Cache = 0;
-      }
-   }
+    if (n > m_BitsCached) {
+        // drop the cache and skip whole bytes directly
+        n -= m_BitsCached;
+        m_Position  += n/8;
+        m_Cache      = 0;
+        m_BitsCached = 0;
+        n %= 8;
+        if (n == 0) return;
+        Refill();
+    }
+    m_Cache <<= n;
+    m_BitsCached -= n;
 }
 
 /*----------------------------------------------------------------------
@@ -556,13 +583,52 @@ AP4_BitReader::SkipBits(unsigned int n)
 void
 AP4_BitReader::SkipBit()
 {
-   if (m_BitsCached == 0) {
-      m_Cache = ReadCache();
-      m_Position += AP4_WORD_BYTES;
-      m_BitsCached = AP4_WORD_BITS - 1;
-   } else {
-      --m_BitsCached;
-   }
+    if (m_BitsCached == 0) Refill();
+    m_Cache <<= 1;
+    --m_BitsCached;
 }
 
+/*----------------------------------------------------------------------
+|   AP4_BitReader::SkipBytes
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_BitReader::SkipBytes(AP4_Size byte_count)
+{
+    SkipBits(8*byte_count);
+    return AP4_SUCCESS;
+}
 
+/*----------------------------------------------------------------------
+|   AP4_BitReader::ReadGolomb
++---------------------------------------------------------------------*/
+AP4_UI32
+AP4_BitReader::ReadGolomb()
+{
+    if (m_BitsCached < 32) Refill();
+    
+    // count the leading zeros, which are all in the cache after a refill
+    unsigned int leading_zeros = m_Cache ? AP4_CountLeadingZeros(m_Cache) : 64;
+    if (leading_zeros > 31) {
+        // not a valid code: consume the zero bits and the bit after them
+        SkipBits(33);
+        return 0;
+    }
+    SkipBits(leading_zeros);
+    
+    // the value is the next leading_zeros+1 bits, minus 1
+    return ReadBits(leading_zeros+1)-1;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_BitReader::ReadSignedGolomb
++---------------------------------------------------------------------*/
+AP4_SI32
+AP4_BitReader::ReadSignedGolomb()
+{
+    AP4_UI32 code_num = ReadGolomb();
+    if (code_num % 2) {
+        return (AP4_SI32)((code_num+1)/2);
+    } else {
+        return -(AP4_SI32)(code_num/2);
+    }
+}
@@ -57,7 +57,7 @@ private:
         AP4_String m_Value;
     };
     static Entry* GetEntry(const char* name, bool autocreate);
-    static AP4_List<Entry>* g_Entries;
+    static AP4_List<Entry> g_Entries;
 };
 
 /*----------------------------------------------------------------------
@@ -66,7 +66,14 @@ private:
 double   AP4_BytesToDoubleBE(const unsigned char* bytes);
 AP4_UI64 AP4_BytesToUInt64BE(const unsigned char* bytes);
 void AP4_BytesFromDoubleBE(unsigned char* bytes, double value);
-void AP4_BytesFromUInt64BE(unsigned char* bytes, AP4_UI64 value);
+
+/**
+ * Convert an array of big-endian 32-bit (or 64-bit) values, using vector
+ * instructions when available. The values may overwrite the bytes
+ * (in-place conversion), but the two arrays may not otherwise overlap.
+ */
+void AP4_BytesToUInt32ArrayBE(const unsigned char* bytes, AP4_UI32* values, AP4_Cardinal count);
+void AP4_BytesToUInt64ArrayBE(const unsigned char* bytes, AP4_UI64* values, AP4_Cardinal count);
 
 /*----------------------------------------------------------------------
 |   AP4_BytesToUInt32BE
@@ -122,6 +129,22 @@ AP4_BytesToInt16BE(const unsigned char* bytes)
     return (AP4_SI16)AP4_BytesToUInt16BE(bytes);
 }
 
+/*----------------------------------------------------------------------
+|   AP4_BytesFromUInt64BE
++---------------------------------------------------------------------*/
+inline void
+AP4_BytesFromUInt64BE(unsigned char* bytes, AP4_UI64 value)
+{
+    bytes[0] = (unsigned char)((value >> 56) & 0xFF);
+    bytes[1] = (unsigned char)((value >> 48) & 0xFF);
+    bytes[2] = (unsigned char)((value >> 40) & 0xFF);
+    bytes[3] = (unsigned char)((value >> 32) & 0xFF);
+    bytes[4] = (unsigned char)((value >> 24) & 0xFF);
+    bytes[5] = (unsigned char)((value >> 16) & 0xFF);
+    bytes[6] = (unsigned char)((value >>  8) & 0xFF);
+    bytes[7] = (unsigned char)((value      ) & 0xFF);
+}
+
 /*----------------------------------------------------------------------
 |   AP4_BytesFromUInt32BE
 +---------------------------------------------------------------------*/
@@ -194,6 +217,8 @@ extern int AP4_FormatStringVN(char *buffer, size_t count, const char *format, va
 #define AP4_CopyMemory(x,y,z) memcpy(x,y,z)
 #define AP4_CompareMemory(x, y, z) memcmp(x, y, z)
 #define AP4_SetMemory(x,y,z) memset(x,y,z)
+#define AP4_MoveMemory(x,y,z) memmove(x,y,z)
+#define AP4_FindByte(x,y,z) memchr(x,y,z)
 #define AP4_CompareStrings(x,y) strcmp(x,y)
 #endif
 
@@ -242,11 +267,17 @@ private:
 /*----------------------------------------------------------------------
 |   AP4_BitReader
 +---------------------------------------------------------------------*/
+/**
+ * MSB-first bit reader.
+ * The reader does not copy the data: the buffer passed to the constructor
+ * must remain valid for as long as the reader is used. Reading past the end
+ * of the buffer returns 0 bits.
+ */
 class AP4_BitReader
 {
 public:
     // types
-    typedef unsigned int BitsWord;
+    typedef AP4_UI64 BitsWord;
 
     // constructor and destructor
     AP4_BitReader(const AP4_UI08* data, unsigned int data_size);
@@ -261,18 +292,21 @@ public:
     AP4_Result   SkipBytes(AP4_Size byte_count);
     void         SkipBit();
     void         SkipBits(unsigned int bit_count);
+    AP4_UI32     ReadGolomb();        // ue(v)
+    AP4_SI32     ReadSignedGolomb();  // se(v)
 
     unsigned int GetBitsRead();
     
 private:
     // methods
-    BitsWord ReadCache() const;
+    void Refill();
 
     // members
-    AP4_DataBuffer m_Buffer;
-    unsigned int   m_Position;
-    BitsWord       m_Cache;
-    unsigned int   m_BitsCached;
+    const AP4_UI08* m_Data;
+    unsigned int    m_DataSize;
+    unsigned int    m_Position;   // number of bytes loaded into the cache
+    BitsWord        m_Cache;      // MSB-aligned
+    unsigned int    m_BitsCached;
 };
     
 #endif // _AP4_UTILS_H_
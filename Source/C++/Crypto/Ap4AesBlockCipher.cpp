@@ -1882,11 +1882,14 @@ AP4_AesCbcBlockCipher::Process(const AP4_UI08* input,
         }
     } else {        
         for (unsigned int i=0; i<block_count; i++) {
+            // save the ciphertext block first, so that input and output may be the same
+            AP4_UI08 next_chaining_block[AP4_AES_BLOCK_SIZE];
+            AP4_CopyMemory(next_chaining_block, input, AP4_AES_BLOCK_SIZE);
             aes_dec_blk(input, output, m_Context);
             for (unsigned int j=0; j<AP4_AES_BLOCK_SIZE; j++) {
                 output[j] ^= chaining_block[j];
             }
-            AP4_CopyMemory(chaining_block, input, AP4_AES_BLOCK_SIZE);
+            AP4_CopyMemory(chaining_block, next_chaining_block, AP4_AES_BLOCK_SIZE);
             input  += AP4_AES_BLOCK_SIZE;
             output += AP4_AES_BLOCK_SIZE;
         }
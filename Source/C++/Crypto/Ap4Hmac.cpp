@@ -31,16 +31,88 @@
  that was released into public domain by Tom St Denis. 
 */
 
+
 /*----------------------------------------------------------------------
 |   includes
 +---------------------------------------------------------------------*/
 #include "Ap4Hmac.h"
 #include "Ap4Utils.h"
 
+/*----------------------------------------------------------------------
+|   acceleration support
+|
+|   Three kinds of accelerated code can be compiled in, each guarded by a
+|   compiler check, and selected at runtime:
+|   - x86 SHA extensions (SHA-NI)
+|   - ARMv8 SHA2 instructions
+|   - SSE2 or NEON, to hash 4 independent messages in parallel lanes
+|   Define AP4_CONFIG_NO_SHA256_ACCELERATION to only use the C code.
++---------------------------------------------------------------------*/
+#if !defined(AP4_CONFIG_NO_SHA256_ACCELERATION)
+
+// x86 SHA extensions
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#if (defined(_MSC_VER) && _MSC_VER >= 1900) || defined(__clang__) || \
+    (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define AP4_SHA256_HAVE_X86_SHA
+#endif
+#endif
+
+// ARMv8 SHA2 instructions
+#if defined(__aarch64__) && !defined(__ARM_BIG_ENDIAN)
+#if defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO)
+#define AP4_SHA256_HAVE_ARM_SHA
+#define AP4_SHA256_ARM_SHA_TARGET
+#elif defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 8 && defined(__linux__)
+#define AP4_SHA256_HAVE_ARM_SHA
+#define AP4_SHA256_ARM_SHA_RUNTIME_CHECK
+#define AP4_SHA256_ARM_SHA_TARGET __attribute__((target("+crypto")))
+#endif
+#endif
+
+// vector lanes
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AP4_SHA256_HAVE_SSE2_LANES
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && defined(__GNUC__)
+#define AP4_SHA256_HAVE_NEON_LANES
+#endif
+
+#endif // AP4_CONFIG_NO_SHA256_ACCELERATION
+
+#if defined(AP4_SHA256_HAVE_X86_SHA)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#define AP4_SHA256_X86_SHA_TARGET
+#else
+#define AP4_SHA256_X86_SHA_TARGET __attribute__((target("sha,sse4.1")))
+#endif
+#endif
+
+#if defined(AP4_SHA256_HAVE_ARM_SHA) || defined(AP4_SHA256_HAVE_NEON_LANES)
+#include <arm_neon.h>
+#endif
+#if defined(AP4_SHA256_ARM_SHA_RUNTIME_CHECK)
+#include <sys/auxv.h>
+#if !defined(HWCAP_SHA2)
+#define HWCAP_SHA2 (1 << 6)
+#endif
+#endif
+
+#if defined(AP4_SHA256_HAVE_SSE2_LANES)
+#include <emmintrin.h>
+#endif
+
 /*----------------------------------------------------------------------
 |   constants
 +---------------------------------------------------------------------*/
-#define AP4_SHA256_BLOCK_SIZE 64
+#define AP4_SHA256_BLOCK_SIZE  64
+#define AP4_SHA256_DIGEST_SIZE 32
+#define AP4_SHA256_MAX_LANES   4
 
 static const AP4_UI32 AP4_Sha256_K[64] = {
 	0x428a2f98UL, 0x71374491UL, 0xb5c0fbcfUL, 0xe9b5dba5UL, 0x3956c25bUL,
@@ -58,24 +130,46 @@ static const AP4_UI32 AP4_Sha256_K[64] = {
 	0x90befffaUL, 0xa4506cebUL, 0xbef9a3f7UL, 0xc67178f2UL
 };
 
+static const AP4_UI32 AP4_Sha256_H[8] = {
+    0x6A09E667UL, 0xBB67AE85UL, 0x3C6EF372UL, 0xA54FF53AUL,
+    0x510E527FUL, 0x9B05688CUL, 0x1F83D9ABUL, 0x5BE0CD19UL
+};
+
+static const AP4_UI08 AP4_Sha256_ZeroBlock[AP4_SHA256_BLOCK_SIZE] = {0};
+
+/*----------------------------------------------------------------------
+|   types
++---------------------------------------------------------------------*/
+// compress block_count consecutive blocks into one state
+typedef void (*AP4_Sha256CompressBlocksFunction)(AP4_UI32*       state,
+                                                 const AP4_UI08* blocks,
+                                                 unsigned int    block_count);
+
+// compress one block into each of the states (8 words per lane)
+typedef void (*AP4_Sha256CompressLanesFunction)(AP4_UI32*              states,
+                                                const AP4_UI08* const* blocks);
+
+typedef struct {
+    AP4_Sha256CompressBlocksFunction CompressBlocks;
+    AP4_Sha256CompressLanesFunction  CompressLanes;
+    unsigned int                     LaneCount;
+} AP4_Sha256Implementation;
+
 /*----------------------------------------------------------------------
 |   AP4_DigestSha256
 +---------------------------------------------------------------------*/
-class AP4_DigestSha256
+class AP4_DigestSha256 : public AP4_Digest
 {
 public:
     AP4_DigestSha256();
-    virtual ~AP4_DigestSha256() {}
-    
-    // AP4_Hmac methods
+
+    // AP4_Digest methods
     virtual AP4_Result Update(const AP4_UI08* data, AP4_Size data_size);
     virtual AP4_Result Final(AP4_DataBuffer& digest);
-    
+
 private:
-    // methods
-    void CompressBlock(const AP4_UI08* block);
-    
     // members
+    AP4_Sha256CompressBlocksFunction m_CompressBlocks;
 	AP4_UI64 m_Length;
     AP4_UI32 m_Pending;
 	AP4_UI32 m_State[8];
@@ -96,36 +190,24 @@ class AP4_HmacSha256 : public AP4_Hmac
 {
 public:
     AP4_HmacSha256(const AP4_UI08* key, AP4_Size key_size);
-    
+
+    // class methods
+    static void MakePadBlocks(const AP4_UI08* key,
+                              AP4_Size        key_size,
+                              AP4_UI08*       inner_block,
+                              AP4_UI08*       outer_block);
+
     // AP4_Hmac methods
     virtual AP4_Result Update(const AP4_UI08* data, AP4_Size data_size) {
         return m_InnerDigest.Update(data, data_size);
     }
     virtual AP4_Result Final(AP4_DataBuffer& buffer);
-    
+
 private:
     AP4_DigestSha256 m_InnerDigest;
     AP4_DigestSha256 m_OuterDigest;
 };
 
-/*----------------------------------------------------------------------
-|   AP4_DigestSha256::AP4_DigestSha256
-+---------------------------------------------------------------------*/
-AP4_DigestSha256::AP4_DigestSha256() :
-    m_Length(0),
-    m_Pending(0)
-{
-	m_State[0] = 0x6A09E667UL;
-	m_State[1] = 0xBB67AE85UL;
-	m_State[2] = 0x3C6EF372UL;
-	m_State[3] = 0xA54FF53AUL;
-	m_State[4] = 0x510E527FUL;
-	m_State[5] = 0x9B05688CUL;
-	m_State[6] = 0x1F83D9ABUL;
-	m_State[7] = 0x5BE0CD19UL;
-    AP4_SetMemory(m_Buffer, 0, sizeof(m_Buffer));
-}
-
 /*----------------------------------------------------------------------
 |   local macros
 +---------------------------------------------------------------------*/
@@ -133,7 +215,7 @@ AP4_DigestSha256::AP4_DigestSha256() :
 ( ((((unsigned long) (x) & 0xFFFFFFFFUL) >> (unsigned long) ((y) & 31)) | \
    ((unsigned long) (x) << (unsigned long) (32 - ((y) & 31)))) & 0xFFFFFFFFUL)
 #define AP4_Sha256_Ch(x,y,z)       (z ^ (x & (y ^ z)))
-#define AP4_Sha256_Maj(x,y,z)      (((x | y) & z) | (x & y)) 
+#define AP4_Sha256_Maj(x,y,z)      (((x | y) & z) | (x & y))
 #define AP4_Sha256_S(x, n)         AP4_Sha256_RORc((x), (n))
 #define AP4_Sha256_R(x, n)         (((x)&0xFFFFFFFFUL)>>(n))
 #define AP4_Sha256_Sigma0(x)       (AP4_Sha256_S(x,  2) ^ AP4_Sha256_S(x, 13) ^ AP4_Sha256_S(x, 22))
@@ -142,45 +224,629 @@ AP4_DigestSha256::AP4_DigestSha256() :
 #define AP4_Sha256_Gamma1(x)       (AP4_Sha256_S(x, 17) ^ AP4_Sha256_S(x, 19) ^ AP4_Sha256_R(x, 10))
 
 /*----------------------------------------------------------------------
-|   AP4_DigestSha256::CompressBlock
+|   AP4_Sha256_CompressBlocks
 +---------------------------------------------------------------------*/
-void
-AP4_DigestSha256::CompressBlock(const AP4_UI08* block)
+static void
+AP4_Sha256_CompressBlocks(AP4_UI32* state, const AP4_UI08* block, unsigned int block_count)
 {
 	AP4_UI32 S[8], W[64];
 
-	/* copy the state into S */
-	for (unsigned int i = 0; i < 8; i++) {
-		S[i] = m_State[i];
-	}
+    for (; block_count; --block_count, block += AP4_SHA256_BLOCK_SIZE) {
+        /* copy the state into S */
+        for (unsigned int i = 0; i < 8; i++) {
+            S[i] = state[i];
+        }
+
+        /* copy the 512-bit block into W[0..15] */
+        for (unsigned int i = 0; i < 16; i++) {
+            W[i] = AP4_BytesToUInt32BE(&block[4*i]);
+        }
+
+        /* fill W[16..63] */
+        for (unsigned int i = 16; i < AP4_SHA256_BLOCK_SIZE; i++) {
+            W[i] = AP4_Sha256_Gamma1(W[i-2]) + W[i-7] + AP4_Sha256_Gamma0(W[i-15]) + W[i-16];
+        }
 
-	/* copy the 512-bit block into W[0..15] */
-	for (unsigned int i = 0; i < 16; i++) {
-		W[i] = AP4_BytesToUInt32BE(&block[4*i]);
+        /* compress */
+        AP4_UI32 t, t0, t1;
+        for (unsigned int i = 0; i < AP4_SHA256_BLOCK_SIZE; ++i) {
+            t0 = S[7] + AP4_Sha256_Sigma1(S[4]) + AP4_Sha256_Ch(S[4], S[5], S[6]) + AP4_Sha256_K[i] + W[i];
+            t1 = AP4_Sha256_Sigma0(S[0]) + AP4_Sha256_Maj(S[0], S[1], S[2]);
+            S[3] += t0;
+            S[7]  = t0 + t1;
+            t = S[7]; S[7] = S[6]; S[6] = S[5]; S[5] = S[4];
+            S[4] = S[3]; S[3] = S[2]; S[2] = S[1]; S[1] = S[0]; S[0] = t;
+        }
+
+        /* feedback */
+        for (unsigned int i = 0; i < 8; i++) {
+            state[i] = state[i] + S[i];
+        }
     }
-    
-	/* fill W[16..63] */
-	for (unsigned int i = 16; i < AP4_SHA256_BLOCK_SIZE; i++) {
-		W[i] = AP4_Sha256_Gamma1(W[i-2]) + W[i-7] + AP4_Sha256_Gamma0(W[i-15]) + W[i-16];
-	}        
-
-	/* compress */
-	AP4_UI32 t, t0, t1;
-	for (unsigned int i = 0; i < AP4_SHA256_BLOCK_SIZE; ++i) {
-        t0 = S[7] + AP4_Sha256_Sigma1(S[4]) + AP4_Sha256_Ch(S[4], S[5], S[6]) + AP4_Sha256_K[i] + W[i];
-        t1 = AP4_Sha256_Sigma0(S[0]) + AP4_Sha256_Maj(S[0], S[1], S[2]);
-        S[3] += t0;
-        S[7]  = t0 + t1;
-		t = S[7]; S[7] = S[6]; S[6] = S[5]; S[5] = S[4]; 
-		S[4] = S[3]; S[3] = S[2]; S[2] = S[1]; S[1] = S[0]; S[0] = t;
-	}
+}
+
+#if defined(AP4_SHA256_HAVE_X86_SHA)
+/*----------------------------------------------------------------------
+|   x86 SHA extensions
+|
+|   The macros take a lane prefix, so that the same sequence of
+|   instructions can be interleaved for two independent messages.
+|   S0/S1 hold the state as ABEF/CDGH, M0..M3 hold the message schedule.
++---------------------------------------------------------------------*/
+#define AP4_SHA256_NI_DECLARE(x) \
+    __m128i x##S0, x##S1, x##M0, x##M1, x##M2, x##M3, x##T, x##SavedS0, x##SavedS1
+
+#define AP4_SHA256_NI_LOAD_STATE(x, state)                                       \
+    x##T  = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&(state)[0]), 0xB1); \
+    x##S1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&(state)[4]), 0x1B); \
+    x##S0 = _mm_alignr_epi8(x##T, x##S1, 8);                                     \
+    x##S1 = _mm_blend_epi16(x##S1, x##T, 0xF0)
 
-	/* feedback */
+#define AP4_SHA256_NI_STORE_STATE(x, state)                                        \
+    x##T  = _mm_shuffle_epi32(x##S0, 0x1B);                                        \
+    x##S1 = _mm_shuffle_epi32(x##S1, 0xB1);                                        \
+    _mm_storeu_si128((__m128i*)&(state)[0], _mm_blend_epi16(x##T, x##S1, 0xF0));   \
+    _mm_storeu_si128((__m128i*)&(state)[4], _mm_alignr_epi8(x##S1, x##T, 8))
+
+#define AP4_SHA256_NI_LOAD_BLOCK(x, block)                                                  \
+    x##M0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)((block)+ 0)), byte_swap);    \
+    x##M1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)((block)+16)), byte_swap);    \
+    x##M2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)((block)+32)), byte_swap);    \
+    x##M3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)((block)+48)), byte_swap);    \
+    x##SavedS0 = x##S0;                                                                    \
+    x##SavedS1 = x##S1
+
+#define AP4_SHA256_NI_FEEDBACK(x)                  \
+    x##S0 = _mm_add_epi32(x##S0, x##SavedS0);      \
+    x##S1 = _mm_add_epi32(x##S1, x##SavedS1)
+
+// 4 rounds with the message words in m
+#define AP4_SHA256_NI_ROUNDS(x, m, k)                                                   \
+    x##T  = _mm_add_epi32(x##m, _mm_loadu_si128((const __m128i*)&AP4_Sha256_K[k]));     \
+    x##S1 = _mm_sha256rnds2_epu32(x##S1, x##S0, x##T);                                  \
+    x##S0 = _mm_sha256rnds2_epu32(x##S0, x##S1, _mm_shuffle_epi32(x##T, 0x0E))
+
+// first half of the schedule of the words that will replace mp
+#define AP4_SHA256_NI_MSG1(x, mp, mc) \
+    x##mp = _mm_sha256msg1_epu32(x##mp, x##mc)
+
+// second half of the schedule of the words that will replace mn
+#define AP4_SHA256_NI_MSG2(x, mn, mc, mp) \
+    x##mn = _mm_sha256msg2_epu32(_mm_add_epi32(x##mn, _mm_alignr_epi8(x##mc, x##mp, 4)), x##mc)
+
+#define AP4_SHA256_NI_BLOCK(R, MSG1, MSG2)                            \
+    R(M0,  0);                                                        \
+    R(M1,  4); MSG1(M0, M1);                                          \
+    R(M2,  8); MSG1(M1, M2);                                          \
+    R(M3, 12); MSG2(M0, M3, M2); MSG1(M2, M3);                        \
+    R(M0, 16); MSG2(M1, M0, M3); MSG1(M3, M0);                        \
+    R(M1, 20); MSG2(M2, M1, M0); MSG1(M0, M1);                        \
+    R(M2, 24); MSG2(M3, M2, M1); MSG1(M1, M2);                        \
+    R(M3, 28); MSG2(M0, M3, M2); MSG1(M2, M3);                        \
+    R(M0, 32); MSG2(M1, M0, M3); MSG1(M3, M0);                        \
+    R(M1, 36); MSG2(M2, M1, M0); MSG1(M0, M1);                        \
+    R(M2, 40); MSG2(M3, M2, M1); MSG1(M1, M2);                        \
+    R(M3, 44); MSG2(M0, M3, M2); MSG1(M2, M3);                        \
+    R(M0, 48); MSG2(M1, M0, M3); MSG1(M3, M0);                        \
+    R(M1, 52); MSG2(M2, M1, M0);                                      \
+    R(M2, 56); MSG2(M3, M2, M1);                                      \
+    R(M3, 60)
+
+#define AP4_SHA256_NI_ROUNDS_1(m, k)    AP4_SHA256_NI_ROUNDS(a, m, k)
+#define AP4_SHA256_NI_MSG1_1(mp, mc)    AP4_SHA256_NI_MSG1(a, mp, mc)
+#define AP4_SHA256_NI_MSG2_1(mn, mc, mp) AP4_SHA256_NI_MSG2(a, mn, mc, mp)
+#define AP4_SHA256_NI_ROUNDS_2(m, k)    AP4_SHA256_NI_ROUNDS(a, m, k); AP4_SHA256_NI_ROUNDS(b, m, k)
+#define AP4_SHA256_NI_MSG1_2(mp, mc)    AP4_SHA256_NI_MSG1(a, mp, mc); AP4_SHA256_NI_MSG1(b, mp, mc)
+#define AP4_SHA256_NI_MSG2_2(mn, mc, mp) AP4_SHA256_NI_MSG2(a, mn, mc, mp); AP4_SHA256_NI_MSG2(b, mn, mc, mp)
+
+/*----------------------------------------------------------------------
+|   AP4_Sha256_CompressBlocksX86
++---------------------------------------------------------------------*/
+AP4_SHA256_X86_SHA_TARGET static void
+AP4_Sha256_CompressBlocksX86(AP4_UI32* state, const AP4_UI08* block, unsigned int block_count)
+{
+    const __m128i byte_swap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    AP4_SHA256_NI_DECLARE(a);
+
+    AP4_SHA256_NI_LOAD_STATE(a, state);
+    for (; block_count; --block_count, block += AP4_SHA256_BLOCK_SIZE) {
+        AP4_SHA256_NI_LOAD_BLOCK(a, block);
+        AP4_SHA256_NI_BLOCK(AP4_SHA256_NI_ROUNDS_1, AP4_SHA256_NI_MSG1_1, AP4_SHA256_NI_MSG2_1);
+        AP4_SHA256_NI_FEEDBACK(a);
+    }
+    AP4_SHA256_NI_STORE_STATE(a, state);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Sha256_CompressLanesX86
++---------------------------------------------------------------------*/
+AP4_SHA256_X86_SHA_TARGET static void
+AP4_Sha256_CompressLanesX86(AP4_UI32* states, const AP4_UI08* const* blocks)
+{
+    const __m128i byte_swap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    AP4_SHA256_NI_DECLARE(a);
+    AP4_SHA256_NI_DECLARE(b);
+
+    AP4_SHA256_NI_LOAD_STATE(a, states);
+    AP4_SHA256_NI_LOAD_STATE(b, states+8);
+    AP4_SHA256_NI_LOAD_BLOCK(a, blocks[0]);
+    AP4_SHA256_NI_LOAD_BLOCK(b, blocks[1]);
+    AP4_SHA256_NI_BLOCK(AP4_SHA256_NI_ROUNDS_2, AP4_SHA256_NI_MSG1_2, AP4_SHA256_NI_MSG2_2);
+    AP4_SHA256_NI_FEEDBACK(a);
+    AP4_SHA256_NI_FEEDBACK(b);
+    AP4_SHA256_NI_STORE_STATE(a, states);
+    AP4_SHA256_NI_STORE_STATE(b, states+8);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Sha256_CpuHasX86Sha
++---------------------------------------------------------------------*/
+static bool
+AP4_Sha256_CpuHasX86Sha()
+{
+    unsigned int ecx_1, ebx_7;
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    ecx_1 = (unsigned int)info[2];
+    __cpuidex(info, 7, 0);
+    ebx_7 = (unsigned int)info[1];
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_max(0, NULL) < 7) return false;
+    __cpuid(1, eax, ebx, ecx, edx);
+    ecx_1 = ecx;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    ebx_7 = ebx;
+#endif
+    // SSSE3, SSE4.1 and SHA
+    return (ecx_1 & (1 << 9)) && (ecx_1 & (1 << 19)) && (ebx_7 & (1 << 29));
+}
+#endif // AP4_SHA256_HAVE_X86_SHA
+
+#if defined(AP4_SHA256_HAVE_ARM_SHA)
+/*----------------------------------------------------------------------
+|   ARMv8 SHA2 instructions
+|
+|   Same structure as the x86 code: the macros take a lane prefix.
+|   S0/S1 hold the state as ABCD/EFGH, M0..M3 hold the message schedule.
++---------------------------------------------------------------------*/
+#define AP4_SHA256_ARM_DECLARE(x) \
+    uint32x4_t x##S0, x##S1, x##M0, x##M1, x##M2, x##M3, x##T, x##U, x##SavedS0, x##SavedS1
+
+#define AP4_SHA256_ARM_LOAD_STATE(x, state)   \
+    x##S0 = vld1q_u32(&(state)[0]);           \
+    x##S1 = vld1q_u32(&(state)[4])
+
+#define AP4_SHA256_ARM_STORE_STATE(x, state)  \
+    vst1q_u32(&(state)[0], x##S0);            \
+    vst1q_u32(&(state)[4], x##S1)
+
+#define AP4_SHA256_ARM_LOAD_BLOCK(x, block)                              \
+    x##M0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8((block)+ 0)));     \
+    x##M1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8((block)+16)));     \
+    x##M2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8((block)+32)));     \
+    x##M3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8((block)+48)));     \
+    x##SavedS0 = x##S0;                                                 \
+    x##SavedS1 = x##S1
+
+#define AP4_SHA256_ARM_FEEDBACK(x)             \
+    x##S0 = vaddq_u32(x##S0, x##SavedS0);      \
+    x##S1 = vaddq_u32(x##S1, x##SavedS1)
+
+// 4 rounds with the message words in m
+#define AP4_SHA256_ARM_ROUNDS(x, m, k)                         \
+    x##T  = vaddq_u32(x##m, vld1q_u32(&AP4_Sha256_K[k]));      \
+    x##U  = x##S0;                                             \
+    x##S0 = vsha256hq_u32(x##S0, x##S1, x##T);                 \
+    x##S1 = vsha256h2q_u32(x##S1, x##U, x##T)
+
+// replace m0 with the words 16 positions further in the schedule
+#define AP4_SHA256_ARM_SCHEDULE(x, m0, m1, m2, m3) \
+    x##m0 = vsha256su1q_u32(vsha256su0q_u32(x##m0, x##m1), x##m2, x##m3)
+
+#define AP4_SHA256_ARM_BLOCK(R, SCHEDULE)                     \
+    R(M0,  0); SCHEDULE(M0, M1, M2, M3);                      \
+    R(M1,  4); SCHEDULE(M1, M2, M3, M0);                      \
+    R(M2,  8); SCHEDULE(M2, M3, M0, M1);                      \
+    R(M3, 12); SCHEDULE(M3, M0, M1, M2);                      \
+    R(M0, 16); SCHEDULE(M0, M1, M2, M3);                      \
+    R(M1, 20); SCHEDULE(M1, M2, M3, M0);                      \
+    R(M2, 24); SCHEDULE(M2, M3, M0, M1);                      \
+    R(M3, 28); SCHEDULE(M3, M0, M1, M2);                      \
+    R(M0, 32); SCHEDULE(M0, M1, M2, M3);                      \
+    R(M1, 36); SCHEDULE(M1, M2, M3, M0);                      \
+    R(M2, 40); SCHEDULE(M2, M3, M0, M1);                      \
+    R(M3, 44); SCHEDULE(M3, M0, M1, M2);                      \
+    R(M0, 48);                                                \
+    R(M1, 52);                                                \
+    R(M2, 56);                                                \
+    R(M3, 60)
+
+#define AP4_SHA256_ARM_ROUNDS_1(m, k)                 AP4_SHA256_ARM_ROUNDS(a, m, k)
+#define AP4_SHA256_ARM_SCHEDULE_1(m0, m1, m2, m3)     AP4_SHA256_ARM_SCHEDULE(a, m0, m1, m2, m3)
+#define AP4_SHA256_ARM_ROUNDS_2(m, k)                 AP4_SHA256_ARM_ROUNDS(a, m, k); AP4_SHA256_ARM_ROUNDS(b, m, k)
+#define AP4_SHA256_ARM_SCHEDULE_2(m0, m1, m2, m3)     AP4_SHA256_ARM_SCHEDULE(a, m0, m1, m2, m3); AP4_SHA256_ARM_SCHEDULE(b, m0, m1, m2, m3)
+
+/*----------------------------------------------------------------------
+|   AP4_Sha256_CompressBlocksArm
++---------------------------------------------------------------------*/
+AP4_SHA256_ARM_SHA_TARGET static void
+AP4_Sha256_CompressBlocksArm(AP4_UI32* state, const AP4_UI08* block, unsigned int block_count)
+{
+    AP4_SHA256_ARM_DECLARE(a);
+
+    AP4_SHA256_ARM_LOAD_STATE(a, state);
+    for (; block_count; --block_count, block += AP4_SHA256_BLOCK_SIZE) {
+        AP4_SHA256_ARM_LOAD_BLOCK(a, block);
+        AP4_SHA256_ARM_BLOCK(AP4_SHA256_ARM_ROUNDS_1, AP4_SHA256_ARM_SCHEDULE_1);
+        AP4_SHA256_ARM_FEEDBACK(a);
+    }
+    AP4_SHA256_ARM_STORE_STATE(a, state);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Sha256_CompressLanesArm
++---------------------------------------------------------------------*/
+AP4_SHA256_ARM_SHA_TARGET static void
+AP4_Sha256_CompressLanesArm(AP4_UI32* states, const AP4_UI08* const* blocks)
+{
+    AP4_SHA256_ARM_DECLARE(a);
+    AP4_SHA256_ARM_DECLARE(b);
+
+    AP4_SHA256_ARM_LOAD_STATE(a, states);
+    AP4_SHA256_ARM_LOAD_STATE(b, states+8);
+    AP4_SHA256_ARM_LOAD_BLOCK(a, blocks[0]);
+    AP4_SHA256_ARM_LOAD_BLOCK(b, blocks[1]);
+    AP4_SHA256_ARM_BLOCK(AP4_SHA256_ARM_ROUNDS_2, AP4_SHA256_ARM_SCHEDULE_2);
+    AP4_SHA256_ARM_FEEDBACK(a);
+    AP4_SHA256_ARM_FEEDBACK(b);
+    AP4_SHA256_ARM_STORE_STATE(a, states);
+    AP4_SHA256_ARM_STORE_STATE(b, states+8);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Sha256_CpuHasArmSha
++---------------------------------------------------------------------*/
+static bool
+AP4_Sha256_CpuHasArmSha()
+{
+#if defined(AP4_SHA256_ARM_SHA_RUNTIME_CHECK)
+    return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#else
+    return true;
+#endif
+}
+#endif // AP4_SHA256_HAVE_ARM_SHA
+
+#if defined(AP4_SHA256_HAVE_SSE2_LANES) || defined(AP4_SHA256_HAVE_NEON_LANES)
+/*----------------------------------------------------------------------
+|   vector lanes
+|
+|   The C code, with each 32-bit word replaced by a vector of 4 words,
+|   one per message.
++---------------------------------------------------------------------*/
+#define AP4_SHA256_HAVE_VECTOR_LANES
+#if defined(AP4_SHA256_HAVE_SSE2_LANES)
+typedef __m128i AP4_Sha256Vector;
+#define AP4_Sha256V_Load(p)     _mm_loadu_si128((const __m128i*)(p))
+#define AP4_Sha256V_Store(p, v) _mm_storeu_si128((__m128i*)(p), (v))
+#define AP4_Sha256V_Set(x)      _mm_set1_epi32((int)(x))
+#define AP4_Sha256V_Add(a, b)   _mm_add_epi32((a), (b))
+#define AP4_Sha256V_And(a, b)   _mm_and_si128((a), (b))
+#define AP4_Sha256V_Or(a, b)    _mm_or_si128((a), (b))
+#define AP4_Sha256V_Xor(a, b)   _mm_xor_si128((a), (b))
+#define AP4_Sha256V_Shr(a, n)   _mm_srli_epi32((a), (n))
+#define AP4_Sha256V_Shl(a, n)   _mm_slli_epi32((a), (n))
+#else
+typedef uint32x4_t AP4_Sha256Vector;
+#define AP4_Sha256V_Load(p)     vld1q_u32(p)
+#define AP4_Sha256V_Store(p, v) vst1q_u32((p), (v))
+#define AP4_Sha256V_Set(x)      vdupq_n_u32(x)
+#define AP4_Sha256V_Add(a, b)   vaddq_u32((a), (b))
+#define AP4_Sha256V_And(a, b)   vandq_u32((a), (b))
+#define AP4_Sha256V_Or(a, b)    vorrq_u32((a), (b))
+#define AP4_Sha256V_Xor(a, b)   veorq_u32((a), (b))
+#define AP4_Sha256V_Shr(a, n)   vshrq_n_u32((a), (n))
+#define AP4_Sha256V_Shl(a, n)   vshlq_n_u32((a), (n))
+#endif
+#define AP4_Sha256V_S(x, n)      AP4_Sha256V_Or(AP4_Sha256V_Shr(x, n), AP4_Sha256V_Shl(x, 32-(n)))
+#define AP4_Sha256V_Xor3(a, b, c) AP4_Sha256V_Xor(AP4_Sha256V_Xor(a, b), c)
+#define AP4_Sha256V_Ch(x,y,z)    AP4_Sha256V_Xor(z, AP4_Sha256V_And(x, AP4_Sha256V_Xor(y, z)))
+#define AP4_Sha256V_Maj(x,y,z)   AP4_Sha256V_Or(AP4_Sha256V_And(AP4_Sha256V_Or(x, y), z), AP4_Sha256V_And(x, y))
+#define AP4_Sha256V_Sigma0(x)    AP4_Sha256V_Xor3(AP4_Sha256V_S(x,  2), AP4_Sha256V_S(x, 13), AP4_Sha256V_S(x, 22))
+#define AP4_Sha256V_Sigma1(x)    AP4_Sha256V_Xor3(AP4_Sha256V_S(x,  6), AP4_Sha256V_S(x, 11), AP4_Sha256V_S(x, 25))
+#define AP4_Sha256V_Gamma0(x)    AP4_Sha256V_Xor3(AP4_Sha256V_S(x,  7), AP4_Sha256V_S(x, 18), AP4_Sha256V_Shr(x,  3))
+#define AP4_Sha256V_Gamma1(x)    AP4_Sha256V_Xor3(AP4_Sha256V_S(x, 17), AP4_Sha256V_S(x, 19), AP4_Sha256V_Shr(x, 10))
+
+/*----------------------------------------------------------------------
+|   AP4_Sha256_CompressLanesVector
++---------------------------------------------------------------------*/
+static void
+AP4_Sha256_CompressLanesVector(AP4_UI32* states, const AP4_UI08* const* blocks)
+{
+    AP4_Sha256Vector S[8], W[64];
+    AP4_UI32         words[4];
+
+    /* transpose the states into S */
+    for (unsigned int i = 0; i < 8; i++) {
+        for (unsigned int lane = 0; lane < 4; lane++) {
+            words[lane] = states[8*lane+i];
+        }
+        S[i] = AP4_Sha256V_Load(words);
+    }
+
+    /* transpose the blocks into W[0..15] */
+    for (unsigned int i = 0; i < 16; i++) {
+        for (unsigned int lane = 0; lane < 4; lane++) {
+            words[lane] = AP4_BytesToUInt32BE(&blocks[lane][4*i]);
+        }
+        W[i] = AP4_Sha256V_Load(words);
+    }
+
+    /* fill W[16..63] */
+    for (unsigned int i = 16; i < AP4_SHA256_BLOCK_SIZE; i++) {
+        W[i] = AP4_Sha256V_Add(AP4_Sha256V_Add(AP4_Sha256V_Gamma1(W[i-2]), W[i-7]),
+                               AP4_Sha256V_Add(AP4_Sha256V_Gamma0(W[i-15]), W[i-16]));
+    }
+
+    /* compress */
+    AP4_Sha256Vector a = S[0], b = S[1], c = S[2], d = S[3];
+    AP4_Sha256Vector e = S[4], f = S[5], g = S[6], h = S[7];
+    for (unsigned int i = 0; i < AP4_SHA256_BLOCK_SIZE; i++) {
+        AP4_Sha256Vector t0 = AP4_Sha256V_Add(AP4_Sha256V_Add(h, AP4_Sha256V_Sigma1(e)),
+                                              AP4_Sha256V_Add(AP4_Sha256V_Ch(e, f, g),
+                                                              AP4_Sha256V_Add(AP4_Sha256V_Set(AP4_Sha256_K[i]), W[i])));
+        AP4_Sha256Vector t1 = AP4_Sha256V_Add(AP4_Sha256V_Sigma0(a), AP4_Sha256V_Maj(a, b, c));
+        h = g; g = f; f = e;
+        e = AP4_Sha256V_Add(d, t0);
+        d = c; c = b; b = a;
+        a = AP4_Sha256V_Add(t0, t1);
+    }
+    S[0] = AP4_Sha256V_Add(S[0], a); S[1] = AP4_Sha256V_Add(S[1], b);
+    S[2] = AP4_Sha256V_Add(S[2], c); S[3] = AP4_Sha256V_Add(S[3], d);
+    S[4] = AP4_Sha256V_Add(S[4], e); S[5] = AP4_Sha256V_Add(S[5], f);
+    S[6] = AP4_Sha256V_Add(S[6], g); S[7] = AP4_Sha256V_Add(S[7], h);
+
+    /* transpose S back into the states */
+    for (unsigned int i = 0; i < 8; i++) {
+        AP4_Sha256V_Store(words, S[i]);
+        for (unsigned int lane = 0; lane < 4; lane++) {
+            states[8*lane+i] = words[lane];
+        }
+    }
+}
+#endif // AP4_SHA256_HAVE_SSE2_LANES || AP4_SHA256_HAVE_NEON_LANES
+
+/*----------------------------------------------------------------------
+|   implementations
++---------------------------------------------------------------------*/
+#if defined(AP4_SHA256_HAVE_X86_SHA)
+static const AP4_Sha256Implementation AP4_Sha256_X86Implementation = {
+    AP4_Sha256_CompressBlocksX86, AP4_Sha256_CompressLanesX86, 2
+};
+#endif
+#if defined(AP4_SHA256_HAVE_ARM_SHA)
+static const AP4_Sha256Implementation AP4_Sha256_ArmImplementation = {
+    AP4_Sha256_CompressBlocksArm, AP4_Sha256_CompressLanesArm, 2
+};
+#endif
+#if defined(AP4_SHA256_HAVE_VECTOR_LANES)
+static const AP4_Sha256Implementation AP4_Sha256_LanesImplementation = {
+    AP4_Sha256_CompressBlocks, AP4_Sha256_CompressLanesVector, 4
+};
+#endif
+static const AP4_Sha256Implementation AP4_Sha256_ScalarImplementation = {
+    AP4_Sha256_CompressBlocks, NULL, 1
+};
+
+/*----------------------------------------------------------------------
+|   AP4_Sha256_SelectImplementation
++---------------------------------------------------------------------*/
+static const AP4_Sha256Implementation*
+AP4_Sha256_SelectImplementation()
+{
+#if defined(AP4_SHA256_HAVE_X86_SHA)
+    if (AP4_Sha256_CpuHasX86Sha()) return &AP4_Sha256_X86Implementation;
+#endif
+#if defined(AP4_SHA256_HAVE_ARM_SHA)
+    if (AP4_Sha256_CpuHasArmSha()) return &AP4_Sha256_ArmImplementation;
+#endif
+#if defined(AP4_SHA256_HAVE_VECTOR_LANES)
+    return &AP4_Sha256_LanesImplementation;
+#else
+    return &AP4_Sha256_ScalarImplementation;
+#endif
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Sha256_ForcedImplementation
+|
+|   set by AP4_Digest::SetSha256Implementation, NULL for automatic
++---------------------------------------------------------------------*/
+static const AP4_Sha256Implementation* AP4_Sha256_ForcedImplementation = NULL;
+
+/*----------------------------------------------------------------------
+|   AP4_Sha256_GetImplementation
++---------------------------------------------------------------------*/
+static const AP4_Sha256Implementation*
+AP4_Sha256_GetImplementation()
+{
+    static const AP4_Sha256Implementation* implementation = AP4_Sha256_SelectImplementation();
+    if (AP4_Sha256_ForcedImplementation) return AP4_Sha256_ForcedImplementation;
+    return implementation;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Sha256Job
++---------------------------------------------------------------------*/
+struct AP4_Sha256Job {
+    // methods
+    void Start(const AP4_UI08* data,
+               AP4_Size        data_size,
+               AP4_UI64        prefix_size,
+               AP4_UI08*       digest);
+    const AP4_UI08* GetBlock() const {
+        return m_NextBlock < m_BlockCount ?
+               m_Data+m_NextBlock*AP4_SHA256_BLOCK_SIZE :
+               m_Tail+(m_NextBlock-m_BlockCount)*AP4_SHA256_BLOCK_SIZE;
+    }
+    bool IsDone() const { return m_NextBlock == m_BlockCount+m_TailBlockCount; }
+    void Finish(AP4_Sha256CompressBlocksFunction compress_blocks, AP4_UI32* state);
+    void Output(const AP4_UI32* state);
+
+    // members
+    const AP4_UI08* m_Data;
+    unsigned int    m_BlockCount;
+    unsigned int    m_TailBlockCount;
+    unsigned int    m_NextBlock;
+    AP4_UI08*       m_Digest;
+    AP4_UI08        m_Tail[2*AP4_SHA256_BLOCK_SIZE]; // last partial block + padding
+};
+
+/*----------------------------------------------------------------------
+|   AP4_Sha256Job::Start
++---------------------------------------------------------------------*/
+void
+AP4_Sha256Job::Start(const AP4_UI08* data,
+                     AP4_Size        data_size,
+                     AP4_UI64        prefix_size,
+                     AP4_UI08*       digest)
+{
+    m_Data       = data;
+    m_BlockCount = data_size/AP4_SHA256_BLOCK_SIZE;
+    m_NextBlock  = 0;
+    m_Digest     = digest;
+
+    /* the padding is the '1' bit, zeros, and the length in bits */
+    unsigned int tail_size = data_size%AP4_SHA256_BLOCK_SIZE;
+    m_TailBlockCount = tail_size < 56 ? 1 : 2;
+    if (tail_size) {
+        AP4_CopyMemory(m_Tail, data+m_BlockCount*AP4_SHA256_BLOCK_SIZE, tail_size);
+    }
+    m_Tail[tail_size] = 0x80;
+    AP4_SetMemory(&m_Tail[tail_size+1], 0, m_TailBlockCount*AP4_SHA256_BLOCK_SIZE-tail_size-1-8);
+    AP4_BytesFromUInt64BE(&m_Tail[m_TailBlockCount*AP4_SHA256_BLOCK_SIZE-8], (prefix_size+data_size)*8);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Sha256Job::Finish
++---------------------------------------------------------------------*/
+void
+AP4_Sha256Job::Finish(AP4_Sha256CompressBlocksFunction compress_blocks, AP4_UI32* state)
+{
+    if (m_NextBlock < m_BlockCount) {
+        compress_blocks(state, m_Data+m_NextBlock*AP4_SHA256_BLOCK_SIZE, m_BlockCount-m_NextBlock);
+        m_NextBlock = m_BlockCount;
+    }
+    compress_blocks(state,
+                    m_Tail+(m_NextBlock-m_BlockCount)*AP4_SHA256_BLOCK_SIZE,
+                    m_BlockCount+m_TailBlockCount-m_NextBlock);
+    m_NextBlock = m_BlockCount+m_TailBlockCount;
+    Output(state);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Sha256Job::Output
++---------------------------------------------------------------------*/
+void
+AP4_Sha256Job::Output(const AP4_UI32* state)
+{
 	for (unsigned int i = 0; i < 8; i++) {
-		m_State[i] = m_State[i] + S[i];
-	}
+		AP4_BytesFromUInt32BE(&m_Digest[4*i], state[i]);
+    }
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Sha256_ComputeMultiple
+|
+|   hash each message, starting from initial_state, which is the state
+|   after hashing prefix_size bytes (a multiple of the block size)
++---------------------------------------------------------------------*/
+static void
+AP4_Sha256_ComputeMultiple(const AP4_UI32*        initial_state,
+                           AP4_UI64               prefix_size,
+                           const AP4_UI08* const* messages,
+                           const AP4_Size*        message_sizes,
+                           unsigned int           message_count,
+                           AP4_UI08* const*       digests)
+{
+    const AP4_Sha256Implementation* implementation = AP4_Sha256_GetImplementation();
+    AP4_Sha256Job   jobs[AP4_SHA256_MAX_LANES];
+    AP4_UI32        states[AP4_SHA256_MAX_LANES*8];
+    const AP4_UI08* blocks[AP4_SHA256_MAX_LANES];
+    bool            busy[AP4_SHA256_MAX_LANES];
+    unsigned int    lane_count = implementation->LaneCount;
+    unsigned int    next_message = 0;
+    unsigned int    active_count = 0;
+
+    /* without lanes, hash the messages one by one */
+    if (lane_count == 1) {
+        for (unsigned int i = 0; i < message_count; i++) {
+            AP4_CopyMemory(states, initial_state, 8*sizeof(AP4_UI32));
+            jobs[0].Start(messages[i], message_sizes[i], prefix_size, digests[i]);
+            jobs[0].Finish(implementation->CompressBlocks, states);
+        }
+        return;
+    }
+
+    AP4_SetMemory(states, 0, sizeof(states));
+    for (unsigned int lane = 0; lane < lane_count; lane++) {
+        busy[lane] = false;
+    }
+    for (;;) {
+        /* give a message to each idle lane */
+        for (unsigned int lane = 0; lane < lane_count && next_message < message_count; lane++) {
+            if (busy[lane]) continue;
+            AP4_CopyMemory(&states[8*lane], initial_state, 8*sizeof(AP4_UI32));
+            jobs[lane].Start(messages[next_message],
+                             message_sizes[next_message],
+                             prefix_size,
+                             digests[next_message]);
+            busy[lane] = true;
+            ++active_count;
+            ++next_message;
+        }
+        if (active_count == 0) break;
+
+        /* finish the last message on its own */
+        if (active_count == 1 && next_message == message_count) {
+            for (unsigned int lane = 0; lane < lane_count; lane++) {
+                if (busy[lane]) jobs[lane].Finish(implementation->CompressBlocks, &states[8*lane]);
+            }
+            break;
+        }
+
+        /* compress one block of each message, idle lanes hash a dummy block */
+        for (unsigned int lane = 0; lane < lane_count; lane++) {
+            blocks[lane] = busy[lane] ? jobs[lane].GetBlock() : AP4_Sha256_ZeroBlock;
+        }
+        implementation->CompressLanes(states, blocks);
+        for (unsigned int lane = 0; lane < lane_count; lane++) {
+            if (!busy[lane]) continue;
+            ++jobs[lane].m_NextBlock;
+            if (jobs[lane].IsDone()) {
+                jobs[lane].Output(&states[8*lane]);
+                busy[lane] = false;
+                --active_count;
+            }
+        }
+    }
 }
 
+/*----------------------------------------------------------------------
+|   AP4_DigestSha256::AP4_DigestSha256
++---------------------------------------------------------------------*/
+AP4_DigestSha256::AP4_DigestSha256() :
+    m_CompressBlocks(AP4_Sha256_GetImplementation()->CompressBlocks),
+    m_Length(0),
+    m_Pending(0)
+{
+    AP4_CopyMemory(m_State, AP4_Sha256_H, sizeof(m_State));
+    AP4_SetMemory(m_Buffer, 0, sizeof(m_Buffer));
+}
 
 /*----------------------------------------------------------------------
 |   AP4_DigestSha256::Update
@@ -190,10 +856,11 @@ AP4_DigestSha256::Update(const AP4_UI08* data, AP4_Size data_size)
 {
 	while (data_size > 0) {
 		if (m_Pending == 0 && data_size >= AP4_SHA256_BLOCK_SIZE) {
-			CompressBlock(data);
-			m_Length  += AP4_SHA256_BLOCK_SIZE * 8;
-			data      += AP4_SHA256_BLOCK_SIZE;
-			data_size -= AP4_SHA256_BLOCK_SIZE;
+            unsigned int block_count = data_size/AP4_SHA256_BLOCK_SIZE;
+			m_CompressBlocks(m_State, data, block_count);
+			m_Length  += (AP4_UI64)block_count * AP4_SHA256_BLOCK_SIZE * 8;
+			data      += block_count * AP4_SHA256_BLOCK_SIZE;
+			data_size -= block_count * AP4_SHA256_BLOCK_SIZE;
 		} else {
 			unsigned int chunk = data_size;
             if (chunk > (AP4_SHA256_BLOCK_SIZE - m_Pending)) {
@@ -204,13 +871,13 @@ AP4_DigestSha256::Update(const AP4_UI08* data, AP4_Size data_size)
 			data      += chunk;
 			data_size -= chunk;
 			if (m_Pending == AP4_SHA256_BLOCK_SIZE) {
-				CompressBlock(m_Buffer);
+				m_CompressBlocks(m_State, m_Buffer, 1);
 				m_Length += 8 * AP4_SHA256_BLOCK_SIZE;
 				m_Pending = 0;
 			}
 		}
 	}
-    
+
     return AP4_SUCCESS;
 }
 
@@ -235,7 +902,7 @@ AP4_DigestSha256::Final(AP4_DataBuffer& digest)
 		while (m_Pending < 64) {
 			m_Buffer[m_Pending++] = 0;
 		}
-		CompressBlock(m_Buffer);
+		m_CompressBlocks(m_State, m_Buffer, 1);
 		m_Pending = 0;
 	}
 
@@ -246,16 +913,16 @@ AP4_DigestSha256::Final(AP4_DataBuffer& digest)
 
 	/* store length */
 	AP4_BytesFromUInt64BE(&m_Buffer[56], m_Length);
-	CompressBlock(m_Buffer);
+	m_CompressBlocks(m_State, m_Buffer, 1);
 
 	/* copy output */
-    digest.SetDataSize(32);
+    digest.SetDataSize(AP4_SHA256_DIGEST_SIZE);
     AP4_UI08* out = digest.UseData();
 	for (unsigned int i = 0; i < 8; i++) {
 		AP4_BytesFromUInt32BE(out, m_State[i]);
         out += 4;
     }
-    
+
 	return AP4_SUCCESS;
 }
 
@@ -264,39 +931,45 @@ AP4_DigestSha256::Final(AP4_DataBuffer& digest)
 +---------------------------------------------------------------------*/
 AP4_HmacSha256::AP4_HmacSha256(const AP4_UI08* key, AP4_Size key_size)
 {
-	AP4_UI08 workspace[AP4_SHA256_BLOCK_SIZE];
-    
+	AP4_UI08 inner_block[AP4_SHA256_BLOCK_SIZE];
+	AP4_UI08 outer_block[AP4_SHA256_BLOCK_SIZE];
+    MakePadBlocks(key, key_size, inner_block, outer_block);
+
+	/* start the inner digest with (key XOR ipad) */
+    m_InnerDigest.Update(inner_block, AP4_SHA256_BLOCK_SIZE);
+
+	/* start the outer digest with (key XOR opad) */
+    m_OuterDigest.Update(outer_block, AP4_SHA256_BLOCK_SIZE);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_HmacSha256::MakePadBlocks
++---------------------------------------------------------------------*/
+void
+AP4_HmacSha256::MakePadBlocks(const AP4_UI08* key,
+                              AP4_Size        key_size,
+                              AP4_UI08*       inner_block,
+                              AP4_UI08*       outer_block)
+{
     /* if the key is larger than the block size, use a digest of the key */
+    AP4_DataBuffer hk;
     if (key_size > AP4_SHA256_BLOCK_SIZE) {
         AP4_DigestSha256 kdigest;
         kdigest.Update(key, key_size);
-        AP4_DataBuffer hk;
         kdigest.Final(hk);
         key = hk.GetData();
         key_size = hk.GetDataSize();
     }
 
-    /* compute key XOR ipad */
+    /* compute key XOR ipad and key XOR opad */
     for (unsigned int i = 0; i < key_size; i++) {
-		workspace[i] = key[i] ^ 0x36;
+		inner_block[i] = key[i] ^ 0x36;
+		outer_block[i] = key[i] ^ 0x5c;
     }
     for (unsigned int i = key_size; i < AP4_SHA256_BLOCK_SIZE; i++) {
-		workspace[i] = 0x36;
+		inner_block[i] = 0x36;
+		outer_block[i] = 0x5c;
     }
-    
-	/* start the inner digest with (key XOR ipad) */
-    m_InnerDigest.Update(workspace, AP4_SHA256_BLOCK_SIZE);
-
-    /* compute key XOR opad */
-    for (unsigned int i = 0; i < key_size; i++) {
-		workspace[i] = key[i] ^ 0x5c;
-    }
-    for (unsigned int i = key_size; i < AP4_SHA256_BLOCK_SIZE; i++) {
-		workspace[i] = 0x5c;
-    }
-    
-	/* start the outer digest with (key XOR opad) */
-    m_OuterDigest.Update(workspace, AP4_SHA256_BLOCK_SIZE);
 }
 
 /*----------------------------------------------------------------------
@@ -309,16 +982,102 @@ AP4_HmacSha256::Final(AP4_DataBuffer& mac)
     AP4_DataBuffer inner;
     m_InnerDigest.Final(inner);
     m_OuterDigest.Update(inner.GetData(), inner.GetDataSize());
-    
+
     /* return the value of the outer digest */
     return m_OuterDigest.Final(mac);
 }
 
+/*----------------------------------------------------------------------
+|   AP4_Digest::Create
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Digest::Create(Algorithm algorithm, AP4_Digest*& digest)
+{
+    switch (algorithm) {
+        case SHA256: digest = new AP4_DigestSha256(); return AP4_SUCCESS;
+        default: digest = NULL; return AP4_ERROR_NOT_SUPPORTED;
+    }
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Digest::SetSha256Implementation
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Digest::SetSha256Implementation(Sha256Implementation implementation)
+{
+    const AP4_Sha256Implementation* forced = NULL;
+    switch (implementation) {
+        case SHA256_IMPLEMENTATION_AUTO:
+            break;
+
+        case SHA256_IMPLEMENTATION_SCALAR:
+            forced = &AP4_Sha256_ScalarImplementation;
+            break;
+
+        case SHA256_IMPLEMENTATION_LANES:
+#if defined(AP4_SHA256_HAVE_VECTOR_LANES)
+            forced = &AP4_Sha256_LanesImplementation;
+            break;
+#else
+            return AP4_ERROR_NOT_SUPPORTED;
+#endif
+
+        case SHA256_IMPLEMENTATION_EXTENSIONS:
+#if defined(AP4_SHA256_HAVE_X86_SHA)
+            if (AP4_Sha256_CpuHasX86Sha()) {
+                forced = &AP4_Sha256_X86Implementation;
+                break;
+            }
+#endif
+#if defined(AP4_SHA256_HAVE_ARM_SHA)
+            if (AP4_Sha256_CpuHasArmSha()) {
+                forced = &AP4_Sha256_ArmImplementation;
+                break;
+            }
+#endif
+            return AP4_ERROR_NOT_SUPPORTED;
+
+        default:
+            return AP4_ERROR_INVALID_PARAMETERS;
+    }
+    AP4_Sha256_ForcedImplementation = forced;
+
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Digest::ComputeMultiple
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Digest::ComputeMultiple(Algorithm              algorithm,
+                            const AP4_UI08* const* messages,
+                            const AP4_Size*        message_sizes,
+                            unsigned int           message_count,
+                            AP4_DataBuffer*        digests)
+{
+    if (algorithm != SHA256) return AP4_ERROR_NOT_SUPPORTED;
+    if (message_count == 0) return AP4_SUCCESS;
+
+    AP4_UI08** outputs = new AP4_UI08*[message_count];
+    for (unsigned int i = 0; i < message_count; i++) {
+        AP4_Result result = digests[i].SetDataSize(AP4_SHA256_DIGEST_SIZE);
+        if (AP4_FAILED(result)) {
+            delete[] outputs;
+            return result;
+        }
+        outputs[i] = digests[i].UseData();
+    }
+    AP4_Sha256_ComputeMultiple(AP4_Sha256_H, 0, messages, message_sizes, message_count, outputs);
+    delete[] outputs;
+
+    return AP4_SUCCESS;
+}
+
 /*----------------------------------------------------------------------
 |   AP4_Hmac::Create
 +---------------------------------------------------------------------*/
 AP4_Result
-AP4_Hmac::Create(Algorithm       algorithm, 
+AP4_Hmac::Create(Algorithm       algorithm,
                  const AP4_UI08* key,
                  AP4_Size        key_size,
                  AP4_Hmac*&      hmac)
@@ -329,3 +1088,54 @@ AP4_Hmac::Create(Algorithm       algorithm,
     }
 }
 
+/*----------------------------------------------------------------------
+|   AP4_Hmac::ComputeMultiple
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Hmac::ComputeMultiple(Algorithm              algorithm,
+                          const AP4_UI08*        key,
+                          AP4_Size               key_size,
+                          const AP4_UI08* const* messages,
+                          const AP4_Size*        message_sizes,
+                          unsigned int           message_count,
+                          AP4_DataBuffer*        macs)
+{
+    if (algorithm != SHA256) return AP4_ERROR_NOT_SUPPORTED;
+    if (message_count == 0) return AP4_SUCCESS;
+
+    /* the states after the (key XOR ipad) and (key XOR opad) blocks are
+       the same for all messages */
+    const AP4_Sha256Implementation* implementation = AP4_Sha256_GetImplementation();
+	AP4_UI08 inner_block[AP4_SHA256_BLOCK_SIZE];
+	AP4_UI08 outer_block[AP4_SHA256_BLOCK_SIZE];
+    AP4_UI32 inner_state[8];
+    AP4_UI32 outer_state[8];
+    AP4_HmacSha256::MakePadBlocks(key, key_size, inner_block, outer_block);
+    AP4_CopyMemory(inner_state, AP4_Sha256_H, sizeof(inner_state));
+    AP4_CopyMemory(outer_state, AP4_Sha256_H, sizeof(outer_state));
+    implementation->CompressBlocks(inner_state, inner_block, 1);
+    implementation->CompressBlocks(outer_state, outer_block, 1);
+
+    /* compute all the inner digests, then all the outer digests */
+    AP4_Result result      = AP4_SUCCESS;
+    AP4_UI08*  inner       = new AP4_UI08[message_count*AP4_SHA256_DIGEST_SIZE];
+    AP4_UI08** inners      = new AP4_UI08*[message_count];
+    AP4_Size*  inner_sizes = new AP4_Size[message_count];
+    AP4_UI08** outputs     = new AP4_UI08*[message_count];
+    for (unsigned int i = 0; i < message_count; i++) {
+        result = macs[i].SetDataSize(AP4_SHA256_DIGEST_SIZE);
+        if (AP4_FAILED(result)) goto end;
+        outputs[i]     = macs[i].UseData();
+        inners[i]      = &inner[i*AP4_SHA256_DIGEST_SIZE];
+        inner_sizes[i] = AP4_SHA256_DIGEST_SIZE;
+    }
+    AP4_Sha256_ComputeMultiple(inner_state, AP4_SHA256_BLOCK_SIZE, messages, message_sizes, message_count, inners);
+    AP4_Sha256_ComputeMultiple(outer_state, AP4_SHA256_BLOCK_SIZE, inners, inner_sizes, message_count, outputs);
+
+end:
+    delete[] inner;
+    delete[] inners;
+    delete[] inner_sizes;
+    delete[] outputs;
+    return result;
+}
@@ -36,6 +36,55 @@
 #include "Ap4Types.h"
 #include "Ap4DataBuffer.h"
 
+/*----------------------------------------------------------------------
+|   AP4_Digest
++---------------------------------------------------------------------*/
+class AP4_Digest
+{
+public:
+    // types
+    typedef enum {
+        SHA256
+    } Algorithm;
+    typedef enum {
+        SHA256_IMPLEMENTATION_AUTO,       // best one for this CPU (default)
+        SHA256_IMPLEMENTATION_SCALAR,     // portable C, one message at a time
+        SHA256_IMPLEMENTATION_LANES,      // portable C, SSE2/NEON lanes
+        SHA256_IMPLEMENTATION_EXTENSIONS  // x86 SHA or ARMv8 SHA2 instructions
+    } Sha256Implementation;
+
+    // class methods
+    static AP4_Result Create(Algorithm algorithm, AP4_Digest*& digest);
+
+    /**
+     * Force the SHA-256 implementation used by the digests, MACs and
+     * ComputeMultiple calls that start after this call. This is meant
+     * for tests: it is not thread safe and must not be called while
+     * other threads are hashing.
+     * Returns AP4_ERROR_NOT_SUPPORTED, and leaves the current selection
+     * unchanged, if the implementation is not available in this build
+     * or on this CPU.
+     */
+    static AP4_Result SetSha256Implementation(Sha256Implementation implementation);
+    
+    /**
+     * Compute the digests of message_count independent messages.
+     * digests must point to an array of message_count buffers.
+     * When the CPU allows it, several messages are hashed in parallel,
+     * which is much faster than hashing small messages one at a time.
+     */
+    static AP4_Result ComputeMultiple(Algorithm              algorithm,
+                                      const AP4_UI08* const* messages,
+                                      const AP4_Size*        message_sizes,
+                                      unsigned int           message_count,
+                                      AP4_DataBuffer*        digests);
+    
+    // methods
+    virtual ~AP4_Digest() {}
+    virtual AP4_Result Update(const AP4_UI08* data, AP4_Size data_size) = 0;
+    virtual AP4_Result Final(AP4_DataBuffer& digest) = 0;
+};
+
 /*----------------------------------------------------------------------
 |   AP4_Hmac
 +---------------------------------------------------------------------*/
@@ -53,6 +102,20 @@ public:
                              AP4_Size        key_size,
                              AP4_Hmac*&      hmac);
     
+    /**
+     * Compute the MACs of message_count independent messages, all with
+     * the same key. macs must point to an array of message_count buffers.
+     * Like AP4_Digest::ComputeMultiple, the messages are hashed in
+     * parallel when the CPU allows it.
+     */
+    static AP4_Result ComputeMultiple(Algorithm              algorithm,
+                                      const AP4_UI08*        key,
+                                      AP4_Size               key_size,
+                                      const AP4_UI08* const* messages,
+                                      const AP4_Size*        message_sizes,
+                                      unsigned int           message_count,
+                                      AP4_DataBuffer*        macs);
+    
     // methods
     virtual ~AP4_Hmac() {}
     virtual AP4_Result Update(const AP4_UI08* data, AP4_Size data_size) = 0;
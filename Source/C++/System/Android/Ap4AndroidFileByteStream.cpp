@@ -37,6 +37,7 @@
 #include <fcntl.h>
 
 #include "Ap4FileByteStream.h"
+#include "Ap4Instrumentation.h"
 
 /*----------------------------------------------------------------------
 |   AP4_AndroidFileByteStream
@@ -204,7 +205,9 @@ AP4_AndroidFileByteStream::ReadPartial(void*     buffer,
                                        AP4_Size  bytes_to_read,
                                        AP4_Size& bytes_read)
 {
+    AP4_InstrumentationScope scope(AP4_Instrumentation::STAGE_STREAM_READ);
     ssize_t nb_read = read(m_FD, buffer, bytes_to_read);
+    if (nb_read > 0) scope.SetByteCount(nb_read);
 
     if (nb_read > 0) {
         bytes_read = (AP4_Size)nb_read;
@@ -231,7 +234,9 @@ AP4_AndroidFileByteStream::WritePartial(const void* buffer,
         bytes_written = 0;
         return AP4_SUCCESS;
     }
+    AP4_InstrumentationScope scope(AP4_Instrumentation::STAGE_STREAM_WRITE);
     ssize_t nb_written = write(m_FD, buffer, bytes_to_write);
+    if (nb_written > 0) scope.SetByteCount(nb_written);
     
     if (nb_written > 0) {
         bytes_written = (AP4_Size)nb_written;
@@ -0,0 +1,159 @@
+/*****************************************************************
+|
+|    AP4 - Posix Threads implementation
+|
+|    Copyright 2002-2016 Axiomatic Systems, LLC
+|
+|
+|    This file is part of Bento4/AP4 (MP4 Atom Processing Library).
+|
+|    Unless you have obtained Bento4 under a difference license,
+|    this version of Bento4 is Bento4|GPL.
+|    Bento4|GPL is free software; you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation; either version 2, or (at your option)
+|    any later version.
+|
+|    Bento4|GPL is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with Bento4|GPL; see the file COPYING.  If not, write to the
+|    Free Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+|    02111-1307, USA.
+|
+****************************************************************/
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include <pthread.h>
+#include <time.h>
+
+#include "Ap4Threads.h"
+
+/*----------------------------------------------------------------------
+|   AP4_PosixThread_EntryPoint
++---------------------------------------------------------------------*/
+static void*
+AP4_PosixThread_EntryPoint(void* argument)
+{
+    AP4_Runnable* target = reinterpret_cast<AP4_Runnable*>(argument);
+    target->Run();
+    return NULL;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Thread::AP4_Thread
++---------------------------------------------------------------------*/
+AP4_Thread::AP4_Thread(AP4_Runnable& target) :
+    m_Target(target),
+    m_Handle(NULL)
+{
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Thread::~AP4_Thread
++---------------------------------------------------------------------*/
+AP4_Thread::~AP4_Thread()
+{
+    Wait();
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Thread::Start
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Thread::Start()
+{
+    if (m_Handle) return AP4_ERROR_INVALID_STATE;
+    pthread_t* thread = new pthread_t;
+    if (pthread_create(thread, NULL, AP4_PosixThread_EntryPoint, &m_Target)) {
+        delete thread;
+        return AP4_FAILURE;
+    }
+    m_Handle = thread;
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Thread::Wait
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Thread::Wait()
+{
+    if (m_Handle == NULL) return AP4_SUCCESS;
+    pthread_t* thread = reinterpret_cast<pthread_t*>(m_Handle);
+    int result = pthread_join(*thread, NULL);
+    delete thread;
+    m_Handle = NULL;
+    
+    return result == 0 ? AP4_SUCCESS : AP4_FAILURE;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mutex::AP4_Mutex
++---------------------------------------------------------------------*/
+AP4_Mutex::AP4_Mutex()
+{
+    pthread_mutex_t* mutex = new pthread_mutex_t;
+    pthread_mutex_init(mutex, NULL);
+    m_Handle = mutex;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mutex::~AP4_Mutex
++---------------------------------------------------------------------*/
+AP4_Mutex::~AP4_Mutex()
+{
+    pthread_mutex_t* mutex = reinterpret_cast<pthread_mutex_t*>(m_Handle);
+    pthread_mutex_destroy(mutex);
+    delete mutex;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mutex::Lock
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mutex::Lock()
+{
+    return pthread_mutex_lock(reinterpret_cast<pthread_mutex_t*>(m_Handle)) == 0 ? AP4_SUCCESS : AP4_FAILURE;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mutex::Unlock
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mutex::Unlock()
+{
+    return pthread_mutex_unlock(reinterpret_cast<pthread_mutex_t*>(m_Handle)) == 0 ? AP4_SUCCESS : AP4_FAILURE;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_System_GetWallClockTime
++---------------------------------------------------------------------*/
+AP4_UI64
+AP4_System_GetWallClockTime()
+{
+    struct timespec now;
+    if (clock_gettime(CLOCK_MONOTONIC, &now) != 0) return 0;
+    return (AP4_UI64)now.tv_sec*1000000+(AP4_UI64)(now.tv_nsec/1000);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_System_GetThreadCpuTime
++---------------------------------------------------------------------*/
+AP4_UI64
+AP4_System_GetThreadCpuTime()
+{
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) return 0;
+    return (AP4_UI64)now.tv_sec*1000000+(AP4_UI64)(now.tv_nsec/1000);
+#else
+    return (AP4_UI64)clock()*1000000/CLOCKS_PER_SEC;
+#endif
+}
@@ -41,6 +41,7 @@
 #endif
 
 #include "Ap4FileByteStream.h"
+#include "Ap4Instrumentation.h"
 
 /*----------------------------------------------------------------------
 |   compatibility wrappers
@@ -103,12 +104,23 @@ public:
     void Release();
 
 private:
+    // types
+    typedef enum {
+        OPERATION_NONE,
+        OPERATION_READ,
+        OPERATION_WRITE
+    } Operation;
+
+    // methods
+    AP4_Result SetOperation(Operation operation);
+
     // members
     AP4_ByteStream* m_Delegator;
     AP4_Cardinal    m_ReferenceCount;
     FILE*           m_File;
     AP4_Position    m_Position;
     AP4_LargeSize   m_Size;
+    Operation       m_LastOperation;
 };
 
 /*----------------------------------------------------------------------
@@ -186,7 +198,8 @@ AP4_StdcFileByteStream::AP4_StdcFileByteStream(AP4_FileByteStream* delegator,
     m_ReferenceCount(1),
     m_File(file),
     m_Position(0),
-    m_Size(size)
+    m_Size(size),
+    m_LastOperation(OPERATION_NONE)
 {
 }
 
@@ -224,6 +237,21 @@ AP4_StdcFileByteStream::Release()
     }
 }
 
+/*----------------------------------------------------------------------
+|   AP4_StdcFileByteStream::SetOperation
+|
+|   stdio requires a seek between a read and a write on the same stream
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_StdcFileByteStream::SetOperation(Operation operation)
+{
+    if (m_LastOperation != operation && m_LastOperation != OPERATION_NONE) {
+        if (AP4_fseek(m_File, m_Position, SEEK_SET) != 0) return AP4_FAILURE;
+    }
+    m_LastOperation = operation;
+    return AP4_SUCCESS;
+}
+
 /*----------------------------------------------------------------------
 |   AP4_StdcFileByteStream::ReadPartial
 +---------------------------------------------------------------------*/
@@ -232,9 +260,16 @@ AP4_StdcFileByteStream::ReadPartial(void*     buffer,
                                     AP4_Size  bytesToRead, 
                                     AP4_Size& bytesRead)
 {
+    AP4_InstrumentationScope scope(AP4_Instrumentation::STAGE_STREAM_READ);
     size_t nbRead;
 
+    if (AP4_FAILED(SetOperation(OPERATION_READ))) {
+        bytesRead = 0;
+        return AP4_ERROR_READ_FAILED;
+    }
+
     nbRead = fread(buffer, 1, bytesToRead, m_File);
+    scope.SetByteCount(nbRead);
 
     if (nbRead > 0) {
         bytesRead = (AP4_Size)nbRead;
@@ -260,7 +295,13 @@ AP4_StdcFileByteStream::WritePartial(const void* buffer,
     size_t nbWritten;
 
     if (bytesToWrite == 0) return AP4_SUCCESS;
+    if (AP4_FAILED(SetOperation(OPERATION_WRITE))) {
+        bytesWritten = 0;
+        return AP4_ERROR_WRITE_FAILED;
+    }
+    AP4_InstrumentationScope scope(AP4_Instrumentation::STAGE_STREAM_WRITE);
     nbWritten = fwrite(buffer, 1, bytesToWrite, m_File);
+    scope.SetByteCount(nbWritten);
     
     if (nbWritten > 0) {
         bytesWritten = (AP4_Size)nbWritten;
@@ -284,7 +325,8 @@ AP4_StdcFileByteStream::Seek(AP4_Position position)
     size_t result;
     result = AP4_fseek(m_File, position, SEEK_SET);
     if (result == 0) {
-        m_Position = position;
+        m_Position      = position;
+        m_LastOperation = OPERATION_NONE;
         return AP4_SUCCESS;
     } else {
         return AP4_FAILURE;
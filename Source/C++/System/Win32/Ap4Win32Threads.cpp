@@ -0,0 +1,159 @@
+/*****************************************************************
+|
+|    AP4 - Win32 Threads implementation
+|
+|    Copyright 2002-2016 Axiomatic Systems, LLC
+|
+|
+|    This file is part of Bento4/AP4 (MP4 Atom Processing Library).
+|
+|    Unless you have obtained Bento4 under a difference license,
+|    this version of Bento4 is Bento4|GPL.
+|    Bento4|GPL is free software; you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation; either version 2, or (at your option)
+|    any later version.
+|
+|    Bento4|GPL is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with Bento4|GPL; see the file COPYING.  If not, write to the
+|    Free Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+|    02111-1307, USA.
+|
+****************************************************************/
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include <windows.h>
+
+#include "Ap4Threads.h"
+
+/*----------------------------------------------------------------------
+|   AP4_Win32Thread_EntryPoint
++---------------------------------------------------------------------*/
+static DWORD WINAPI
+AP4_Win32Thread_EntryPoint(LPVOID argument)
+{
+    AP4_Runnable* target = reinterpret_cast<AP4_Runnable*>(argument);
+    target->Run();
+    return 0;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Thread::AP4_Thread
++---------------------------------------------------------------------*/
+AP4_Thread::AP4_Thread(AP4_Runnable& target) :
+    m_Target(target),
+    m_Handle(NULL)
+{
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Thread::~AP4_Thread
++---------------------------------------------------------------------*/
+AP4_Thread::~AP4_Thread()
+{
+    Wait();
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Thread::Start
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Thread::Start()
+{
+    if (m_Handle) return AP4_ERROR_INVALID_STATE;
+    HANDLE thread = CreateThread(NULL, 0, AP4_Win32Thread_EntryPoint, &m_Target, 0, NULL);
+    if (thread == NULL) return AP4_FAILURE;
+    m_Handle = thread;
+    
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Thread::Wait
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Thread::Wait()
+{
+    if (m_Handle == NULL) return AP4_SUCCESS;
+    DWORD result = WaitForSingleObject((HANDLE)m_Handle, INFINITE);
+    CloseHandle((HANDLE)m_Handle);
+    m_Handle = NULL;
+    
+    return result == WAIT_OBJECT_0 ? AP4_SUCCESS : AP4_FAILURE;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mutex::AP4_Mutex
++---------------------------------------------------------------------*/
+AP4_Mutex::AP4_Mutex()
+{
+    CRITICAL_SECTION* mutex = new CRITICAL_SECTION;
+    InitializeCriticalSection(mutex);
+    m_Handle = mutex;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mutex::~AP4_Mutex
++---------------------------------------------------------------------*/
+AP4_Mutex::~AP4_Mutex()
+{
+    CRITICAL_SECTION* mutex = reinterpret_cast<CRITICAL_SECTION*>(m_Handle);
+    DeleteCriticalSection(mutex);
+    delete mutex;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mutex::Lock
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mutex::Lock()
+{
+    EnterCriticalSection(reinterpret_cast<CRITICAL_SECTION*>(m_Handle));
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_Mutex::Unlock
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_Mutex::Unlock()
+{
+    LeaveCriticalSection(reinterpret_cast<CRITICAL_SECTION*>(m_Handle));
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_System_GetWallClockTime
++---------------------------------------------------------------------*/
+AP4_UI64
+AP4_System_GetWallClockTime()
+{
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER now;
+    if (!QueryPerformanceFrequency(&frequency) || frequency.QuadPart == 0) return 0;
+    QueryPerformanceCounter(&now);
+    return (AP4_UI64)(now.QuadPart/frequency.QuadPart)*1000000+
+           (AP4_UI64)((now.QuadPart%frequency.QuadPart)*1000000/frequency.QuadPart);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_System_GetThreadCpuTime
++---------------------------------------------------------------------*/
+AP4_UI64
+AP4_System_GetThreadCpuTime()
+{
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    if (!GetThreadTimes(GetCurrentThread(), &creation_time, &exit_time, &kernel_time, &user_time)) {
+        return 0;
+    }
+    AP4_UI64 kernel = ((AP4_UI64)kernel_time.dwHighDateTime<<32) | kernel_time.dwLowDateTime;
+    AP4_UI64 user   = ((AP4_UI64)user_time.dwHighDateTime<<32)   | user_time.dwLowDateTime;
+    return (kernel+user)/10; // FILETIME units are 100ns
+}
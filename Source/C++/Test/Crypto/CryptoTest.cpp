@@ -36,6 +36,7 @@
 #include "Ap4StreamCipher.h"
 #include "Ap4Hmac.h"
 #include "Ap4KeyWrap.h"
+#include "Ap4CommonEncryption.h"
 
 #define REPEAT_COUNT 10000
 
@@ -1584,6 +1585,127 @@ TestHmac()
     return 0;
 }
 
+/*----------------------------------------------------------------------
+|   TestDigestImplementation
++---------------------------------------------------------------------*/
+const unsigned int DIGEST_MESSAGE_COUNT = 150;
+
+static int
+TestDigestImplementation(AP4_DataBuffer* reference_digests, AP4_DataBuffer* reference_macs)
+{
+    // FIPS 180-2 vectors
+    const char* inputs[] = {
+        "",
+        "abc",
+        "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"
+    };
+    AP4_UI08 outputs[3][32] = {
+        {0xe3, 0xb0, 0xc4, 0x42, 0x98, 0xfc, 0x1c, 0x14, 0x9a, 0xfb, 0xf4, 0xc8, 0x99, 0x6f, 0xb9, 0x24,
+         0x27, 0xae, 0x41, 0xe4, 0x64, 0x9b, 0x93, 0x4c, 0xa4, 0x95, 0x99, 0x1b, 0x78, 0x52, 0xb8, 0x55},
+        {0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+         0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad},
+        {0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8, 0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+         0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67, 0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1}
+    };
+    for (unsigned int i=0; i<3; i++) {
+        AP4_Digest* digest = NULL;
+        AP4_Result result = AP4_Digest::Create(AP4_Digest::SHA256, digest);
+        CHECK(result == AP4_SUCCESS);
+        result = digest->Update((const AP4_UI08*)inputs[i], (AP4_Size)strlen(inputs[i]));
+        CHECK(result == AP4_SUCCESS);
+        AP4_DataBuffer value;
+        result = digest->Final(value);
+        CHECK(result == AP4_SUCCESS);
+        CHECK(value.GetDataSize() == 32);
+        CHECK(BuffersEqual(value.GetData(), outputs[i], 32));
+        delete digest;
+    }
+    
+    // messages of all sizes around the block boundaries, hashed together
+    // must give the same values as when hashed one by one, and as with
+    // the reference implementation. The counts are chosen so that the
+    // last lanes are only partially filled.
+    const unsigned int message_count = DIGEST_MESSAGE_COUNT;
+    AP4_UI08        data[message_count];
+    const AP4_UI08* messages[message_count];
+    AP4_Size        message_sizes[message_count];
+    for (unsigned int i=0; i<message_count; i++) {
+        data[i]          = (AP4_UI08)(i*7);
+        messages[i]      = data;
+        message_sizes[i] = i;
+    }
+    const unsigned int counts[] = {1, 2, 3, 5, 7, message_count};
+    for (unsigned int c=0; c<sizeof(counts)/sizeof(counts[0]); c++) {
+        unsigned int   count = counts[c];
+        AP4_DataBuffer digests[message_count];
+        AP4_Result result = AP4_Digest::ComputeMultiple(AP4_Digest::SHA256, messages, message_sizes, count, digests);
+        CHECK(result == AP4_SUCCESS);
+        AP4_DataBuffer macs[message_count];
+        result = AP4_Hmac::ComputeMultiple(AP4_Hmac::SHA256, data, 20, messages, message_sizes, count, macs);
+        CHECK(result == AP4_SUCCESS);
+        for (unsigned int i=0; i<count; i++) {
+            AP4_Digest* digest = NULL;
+            AP4_Digest::Create(AP4_Digest::SHA256, digest);
+            digest->Update(messages[i], message_sizes[i]);
+            AP4_DataBuffer value;
+            digest->Final(value);
+            CHECK(BuffersEqual(value.GetData(), digests[i].GetData(), 32));
+            delete digest;
+            
+            AP4_Hmac* hmac = NULL;
+            AP4_Hmac::Create(AP4_Hmac::SHA256, data, 20, hmac);
+            hmac->Update(messages[i], message_sizes[i]);
+            hmac->Final(value);
+            CHECK(BuffersEqual(value.GetData(), macs[i].GetData(), 32));
+            delete hmac;
+
+            if (count != message_count) continue;
+            if (reference_digests[i].GetDataSize() == 0) {
+                reference_digests[i].SetData(digests[i].GetData(), 32);
+                reference_macs[i].SetData(macs[i].GetData(), 32);
+            } else {
+                CHECK(BuffersEqual(reference_digests[i].GetData(), digests[i].GetData(), 32));
+                CHECK(BuffersEqual(reference_macs[i].GetData(), macs[i].GetData(), 32));
+            }
+        }
+    }
+    
+    return 0;
+}
+
+/*----------------------------------------------------------------------
+|   TestDigest
++---------------------------------------------------------------------*/
+static int
+TestDigest()
+{
+    // the scalar implementation goes first and is the reference for the others
+    struct {
+        AP4_Digest::Sha256Implementation implementation;
+        const char*                      name;
+    } implementations[] = {
+        {AP4_Digest::SHA256_IMPLEMENTATION_SCALAR,     "scalar"},
+        {AP4_Digest::SHA256_IMPLEMENTATION_LANES,      "lanes"},
+        {AP4_Digest::SHA256_IMPLEMENTATION_EXTENSIONS, "extensions"},
+        {AP4_Digest::SHA256_IMPLEMENTATION_AUTO,       "auto"}
+    };
+    AP4_DataBuffer reference_digests[DIGEST_MESSAGE_COUNT];
+    AP4_DataBuffer reference_macs[DIGEST_MESSAGE_COUNT];
+    int result = 0;
+    for (unsigned int i=0; i<sizeof(implementations)/sizeof(implementations[0]); i++) {
+        if (AP4_FAILED(AP4_Digest::SetSha256Implementation(implementations[i].implementation))) {
+            printf("SHA-256 %s: not available\n", implementations[i].name);
+            continue;
+        }
+        printf("SHA-256 %s\n", implementations[i].name);
+        result = TestDigestImplementation(reference_digests, reference_macs);
+        if (result) break;
+    }
+    AP4_Digest::SetSha256Implementation(AP4_Digest::SHA256_IMPLEMENTATION_AUTO);
+    
+    return result;
+}
+
 /*----------------------------------------------------------------------
 |   TestKeyWrap
 +---------------------------------------------------------------------*/
@@ -2304,6 +2426,135 @@ TestCbcStreamCipher()
     return 0;
 }
 
+/*----------------------------------------------------------------------
+|   TestCencSampleDecrypter
+|
+|   decrypting a run of samples with DecryptSamples must give the same
+|   result as decrypting them one by one
++---------------------------------------------------------------------*/
+static int
+TestCencSampleDecrypter(AP4_UI32 cipher_type,
+                        AP4_UI08 crypt_byte_block,
+                        AP4_UI08 skip_byte_block,
+                        AP4_UI08 iv_size,
+                        bool     use_subsamples)
+{
+    const unsigned int sample_count = 20;
+    AP4_UI08 key[16] = {0x2C, 0xD7, 0xFA, 0x67, 0x75, 0x04, 0xF1, 0x3D,
+                        0x5E, 0x58, 0xEF, 0x34, 0x95, 0x72, 0x42, 0x31};
+    
+    // random samples, stored back to back, with random IVs and subsamples
+    AP4_CencSampleInfoTable* table = new AP4_CencSampleInfoTable(0,
+                                                                 crypt_byte_block,
+                                                                 skip_byte_block,
+                                                                 sample_count,
+                                                                 iv_size);
+    AP4_UI32       sample_sizes[sample_count];
+    AP4_DataBuffer data_in;
+    for (unsigned int i=0; i<sample_count; i++) {
+        AP4_UI08 iv[16];
+        for (unsigned int j=0; j<iv_size; j++) iv[j] = (AP4_UI08)rand();
+        table->SetIv(i, iv);
+        
+        // sizes that are and are not multiples of the block size
+        sample_sizes[i] = (i%4 == 0) ? 16*(1+rand()%64) : 1+rand()%1000;
+        if (use_subsamples) {
+            // up to 3 subsamples, the last one ending with the sample
+            AP4_UI08     map[3*6];
+            unsigned int subsample_count = 1+rand()%3;
+            AP4_UI32     remaining = sample_sizes[i];
+            for (unsigned int j=0; j<subsample_count; j++) {
+                AP4_UI32 size  = (j == subsample_count-1) ? remaining : rand()%(remaining+1);
+                AP4_UI16 clear = (AP4_UI16)(size ? rand()%(size < 100 ? size+1 : 100) : 0);
+                AP4_BytesFromUInt16BE(&map[6*j],   clear);
+                AP4_BytesFromUInt32BE(&map[6*j+2], size-clear);
+                remaining -= size;
+            }
+            table->AddSubSampleData(subsample_count, map);
+        }
+        
+        AP4_Size offset = data_in.GetDataSize();
+        data_in.SetDataSize(offset+sample_sizes[i]);
+        for (unsigned int j=0; j<sample_sizes[i]; j++) {
+            data_in.UseData()[offset+j] = (AP4_UI08)rand();
+        }
+    }
+    
+    // some bytes after the last sample, which must be copied as is
+    AP4_Size samples_size = data_in.GetDataSize();
+    data_in.SetDataSize(samples_size+7);
+    AP4_SetMemory(data_in.UseData()+samples_size, 0x42, 7);
+    
+    // with a pattern (cbcs), the IV is reset at each subsample
+    AP4_CencSampleDecrypter* decrypter = NULL;
+    AP4_Result result = AP4_CencSampleDecrypter::Create(table,
+                                                        cipher_type,
+                                                        key,
+                                                        16,
+                                                        NULL,
+                                                        crypt_byte_block != 0,
+                                                        decrypter);
+    CHECK(result == AP4_SUCCESS);
+    
+    // decrypt the samples one by one
+    AP4_DataBuffer expected;
+    AP4_Size       offset = 0;
+    for (unsigned int i=0; i<sample_count; i++) {
+        AP4_DataBuffer sample_in(data_in.GetData()+offset, sample_sizes[i]);
+        AP4_DataBuffer sample_out;
+        result = decrypter->DecryptSampleData(sample_in, sample_out, NULL);
+        CHECK(result == AP4_SUCCESS);
+        CHECK(sample_out.GetDataSize() == sample_sizes[i]);
+        expected.AppendData(sample_out.GetData(), sample_out.GetDataSize());
+        offset += sample_sizes[i];
+    }
+    expected.AppendData(data_in.GetData()+samples_size, 7);
+    
+    // decrypt them in two runs
+    AP4_DataBuffer first_in(data_in.GetData(), sample_sizes[0]+sample_sizes[1]+sample_sizes[2]);
+    AP4_DataBuffer second_in(data_in.GetData()+first_in.GetDataSize(), data_in.GetDataSize()-first_in.GetDataSize());
+    AP4_DataBuffer first_out;
+    AP4_DataBuffer second_out;
+    decrypter->SetSampleIndex(0);
+    result = decrypter->DecryptSamples(3, sample_sizes, first_in, first_out);
+    CHECK(result == AP4_SUCCESS);
+    result = decrypter->DecryptSamples(sample_count-3, &sample_sizes[3], second_in, second_out);
+    CHECK(result == AP4_SUCCESS);
+    CHECK(first_out.GetDataSize()+second_out.GetDataSize() == expected.GetDataSize());
+    CHECK(BuffersEqual(first_out.GetData(), expected.GetData(), first_out.GetDataSize()));
+    CHECK(BuffersEqual(second_out.GetData(), expected.GetData()+first_out.GetDataSize(), second_out.GetDataSize()));
+    
+    // the samples must not go past the end of the sample info table
+    result = decrypter->DecryptSamples(1, sample_sizes, first_in, first_out);
+    CHECK(result == AP4_ERROR_OUT_OF_RANGE);
+    
+    delete decrypter;
+    return 0;
+}
+
+/*----------------------------------------------------------------------
+|   TestCencSampleDecrypters
++---------------------------------------------------------------------*/
+static int
+TestCencSampleDecrypters()
+{
+    int result;
+    
+    // CENC, with and without subsamples
+    result = TestCencSampleDecrypter(AP4_CENC_CIPHER_AES_128_CTR, 0, 0, 8, true);
+    if (result) return result;
+    result = TestCencSampleDecrypter(AP4_CENC_CIPHER_AES_128_CTR, 0, 0, 16, false);
+    if (result) return result;
+    
+    // CBCS (1:9 pattern) with subsamples, and CBC1
+    result = TestCencSampleDecrypter(AP4_CENC_CIPHER_AES_128_CBC, 1, 9, 16, true);
+    if (result) return result;
+    result = TestCencSampleDecrypter(AP4_CENC_CIPHER_AES_128_CBC, 0, 0, 16, false);
+    if (result) return result;
+    
+    return 0;
+}
+
 int
 main(int /*argc*/, char** /*argv*/)
 {
@@ -2312,6 +2563,9 @@ main(int /*argc*/, char** /*argv*/)
     result = TestHmac();
     if (result) return result;
 
+    result = TestDigest();
+    if (result) return result;
+
     result = TestKeyWrap();
     if (result) return result;
     
@@ -2323,6 +2577,9 @@ main(int /*argc*/, char** /*argv*/)
 
     result = TestCbcStreamCipher();
     if (result) return result;
+
+    result = TestCencSampleDecrypters();
+    if (result) return result;
     
     return 0;
 }
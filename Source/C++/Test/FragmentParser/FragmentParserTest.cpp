@@ -103,6 +103,72 @@ ShowSample(AP4_Sample& sample, unsigned int index, AP4_SampleDecrypter* sample_d
     }
 }
 
+/*----------------------------------------------------------------------
+|   CheckSampleLookup
++---------------------------------------------------------------------*/
+static int
+CheckSampleLookup(AP4_FragmentSampleTable* sample_table, AP4_Ordinal index)
+{
+    AP4_Sample sample;
+    CHECK(AP4_SUCCEEDED(sample_table->GetSample(index, sample)));
+    
+    // the first and the last tick of the sample must both find it
+    AP4_Ordinal found = 0;
+    CHECK(AP4_SUCCEEDED(sample_table->GetSampleIndexForTimeStamp(sample.GetDts(), found)));
+    CHECK(found == index);
+    if (sample.GetDuration()) {
+        AP4_UI64 last_tick = sample.GetDts()+sample.GetDuration()-1;
+        CHECK(AP4_SUCCEEDED(sample_table->GetSampleIndexForTimeStamp(last_tick, found)));
+        CHECK(found == index);
+    }
+    
+    // compare the sync sample lookups with a linear search
+    AP4_Cardinal sample_count = sample_table->GetSampleCount();
+    AP4_Ordinal  sync_before  = 0;
+    AP4_Ordinal  sync_after   = sample_count;
+    for (unsigned int i=0; i<sample_count; i++) {
+        CHECK(AP4_SUCCEEDED(sample_table->GetSample(i, sample)));
+        if (!sample.IsSync()) continue;
+        if (i <= index) sync_before = i;
+        if (i >= index && sync_after == sample_count) sync_after = i;
+    }
+    CHECK(sample_table->GetNearestSyncSampleIndex(index, true)  == sync_before);
+    CHECK(sample_table->GetNearestSyncSampleIndex(index, false) == sync_after);
+    
+    return 0;
+}
+
+/*----------------------------------------------------------------------
+|   CheckSampleLookups
++---------------------------------------------------------------------*/
+static int
+CheckSampleLookups(AP4_FragmentSampleTable* sample_table)
+{
+    AP4_Cardinal sample_count = sample_table->GetSampleCount();
+    if (sample_count == 0) return 0;
+    
+    // the first, middle and last samples
+    CHECK(CheckSampleLookup(sample_table, 0) == 0);
+    CHECK(CheckSampleLookup(sample_table, sample_count/2) == 0);
+    CHECK(CheckSampleLookup(sample_table, sample_count-1) == 0);
+    
+    // times outside of the fragment
+    AP4_Sample  sample;
+    AP4_Ordinal found = 0;
+    CHECK(AP4_SUCCEEDED(sample_table->GetSample(sample_count-1, sample)));
+    CHECK(AP4_FAILED(sample_table->GetSampleIndexForTimeStamp(sample.GetDts()+sample.GetDuration(), found)));
+    CHECK(AP4_SUCCEEDED(sample_table->GetSample(0, sample)));
+    if (sample.GetDts()) {
+        CHECK(AP4_FAILED(sample_table->GetSampleIndexForTimeStamp(sample.GetDts()-1, found)));
+    }
+    
+    // past the last sample
+    CHECK(sample_table->GetNearestSyncSampleIndex(sample_count, false) == sample_count);
+    
+    printf("sample lookups OK\n");
+    return 0;
+}
+
 /*----------------------------------------------------------------------
 |   ProcessSamples
 +---------------------------------------------------------------------*/
@@ -147,7 +213,7 @@ ProcessSamples(AP4_Track*               track,
         ShowSample(sample, i, sample_decrypter);
     }
     
-    return 0;
+    return CheckSampleLookups(sample_table);
 }
 
 /*----------------------------------------------------------------------
@@ -161,6 +227,7 @@ ProcessMoof(AP4_Movie*         movie,
             AP4_Position       mdat_payload_offset)
 {
     AP4_Result result;
+    int        failures = 0;
     
     AP4_MovieFragment* fragment = new AP4_MovieFragment(moof);
     printf("fragment sequence number=%d\n", fragment->GetSequenceNumber());
@@ -188,7 +255,7 @@ ProcessMoof(AP4_Movie*         movie,
         result = fragment->CreateSampleTable(movie, ids[i], sample_stream, moof_offset, mdat_payload_offset, 0, sample_table);
         CHECK(result == AP4_SUCCESS || result == AP4_ERROR_NO_SUCH_ITEM);
         if (AP4_SUCCEEDED(result) ) {
-            ProcessSamples(track, traf, *sample_stream, moof_offset, sample_table);
+            if (ProcessSamples(track, traf, *sample_stream, moof_offset, sample_table)) ++failures;
             delete sample_table;
         } else {
             printf("no sample table for this track\n");
@@ -196,7 +263,7 @@ ProcessMoof(AP4_Movie*         movie,
     }
     
     delete fragment;
-    return 0;
+    return failures ? -1 : 0;
 }
 
 /*----------------------------------------------------------------------
@@ -224,6 +291,7 @@ main(int argc, char** argv)
     
     AP4_Atom* atom = NULL;
     AP4_DefaultAtomFactory atom_factory;
+    int failures = 0;
     do {
         // process the next atom
         result = atom_factory.CreateAtomFromStream(*input, atom);
@@ -237,7 +305,7 @@ main(int argc, char** argv)
                     input->Tell(position);
         
                     // process the movie fragment
-                    ProcessMoof(movie, moof, input, position-atom->GetSize(), position+8);
+                    if (ProcessMoof(movie, moof, input, position-atom->GetSize(), position+8)) ++failures;
 
                     // go back to where we were before processing the fragment
                     input->Seek(position);
@@ -252,6 +320,6 @@ main(int argc, char** argv)
     delete file;
     input->Release();
 
-    return 0;                                            
+    return failures ? 1 : 0;                                            
 }
 
@@ -0,0 +1,177 @@
+/*****************************************************************
+|
+|    AP4 - AP4_Mpeg2TsRemuxer test
+|
+|    Copyright 2002-2016 Axiomatic Systems, LLC
+|
+|
+|    This file is part of Bento4/AP4 (MP4 Atom Processing Library).
+|
+|    Unless you have obtained Bento4 under a difference license,
+|    this version of Bento4 is Bento4|GPL.
+|    Bento4|GPL is free software; you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation; either version 2, or (at your option)
+|    any later version.
+|
+|    Bento4|GPL is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with Bento4|GPL; see the file COPYING.  If not, write to the
+|    Free Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+|    02111-1307, USA.
+|
+ ****************************************************************/
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Ap4.h"
+
+/*----------------------------------------------------------------------
+|   TrackWriter
+|
+|   Writes each track to its own fragmented MP4 file: the init segment
+|   of the track followed by all its fragments.
++---------------------------------------------------------------------*/
+class TrackWriter : public AP4_SegmentBuilder::ChunkListener {
+public:
+    TrackWriter(const char* video_filename, const char* audio_filename) :
+        m_VideoFilename(video_filename),
+        m_AudioFilename(audio_filename),
+        m_VideoStream(NULL),
+        m_AudioStream(NULL),
+        m_ChunkCount(0) {}
+    ~TrackWriter() {
+        if (m_VideoStream) m_VideoStream->Release();
+        if (m_AudioStream) m_AudioStream->Release();
+    }
+    
+    // AP4_SegmentBuilder::ChunkListener methods
+    virtual AP4_Result OnChunk(AP4_SegmentBuilder& builder,
+                               const AP4_UI08*     data,
+                               AP4_Size            data_size,
+                               unsigned int        /* sequence_number */,
+                               bool                /* starts_segment */) {
+        AP4_ByteStream*& stream = builder.GetTrackId() == AP4_MPEG2_TS_REMUXER_VIDEO_TRACK_ID ? m_VideoStream : m_AudioStream;
+        if (stream == NULL) {
+            // the first chunk: start with the init segment
+            const char* filename = builder.GetTrackId() == AP4_MPEG2_TS_REMUXER_VIDEO_TRACK_ID ? m_VideoFilename : m_AudioFilename;
+            AP4_Result result = AP4_FileByteStream::Create(filename, AP4_FileByteStream::STREAM_MODE_WRITE, stream);
+            if (AP4_FAILED(result)) {
+                fprintf(stderr, "ERROR: cannot create output file %s (%d)\n", filename, result);
+                return result;
+            }
+            result = builder.WriteInitSegment(*stream);
+            if (AP4_FAILED(result)) {
+                fprintf(stderr, "ERROR: cannot write init segment (%d)\n", result);
+                return result;
+            }
+        }
+        ++m_ChunkCount;
+        return stream->Write(data, data_size);
+    }
+    
+    unsigned int GetChunkCount() { return m_ChunkCount; }
+
+private:
+    const char*     m_VideoFilename;
+    const char*     m_AudioFilename;
+    AP4_ByteStream* m_VideoStream;
+    AP4_ByteStream* m_AudioStream;
+    unsigned int    m_ChunkCount;
+};
+
+/*----------------------------------------------------------------------
+|   main
++---------------------------------------------------------------------*/
+int
+main(int argc, char** argv)
+{
+    if (argc < 5) {
+        printf("usage: mpeg2tsremuxertest <input-ts-filename> <fragment-duration-ms> <output-video-filename> <output-audio-filename> [<frames-per-second>]\n");
+        return 1;
+    }
+
+    // init the variables
+    const char*  input_filename    = argv[1];
+    unsigned int fragment_duration = (unsigned int)strtoul(argv[2], NULL, 10);
+    double       frames_per_second = argc > 5 ? strtod(argv[5], NULL) : 0.0;
+    AP4_Result   result;
+
+    AP4_ByteStream* input_stream = NULL;
+    result = AP4_FileByteStream::Create(input_filename,
+                                        AP4_FileByteStream::STREAM_MODE_READ, 
+                                        input_stream);
+    if (AP4_FAILED(result)) {
+        fprintf(stderr, "ERROR: cannot open input file (%d)\n", result);
+        return 1;
+    }
+    
+    // feed the input to the remuxer, through a fixed size buffer 
+    TrackWriter        writer(argv[3], argv[4]);
+    AP4_Mpeg2TsRemuxer remuxer(writer, fragment_duration, frames_per_second);
+    unsigned char      input_buffer[64*1024];
+    AP4_Size           bytes_in_buffer = 0;
+    for (;;) {
+        AP4_Size bytes_read = 0;
+        result = input_stream->ReadPartial(input_buffer+bytes_in_buffer,
+                                           sizeof(input_buffer)-bytes_in_buffer,
+                                           bytes_read);
+        if (result == AP4_ERROR_EOS) break;
+        if (AP4_FAILED(result)) {
+            fprintf(stderr, "ERROR: failed to read from input file (%d)\n", result);
+            break;
+        }
+        bytes_in_buffer += bytes_read;
+        
+        AP4_Size bytes_consumed = 0;
+        result = remuxer.Feed(input_buffer, bytes_in_buffer, bytes_consumed);
+        if (AP4_FAILED(result)) {
+            fprintf(stderr, "ERROR: Feed() failed (%d)\n", result);
+            break;
+        }
+        
+        // keep the bytes that were not consumed
+        bytes_in_buffer -= bytes_consumed;
+        AP4_MoveMemory(input_buffer, input_buffer+bytes_consumed, bytes_in_buffer);
+    }
+    result = remuxer.Finish();
+    if (AP4_FAILED(result)) {
+        fprintf(stderr, "ERROR: Finish() failed (%d)\n", result);
+    }
+
+    // print some stats
+    AP4_Mpeg2TsReader& reader = remuxer.GetReader();
+    for (unsigned int i=0; i<reader.GetStreams().ItemCount(); i++) {
+        AP4_Mpeg2TsReader::Stream* stream = reader.GetStreams()[i];
+        printf("stream: PID=%d, type=0x%02x%s\n", 
+               stream->GetPID(),
+               stream->GetStreamType(),
+               stream->IsEnabled() ? "" : " (skipped)");
+    }
+    printf("chunks: %d, sync losses: %d, discontinuities: %d, dropped PES packets: %d, invalid PES packets: %d\n",
+           writer.GetChunkCount(),
+           reader.GetSyncLossCount(),
+           reader.GetDiscontinuityCount(),
+           reader.GetDroppedPesCount(),
+           remuxer.GetInvalidPesCount());
+    AP4_UI64 first_pts = 0;
+    if (AP4_SUCCEEDED(remuxer.GetFirstPts(AP4_MPEG2_TS_REMUXER_VIDEO_TRACK_ID, first_pts))) {
+        printf("video: first PTS=%lld\n", first_pts);
+    }
+    if (AP4_SUCCEEDED(remuxer.GetFirstPts(AP4_MPEG2_TS_REMUXER_AUDIO_TRACK_ID, first_pts))) {
+        printf("audio: first PTS=%lld\n", first_pts);
+    }
+    
+    // cleanup and exit
+    input_stream->Release();
+
+    return AP4_FAILED(result) ? 1 : 0;
+}
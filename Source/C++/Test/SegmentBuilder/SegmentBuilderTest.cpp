@@ -0,0 +1,156 @@
+/*****************************************************************
+|
+|    AP4 - AP4_SegmentBuilder test
+|
+|    Copyright 2002-2016 Axiomatic Systems, LLC
+|
+|
+|    This file is part of Bento4/AP4 (MP4 Atom Processing Library).
+|
+|    Unless you have obtained Bento4 under a difference license,
+|    this version of Bento4 is Bento4|GPL.
+|    Bento4|GPL is free software; you can redistribute it and/or modify
+|    it under the terms of the GNU General Public License as published by
+|    the Free Software Foundation; either version 2, or (at your option)
+|    any later version.
+|
+|    Bento4|GPL is distributed in the hope that it will be useful,
+|    but WITHOUT ANY WARRANTY; without even the implied warranty of
+|    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+|    GNU General Public License for more details.
+|
+|    You should have received a copy of the GNU General Public License
+|    along with Bento4|GPL; see the file COPYING.  If not, write to the
+|    Free Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+|    02111-1307, USA.
+|
+ ****************************************************************/
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Ap4.h"
+
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+const unsigned int GOP_SIZE     = 10;
+const unsigned int CHUNK_SIZE   = 4;
+const unsigned int SAMPLE_COUNT = 3*GOP_SIZE;
+
+/*----------------------------------------------------------------------
+|   macros
++---------------------------------------------------------------------*/
+#define CHECK(x)                                                 \
+do {                                                             \
+    if (!(x)) {                                                  \
+        fprintf(stderr, "ERROR line %d: %s\n", __LINE__, #x);    \
+        return AP4_FAILURE;                                      \
+    }                                                            \
+} while(0)
+
+/*----------------------------------------------------------------------
+|   TestVideoSegmentBuilder
++---------------------------------------------------------------------*/
+class TestVideoSegmentBuilder : public AP4_SegmentBuilder {
+public:
+    TestVideoSegmentBuilder() : AP4_SegmentBuilder(AP4_Track::TYPE_VIDEO, 1) {}
+
+    // AP4_SegmentBuilder methods
+    virtual AP4_Result WriteInitSegment(AP4_ByteStream& /* stream */) {
+        return AP4_ERROR_NOT_SUPPORTED;
+    }
+};
+
+/*----------------------------------------------------------------------
+|   ChunkChecker
+|
+|   Checks that the first sample flags of each chunk match the sync
+|   flag of its first sample.
++---------------------------------------------------------------------*/
+class ChunkChecker : public AP4_SegmentBuilder::ChunkListener {
+public:
+    ChunkChecker() : m_ChunkCount(0), m_FirstSample(0), m_MidGopChunkCount(0) {}
+
+    // AP4_SegmentBuilder::ChunkListener methods
+    virtual AP4_Result OnChunk(AP4_SegmentBuilder& /* builder */,
+                               const AP4_UI08*     data,
+                               AP4_Size            data_size,
+                               unsigned int        /* sequence_number */,
+                               bool                /* starts_segment */) {
+        // parse the moof
+        AP4_MemoryByteStream* stream = new AP4_MemoryByteStream(data, data_size);
+        AP4_Atom* atom = NULL;
+        AP4_Result result = AP4_DefaultAtomFactory::Instance_.CreateAtomFromStream(*stream, atom);
+        stream->Release();
+        CHECK(AP4_SUCCEEDED(result));
+        AP4_ContainerAtom* moof = AP4_DYNAMIC_CAST(AP4_ContainerAtom, atom);
+        CHECK(moof != NULL && moof->GetType() == AP4_ATOM_TYPE_MOOF);
+        AP4_TrunAtom* trun = AP4_DYNAMIC_CAST(AP4_TrunAtom, moof->FindChild("traf/trun"));
+        CHECK(trun != NULL);
+        CHECK(trun->GetFlags() & AP4_TRUN_FLAG_FIRST_SAMPLE_FLAGS_PRESENT);
+
+        // check the flags of the first sample
+        bool sync = (m_FirstSample%GOP_SIZE) == 0;
+        AP4_UI32 flags = trun->GetFirstSampleFlags();
+        if (sync) {
+            CHECK(flags == 0x2000000);
+        } else {
+            CHECK(flags == 0x10000);
+            ++m_MidGopChunkCount;
+        }
+
+        ++m_ChunkCount;
+        m_FirstSample += trun->GetEntries().ItemCount();
+        delete atom;
+
+        return AP4_SUCCESS;
+    }
+
+    unsigned int m_ChunkCount;
+    unsigned int m_FirstSample;
+    unsigned int m_MidGopChunkCount;
+};
+
+/*----------------------------------------------------------------------
+|   TestMidGopChunks
++---------------------------------------------------------------------*/
+static AP4_Result
+TestMidGopChunks()
+{
+    AP4_MemoryByteStream* sample_data = new AP4_MemoryByteStream(16);
+    TestVideoSegmentBuilder builder;
+    ChunkChecker checker;
+    builder.EnableChunking(&checker, CHUNK_SIZE, 0);
+
+    // one sync sample every GOP_SIZE samples, so most chunks start mid-GOP
+    AP4_Result result = AP4_SUCCESS;
+    for (unsigned int i=0; i<SAMPLE_COUNT && AP4_SUCCEEDED(result); i++) {
+        AP4_Sample sample(*sample_data, 0, 16, 1000, 0, 1000*i, 0, (i%GOP_SIZE) == 0);
+        result = builder.AddSample(sample);
+    }
+    if (AP4_SUCCEEDED(result)) result = builder.FlushChunk();
+    sample_data->Release();
+    CHECK(AP4_SUCCEEDED(result));
+
+    CHECK(checker.m_FirstSample == SAMPLE_COUNT);
+    CHECK(checker.m_ChunkCount == (SAMPLE_COUNT+CHUNK_SIZE-1)/CHUNK_SIZE);
+    CHECK(checker.m_MidGopChunkCount > 0);
+
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   main
++---------------------------------------------------------------------*/
+int
+main(int /*argc*/, char** /*argv*/)
+{
+    if (AP4_FAILED(TestMidGopChunks())) return 1;
+
+    printf("OK\n");
+    return 0;
+}
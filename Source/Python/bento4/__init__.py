@@ -3,6 +3,8 @@ import sys
 
 if sys.platform == 'darwin':
     bento4dll = 'libBento4C.dylib'
+elif sys.platform.startswith('linux'):
+    bento4dll = 'libBento4C.so'
 else:
     raise "Unsupported Platform"
 
@@ -30,3 +32,35 @@ Ap4LargeSize = c_ulonglong
 Ap4Offset    = c_longlong
 Ap4Position  = c_ulonglong
 
+# opaque object pointers (returned as-is, so that they can be passed back
+# to the library without being truncated to an int on 64-bit platforms)
+class Ap4Object(c_void_p):
+    pass
+
+for name in ['AP4_ByteStream_FromDelegate',
+             'AP4_FileByteStream_Create',
+             'AP4_MemoryByteStream_Create',
+             'AP4_MemoryByteStream_FromBuffer',
+             'AP4_DataBuffer_Create',
+             'AP4_File_Create',
+             'AP4_File_FromStream',
+             'AP4_File_GetMovie',
+             'AP4_Movie_Create',
+             'AP4_Movie_GetTrackByIndex',
+             'AP4_Track_Create',
+             'AP4_Track_GetSampleDescription',
+             'AP4_SampleDescription_AsAudio',
+             'AP4_SampleDescription_AsVideo',
+             'AP4_SampleDescription_AsAvc',
+             'AP4_SampleDescription_AsMpeg',
+             'AP4_SampleDescription_AsMpegAudio',
+             'AP4_Sample_CreateEmpty',
+             'AP4_PrintInspector_Create',
+             'AP4_JsonInspector_Create',
+             'AP4_AtomInspector_FromDelegate',
+             'AP4_Fragmenter_Create',
+             'AP4_CencEncryptingProcessor_Create',
+             'AP4_CencEncryptingProcessor_AsProcessor']:
+    getattr(lb4, name).restype = Ap4Object
+lb4.AP4_File_GetTopLevelAtomType.restype = Ap4UI32
+lb4.AP4_File_GetTopLevelAtomSize.restype = Ap4UI64
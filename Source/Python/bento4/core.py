@@ -1,6 +1,7 @@
 from bento4 import *
 from bento4.errors import check_result
-from ctypes import c_int, c_char_p, string_at
+from bento4.streams import FileByteStream
+from ctypes import c_int, c_double, c_char_p, string_at
 from struct import pack, unpack
 
 def atom_type(name):
@@ -44,7 +45,7 @@ class File(object):
     def __del__(self):
         lb4.AP4_File_Destroy(self.bt4file)
         try:
-            lb4.AP4_Stream_Release(self.bt4stream)
+            lb4.AP4_ByteStream_Release(self.bt4stream)
         except AttributeError:
             pass # depending on how the object was created,
                  # self.bt4stream may or may not exist
@@ -65,7 +66,7 @@ class File(object):
             return self.moov
         
         bt4movie = lb4.AP4_File_GetMovie(self.bt4file)
-        if bt4movie is None:
+        if not bt4movie:
             return None
         else:
             self.moov = Movie(bt4movie=bt4movie)
@@ -105,7 +106,71 @@ class File(object):
           compat_brand_array(*compat_brands), compat_count)
     
     type = property(get_type, set_type)
-        
+
+    @property
+    def atoms(self):
+        """list of (type, size) tuples, one for each top-level atom"""
+        result = []
+        count = lb4.AP4_File_GetTopLevelAtomCount(self.bt4file)
+        for i in xrange(count):
+            type = lb4.AP4_File_GetTopLevelAtomType(self.bt4file, Ap4Ordinal(i))
+            size = lb4.AP4_File_GetTopLevelAtomSize(self.bt4file, Ap4Ordinal(i))
+            result += [(atom_name(type), size)]
+        return result
+
+    def write_atom(self, index, stream):
+        """write the top-level atom at index to a ByteStream"""
+        f = lb4.AP4_File_WriteTopLevelAtom
+        f.restype = check_result
+        f(self.bt4file, Ap4Ordinal(index), stream.bt4stream)
+
+    def fragment(self, output, fragment_duration=0, timescale=0, track_id=0,
+                 index=False, trim=False, no_tfdt=False, tfdt_start=0.0,
+                 sequence_number_start=1, force_i_frame_sync=None):
+        """write a fragmented version of the file (like mp4fragment)
+           output: a ByteStream or a file name
+           fragment_duration: in milliseconds, 0 means auto-detect
+           force_i_frame_sync: None, 'auto' or 'all'"""
+        if isinstance(output, basestring):
+            output = FileByteStream(output, FileByteStream.MODE_WRITE)
+        sync_modes = {None: 0, 'auto': 1, 'all': 2}
+        bt4fragmenter = lb4.AP4_Fragmenter_Create(self.bt4file, self.bt4stream)
+        try:
+            lb4.AP4_Fragmenter_SetFragmentDuration(bt4fragmenter, c_uint(fragment_duration))
+            lb4.AP4_Fragmenter_SetTimescale(bt4fragmenter, Ap4UI32(timescale))
+            lb4.AP4_Fragmenter_SetTrackId(bt4fragmenter, Ap4UI32(track_id))
+            lb4.AP4_Fragmenter_SetCreateSegmentIndex(bt4fragmenter, c_int(index))
+            lb4.AP4_Fragmenter_SetTrim(bt4fragmenter, c_int(trim))
+            lb4.AP4_Fragmenter_SetNoTfdt(bt4fragmenter, c_int(no_tfdt))
+            lb4.AP4_Fragmenter_SetTfdtStart(bt4fragmenter, c_double(tfdt_start))
+            lb4.AP4_Fragmenter_SetSequenceNumberStart(bt4fragmenter, c_uint(sequence_number_start))
+            lb4.AP4_Fragmenter_SetForceSyncMode(bt4fragmenter, c_int(sync_modes[force_i_frame_sync]))
+            f = lb4.AP4_Fragmenter_Fragment
+            f.restype = check_result
+            f(bt4fragmenter, output.bt4stream)
+        finally:
+            lb4.AP4_Fragmenter_Destroy(bt4fragmenter)
+
+    def split(self, init_output, segment_pattern='segment-%d.m4s'):
+        """split a fragmented file into an init segment (ftyp and moov)
+           and one media segment per moof (like mp4split)
+           init_output: a ByteStream or a file name
+           segment_pattern: file name pattern, with the segment number"""
+        if isinstance(init_output, basestring):
+            init_output = FileByteStream(init_output, FileByteStream.MODE_WRITE)
+        segment_count = 0
+        segment = None
+        for i, (type, size) in enumerate(self.atoms):
+            if type == 'moof':
+                segment_count += 1
+                segment = FileByteStream(segment_pattern % segment_count,
+                                         FileByteStream.MODE_WRITE)
+            if type in ('ftyp', 'moov'):
+                self.write_atom(i, init_output)
+            elif segment and type not in ('mfra', 'free', 'skip'):
+                self.write_atom(i, segment)
+        return segment_count
+
     
 class Movie(object):
     
@@ -263,7 +328,7 @@ class Track(object):
     def sample_description(self, index):
         bt4desc = lb4.AP4_Track_GetSampleDescription(self.bt4track,
                                                            Ap4Ordinal(index))
-        if bt4desc == 0:
+        if not bt4desc:
             raise IndexError()
         sampledesc_type = lb4.AP4_SampleDescription_GetType(bt4desc)
         track_type = self.type
@@ -609,4 +674,49 @@ class MpegVideoSampleDescription(MpegSampleDescription,
 
         
             
-        
\ No newline at end of file
+        
+
+
+class CencEncryptingProcessor(object):
+    VARIANT_PIFF_CTR  = 0
+    VARIANT_PIFF_CBC  = 1
+    VARIANT_MPEG_CENC = 2
+    VARIANT_MPEG_CBC1 = 3
+    VARIANT_MPEG_CENS = 4
+    VARIANT_MPEG_CBCS = 5
+
+    def __init__(self, variant=VARIANT_MPEG_CENC):
+        self.bt4processor = lb4.AP4_CencEncryptingProcessor_Create(c_int(variant))
+
+    def __del__(self):
+        bt4processor = lb4.AP4_CencEncryptingProcessor_AsProcessor(self.bt4processor)
+        lb4.AP4_Processor_Destroy(bt4processor)
+
+    def set_key(self, track_id, key, iv):
+        """key: 16-byte binary string
+           iv: 8 or 16-byte binary string (8-byte IVs are zero-padded,
+               like mp4encrypt does)"""
+        if len(iv) == 8:
+            iv += '\0'*8
+        f = lb4.AP4_CencEncryptingProcessor_SetKey
+        f.restype = check_result
+        f(self.bt4processor, Ap4UI32(track_id),
+          c_char_p(key), Ap4Size(len(key)),
+          c_char_p(iv), Ap4Size(len(iv)))
+
+    def set_property(self, track_id, name, value):
+        f = lb4.AP4_CencEncryptingProcessor_SetProperty
+        f.restype = check_result
+        f(self.bt4processor, Ap4UI32(track_id), c_char_p(name), c_char_p(value))
+
+    def process(self, input, output):
+        """input: a File (its stream is re-read from the start) or a ByteStream
+           output: a ByteStream or a file name"""
+        if isinstance(output, basestring):
+            output = FileByteStream(output, FileByteStream.MODE_WRITE)
+        bt4input = input.bt4stream
+        lb4.AP4_ByteStream_Seek(bt4input, Ap4Position(0))
+        bt4processor = lb4.AP4_CencEncryptingProcessor_AsProcessor(self.bt4processor)
+        f = lb4.AP4_Processor_Process
+        f.restype = check_result
+        f(bt4processor, bt4input, output.bt4stream)
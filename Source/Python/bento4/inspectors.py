@@ -17,6 +17,14 @@ class PrintInspector(AtomInspector):
         self.stream = stream
         bt4inspector = lb4.AP4_PrintInspector_Create(stream.bt4stream)
         super(PrintInspector, self).__init__(bt4inspector)
+
+
+class JsonInspector(AtomInspector):
+    def __init__(self, stream):
+        self.stream = stream
+        bt4inspector = lb4.AP4_JsonInspector_Create(stream.bt4stream)
+        super(JsonInspector, self).__init__(bt4inspector)
+
         
 class InspectorDelegate(Structure):
     pass
@@ -186,7 +186,7 @@ class FileByteStream(ByteStream):
         result = Ap4Result(0)
         f = lb4.AP4_FileByteStream_Create
         bt4stream = f(c_char_p(name), c_int(mode), byref(result))
-        check_result(result)
+        check_result(result.value)
         super(FileByteStream, self).__init__(bt4stream)
 
         
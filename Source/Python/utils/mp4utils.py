@@ -514,8 +514,8 @@ class Mp4File:
         for track in self.info['tracks']:
             self.tracks[track['id']] = Mp4Track(self, track)
 
-        # get a complete file dump
-        json_dump = Mp4Dump(options, filename, format='json', verbosity='1')
+        # get a file dump, with the fragments reduced to a summary
+        json_dump = Mp4Dump(options, filename, format='segments', verbosity='1')
         #print json_dump
         self.tree = json.loads(json_dump, strict=False, object_pairs_hook=collections.OrderedDict)
 
@@ -553,32 +553,17 @@ class Mp4File:
                 trafs = FilterChildren(atom, 'traf')
                 if len(trafs) != 1:
                     PrintErrorAndExit('ERROR: unsupported input file, more than one "traf" box in fragment')
-                tfhd = FilterChildren(trafs[0], 'tfhd')[0]
-                track = self.tracks[tfhd['track ID']]
+                traf = trafs[0]
+                track = self.tracks[traf['track ID']]
                 track.moofs.append(segment_index)
-                segment_duration = 0
-                default_sample_duration = tfhd.get('default sample duration', track.default_sample_duration)
-                for trun in FilterChildren(trafs[0], 'trun'):
+                for trun in FilterChildren(traf, 'trun'):
                     track.sample_counts.append(trun['sample count'])
-                    for (name, value) in trun.items():
-                        if name[0] in '0123456789':
-                            sample_duration = -1
-                            fields = value.split(',')
-                            for field in fields:
-                                if field.startswith('d:'):
-                                    sample_duration = int(field[2:])
-                            if sample_duration == -1:
-                                sample_duration = default_sample_duration
-                            segment_duration += sample_duration
+                segment_duration = traf['duration']
                 track.segment_scaled_durations.append(segment_duration)
                 segment_duration_sec = float(segment_duration) / float(track.timescale)
                 track.segment_durations.append(segment_duration_sec)
                 segment_index += 1
 
-                # remove the 'trun' entries to save some memory
-                for traf in trafs:
-                    traf['children'] = [x for x in traf['children'] if x['name'] != 'trun']
-
             elif atom['name'] == 'mdat':
                 # end of fragment on 'mdat' atom
                 if track:
@@ -0,0 +1,118 @@
+#! /usr/bin/env python
+
+# Checks that the tools that can update a file in place (--in-place) give
+# the same atoms and samples as when they write a new output file (only
+# the padding and the chunk offsets may differ).
+#
+# usage: Bento4InPlaceTester.py <bin-dir> [<work-dir>]
+
+import os
+import sys
+import shutil
+import tempfile
+import os.path as path
+from subprocess import call, check_output
+
+TEST_FILE = path.join(path.dirname(path.abspath(__file__)), 'Data', 'test-001.mp4')
+
+PSSH_SYSTEM_ID = 'edef8ba979d64acea3c827dcd51d21ed'
+
+def Bento4Command(name, *args):
+    executable = path.join(BIN_ROOT, name)
+    return call([executable]+list(args))
+
+def DumpAtoms(filename):
+    # the top-level atoms, without the padding, in any order
+    dump = check_output([path.join(BIN_ROOT, 'mp4dump'), filename]).decode('utf-8')
+    atoms = []
+    for line in dump.splitlines():
+        if not line.startswith(' '):
+            atoms.append([])
+        atoms[-1].append(line)
+    atoms = ['\n'.join(atom) for atom in atoms if not atom[0].startswith(('[free]', '[skip]'))]
+    return sorted(atoms)
+
+def DumpSamples(filename):
+    # the first bytes of each sample are enough to check the chunk offsets
+    info = check_output([path.join(BIN_ROOT, 'mp4info'), '--show-samples', '--show-sample-data', filename]).decode('utf-8')
+    return [line for line in info.splitlines() if 'fast start' not in line]
+
+def ReadFile(filename):
+    with open(filename, 'rb') as f:
+        return f.read()
+
+def MakeFileWithOpenEndedMdat(output):
+    # a copy of the test file with the moov atom first, and a size of 0
+    # for the last atom (mdat), which then extends to the end of the file
+    fast_start = path.join(WORK_DIR, 'fast-start.mp4')
+    Bento4Command('mp4edit', TEST_FILE, fast_start)
+    data = bytearray(ReadFile(fast_start))
+    position = 0
+    last = 0
+    while position+8 <= len(data):
+        last = position
+        size = (data[position] << 24) | (data[position+1] << 16) | (data[position+2] << 8) | data[position+3]
+        if size < 8: break
+        position += size
+    assert data[last+4:last+8] == b'mdat'
+    data[last:last+4] = b'\0\0\0\0'
+    with open(output, 'wb') as f:
+        f.write(data)
+
+def CheckInPlace(name, tool, commands, input, expect_failure=False):
+    in_place = path.join(WORK_DIR, name+'-in-place.mp4')
+    output   = path.join(WORK_DIR, name+'-output.mp4')
+    shutil.copyfile(input, in_place)
+
+    result = Bento4Command(tool, *(['--in-place']+commands+[in_place]))
+    if expect_failure:
+        if result != 1:
+            print('FAILED: '+name+' (exit code '+str(result)+', expected 1)')
+            return False
+        if ReadFile(in_place) != ReadFile(input):
+            print('FAILED: '+name+' (the input was modified)')
+            return False
+        print('OK: '+name)
+        return True
+
+    if result != 0:
+        print('FAILED: '+name+' (exit code '+str(result)+')')
+        return False
+    if Bento4Command(tool, *(commands+[input, output])) != 0:
+        print('FAILED: '+name+' (output file mode)')
+        return False
+    if DumpAtoms(in_place) != DumpAtoms(output) or DumpSamples(in_place) != DumpSamples(output):
+        print('FAILED: '+name+' (the in-place result differs from the output file)')
+        return False
+    print('OK: '+name)
+    return True
+
+###########################
+if len(sys.argv) < 2:
+    print('usage: Bento4InPlaceTester.py <bin-dir> [<work-dir>]')
+    sys.exit(1)
+BIN_ROOT = sys.argv[1]
+if len(sys.argv) >= 3:
+    WORK_DIR = sys.argv[2]
+else:
+    WORK_DIR = tempfile.mkdtemp()
+
+pssh_data = path.join(WORK_DIR, 'pssh.bin')
+with open(pssh_data, 'wb') as f:
+    f.write(b'\x08\x01\x12\x10'+b'\x42'*16)
+long_value = 'X'*2000
+open_ended = path.join(WORK_DIR, 'open-ended.mp4')
+MakeFileWithOpenEndedMdat(open_ended)
+
+ok = True
+ok &= CheckInPlace('mp4tag-set',    'mp4tag', ['--set', 'Name:S:Hello'], TEST_FILE)
+ok &= CheckInPlace('mp4tag-remove', 'mp4tag', ['--remove', 'Tool'], TEST_FILE)
+ok &= CheckInPlace('mp4tag-grow',   'mp4tag', ['--set', 'Name:S:'+long_value], TEST_FILE)
+ok &= CheckInPlace('mp4tag-open-ended', 'mp4tag', ['--set', 'Name:S:'+long_value], open_ended, expect_failure=True)
+if path.exists(path.join(BIN_ROOT, 'mp4pssh')):
+    ok &= CheckInPlace('mp4pssh-insert', 'mp4pssh', ['--insert', PSSH_SYSTEM_ID+':'+pssh_data], TEST_FILE)
+else:
+    print('SKIPPED: mp4pssh (not found in '+BIN_ROOT+')')
+
+if not ok:
+    sys.exit(1)